@@ -0,0 +1,406 @@
+/*
+* Vulkan content and motion adaptive shading rate
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanAdaptiveShadingRate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace vks
+{
+	namespace
+	{
+		// Motion blurs the content, so the error visible at the tile's velocity (in pixels per frame) is attenuated
+		// Fitted to the perceived error of half and quarter rate shading (incl. the quarter to half rate error ratio of 2.13)
+		float halfRateAttenuation(float velocity)
+		{
+			return std::pow(1.0f / (1.0f + std::pow(1.05f * velocity, 3.10f)), 0.35f);
+		}
+
+		float quarterRateAttenuation(float velocity)
+		{
+			return 2.13f * std::pow(1.0f / (1.0f + std::pow(0.55f * velocity, 2.41f)), 0.49f);
+		}
+
+		// log2 of the fragment size along one axis
+		uint32_t axisRate(float error, float velocity, float threshold)
+		{
+			if (halfRateAttenuation(velocity) * error >= threshold) {
+				return 0;
+			}
+			if (quarterRateAttenuation(velocity) * error < threshold) {
+				return 2;
+			}
+			return 1;
+		}
+	}
+
+	AdaptiveShadingRate::~AdaptiveShadingRate()
+	{
+		destroy();
+	}
+
+	void AdaptiveShadingRate::prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, Mode mode, VkExtent2D texelSize, uint32_t width, uint32_t height)
+	{
+		assert(rateShader.module != VK_NULL_HANDLE);
+		assert(texelSize.width > 0 && texelSize.height > 0);
+		this->device = device;
+		this->queue = queue;
+		this->mode = mode;
+		params.reprojection = glm::mat4(1.0f);
+		params.tile = glm::uvec4(texelSize.width, texelSize.height, mode == Mode::FragmentShadingRateKHR ? 1 : 0, 0);
+
+		// Source images are only read with texelFetch
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_NEAREST;
+		samplerCI.minFilter = VK_FILTER_NEAREST;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &paramsBuffer, sizeof(Params)));
+		VK_CHECK_RESULT(paramsBuffer.map());
+
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Binding 0: Frame parameters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1: Color of the previous frame
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2: Depth of the previous frame
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Binding 3: Tile statistics
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// Binding 4: Encoded rates, four tiles per element
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayout));
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCI.stage = rateShader;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &pipeline));
+
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+
+		resize(width, height);
+	}
+
+	void AdaptiveShadingRate::createRateImage()
+	{
+		const VkExtent2D extent = getExtent();
+
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = VK_FORMAT_R8_UINT;
+		imageCI.extent = { extent.width, extent.height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// Same bit as VK_IMAGE_USAGE_SHADING_RATE_IMAGE_BIT_NV
+		imageCI.usage = VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = VK_FORMAT_R8_UINT;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		viewCI.image = image;
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &view));
+
+		const VkDeviceSize tileCount = static_cast<VkDeviceSize>(extent.width) * extent.height;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &statisticsBuffer, tileCount * sizeof(TileStatistics)));
+		// Rates are packed into uints by the shader, the copy into the image reads them as tightly packed bytes
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &rateBuffer, (tileCount + 3) / 4 * sizeof(uint32_t)));
+
+		// Zero is the full rate in both encodings, so the image is usable before the first update
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdFillBuffer(commandBuffer, rateBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		bufferBarrier.buffer = rateBuffer.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+		copyToImage(commandBuffer, rateBuffer.buffer);
+		device->flushCommandBuffer(commandBuffer, queue);
+	}
+
+	void AdaptiveShadingRate::destroyRateImage()
+	{
+		vkDestroyImageView(device->logicalDevice, view, nullptr);
+		vkDestroyImage(device->logicalDevice, image, nullptr);
+		vkFreeMemory(device->logicalDevice, memory, nullptr);
+		view = VK_NULL_HANDLE;
+		image = VK_NULL_HANDLE;
+		memory = VK_NULL_HANDLE;
+		statisticsBuffer.destroy();
+		rateBuffer.destroy();
+	}
+
+	void AdaptiveShadingRate::updateDescriptorSet()
+	{
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &paramsBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &statisticsBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &rateBuffer.descriptor),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void AdaptiveShadingRate::copyToImage(VkCommandBuffer commandBuffer, VkBuffer buffer)
+	{
+		// Every texel is overwritten, so the old content is discarded instead of transitioned
+		// Shading rate stage and access bits are shared by the NV and KHR extensions
+		VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+		imageBarrier.srcAccessMask = 0;
+		imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarrier.image = image;
+		imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		const VkExtent2D extent = getExtent();
+		VkBufferImageCopy copyRegion{};
+		copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.imageExtent = { extent.width, extent.height, 1 };
+		vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+		imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+	}
+
+	void AdaptiveShadingRate::resize(uint32_t width, uint32_t height)
+	{
+		params.size = glm::uvec4(width, height, (width + params.tile.x - 1) / params.tile.x, (height + params.tile.y - 1) / params.tile.y);
+		colorView = VK_NULL_HANDLE;
+		depthView = VK_NULL_HANDLE;
+		destroyRateImage();
+		createRateImage();
+		updateDescriptorSet();
+		memcpy(paramsBuffer.mapped, &params, sizeof(Params));
+	}
+
+	void AdaptiveShadingRate::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		destroyRateImage();
+		paramsBuffer.destroy();
+		vkDestroySampler(device->logicalDevice, sampler, nullptr);
+		vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+		sampler = VK_NULL_HANDLE;
+		pipeline = VK_NULL_HANDLE;
+		pipelineLayout = VK_NULL_HANDLE;
+		descriptorSetLayout = VK_NULL_HANDLE;
+		descriptorPool = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	void AdaptiveShadingRate::setSource(VkImageView colorView, VkImageView depthView)
+	{
+		this->colorView = colorView;
+		this->depthView = depthView;
+		VkDescriptorImageInfo colorDescriptor = vks::initializers::descriptorImageInfo(sampler, colorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkDescriptorImageInfo depthDescriptor = vks::initializers::descriptorImageInfo(sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &colorDescriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &depthDescriptor),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void AdaptiveShadingRate::updateView(const glm::mat4& previousViewProjection, const glm::mat4& viewProjection)
+	{
+		params.reprojection = viewProjection * glm::inverse(previousViewProjection);
+		params.threshold = glm::vec4(sensitivity, environmentLuminance, 0.0f, 0.0f);
+		memcpy(paramsBuffer.mapped, &params, sizeof(Params));
+	}
+
+	void AdaptiveShadingRate::update(VkCommandBuffer commandBuffer)
+	{
+		assert(colorView != VK_NULL_HANDLE && depthView != VK_NULL_HANDLE);
+
+		// The rates of the last update may still be read by its copy, the statistics by a validation readback
+		VkBufferMemoryBarrier bufferBarriers[2];
+		bufferBarriers[0] = vks::initializers::bufferMemoryBarrier();
+		bufferBarriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		bufferBarriers[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarriers[0].buffer = rateBuffer.buffer;
+		bufferBarriers[0].size = VK_WHOLE_SIZE;
+		bufferBarriers[1] = bufferBarriers[0];
+		bufferBarriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarriers[1].buffer = statisticsBuffer.buffer;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 2, bufferBarriers, 0, nullptr);
+
+		// Tiles are or'ed into the packed rates
+		vkCmdFillBuffer(commandBuffer, rateBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		bufferBarriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarriers[0], 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdDispatch(commandBuffer, params.size.z, params.size.w, 1);
+
+		bufferBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		bufferBarriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 2, bufferBarriers, 0, nullptr);
+
+		copyToImage(commandBuffer, rateBuffer.buffer);
+	}
+
+	void AdaptiveShadingRate::upload(const std::vector<uint8_t>& rates)
+	{
+		const VkExtent2D extent = getExtent();
+		assert(rates.size() == static_cast<size_t>(extent.width) * extent.height);
+		vks::Buffer staging;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, rates.size(), (void*)rates.data()));
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		copyToImage(commandBuffer, staging.buffer);
+		device->flushCommandBuffer(commandBuffer, queue);
+		staging.destroy();
+	}
+
+	VkImageView AdaptiveShadingRate::getView() const
+	{
+		return view;
+	}
+
+	VkExtent2D AdaptiveShadingRate::getExtent() const
+	{
+		return { params.size.z, params.size.w };
+	}
+
+	VkExtent2D AdaptiveShadingRate::getTexelSize() const
+	{
+		return { params.tile.x, params.tile.y };
+	}
+
+	AdaptiveShadingRate::Mode AdaptiveShadingRate::getMode() const
+	{
+		return mode;
+	}
+
+	std::vector<VkShadingRatePaletteEntryNV> AdaptiveShadingRate::getPaletteNV()
+	{
+		// Indexed by encodeRate, NV entries are named width x height
+		return {
+			VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_PIXEL_NV,
+			VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_1X2_PIXELS_NV,
+			VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X1_PIXELS_NV,
+			VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X2_PIXELS_NV,
+			VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X4_PIXELS_NV,
+			VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_4X2_PIXELS_NV,
+			VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_4X4_PIXELS_NV,
+		};
+	}
+
+	uint8_t AdaptiveShadingRate::encodeRate(Mode mode, const glm::uvec2& rate)
+	{
+		assert(rate.x <= 2 && rate.y <= 2);
+		if (mode == Mode::FragmentShadingRateKHR) {
+			return static_cast<uint8_t>((rate.x << 2) | rate.y);
+		}
+		// 4x1 and 1x4 are not in the palette and map to 2x1 and 1x2, must match encodeRate() in shadingrate.comp
+		const uint8_t paletteIndex[9] = { 0, 1, 1, 2, 3, 4, 2, 5, 6 };
+		return paletteIndex[rate.x * 3 + rate.y];
+	}
+
+	glm::uvec2 AdaptiveShadingRate::selectRate(const TileStatistics& tile, float sensitivity, float environmentLuminance)
+	{
+		const float threshold = sensitivity * (tile.luminance.x + environmentLuminance);
+		glm::uvec2 rate(axisRate(tile.luminance.y, tile.velocity.x, threshold), axisRate(tile.luminance.z, tile.velocity.y, threshold));
+		// Quarter rate on both axes is too coarse, keep it for the axis with the lower error
+		if (rate.x == 2 && rate.y == 2) {
+			if (tile.luminance.y >= tile.luminance.z) {
+				rate.x = 1;
+			} else {
+				rate.y = 1;
+			}
+		}
+		// 4x1 and 1x4 are not supported by all devices, fall back to the finer rate
+		rate.x = std::min(rate.x, rate.y + 1);
+		rate.y = std::min(rate.y, rate.x + 1);
+		return rate;
+	}
+
+	void AdaptiveShadingRate::readBuffer(const vks::Buffer& buffer, void* data, VkDeviceSize size)
+	{
+		vks::Buffer staging;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, size));
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion{ 0, 0, size };
+		vkCmdCopyBuffer(commandBuffer, buffer.buffer, staging.buffer, 1, &copyRegion);
+		device->flushCommandBuffer(commandBuffer, queue);
+		VK_CHECK_RESULT(staging.map());
+		memcpy(data, staging.mapped, size);
+		staging.destroy();
+	}
+
+	uint32_t AdaptiveShadingRate::validate()
+	{
+		vkDeviceWaitIdle(device->logicalDevice);
+
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		update(commandBuffer);
+		device->flushCommandBuffer(commandBuffer, queue);
+
+		const uint32_t tileCount = params.size.z * params.size.w;
+		std::vector<TileStatistics> statistics(tileCount);
+		std::vector<uint8_t> rates(tileCount);
+		readBuffer(statisticsBuffer, statistics.data(), statistics.size() * sizeof(TileStatistics));
+		readBuffer(rateBuffer, rates.data(), rates.size());
+
+		// Selection is done with the threshold the GPU used, errors close to it may round either way
+		uint32_t mismatches = 0;
+		for (uint32_t i = 0; i < tileCount; i++) {
+			bool match = false;
+			for (float scale : { 1.0f, 0.999f, 1.001f }) {
+				const glm::uvec2 rate = selectRate(statistics[i], params.threshold.x * scale, params.threshold.y);
+				match |= (rates[i] == encodeRate(mode, rate));
+			}
+			if (!match) {
+				mismatches++;
+			}
+		}
+		return mismatches;
+	}
+}
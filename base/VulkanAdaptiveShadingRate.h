@@ -0,0 +1,162 @@
+/*
+* Vulkan content and motion adaptive shading rate
+*
+* Derives a per tile shading rate from the luminance and camera motion of the previous frame with a compute shader
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/**
+	* @brief Content and motion adaptive shading rate image
+	*
+	* Every frame a compute dispatch (one work group per shading rate texel, called tile) analyses the previous frame's final color and depth:
+	*   - the error of shading the tile at half rate, estimated per axis from the luminance differences of neighbouring pixels
+	*   - the minimum screen space velocity of the tile, from reprojecting the previous depth with the camera matrices (camera motion only)
+	* It then picks the coarsest rate per axis whose error, attenuated by the tile's motion, stays below a just noticeable difference
+	* threshold relative to the tile's mean luminance (see selectRate). Quarter rate on both axes (4x4) is never selected, neither are 4x1 and 1x4.
+	*
+	* Rates are stored in an R8_UINT image with one texel per tile, encoded as an index into getPaletteNV() (VK_NV_shading_rate_image)
+	* or as (log2(width) << 2) | log2(height) (VK_KHR_fragment_shading_rate). The image is kept in VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR,
+	* which is the same layout as VK_IMAGE_LAYOUT_SHADING_RATE_OPTIMAL_NV.
+	*
+	* Frame parameters (reprojection, threshold) live in a host visible uniform buffer, so command buffers can be prerecorded.
+	* selectRate() implements the rate selection on the CPU, validate() compares the GPU rates against it.
+	*/
+	class AdaptiveShadingRate
+	{
+	public:
+		/** @brief Extension the rate image is consumed by, selects the encoding of the rates */
+		enum class Mode { ShadingRateImageNV, FragmentShadingRateKHR };
+
+		/** @brief Content and motion of a tile, layout matches the compute shader's storage buffer */
+		struct TileStatistics {
+			/** @brief Mean luminance (x), half rate error horizontally (y) and vertically (z) */
+			glm::vec4 luminance;
+			/** @brief Minimum absolute velocity of the tile's pixels in pixels per frame horizontally (x) and vertically (y) */
+			glm::vec4 velocity;
+		};
+
+		/** @brief Layout matches the compute shader's uniform block */
+		struct Params {
+			/** @brief Previous frame's clip space to current frame's clip space */
+			glm::mat4 reprojection;
+			/** @brief Width and height of the source images, tile count in x and y */
+			glm::uvec4 size;
+			/** @brief Tile width and height in pixels, encoding (0 = NV palette index, 1 = KHR) */
+			glm::uvec4 tile;
+			/** @brief Sensitivity and environment luminance of the visibility threshold */
+			glm::vec4 threshold;
+		};
+
+		/** @brief Compute shader stage for the rate selection, needs to be set before calling prepare */
+		VkPipelineShaderStageCreateInfo rateShader{};
+		/** @brief Just noticeable luminance difference relative to the tile's mean luminance, higher values select coarser rates */
+		float sensitivity = 0.15f;
+		/** @brief Luminance added to the tile's mean to account for ambient light, keeps the threshold from vanishing in dark tiles */
+		float environmentLuminance = 0.05f;
+
+	private:
+		vks::VulkanDevice* device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		Mode mode = Mode::FragmentShadingRateKHR;
+		Params params{};
+
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkImageView colorView = VK_NULL_HANDLE;
+		VkImageView depthView = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		vks::Buffer paramsBuffer;
+		vks::Buffer statisticsBuffer;
+		vks::Buffer rateBuffer;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		void createRateImage();
+		void destroyRateImage();
+		void updateDescriptorSet();
+		void copyToImage(VkCommandBuffer commandBuffer, VkBuffer buffer);
+		void readBuffer(const vks::Buffer& buffer, void* data, VkDeviceSize size);
+	public:
+		~AdaptiveShadingRate();
+
+		/**
+		* Create the shading rate image, buffers and the compute pipeline
+		*
+		* @param device Device to create the resources on
+		* @param queue Queue used for uploads, layout initialization and the validation readback
+		* @param pipelineCache Pipeline cache for the compute pipeline
+		* @param mode Extension the rate image is used with
+		* @param texelSize Size of a shading rate texel (tile) in pixels, must be supported by the device for the given mode
+		* @param width Width of the render target in pixels
+		* @param height Height of the render target in pixels
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, Mode mode, VkExtent2D texelSize, uint32_t width, uint32_t height);
+		void destroy();
+		/**
+		* Recreates the shading rate image for a new render target size, all tiles are set to full rate
+		* @note The source views need to be set again and consumers need to be updated with the new view afterwards
+		*/
+		void resize(uint32_t width, uint32_t height);
+		/**
+		* Sets the images the rates are derived from, both need to be the size of the render target and in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when update() runs
+		* @param colorView Final color of the previous frame
+		* @param depthView Depth of the previous frame (depth aspect only)
+		*/
+		void setSource(VkImageView colorView, VkImageView depthView);
+		/** @brief Updates the camera reprojection and threshold, call once per frame with the (unjittered) view projection matrices of the source and the upcoming frame */
+		void updateView(const glm::mat4& previousViewProjection, const glm::mat4& viewProjection);
+		/** @brief Records the rate selection and the copy into the shading rate image, must be recorded outside of a render pass before the frame is rendered */
+		void update(VkCommandBuffer commandBuffer);
+		/** @brief Replaces the content of the shading rate image with fixed (encoded) rates, one byte per tile in row order */
+		void upload(const std::vector<uint8_t>& rates);
+
+		/** @brief R8_UINT shading rate image with one texel per tile */
+		VkImageView getView() const;
+		/** @brief Size of the shading rate image in texels */
+		VkExtent2D getExtent() const;
+		/** @brief Size of a shading rate texel (tile) in pixels */
+		VkExtent2D getTexelSize() const;
+		Mode getMode() const;
+
+		/** @brief Palette the NV encoding indexes into, to be used for VkShadingRatePaletteNV */
+		static std::vector<VkShadingRatePaletteEntryNV> getPaletteNV();
+		/**
+		* Encodes a shading rate for the given mode
+		* @param rate Fragment size per axis as log2 (0 = 1 pixel, 1 = 2 pixels, 2 = 4 pixels)
+		*/
+		static uint8_t encodeRate(Mode mode, const glm::uvec2& rate);
+		/**
+		* Selects the shading rate of a tile on the CPU, same computation as in shadingrate.comp
+		* @return Fragment size per axis as log2
+		*/
+		static glm::uvec2 selectRate(const TileStatistics& tile, float sensitivity, float environmentLuminance);
+		/**
+		* Reruns the rate selection on the current source images and compares the GPU rates of all tiles against the CPU reference
+		* Tiles whose error is within floating point tolerance of a threshold may select either rate
+		* @note Waits for the device to become idle
+		* @return Number of tiles with a mismatching rate
+		*/
+		uint32_t validate();
+	};
+}
@@ -0,0 +1,257 @@
+/*
+* Vulkan async compute
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanAsyncCompute.h"
+
+namespace vks
+{
+	AsyncCompute::~AsyncCompute()
+	{
+		destroy();
+	}
+
+	void AsyncCompute::getFeatures(std::vector<const char*>& extensions, VkPhysicalDeviceTimelineSemaphoreFeaturesKHR& features)
+	{
+		extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		features.timelineSemaphore = VK_TRUE;
+	}
+
+	bool AsyncCompute::isAsync() const
+	{
+		return device->queueFamilyIndices.compute != device->queueFamilyIndices.graphics;
+	}
+
+	VkQueue AsyncCompute::getQueue() const
+	{
+		return computeQueue;
+	}
+
+	uint32_t AsyncCompute::getQueueFamilyIndex() const
+	{
+		return device->queueFamilyIndices.compute;
+	}
+
+	VkCommandBuffer AsyncCompute::getCommandBuffer(uint32_t index) const
+	{
+		return commandBuffers[index];
+	}
+
+	bool AsyncCompute::timestampsSupported() const
+	{
+		return queryPool != VK_NULL_HANDLE;
+	}
+
+	VkSemaphore AsyncCompute::createTimeline()
+	{
+		VkSemaphoreTypeCreateInfoKHR semaphoreTypeCI{};
+		semaphoreTypeCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		semaphoreTypeCI.initialValue = 0;
+		VkSemaphoreCreateInfo semaphoreCI = vks::initializers::semaphoreCreateInfo();
+		semaphoreCI.pNext = &semaphoreTypeCI;
+		VkSemaphore semaphore;
+		VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCI, nullptr, &semaphore));
+		return semaphore;
+	}
+
+	void AsyncCompute::prepare(vks::VulkanDevice* device, VkQueue graphicsQueue, uint32_t commandBufferCount)
+	{
+		this->device = device;
+		this->graphicsQueue = graphicsQueue;
+		vkGetDeviceQueue(device->logicalDevice, device->queueFamilyIndices.compute, 0, &computeQueue);
+
+		VkCommandPoolCreateInfo commandPoolCI = vks::initializers::commandPoolCreateInfo();
+		commandPoolCI.queueFamilyIndex = device->queueFamilyIndices.compute;
+		commandPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		VK_CHECK_RESULT(vkCreateCommandPool(device->logicalDevice, &commandPoolCI, nullptr, &commandPool));
+		commandBuffers.resize(commandBufferCount);
+		VkCommandBufferAllocateInfo commandBufferAI = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, commandBufferCount);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &commandBufferAI, commandBuffers.data()));
+
+		graphicsTimeline = createTimeline();
+		computeTimeline = createTimeline();
+		graphicsValue = 0;
+		computeValue = 0;
+
+		// Not all compute only queue families support timestamps
+		const uint32_t validBits = device->queueFamilyProperties[device->queueFamilyIndices.compute].timestampValidBits;
+		if (validBits > 0) {
+			timestampPeriod = device->properties.limits.timestampPeriod;
+			timestampMask = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCI.queryCount = commandBufferCount * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCI, nullptr, &queryPool));
+		}
+	}
+
+	void AsyncCompute::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		// Compute work may still be in flight after the graphics queue has become idle
+		vkQueueWaitIdle(computeQueue);
+		vkQueueWaitIdle(graphicsQueue);
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+		}
+		vkDestroySemaphore(device->logicalDevice, graphicsTimeline, nullptr);
+		vkDestroySemaphore(device->logicalDevice, computeTimeline, nullptr);
+		vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+		commandBuffers.clear();
+		queryPool = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	void AsyncCompute::recordBarrier(VkCommandBuffer commandBuffer, Transfer transfer, const std::vector<ImageTransfer>& images, bool acquire)
+	{
+		const uint32_t graphicsFamily = device->queueFamilyIndices.graphics;
+		const uint32_t computeFamily = device->queueFamilyIndices.compute;
+		const bool ownershipTransfer = graphicsFamily != computeFamily;
+		// Within the same queue family the release alone is a complete barrier
+		if (acquire && !ownershipTransfer) {
+			return;
+		}
+
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		VkPipelineStageFlags srcStageMask = 0;
+		VkPipelineStageFlags dstStageMask = 0;
+		for (const ImageTransfer& image : images) {
+			VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+			imageBarrier.image = image.image;
+			imageBarrier.subresourceRange = image.subresourceRange;
+			imageBarrier.oldLayout = image.oldLayout;
+			imageBarrier.newLayout = image.newLayout;
+			if (ownershipTransfer) {
+				imageBarrier.srcQueueFamilyIndex = (transfer == Transfer::GraphicsToCompute) ? graphicsFamily : computeFamily;
+				imageBarrier.dstQueueFamilyIndex = (transfer == Transfer::GraphicsToCompute) ? computeFamily : graphicsFamily;
+			} else {
+				imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			}
+			// The access masks of the queue not recording the barrier are ignored for ownership transfers
+			if (!ownershipTransfer) {
+				imageBarrier.srcAccessMask = image.srcAccessMask;
+				imageBarrier.dstAccessMask = image.dstAccessMask;
+				srcStageMask |= image.srcStageMask;
+				dstStageMask |= image.dstStageMask;
+			} else if (acquire) {
+				imageBarrier.dstAccessMask = image.dstAccessMask;
+				srcStageMask |= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+				dstStageMask |= image.dstStageMask;
+			} else {
+				imageBarrier.srcAccessMask = image.srcAccessMask;
+				srcStageMask |= image.srcStageMask;
+				dstStageMask |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			}
+			imageBarriers.push_back(imageBarrier);
+		}
+		vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	void AsyncCompute::release(VkCommandBuffer commandBuffer, Transfer transfer, const std::vector<ImageTransfer>& images)
+	{
+		recordBarrier(commandBuffer, transfer, images, false);
+	}
+
+	void AsyncCompute::acquire(VkCommandBuffer commandBuffer, Transfer transfer, const std::vector<ImageTransfer>& images)
+	{
+		recordBarrier(commandBuffer, transfer, images, true);
+	}
+
+	uint64_t AsyncCompute::submit(VkQueue queue, VkSemaphore signalTimeline, uint64_t signalValue, VkCommandBuffer commandBuffer,
+		const std::vector<VkSemaphore>& waitSemaphores, const std::vector<uint64_t>& waitValues, const std::vector<VkPipelineStageFlags>& waitStages,
+		VkSemaphore signalSemaphore)
+	{
+		// Values for binary semaphores are ignored, but the arrays need to cover all semaphores
+		std::vector<VkSemaphore> signalSemaphores = { signalTimeline };
+		std::vector<uint64_t> signalValues = { signalValue };
+		if (signalSemaphore != VK_NULL_HANDLE) {
+			signalSemaphores.push_back(signalSemaphore);
+			signalValues.push_back(0);
+		}
+
+		VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+		timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+		timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
+		submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+		submitInfo.pSignalSemaphores = signalSemaphores.data();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		return signalValue;
+	}
+
+	uint64_t AsyncCompute::submitGraphics(VkCommandBuffer commandBuffer, uint64_t waitComputeValue, VkPipelineStageFlags computeWaitStage,
+		VkSemaphore waitSemaphore, VkPipelineStageFlags waitStage, VkSemaphore signalSemaphore)
+	{
+		std::vector<VkSemaphore> waitSemaphores;
+		std::vector<uint64_t> waitValues;
+		std::vector<VkPipelineStageFlags> waitStages;
+		if (waitComputeValue > 0) {
+			waitSemaphores.push_back(computeTimeline);
+			waitValues.push_back(waitComputeValue);
+			waitStages.push_back(computeWaitStage);
+		}
+		if (waitSemaphore != VK_NULL_HANDLE) {
+			waitSemaphores.push_back(waitSemaphore);
+			waitValues.push_back(0);
+			waitStages.push_back(waitStage);
+		}
+		return submit(graphicsQueue, graphicsTimeline, ++graphicsValue, commandBuffer, waitSemaphores, waitValues, waitStages, signalSemaphore);
+	}
+
+	uint64_t AsyncCompute::submitCompute(VkCommandBuffer commandBuffer, uint64_t waitGraphicsValue)
+	{
+		std::vector<VkSemaphore> waitSemaphores;
+		std::vector<uint64_t> waitValues;
+		std::vector<VkPipelineStageFlags> waitStages;
+		if (waitGraphicsValue > 0) {
+			waitSemaphores.push_back(graphicsTimeline);
+			waitValues.push_back(waitGraphicsValue);
+			waitStages.push_back(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		}
+		return submit(computeQueue, computeTimeline, ++computeValue, commandBuffer, waitSemaphores, waitValues, waitStages, VK_NULL_HANDLE);
+	}
+
+	void AsyncCompute::writeTimestamp(VkCommandBuffer commandBuffer, uint32_t index, bool end)
+	{
+		if (queryPool == VK_NULL_HANDLE) {
+			return;
+		}
+		if (!end) {
+			vkCmdResetQueryPool(commandBuffer, queryPool, index * 2, 2);
+		}
+		vkCmdWriteTimestamp(commandBuffer, end ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, index * 2 + (end ? 1 : 0));
+	}
+
+	float AsyncCompute::getTime(uint32_t index)
+	{
+		if (queryPool == VK_NULL_HANDLE) {
+			return -1.0f;
+		}
+		uint64_t timestamps[2] = {};
+		VkResult result = vkGetQueryPoolResults(device->logicalDevice, queryPool, index * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return -1.0f;
+		}
+		return (float)((timestamps[1] - timestamps[0]) & timestampMask) * timestampPeriod / 1000000.0f;
+	}
+}
@@ -0,0 +1,149 @@
+/*
+* Vulkan async compute
+*
+* Runs independent compute work on a dedicated compute queue family, synchronized with graphics work by timeline semaphores
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Submission and queue ownership helper for compute work that overlaps graphics work
+	*
+	* Two timeline semaphores order the work of both queues: every graphics submit signals the next value of the graphics timeline,
+	* every compute submit signals the next value of the compute timeline. A submit waits for a value of the other queue's timeline
+	* returned by an earlier submit, so dependencies are expressed per frame instead of with one binary semaphore per pair of submits.
+	*
+	* Typical pipelining for post-processing with two frame slots (frame N uses slot N % 2):
+	*   - compute: post-process frame N - 1, waits for the graphics value of frame N - 1's scene
+	*   - graphics: render the scene of frame N into its slot, no wait, runs concurrently with the compute work above
+	*   - graphics: composite the post-processed frame N - 1, waits for the compute value at the stage that reads its result
+	* Images handed between the queues need a release barrier on the queue giving them up and a matching acquire barrier on the queue
+	* receiving them (see release() and acquire()). Images whose content is discarded by the next use (initial layout undefined)
+	* don't need to be transferred back, as long as the timeline waits order the accesses.
+	*
+	* If the device has no compute queue family separate from graphics, the same queue family (and queue) is used, the ownership
+	* transfers turn into plain barriers and the work is serialized, which still gives correct results.
+	*
+	* Requires VK_KHR_timeline_semaphore with the timelineSemaphore feature enabled (core in Vulkan 1.2), see getFeatures().
+	*/
+	class AsyncCompute
+	{
+	public:
+		/** @brief Direction of an ownership transfer */
+		enum class Transfer { GraphicsToCompute, ComputeToGraphics };
+
+		/** @brief Image handed from one queue family to the other, release and acquire need to be called with identical values */
+		struct ImageTransfer {
+			VkImage image = VK_NULL_HANDLE;
+			VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			/** @brief Stage and access of the last use on the releasing queue */
+			VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			VkAccessFlags srcAccessMask = 0;
+			/** @brief Stage and access of the first use on the acquiring queue */
+			VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			VkAccessFlags dstAccessMask = 0;
+		};
+
+	private:
+		vks::VulkanDevice* device = nullptr;
+		VkQueue graphicsQueue = VK_NULL_HANDLE;
+		VkQueue computeQueue = VK_NULL_HANDLE;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> commandBuffers;
+
+		VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+		VkSemaphore computeTimeline = VK_NULL_HANDLE;
+		uint64_t graphicsValue = 0;
+		uint64_t computeValue = 0;
+
+		// Two timestamps per command buffer, only if the compute queue family supports them
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		float timestampPeriod = 1.0f;
+		uint64_t timestampMask = ~0ULL;
+
+		VkSemaphore createTimeline();
+		void recordBarrier(VkCommandBuffer commandBuffer, Transfer transfer, const std::vector<ImageTransfer>& images, bool acquire);
+		uint64_t submit(VkQueue queue, VkSemaphore signalTimeline, uint64_t signalValue, VkCommandBuffer commandBuffer,
+			const std::vector<VkSemaphore>& waitSemaphores, const std::vector<uint64_t>& waitValues, const std::vector<VkPipelineStageFlags>& waitStages,
+			VkSemaphore signalSemaphore);
+	public:
+		~AsyncCompute();
+
+		/**
+		* Enables the features required for timeline semaphores, call from getEnabledFeatures/getEnabledExtensions
+		* @param extensions Enabled device extensions, VK_KHR_timeline_semaphore is appended
+		* @param features Feature structure that needs to be part of the device creation pNext chain
+		*/
+		static void getFeatures(std::vector<const char*>& extensions, VkPhysicalDeviceTimelineSemaphoreFeaturesKHR& features);
+
+		/**
+		* Creates the compute command pool and buffers, the timeline semaphores and the timestamp queries
+		*
+		* @param device Device with a compute queue family (VulkanDevice::queueFamilyIndices.compute)
+		* @param graphicsQueue Queue of the graphics queue family the graphics work is submitted to
+		* @param commandBufferCount Number of compute command buffers, usually one per frame slot
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue graphicsQueue, uint32_t commandBufferCount);
+		/** @brief Waits for both queues to become idle and destroys all resources */
+		void destroy();
+
+		/** @brief True if compute work runs on a queue family separate from graphics and can overlap graphics work */
+		bool isAsync() const;
+		VkQueue getQueue() const;
+		uint32_t getQueueFamilyIndex() const;
+		/** @brief Compute command buffer, created on the compute queue family */
+		VkCommandBuffer getCommandBuffer(uint32_t index) const;
+
+		/**
+		* Records the release half of ownership transfers, recorded on the queue giving up the images after their last use
+		* @note Also performs the layout transitions, the acquire on the other queue repeats them as required by the specification
+		*/
+		void release(VkCommandBuffer commandBuffer, Transfer transfer, const std::vector<ImageTransfer>& images);
+		/** @brief Records the acquire half of ownership transfers, recorded on the receiving queue before the first use of the images */
+		void acquire(VkCommandBuffer commandBuffer, Transfer transfer, const std::vector<ImageTransfer>& images);
+
+		/**
+		* Submits graphics work to the graphics queue
+		* @param commandBuffer Graphics command buffer
+		* @param waitComputeValue Compute timeline value to wait for (0 for no dependency, see submitCompute)
+		* @param computeWaitStage First stage of the command buffer that depends on the compute work
+		* @param waitSemaphore Optional binary semaphore to wait for (e.g. swap chain image acquisition)
+		* @param waitStage Stage at which the binary semaphore is waited for
+		* @param signalSemaphore Optional binary semaphore to signal (e.g. for presentation)
+		* @return Graphics timeline value signaled once the work has finished
+		*/
+		uint64_t submitGraphics(VkCommandBuffer commandBuffer, uint64_t waitComputeValue, VkPipelineStageFlags computeWaitStage,
+			VkSemaphore waitSemaphore = VK_NULL_HANDLE, VkPipelineStageFlags waitStage = 0, VkSemaphore signalSemaphore = VK_NULL_HANDLE);
+		/**
+		* Submits compute work to the compute queue
+		* @param commandBuffer Compute command buffer from getCommandBuffer
+		* @param waitGraphicsValue Graphics timeline value to wait for (0 for no dependency), waited for at the compute shader stage
+		* @return Compute timeline value signaled once the work has finished
+		*/
+		uint64_t submitCompute(VkCommandBuffer commandBuffer, uint64_t waitGraphicsValue);
+
+		/** @brief True if the compute queue family supports timestamps */
+		bool timestampsSupported() const;
+		/** @brief Records the first or second timestamp of a compute command buffer, the first one also resets its queries */
+		void writeTimestamp(VkCommandBuffer commandBuffer, uint32_t index, bool end);
+		/**
+		* Reads the time between both timestamps of a compute command buffer without waiting
+		* @return Time in ms, negative if the results are not available (yet)
+		*/
+		float getTime(uint32_t index);
+	};
+}
@@ -0,0 +1,306 @@
+/*
+* Vulkan mip chain bloom
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanBloom.h"
+
+#include <algorithm>
+
+namespace vks
+{
+	namespace
+	{
+		// Storage image support for this format is mandatory, unlike for packed formats like B10G11R11
+		const VkFormat mipChainFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		const uint32_t workGroupSize = 8;
+	}
+
+	Bloom::~Bloom()
+	{
+		destroy();
+	}
+
+	VkImageView Bloom::getView() const
+	{
+		return levelViews.empty() ? VK_NULL_HANDLE : levelViews[0];
+	}
+
+	VkExtent2D Bloom::getExtent() const
+	{
+		return { std::max(width / 2, 1u), std::max(height / 2, 1u) };
+	}
+
+	uint32_t Bloom::getMipLevels() const
+	{
+		return mipLevels;
+	}
+
+	void Bloom::prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, uint32_t width, uint32_t height)
+	{
+		assert(downsampleShader.module != VK_NULL_HANDLE && upsampleShader.module != VK_NULL_HANDLE);
+		assert(maxMipLevels > 0);
+		this->device = device;
+		this->queue = queue;
+		this->width = width;
+		this->height = height;
+
+		// Bilinear filtering is part of both filters, every tap covers four texels
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_LINEAR;
+		samplerCI.minFilter = VK_FILTER_LINEAR;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.maxLod = 1.0f;
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &paramsBuffer, sizeof(Params)));
+		VK_CHECK_RESULT(paramsBuffer.map());
+
+		// Both passes share the layout, the level written is passed as a push constant
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Binding 0: Input (previous level or source for the downsample, smaller level for the upsample)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1: Output level
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2: Parameters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+		// One set per pass, reallocated whenever the mip chain is recreated
+		const uint32_t maxSets = maxMipLevels * 2;
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxSets),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxSets),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxSets),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, maxSets);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(uint32_t), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayout));
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCI.stage = downsampleShader;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &pipelines.downsample));
+		computePipelineCI.stage = upsampleShader;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &pipelines.upsample));
+
+		createMipChain();
+		updateParams();
+	}
+
+	void Bloom::createMipChain()
+	{
+		const VkExtent2D extent = getExtent();
+		// Stop before the smallest level gets narrower than two texels, further levels would only add a constant
+		mipLevels = 1;
+		while ((mipLevels < maxMipLevels) && ((std::min(extent.width, extent.height) >> mipLevels) >= 2)) {
+			mipLevels++;
+		}
+
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = mipChainFormat;
+		imageCI.extent = { extent.width, extent.height, 1 };
+		imageCI.mipLevels = mipLevels;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+		levelViews.resize(mipLevels);
+		for (uint32_t level = 0; level < mipLevels; level++) {
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = mipChainFormat;
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+			viewCI.image = image;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &levelViews[level]));
+		}
+
+		// All levels are written and read by the compute passes, level 0 is also sampled by the consumer, so the image stays in the general layout
+		// Every level is fully written by the downsample before it's read, so no clear is required
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 });
+		device->flushCommandBuffer(commandBuffer, queue);
+
+		VK_CHECK_RESULT(vkResetDescriptorPool(device->logicalDevice, descriptorPool, 0));
+		downsampleSets.resize(mipLevels);
+		upsampleSets.resize(mipLevels - 1);
+		std::vector<VkDescriptorSetLayout> setLayouts(mipLevels, descriptorSetLayout);
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, setLayouts.data(), mipLevels);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, downsampleSets.data()));
+		if (!upsampleSets.empty()) {
+			allocInfo.descriptorSetCount = static_cast<uint32_t>(upsampleSets.size());
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, upsampleSets.data()));
+		}
+		updateDescriptorSets();
+	}
+
+	void Bloom::destroyMipChain()
+	{
+		for (VkImageView view : levelViews) {
+			vkDestroyImageView(device->logicalDevice, view, nullptr);
+		}
+		vkDestroyImage(device->logicalDevice, image, nullptr);
+		vkFreeMemory(device->logicalDevice, memory, nullptr);
+		levelViews.clear();
+		downsampleSets.clear();
+		upsampleSets.clear();
+		image = VK_NULL_HANDLE;
+		memory = VK_NULL_HANDLE;
+		sourceView = VK_NULL_HANDLE;
+	}
+
+	void Bloom::updateDescriptorSets()
+	{
+		std::vector<VkDescriptorImageInfo> levelDescriptors(mipLevels);
+		std::vector<VkDescriptorImageInfo> storageDescriptors(mipLevels);
+		for (uint32_t level = 0; level < mipLevels; level++) {
+			levelDescriptors[level] = vks::initializers::descriptorImageInfo(sampler, levelViews[level], VK_IMAGE_LAYOUT_GENERAL);
+			storageDescriptors[level] = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL);
+		}
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+		for (uint32_t level = 0; level < mipLevels; level++) {
+			// The input of the first downsample is the source, see setSource
+			if (level > 0) {
+				writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(downsampleSets[level], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &levelDescriptors[level - 1]));
+			}
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(downsampleSets[level], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &storageDescriptors[level]));
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(downsampleSets[level], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &paramsBuffer.descriptor));
+		}
+		for (uint32_t level = 0; level + 1 < mipLevels; level++) {
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(upsampleSets[level], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &levelDescriptors[level + 1]));
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(upsampleSets[level], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &storageDescriptors[level]));
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(upsampleSets[level], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &paramsBuffer.descriptor));
+		}
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void Bloom::setSource(VkImageView view)
+	{
+		sourceView = view;
+		VkDescriptorImageInfo sourceDescriptor = vks::initializers::descriptorImageInfo(sampler, sourceView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(downsampleSets[0], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &sourceDescriptor);
+		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+	}
+
+	void Bloom::updateParams()
+	{
+		Params params{};
+		params.threshold = glm::vec4(threshold, std::max(knee, 0.0f), 0.0f, 0.0f);
+		// Level 0 holds the sum of all levels after the upsample, dividing by their number keeps the intensity independent of the chain length
+		params.scale = glm::vec4(radius, intensity / (float)std::max(mipLevels, 1u), (float)mipLevels, 0.0f);
+		memcpy(paramsBuffer.mapped, &params, sizeof(Params));
+	}
+
+	void Bloom::resize(uint32_t width, uint32_t height)
+	{
+		this->width = width;
+		this->height = height;
+		destroyMipChain();
+		createMipChain();
+		// The level count may have changed
+		updateParams();
+	}
+
+	void Bloom::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		destroyMipChain();
+		paramsBuffer.destroy();
+		vkDestroyPipeline(device->logicalDevice, pipelines.downsample, nullptr);
+		vkDestroyPipeline(device->logicalDevice, pipelines.upsample, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+		vkDestroySampler(device->logicalDevice, sampler, nullptr);
+		pipelines = {};
+		pipelineLayout = VK_NULL_HANDLE;
+		descriptorSetLayout = VK_NULL_HANDLE;
+		descriptorPool = VK_NULL_HANDLE;
+		sampler = VK_NULL_HANDLE;
+		mipLevels = 0;
+		device = nullptr;
+	}
+
+	void Bloom::dispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet descriptorSet, uint32_t level)
+	{
+		const VkExtent2D extent = getExtent();
+		const uint32_t levelWidth = std::max(extent.width >> level, 1u);
+		const uint32_t levelHeight = std::max(extent.height >> level, 1u);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &level);
+		vkCmdDispatch(commandBuffer, (levelWidth + workGroupSize - 1) / workGroupSize, (levelHeight + workGroupSize - 1) / workGroupSize, 1);
+
+		// The level written is the input of the next pass
+		VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+		imageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.image = image;
+		imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+	}
+
+	void Bloom::render(VkCommandBuffer commandBuffer)
+	{
+		assert(sourceView != VK_NULL_HANDLE);
+
+		// The source is rendered before, level 0 must no longer be sampled by the previous frame's composition
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			1, &memoryBarrier,
+			0, nullptr,
+			0, nullptr);
+
+		for (uint32_t level = 0; level < mipLevels; level++) {
+			dispatch(commandBuffer, pipelines.downsample, downsampleSets[level], level);
+		}
+		// The smallest level is its own blurred result, each larger level accumulates the one below it
+		for (int32_t level = static_cast<int32_t>(mipLevels) - 2; level >= 0; level--) {
+			dispatch(commandBuffer, pipelines.upsample, upsampleSets[level], static_cast<uint32_t>(level));
+		}
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0,
+			1, &memoryBarrier,
+			0, nullptr,
+			0, nullptr);
+	}
+}
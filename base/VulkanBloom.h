@@ -0,0 +1,128 @@
+/*
+* Vulkan mip chain bloom
+*
+* Dual filter bloom: a 13 tap downsample chain followed by a tent filter upsample chain that accumulates the blurred levels
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/**
+	* @brief Resolution independent bloom on a mip chain
+	*
+	* The bloom is built in an R16G16B16A16_SFLOAT image with getMipLevels() levels, level 0 has half the size of the source.
+	* render() records one compute dispatch per level:
+	*   - downsample: each level is filtered from the one above it (the source for level 0) with the 13 tap filter of Jimenez
+	*     ("Next generation post processing in Call of Duty: Advanced Warfare"). Level 0 additionally applies a Karis average
+	*     against fireflies and a soft brightness threshold.
+	*   - upsample: from the smallest level upwards, each level adds the 3x3 tent filtered level below it to itself.
+	* Level 0 then holds the sum of all blurred levels, scaled by intensity / level count, and is sampled by the consumer (usually
+	* additively blended over the scene). The blur width follows from the number of levels instead of a kernel size, so the cost
+	* stays at roughly 1.33 times a half resolution pass for any radius.
+	*
+	* Parameters live in a host visible uniform buffer written by updateParams(), so command buffers can be prerecorded.
+	*/
+	class Bloom
+	{
+	public:
+		/** @brief Layout matches the compute shaders' uniform block */
+		struct Params {
+			/** @brief Brightness threshold (x) and soft knee width (y) of the first downsample */
+			glm::vec4 threshold;
+			/** @brief Upsample filter radius in texels (x), scale applied by the last pass writing level 0 (y) and the level count (z) */
+			glm::vec4 scale;
+		};
+
+		/** @brief Compute shader stages of the downsample and upsample passes, need to be set before calling prepare */
+		VkPipelineShaderStageCreateInfo downsampleShader{};
+		VkPipelineShaderStageCreateInfo upsampleShader{};
+		/** @brief Upper limit for the number of levels, each level doubles the blur width, needs to be set before calling prepare */
+		uint32_t maxMipLevels = 6;
+		/** @brief Source brightness (max. of the color channels) below which pixels don't contribute, 0 blooms the whole source */
+		float threshold = 0.0f;
+		/** @brief Width of the quadratic transition around the threshold */
+		float knee = 0.5f;
+		/** @brief Scale of the accumulated bloom */
+		float intensity = 1.0f;
+		/** @brief Upsample tent filter radius in texels of the smaller level */
+		float radius = 1.0f;
+
+	private:
+		vks::VulkanDevice* device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 0;
+
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		// One view per level, used as storage image and as sampled input of the next pass
+		std::vector<VkImageView> levelViews;
+		VkImageView sourceView = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		vks::Buffer paramsBuffer;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> downsampleSets;
+		std::vector<VkDescriptorSet> upsampleSets;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		struct {
+			VkPipeline downsample = VK_NULL_HANDLE;
+			VkPipeline upsample = VK_NULL_HANDLE;
+		} pipelines;
+
+		void createMipChain();
+		void destroyMipChain();
+		void updateDescriptorSets();
+		void dispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet descriptorSet, uint32_t level);
+	public:
+		~Bloom();
+
+		/**
+		* Create the mip chain, parameter buffer and compute pipelines
+		*
+		* @param device Device to create the resources on
+		* @param queue Queue used for the initial layout transition
+		* @param pipelineCache Pipeline cache for the compute pipelines
+		* @param width Width of the source image in pixels
+		* @param height Height of the source image in pixels
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, uint32_t width, uint32_t height);
+		void destroy();
+		/**
+		* Recreates the mip chain for a new source size
+		* @note The source view needs to be set again and consumers need to be updated with the new view afterwards
+		*/
+		void resize(uint32_t width, uint32_t height);
+		/** @brief Sets the image the bloom is generated from, it must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when render() runs */
+		void setSource(VkImageView view);
+		/** @brief Writes threshold, knee, intensity and radius to the parameter buffer, call after changing any of them */
+		void updateParams();
+		/**
+		* Records the downsample and upsample chains, must be recorded outside of a render pass
+		* Waits for color attachment writes to the source and makes level 0 visible to fragment shaders
+		*/
+		void render(VkCommandBuffer commandBuffer);
+
+		/** @brief Level 0 of the mip chain holding the final bloom, stays in VK_IMAGE_LAYOUT_GENERAL */
+		VkImageView getView() const;
+		/** @brief Size of level 0 in pixels */
+		VkExtent2D getExtent() const;
+		uint32_t getMipLevels() const;
+	};
+}
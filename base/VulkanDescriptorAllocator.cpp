@@ -0,0 +1,392 @@
+/*
+* Growable descriptor allocator
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanDescriptorAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "VulkanInitializers.hpp"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	namespace
+	{
+		// Serialized state, compared on lookups since different states may share a hash
+		struct Key {
+			std::vector<uint8_t> bytes;
+
+			template<typename T>
+			void add(const T& data)
+			{
+				const uint8_t* first = reinterpret_cast<const uint8_t*>(&data);
+				bytes.insert(bytes.end(), first, first + sizeof(T));
+			}
+
+			// FNV-1a
+			uint64_t hash() const
+			{
+				uint64_t value = 14695981039346656037ull;
+				for (uint8_t byte : bytes) {
+					value ^= byte;
+					value *= 1099511628211ull;
+				}
+				return value;
+			}
+		};
+
+		// Pools double in size up to this factor, so a scene with many sets doesn't end up with hundreds of small pools
+		const uint32_t maxPoolGrowth = 16;
+
+		uint32_t getPoolSetCount(uint32_t setsPerPool, size_t poolCount)
+		{
+			return setsPerPool * std::min(1u << std::min(static_cast<uint32_t>(poolCount), 31u), maxPoolGrowth);
+		}
+
+		bool isOutOfPoolMemory(VkResult result)
+		{
+			return (result == VK_ERROR_OUT_OF_POOL_MEMORY) || (result == VK_ERROR_FRAGMENTED_POOL);
+		}
+	}
+
+	DescriptorAllocator::~DescriptorAllocator()
+	{
+		destroy();
+	}
+
+	void DescriptorAllocator::prepare(VkDevice device, uint32_t setsPerPool, const std::vector<PoolSizeRatio>& poolSizeRatios)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		assert(setsPerPool > 0);
+		this->device = device;
+		this->setsPerPool = setsPerPool;
+		this->poolSizeRatios = poolSizeRatios;
+		if (this->poolSizeRatios.empty()) {
+			this->poolSizeRatios = {
+				{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+				{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+				{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+				{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0.5f },
+				{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0.5f },
+			};
+		}
+	}
+
+	VkDescriptorSetLayout DescriptorAllocator::getLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayoutCreateFlags flags)
+	{
+		Key key;
+		key.add(flags);
+		for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+			key.add(binding.binding);
+			key.add(binding.descriptorType);
+			key.add(binding.descriptorCount);
+			key.add(binding.stageFlags);
+			// Immutable samplers are part of the layout, so they are compared by handle instead of by address
+			const bool immutableSamplers = binding.pImmutableSamplers != nullptr;
+			key.add(immutableSamplers);
+			for (uint32_t i = 0; immutableSamplers && i < binding.descriptorCount; i++) {
+				key.add(binding.pImmutableSamplers[i]);
+			}
+		}
+		const uint64_t hash = key.hash();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		assert(device);
+		auto range = layouts.equal_range(hash);
+		for (auto it = range.first; it != range.second; it++) {
+			if (it->second.key == key.bytes) {
+				return it->second.layout;
+			}
+		}
+		VkDescriptorSetLayout layout;
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(bindings);
+		descriptorSetLayoutCI.flags = flags;
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &layout));
+		layouts.emplace(hash, CachedLayout{ std::move(key.bytes), layout });
+		std::vector<VkDescriptorSetLayoutBinding>& storedBindings = layoutBindings[layout];
+		storedBindings = bindings;
+		for (VkDescriptorSetLayoutBinding& binding : storedBindings) {
+			binding.pImmutableSamplers = nullptr;
+		}
+		return layout;
+	}
+
+	VkDescriptorPool DescriptorAllocator::createPool(uint32_t maxSets, VkDescriptorSetLayout layout, VkDescriptorPoolCreateFlags flags)
+	{
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (const PoolSizeRatio& ratio : poolSizeRatios) {
+			poolSizes.push_back(vks::initializers::descriptorPoolSize(ratio.type, std::max(static_cast<uint32_t>(std::ceil(ratio.ratio * maxSets)), 1u)));
+		}
+		// Make sure that at least one set of the requested layout fits, even if its descriptor counts exceed the ratios
+		auto it = layoutBindings.find(layout);
+		if (it != layoutBindings.end()) {
+			std::vector<VkDescriptorPoolSize> layoutSizes;
+			for (const VkDescriptorSetLayoutBinding& binding : it->second) {
+				auto size = std::find_if(layoutSizes.begin(), layoutSizes.end(), [&binding](const VkDescriptorPoolSize& poolSize) { return poolSize.type == binding.descriptorType; });
+				if (size != layoutSizes.end()) {
+					size->descriptorCount += binding.descriptorCount;
+				} else {
+					layoutSizes.push_back(vks::initializers::descriptorPoolSize(binding.descriptorType, binding.descriptorCount));
+				}
+			}
+			for (const VkDescriptorPoolSize& layoutSize : layoutSizes) {
+				auto size = std::find_if(poolSizes.begin(), poolSizes.end(), [&layoutSize](const VkDescriptorPoolSize& poolSize) { return poolSize.type == layoutSize.type; });
+				if (size != poolSizes.end()) {
+					size->descriptorCount = std::max(size->descriptorCount, layoutSize.descriptorCount);
+				} else {
+					poolSizes.push_back(layoutSize);
+				}
+			}
+		}
+		VkDescriptorPool pool;
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, maxSets);
+		descriptorPoolCI.flags = flags;
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &pool));
+		return pool;
+	}
+
+	VkDescriptorSet DescriptorAllocator::allocateFromPools(std::vector<Pool>& pools, VkDescriptorSetLayout layout, VkDescriptorPoolCreateFlags flags, uint32_t& poolIndex)
+	{
+		assert(device);
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		// Newer pools are larger and more likely to have space left, so they are tried first
+		for (size_t i = pools.size(); i-- > 0;) {
+			if (pools[i].full) {
+				continue;
+			}
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(pools[i].pool, &layout, 1);
+			VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+			if (result == VK_SUCCESS) {
+				pools[i].allocatedSets++;
+				poolIndex = static_cast<uint32_t>(i);
+				return descriptorSet;
+			}
+			if (!isOutOfPoolMemory(result)) {
+				VK_CHECK_RESULT(result);
+			}
+			pools[i].full = true;
+		}
+		// All pools are exhausted, so add a new one
+		Pool pool{};
+		pool.pool = createPool(getPoolSetCount(setsPerPool, pools.size()), layout, flags);
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(pool.pool, &layout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+		pool.allocatedSets = 1;
+		pools.push_back(pool);
+		poolIndex = static_cast<uint32_t>(pools.size() - 1);
+		return descriptorSet;
+	}
+
+	VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		SetState state{};
+		state.layout = layout;
+		// Persistent sets can be freed individually
+		VkDescriptorSet descriptorSet = allocateFromPools(pools, layout, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, state.pool);
+		sets[descriptorSet] = state;
+		return descriptorSet;
+	}
+
+	void DescriptorAllocator::free(VkDescriptorSet descriptorSet)
+	{
+		if (descriptorSet == VK_NULL_HANDLE) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = sets.find(descriptorSet);
+		assert(it != sets.end());
+		Pool& pool = pools[it->second.pool];
+		sets.erase(it);
+		pool.full = false;
+		pool.allocatedSets--;
+		if (pool.allocatedSets == 0) {
+			// Resetting an empty pool also gets rid of any fragmentation
+			VK_CHECK_RESULT(vkResetDescriptorPool(device, pool.pool, 0));
+		} else {
+			VK_CHECK_RESULT(vkFreeDescriptorSets(device, pool.pool, 1, &descriptorSet));
+		}
+	}
+
+	void DescriptorAllocator::beginFrame(uint32_t frameIndex)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (frameIndex >= frames.size()) {
+			frames.resize(frameIndex + 1);
+		}
+		Frame& frame = frames[frameIndex];
+		// Only pools that sets have been allocated from need a reset
+		for (Pool& pool : frame.pools) {
+			if (pool.allocatedSets > 0) {
+				VK_CHECK_RESULT(vkResetDescriptorPool(device, pool.pool, 0));
+				pool.allocatedSets = 0;
+			}
+			pool.full = false;
+		}
+		frame.allocatedSets = 0;
+		currentFrame = frameIndex;
+	}
+
+	VkDescriptorSet DescriptorAllocator::allocateTransient(VkDescriptorSetLayout layout)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (frames.empty()) {
+			frames.resize(1);
+		}
+		Frame& frame = frames[currentFrame];
+		uint32_t poolIndex;
+		VkDescriptorSet descriptorSet = allocateFromPools(frame.pools, layout, 0, poolIndex);
+		frame.allocatedSets++;
+		return descriptorSet;
+	}
+
+	bool DescriptorAllocator::isRedundant(const VkWriteDescriptorSet& writeDescriptorSet)
+	{
+		auto it = sets.find(writeDescriptorSet.dstSet);
+		if (it == sets.end()) {
+			return false;
+		}
+		SetState& state = it->second;
+
+		bool supported = (writeDescriptorSet.pNext == nullptr);
+		switch (writeDescriptorSet.descriptorType) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			supported = supported && (writeDescriptorSet.pImageInfo != nullptr);
+			break;
+		case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			supported = supported && (writeDescriptorSet.pTexelBufferView != nullptr);
+			break;
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+			supported = supported && (writeDescriptorSet.pBufferInfo != nullptr);
+			break;
+		default:
+			supported = false;
+		}
+		// A write with multiple descriptors may continue into the following bindings, which is only tracked if the binding is known to be large enough
+		bool withinBinding = (writeDescriptorSet.descriptorCount == 1);
+		if (!withinBinding) {
+			auto bindings = layoutBindings.find(state.layout);
+			if (bindings != layoutBindings.end()) {
+				for (const VkDescriptorSetLayoutBinding& binding : bindings->second) {
+					if (binding.binding == writeDescriptorSet.dstBinding) {
+						withinBinding = (writeDescriptorSet.dstArrayElement + writeDescriptorSet.descriptorCount <= binding.descriptorCount);
+					}
+				}
+			}
+		}
+		if (!supported || !withinBinding) {
+			// The write can't be compared, so it could change any descriptor of the set
+			state.writtenDescriptors.clear();
+			return false;
+		}
+
+		bool redundant = true;
+		for (uint32_t i = 0; i < writeDescriptorSet.descriptorCount; i++) {
+			Key descriptor;
+			descriptor.add(writeDescriptorSet.descriptorType);
+			if (writeDescriptorSet.pImageInfo) {
+				descriptor.add(writeDescriptorSet.pImageInfo[i].sampler);
+				descriptor.add(writeDescriptorSet.pImageInfo[i].imageView);
+				descriptor.add(writeDescriptorSet.pImageInfo[i].imageLayout);
+			} else if (writeDescriptorSet.pBufferInfo) {
+				descriptor.add(writeDescriptorSet.pBufferInfo[i].buffer);
+				descriptor.add(writeDescriptorSet.pBufferInfo[i].offset);
+				descriptor.add(writeDescriptorSet.pBufferInfo[i].range);
+			} else {
+				descriptor.add(writeDescriptorSet.pTexelBufferView[i]);
+			}
+			const uint32_t arrayElement = writeDescriptorSet.dstArrayElement + i;
+			auto written = std::find_if(state.writtenDescriptors.begin(), state.writtenDescriptors.end(), [&](const WrittenDescriptor& descriptor) { return descriptor.binding == writeDescriptorSet.dstBinding && descriptor.arrayElement == arrayElement; });
+			if (written == state.writtenDescriptors.end()) {
+				state.writtenDescriptors.push_back({ writeDescriptorSet.dstBinding, arrayElement, std::move(descriptor.bytes) });
+				redundant = false;
+			} else if (written->descriptor != descriptor.bytes) {
+				written->descriptor = std::move(descriptor.bytes);
+				redundant = false;
+			}
+		}
+		return redundant;
+	}
+
+	void DescriptorAllocator::updateDescriptorSets(const std::vector<VkWriteDescriptorSet>& writeDescriptorSets)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<VkWriteDescriptorSet> writes;
+		writes.reserve(writeDescriptorSets.size());
+		for (const VkWriteDescriptorSet& writeDescriptorSet : writeDescriptorSets) {
+			if (isRedundant(writeDescriptorSet)) {
+				statistics.skippedWrites++;
+			} else {
+				writes.push_back(writeDescriptorSet);
+			}
+		}
+		if (!writes.empty()) {
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+
+	void DescriptorAllocator::invalidate(VkDescriptorSet descriptorSet)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = sets.find(descriptorSet);
+		if (it != sets.end()) {
+			it->second.writtenDescriptors.clear();
+		}
+	}
+
+	void DescriptorAllocator::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!device) {
+			return;
+		}
+		for (Pool& pool : pools) {
+			vkDestroyDescriptorPool(device, pool.pool, nullptr);
+		}
+		for (Frame& frame : frames) {
+			for (Pool& pool : frame.pools) {
+				vkDestroyDescriptorPool(device, pool.pool, nullptr);
+			}
+		}
+		for (auto& layout : layouts) {
+			vkDestroyDescriptorSetLayout(device, layout.second.layout, nullptr);
+		}
+		pools.clear();
+		frames.clear();
+		currentFrame = 0;
+		sets.clear();
+		layouts.clear();
+		layoutBindings.clear();
+		statistics = {};
+		device = VK_NULL_HANDLE;
+	}
+
+	DescriptorAllocator::Statistics DescriptorAllocator::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Statistics current = statistics;
+		current.pools = static_cast<uint32_t>(pools.size());
+		for (const Frame& frame : frames) {
+			current.transientPools += static_cast<uint32_t>(frame.pools.size());
+		}
+		current.allocatedSets = static_cast<uint32_t>(sets.size());
+		current.transientSets = frames.empty() ? 0 : frames[currentFrame].allocatedSets;
+		current.layouts = static_cast<uint32_t>(layouts.size());
+		return current;
+	}
+}
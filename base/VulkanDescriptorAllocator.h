@@ -0,0 +1,140 @@
+/*
+* Growable descriptor allocator
+*
+* Allocates descriptor sets from a list of pools that grows whenever a pool runs out of memory, so the number of sets doesn't
+* need to be known upfront. Persistent sets can be freed individually (e.g. when a model is unloaded), transient sets are
+* allocated from per-frame pools that are reset in bulk. Also caches descriptor set layouts and skips redundant descriptor writes
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+namespace vks
+{
+	/**
+	* @brief Allocates descriptor sets from pools that are created on demand
+	*
+	* All functions are thread safe. Pools are created lazily with the first allocation, so an unused allocator doesn't cost anything.
+	*/
+	class DescriptorAllocator
+	{
+	public:
+		/** @brief Number of descriptors of a type per set a pool is sized for */
+		struct PoolSizeRatio {
+			VkDescriptorType type;
+			float ratio;
+		};
+
+		struct Statistics {
+			uint32_t pools = 0;
+			uint32_t transientPools = 0;
+			/** @brief Persistent sets that are currently allocated */
+			uint32_t allocatedSets = 0;
+			/** @brief Transient sets allocated since the frame's pools have last been reset */
+			uint32_t transientSets = 0;
+			uint32_t layouts = 0;
+			/** @brief Descriptor writes that have been skipped as they didn't change the set */
+			uint32_t skippedWrites = 0;
+		};
+
+		DescriptorAllocator() = default;
+		DescriptorAllocator(const DescriptorAllocator&) = delete;
+		DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+		~DescriptorAllocator();
+
+		/**
+		* @param device Device the pools and layouts are created on
+		* @param setsPerPool Number of sets the first pool is sized for, each further pool is larger than the previous one
+		* @param poolSizeRatios Descriptors per set for each type, defaults to a mix that fits the samples
+		*/
+		void prepare(VkDevice device, uint32_t setsPerPool = 64, const std::vector<PoolSizeRatio>& poolSizeRatios = {});
+		/**
+		* Returns a descriptor set layout for the given bindings, identical bindings always return the same layout
+		* @note The layout is owned by the allocator and must not be destroyed by the caller
+		*/
+		VkDescriptorSetLayout getLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayoutCreateFlags flags = 0);
+		/** @brief Allocates a set that stays valid until it's freed or the allocator is destroyed, a new pool is added if all pools are exhausted */
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+		/** @brief Returns a set allocated with allocate to its pool, the set must no longer be used by pending command buffers */
+		void free(VkDescriptorSet descriptorSet);
+		/**
+		* Resets the transient pools of a frame, to be called once the command buffers of that frame have completed
+		* @param frameIndex Frame (e.g. swap chain image) index, frames are added as required
+		*/
+		void beginFrame(uint32_t frameIndex);
+		/** @brief Allocates a set that is valid until the pools of the current frame are reset with the next beginFrame for that frame */
+		VkDescriptorSet allocateTransient(VkDescriptorSetLayout layout);
+		/**
+		* Same as vkUpdateDescriptorSets, but skips buffer and image writes to persistent sets that wouldn't change the contents of the set
+		* @note Descriptors are compared by handle, so sets that are written directly with vkUpdateDescriptorSets or that refer to a recreated resource need to be invalidated
+		*/
+		void updateDescriptorSets(const std::vector<VkWriteDescriptorSet>& writeDescriptorSets);
+		/** @brief Forgets the descriptors written to a set, so the next updateDescriptorSets for it isn't skipped */
+		void invalidate(VkDescriptorSet descriptorSet);
+		/** @brief Destroys all pools and layouts, sets allocated from the allocator become invalid */
+		void destroy();
+		Statistics getStatistics() const;
+
+	private:
+		struct Pool {
+			VkDescriptorPool pool = VK_NULL_HANDLE;
+			// Set if an allocation failed, cleared when a set is freed or the pool is reset
+			bool full = false;
+			uint32_t allocatedSets = 0;
+		};
+
+		struct Frame {
+			std::vector<Pool> pools;
+			uint32_t allocatedSets = 0;
+		};
+
+		struct WrittenDescriptor {
+			uint32_t binding;
+			uint32_t arrayElement;
+			// Serialized descriptor info of the last write
+			std::vector<uint8_t> descriptor;
+		};
+
+		struct CachedLayout {
+			// Serialized create flags and bindings
+			std::vector<uint8_t> key;
+			VkDescriptorSetLayout layout;
+		};
+
+		// Only tracked for persistent sets, transient sets are written once per frame anyway
+		struct SetState {
+			uint32_t pool = 0;
+			VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+			// Descriptors last written to the set, used to skip redundant writes
+			std::vector<WrittenDescriptor> writtenDescriptors;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		uint32_t setsPerPool = 64;
+		std::vector<PoolSizeRatio> poolSizeRatios;
+
+		mutable std::mutex mutex;
+		std::vector<Pool> pools;
+		std::vector<Frame> frames;
+		uint32_t currentFrame = 0;
+		std::unordered_map<VkDescriptorSet, SetState> sets;
+		std::unordered_multimap<uint64_t, CachedLayout> layouts;
+		// Bindings of the layouts created by getLayout, so pools can be sized to fit them and writes can be checked against them
+		std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSetLayoutBinding>> layoutBindings;
+		Statistics statistics;
+
+		VkDescriptorPool createPool(uint32_t maxSets, VkDescriptorSetLayout layout, VkDescriptorPoolCreateFlags flags);
+		VkDescriptorSet allocateFromPools(std::vector<Pool>& pools, VkDescriptorSetLayout layout, VkDescriptorPoolCreateFlags flags, uint32_t& poolIndex);
+		bool isRedundant(const VkWriteDescriptorSet& writeDescriptorSet);
+	};
+}
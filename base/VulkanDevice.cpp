@@ -13,6 +13,7 @@
 #define VK_ENABLE_BETA_EXTENSIONS
 #endif
 #include <VulkanDevice.h>
+#include <VulkanTrace.h>
 #include <unordered_set>
 
 namespace vks
@@ -26,6 +27,7 @@ namespace vks
 	{
 		assert(physicalDevice);
 		this->physicalDevice = physicalDevice;
+		creationThread = std::this_thread::get_id();
 
 		// Store Properties features, limits and properties of the physical device for later use
 		// Device properties also contain limits and sparse properties
@@ -68,6 +70,10 @@ namespace vks
 		{
 			vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
 		}
+		for (auto& threadCommandPool : threadCommandPools)
+		{
+			vkDestroyCommandPool(logicalDevice, threadCommandPool.second, nullptr);
+		}
 		if (logicalDevice)
 		{
 			vkDestroyDevice(logicalDevice, nullptr);
@@ -440,6 +446,7 @@ namespace vks
 	*/
 	void VulkanDevice::copyBuffer(vks::Buffer *src, vks::Buffer *dst, VkQueue queue, VkBufferCopy *copyRegion)
 	{
+		VKS_TRACE_SCOPE("Copy buffer");
 		assert(dst->size <= src->size);
 		assert(src->buffer);
 		VkCommandBuffer copyCmd = createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -504,7 +511,29 @@ namespace vks
 			
 	VkCommandBuffer VulkanDevice::createCommandBuffer(VkCommandBufferLevel level, bool begin)
 	{
-		return createCommandBuffer(level, commandPool, begin);
+		return createCommandBuffer(level, getCommandPool(), begin);
+	}
+
+	/**
+	* Get the default command pool for the calling thread
+	*
+	* @return The default command pool on the thread that created the device, a separate pool (created on first use) for any other thread
+	*
+	* @note Command pools must be externally synchronized, so each thread (e.g. of a startup task graph) records into its own pool
+	*/
+	VkCommandPool VulkanDevice::getCommandPool()
+	{
+		if (std::this_thread::get_id() == creationThread)
+		{
+			return commandPool;
+		}
+		std::lock_guard<std::mutex> lock(threadCommandPoolsMutex);
+		VkCommandPool& pool = threadCommandPools[std::this_thread::get_id()];
+		if (pool == VK_NULL_HANDLE)
+		{
+			pool = createCommandPool(queueFamilyIndices.graphics);
+		}
+		return pool;
 	}
 
 	/**
@@ -520,6 +549,7 @@ namespace vks
 	*/
 	void VulkanDevice::flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, VkCommandPool pool, bool free)
 	{
+		VKS_TRACE_SCOPE("Flush command buffer");
 		if (commandBuffer == VK_NULL_HANDLE)
 		{
 			return;
@@ -535,7 +565,10 @@ namespace vks
 		VkFence fence;
 		VK_CHECK_RESULT(vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence));
 		// Submit to the queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+		}
 		// Wait for the fence to signal that command buffer has finished executing
 		VK_CHECK_RESULT(vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
 		vkDestroyFence(logicalDevice, fence, nullptr);
@@ -547,7 +580,7 @@ namespace vks
 
 	void VulkanDevice::flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free)
 	{
-		return flushCommandBuffer(commandBuffer, queue, commandPool, free);
+		return flushCommandBuffer(commandBuffer, queue, getCommandPool(), free);
 	}
 
 	/**
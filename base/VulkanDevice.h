@@ -16,6 +16,9 @@
 #include <algorithm>
 #include <assert.h>
 #include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace vks
 {
@@ -39,6 +42,11 @@ struct VulkanDevice
 	std::vector<std::string> supportedExtensions;
 	/** @brief Default command pool for the graphics queue family index */
 	VkCommandPool commandPool = VK_NULL_HANDLE;
+	/**
+	* @brief Serializes queue submissions done through this device (e.g. flushCommandBuffer), so loaders can be run from multiple threads
+	* @note Code submitting to the same queue directly while other threads use the device needs to lock this too
+	*/
+	std::mutex queueMutex;
 	/** @brief Set to true when the debug marker extension is detected */
 	bool enableDebugMarkers = false;
 	/** @brief Contains queue family indices */
@@ -48,6 +56,10 @@ struct VulkanDevice
 		uint32_t compute;
 		uint32_t transfer;
 	} queueFamilyIndices;
+	/** @brief Command pools for threads other than the one that created the device, see getCommandPool */
+	std::unordered_map<std::thread::id, VkCommandPool> threadCommandPools;
+	std::mutex threadCommandPoolsMutex;
+	std::thread::id creationThread;
 	operator VkDevice() const
 	{
 		return logicalDevice;
@@ -63,6 +75,7 @@ struct VulkanDevice
 	VkCommandPool   createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 	VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, VkCommandPool pool, bool begin = false);
 	VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, bool begin = false);
+	VkCommandPool   getCommandPool();
 	void            flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, VkCommandPool pool, bool free = true);
 	void            flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free = true);
 	bool            extensionSupported(std::string extension);
@@ -0,0 +1,409 @@
+/*
+* Vulkan dynamic resolution
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanDynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace vks
+{
+	namespace
+	{
+		// Frames to wait after a scale change before the controller reacts again, gives the average time to settle at the new scale
+		const uint32_t settleFrames = 16;
+		// Weight of a new frame time in the moving average
+		const float averageWeight = 0.1f;
+		// No change if the average frame time is within this fraction of the target
+		const float deadband = 0.05f;
+		// Largest scale change per controller step
+		const float maxScaleChange = 0.1f;
+	}
+
+	DynamicResolution::~DynamicResolution()
+	{
+		destroy();
+	}
+
+	VkRenderPass DynamicResolution::getRenderPass() const
+	{
+		return renderPass;
+	}
+
+	float DynamicResolution::getScale() const
+	{
+		return scale;
+	}
+
+	float DynamicResolution::getGpuTime() const
+	{
+		return gpuTime;
+	}
+
+	bool DynamicResolution::hasTimestamps() const
+	{
+		return timestampsSupported;
+	}
+
+	VkExtent2D DynamicResolution::getRenderExtent() const
+	{
+		VkExtent2D extent;
+		extent.width = std::min(std::max(static_cast<uint32_t>(std::round(outputWidth * scale)), 1u), targetWidth);
+		extent.height = std::min(std::max(static_cast<uint32_t>(std::round(outputHeight * scale)), 1u), targetHeight);
+		return extent;
+	}
+
+	void DynamicResolution::prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, VkRenderPass outputRenderPass, VkFormat colorFormat, VkFormat depthFormat, uint32_t width, uint32_t height, uint32_t commandBufferCount)
+	{
+		assert(upscaleShaders[0].module != VK_NULL_HANDLE && upscaleShaders[1].module != VK_NULL_HANDLE);
+		assert(maxScale >= minScale && minScale > 0.0f);
+		this->device = device;
+		this->colorFormat = colorFormat;
+		this->depthFormat = depthFormat;
+		this->commandBufferCount = commandBufferCount;
+		outputWidth = width;
+		outputHeight = height;
+		scale = std::min(1.0f, maxScale);
+
+		// Timestamps need to be supported by the graphics queue
+		const uint32_t validBits = device->queueFamilyProperties[device->queueFamilyIndices.graphics].timestampValidBits;
+		timestampsSupported = validBits > 0;
+		timestampPeriod = device->properties.limits.timestampPeriod;
+		timestampMask = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+		if (timestampsSupported) {
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCI.queryCount = commandBufferCount * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCI, nullptr, &queryPool));
+			// Queries are undefined after creation and can't be read before they have been reset
+			VkCommandBuffer resetCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(resetCmd, queryPool, 0, queryPoolCI.queryCount);
+			device->flushCommandBuffer(resetCmd, queue, true);
+		}
+
+		// Bilinear filtering for the upscale, clamped to the rendered part of the target in the shader
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_LINEAR;
+		samplerCI.minFilter = VK_FILTER_LINEAR;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.maxLod = 1.0f;
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+
+		createRenderPass();
+
+		VkDescriptorSetLayoutBinding setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(&setLayoutBinding, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+
+		createUpscalePipeline(pipelineCache, outputRenderPass);
+		createTarget();
+	}
+
+	void DynamicResolution::createRenderPass()
+	{
+		std::array<VkAttachmentDescription, 2> attachmentDescriptions{};
+		attachmentDescriptions[0].format = colorFormat;
+		attachmentDescriptions[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachmentDescriptions[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachmentDescriptions[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachmentDescriptions[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachmentDescriptions[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachmentDescriptions[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachmentDescriptions[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		attachmentDescriptions[1].format = depthFormat;
+		attachmentDescriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachmentDescriptions[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachmentDescriptions[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachmentDescriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachmentDescriptions[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpassDescription{};
+		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpassDescription.colorAttachmentCount = 1;
+		subpassDescription.pColorAttachments = &colorReference;
+		subpassDescription.pDepthStencilAttachment = &depthReference;
+
+		// The upscale of the previous frame must have finished sampling before the target is written again
+		std::array<VkSubpassDependency, 3> dependencies{};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].dstSubpass = 0;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+		dependencies[2].srcSubpass = 0;
+		dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+		renderPassCI.attachmentCount = static_cast<uint32_t>(attachmentDescriptions.size());
+		renderPassCI.pAttachments = attachmentDescriptions.data();
+		renderPassCI.subpassCount = 1;
+		renderPassCI.pSubpasses = &subpassDescription;
+		renderPassCI.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassCI.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassCI, nullptr, &renderPass));
+	}
+
+	void DynamicResolution::createUpscalePipeline(VkPipelineCache pipelineCache, VkRenderPass outputRenderPass)
+	{
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(PushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayout));
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
+		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
+		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
+		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
+		VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
+		VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+
+		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayout, outputRenderPass, 0);
+		pipelineCI.pVertexInputState = &emptyInputState;
+		pipelineCI.pInputAssemblyState = &inputAssemblyState;
+		pipelineCI.pRasterizationState = &rasterizationState;
+		pipelineCI.pColorBlendState = &colorBlendState;
+		pipelineCI.pMultisampleState = &multisampleState;
+		pipelineCI.pViewportState = &viewportState;
+		pipelineCI.pDepthStencilState = &depthStencilState;
+		pipelineCI.pDynamicState = &dynamicState;
+		pipelineCI.stageCount = static_cast<uint32_t>(upscaleShaders.size());
+		pipelineCI.pStages = upscaleShaders.data();
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+	}
+
+	void DynamicResolution::createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask, Attachment& attachment)
+	{
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = format;
+		imageCI.extent = { targetWidth, targetHeight, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = usage;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &attachment.image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, attachment.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &attachment.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, attachment.image, attachment.memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = format;
+		viewCI.subresourceRange = { aspectMask, 0, 1, 0, 1 };
+		viewCI.image = attachment.image;
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &attachment.view));
+	}
+
+	void DynamicResolution::destroyAttachment(Attachment& attachment)
+	{
+		vkDestroyImageView(device->logicalDevice, attachment.view, nullptr);
+		vkDestroyImage(device->logicalDevice, attachment.image, nullptr);
+		vkFreeMemory(device->logicalDevice, attachment.memory, nullptr);
+		attachment = Attachment();
+	}
+
+	void DynamicResolution::createTarget()
+	{
+		// The target is sized for the largest scale, so scale changes only need a different render area
+		targetWidth = static_cast<uint32_t>(std::ceil(outputWidth * maxScale));
+		targetHeight = static_cast<uint32_t>(std::ceil(outputHeight * maxScale));
+
+		createAttachment(colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, color);
+		VkImageAspectFlags depthAspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (vks::tools::formatHasStencil(depthFormat)) {
+			depthAspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+		createAttachment(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthAspectMask, depth);
+
+		std::array<VkImageView, 2> attachments = { color.view, depth.view };
+		VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+		framebufferCI.renderPass = renderPass;
+		framebufferCI.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferCI.pAttachments = attachments.data();
+		framebufferCI.width = targetWidth;
+		framebufferCI.height = targetHeight;
+		framebufferCI.layers = 1;
+		VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &framebufferCI, nullptr, &framebuffer));
+
+		VkDescriptorImageInfo imageDescriptor = vks::initializers::descriptorImageInfo(sampler, color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptor);
+		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+	}
+
+	void DynamicResolution::destroyTarget()
+	{
+		vkDestroyFramebuffer(device->logicalDevice, framebuffer, nullptr);
+		framebuffer = VK_NULL_HANDLE;
+		destroyAttachment(color);
+		destroyAttachment(depth);
+	}
+
+	void DynamicResolution::resize(uint32_t width, uint32_t height)
+	{
+		outputWidth = width;
+		outputHeight = height;
+		destroyTarget();
+		createTarget();
+	}
+
+	void DynamicResolution::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		destroyTarget();
+		vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+		vkDestroyRenderPass(device->logicalDevice, renderPass, nullptr);
+		vkDestroySampler(device->logicalDevice, sampler, nullptr);
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+		}
+		pipeline = VK_NULL_HANDLE;
+		pipelineLayout = VK_NULL_HANDLE;
+		descriptorSetLayout = VK_NULL_HANDLE;
+		descriptorPool = VK_NULL_HANDLE;
+		descriptorSet = VK_NULL_HANDLE;
+		renderPass = VK_NULL_HANDLE;
+		sampler = VK_NULL_HANDLE;
+		queryPool = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	void DynamicResolution::getRenderPassBeginInfo(VkRenderPassBeginInfo& renderPassBeginInfo, VkViewport& viewport, VkRect2D& scissor) const
+	{
+		const VkExtent2D extent = getRenderExtent();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = framebuffer;
+		renderPassBeginInfo.renderArea.offset = { 0, 0 };
+		renderPassBeginInfo.renderArea.extent = extent;
+		viewport = vks::initializers::viewport((float)extent.width, (float)extent.height, 0.0f, 1.0f);
+		scissor = vks::initializers::rect2D(extent.width, extent.height, 0, 0);
+	}
+
+	bool DynamicResolution::setScale(float scale)
+	{
+		const VkExtent2D previousExtent = getRenderExtent();
+		scale = std::round(scale / scaleStep) * scaleStep;
+		this->scale = std::min(std::max(scale, minScale), maxScale);
+		const VkExtent2D extent = getRenderExtent();
+		return (extent.width != previousExtent.width) || (extent.height != previousExtent.height);
+	}
+
+	void DynamicResolution::beginFrame(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex)
+	{
+		if (!timestampsSupported) {
+			return;
+		}
+		assert(commandBufferIndex < commandBufferCount);
+		vkCmdResetQueryPool(commandBuffer, queryPool, commandBufferIndex * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, commandBufferIndex * 2);
+	}
+
+	void DynamicResolution::endFrame(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex)
+	{
+		if (!timestampsSupported) {
+			return;
+		}
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, commandBufferIndex * 2 + 1);
+	}
+
+	void DynamicResolution::upscale(VkCommandBuffer commandBuffer)
+	{
+		const VkExtent2D extent = getRenderExtent();
+		PushConstants pushConstants;
+		pushConstants.uvScale[0] = (float)extent.width / (float)targetWidth;
+		pushConstants.uvScale[1] = (float)extent.height / (float)targetHeight;
+		// Keep the bilinear footprint inside the rendered area, texels outside of it hold stale contents from larger scales
+		pushConstants.uvClamp[0] = ((float)extent.width - 0.5f) / (float)targetWidth;
+		pushConstants.uvClamp[1] = ((float)extent.height - 0.5f) / (float)targetHeight;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	}
+
+	bool DynamicResolution::update(uint32_t commandBufferIndex)
+	{
+		if (!timestampsSupported) {
+			return false;
+		}
+		// Each timestamp is followed by its availability, both need to be written by a completed frame (which isn't the case until the command buffer has been submitted once)
+		uint64_t timestamps[4] = {};
+		VkResult result = vkGetQueryPoolResults(device->logicalDevice, queryPool, commandBufferIndex * 2, 2, sizeof(timestamps), timestamps, 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (result == VK_NOT_READY || timestamps[1] == 0 || timestamps[3] == 0) {
+			return false;
+		}
+		VK_CHECK_RESULT(result);
+		gpuTime = (float)((timestamps[2] - timestamps[0]) & timestampMask) * timestampPeriod / 1000000.0f;
+		averageGpuTime = (averageGpuTime > 0.0f) ? averageGpuTime + (gpuTime - averageGpuTime) * averageWeight : gpuTime;
+
+		framesSinceChange++;
+		if (!enabled || framesSinceChange < settleFrames) {
+			return false;
+		}
+		const float ratio = targetFrameTime / averageGpuTime;
+		if (std::abs(ratio - 1.0f) < deadband) {
+			return false;
+		}
+		// Fragment cost is roughly proportional to the pixel count, i.e. to the square of the scale
+		float change = scale * std::sqrt(ratio) - scale;
+		change = std::min(std::max(change, -maxScaleChange), maxScaleChange);
+		if (!setScale(scale + change)) {
+			return false;
+		}
+		framesSinceChange = 0;
+		averageGpuTime = 0.0f;
+		return true;
+	}
+}
@@ -0,0 +1,146 @@
+/*
+* Vulkan dynamic resolution
+*
+* Renders into an oversized target with a variable viewport and upscales to the swapchain, the render scale is driven by measured GPU frame times
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Dynamic resolution scaling
+	*
+	* The scene is rendered to a color and depth target allocated once at maxScale times the output size. Only the top left
+	* getRenderExtent() part of it is rendered to (render area, viewport and scissor), so changing the render scale never reallocates
+	* any resources. upscale() then samples that part with bilinear filtering and draws it as a fullscreen triangle into the output render pass.
+	*
+	* Two timestamps per command buffer measure the GPU time of a frame. update() feeds the result of the last completed frame into
+	* a controller that scales the pixel count by the ratio of target to measured frame time. Changes are quantized and rate limited,
+	* so command buffers only need to be rebuilt occasionally.
+	*/
+	class DynamicResolution
+	{
+	public:
+		/** @brief Render scale is quantized to multiples of this to avoid rebuilding command buffers for insignificant changes */
+		static constexpr float scaleStep = 1.0f / 32.0f;
+
+		/** @brief Shader stages for the upscale pass (fullscreen triangle), need to be set before calling prepare */
+		std::array<VkPipelineShaderStageCreateInfo, 2> upscaleShaders{};
+		/** @brief Size of the render target relative to the output, needs to be set before calling prepare */
+		float maxScale = 1.0f;
+		/** @brief Lower bound for the render scale */
+		float minScale = 0.5f;
+		/** @brief GPU frame time the controller aims for (in ms) */
+		float targetFrameTime = 16.6f;
+		/** @brief Adjusts the render scale from measured frame times, if disabled the current scale is kept */
+		bool enabled = true;
+
+	private:
+		struct Attachment {
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+		};
+
+		struct PushConstants {
+			float uvScale[2];
+			float uvClamp[2];
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+		VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+		uint32_t outputWidth = 0;
+		uint32_t outputHeight = 0;
+		uint32_t targetWidth = 0;
+		uint32_t targetHeight = 0;
+		float scale = 1.0f;
+
+		Attachment color;
+		Attachment depth;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		uint32_t commandBufferCount = 0;
+		bool timestampsSupported = false;
+		float timestampPeriod = 1.0f;
+		uint64_t timestampMask = ~0ULL;
+		float gpuTime = 0.0f;
+		float averageGpuTime = 0.0f;
+		uint32_t framesSinceChange = 0;
+
+		void createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask, Attachment& attachment);
+		void destroyAttachment(Attachment& attachment);
+		void createTarget();
+		void destroyTarget();
+		void createRenderPass();
+		void createUpscalePipeline(VkPipelineCache pipelineCache, VkRenderPass outputRenderPass);
+	public:
+		~DynamicResolution();
+
+		/**
+		* Create the render target, upscale pipeline and timestamp queries
+		*
+		* @param device Device to create the resources on
+		* @param queue Queue used to reset the timestamp queries before their first use
+		* @param pipelineCache Pipeline cache for the upscale pipeline
+		* @param outputRenderPass Render pass the upscale pass is recorded in (e.g. the swapchain render pass)
+		* @param colorFormat Format of the scene color target
+		* @param depthFormat Format of the scene depth target
+		* @param width Width of the output in pixels
+		* @param height Height of the output in pixels
+		* @param commandBufferCount Number of command buffers that record timestamps (one query pair each)
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, VkRenderPass outputRenderPass, VkFormat colorFormat, VkFormat depthFormat, uint32_t width, uint32_t height, uint32_t commandBufferCount);
+		void destroy();
+		/** @brief Recreates the render target for a new output size, command buffers need to be rebuilt afterwards */
+		void resize(uint32_t width, uint32_t height);
+
+		/** @brief Render pass for the scene, its attachments are cleared to color and depth 1.0 and left ready for sampling */
+		VkRenderPass getRenderPass() const;
+		/** @brief Sets the render pass begin info, viewport and scissor for the current render extent */
+		void getRenderPassBeginInfo(VkRenderPassBeginInfo& renderPassBeginInfo, VkViewport& viewport, VkRect2D& scissor) const;
+		/** @brief Part of the target that is rendered to at the current scale */
+		VkExtent2D getRenderExtent() const;
+		float getScale() const;
+		/** @brief Sets the render scale (clamped to minScale..maxScale), returns true if the render extent changed */
+		bool setScale(float scale);
+
+		/** @brief Records the start timestamp, must be the first command of the frame's command buffer */
+		void beginFrame(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex);
+		/** @brief Records the end timestamp, must be the last command of the frame's command buffer */
+		void endFrame(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex);
+		/** @brief Draws the scaled scene into the current (output) render pass */
+		void upscale(VkCommandBuffer commandBuffer);
+
+		/**
+		* Reads the GPU time of a completed frame and runs the scale controller
+		*
+		* @param commandBufferIndex Command buffer of the frame to read the timestamps for (doesn't wait if results are not available yet)
+		* @return True if the render extent changed and command buffers need to be rebuilt
+		*/
+		bool update(uint32_t commandBufferIndex);
+		/** @brief GPU time of the last measured frame in ms (0 if timestamps are not supported) */
+		float getGpuTime() const;
+		bool hasTimestamps() const;
+	};
+}
@@ -0,0 +1,319 @@
+/*
+* Vulkan geometry pool
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanGeometryPool.h"
+
+namespace vks
+{
+	void GeometryPool::create(vks::VulkanDevice* device, VkQueue transferQueue, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, VkBufferUsageFlags additionalUsageFlags)
+	{
+		this->device = device;
+		this->transferQueue = transferQueue;
+		vertexArena.stride = vertexStride;
+		vertexArena.usageFlags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | additionalUsageFlags;
+		indexArena.stride = sizeof(uint32_t);
+		indexArena.usageFlags = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | additionalUsageFlags;
+		createArenaBuffer(vertexArena, vertexCapacity);
+		createArenaBuffer(indexArena, indexCapacity);
+	}
+
+	GeometryPool::~GeometryPool()
+	{
+		destroy();
+	}
+
+	void GeometryPool::destroy()
+	{
+		vertexArena.buffer.destroy();
+		indexArena.buffer.destroy();
+		vertexArena = {};
+		indexArena = {};
+		releaseRetiredBuffers();
+		allocations.clear();
+		freeHandles.clear();
+	}
+
+	void GeometryPool::createArenaBuffer(Arena& arena, uint32_t capacity)
+	{
+		arena.capacity = std::max(capacity, 1u);
+		// Transfer source is required for repacking
+		VK_CHECK_RESULT(device->createBuffer(
+			arena.usageFlags | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&arena.buffer,
+			static_cast<VkDeviceSize>(arena.capacity) * arena.stride));
+		arena.freeBlocks = { { 0, arena.capacity } };
+	}
+
+	bool GeometryPool::fits(const Arena& arena, uint32_t count) const
+	{
+		if (count == 0) {
+			return true;
+		}
+		for (const Block& block : arena.freeBlocks) {
+			if (block.size >= count) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	uint32_t GeometryPool::freeCount(const Arena& arena) const
+	{
+		uint32_t count = 0;
+		for (const Block& block : arena.freeBlocks) {
+			count += block.size;
+		}
+		return count;
+	}
+
+	// Best fit, keeps large blocks intact for large requests
+	uint32_t GeometryPool::allocateBlock(Arena& arena, uint32_t count)
+	{
+		if (count == 0) {
+			return 0;
+		}
+		size_t best = arena.freeBlocks.size();
+		for (size_t i = 0; i < arena.freeBlocks.size(); i++) {
+			if ((arena.freeBlocks[i].size >= count) && ((best == arena.freeBlocks.size()) || (arena.freeBlocks[i].size < arena.freeBlocks[best].size))) {
+				best = i;
+			}
+		}
+		assert(best < arena.freeBlocks.size());
+		Block& block = arena.freeBlocks[best];
+		const uint32_t offset = block.offset;
+		block.offset += count;
+		block.size -= count;
+		if (block.size == 0) {
+			arena.freeBlocks.erase(arena.freeBlocks.begin() + best);
+		}
+		return offset;
+	}
+
+	// Free blocks are kept sorted by offset, so merging only needs to look at direct neighbours
+	void GeometryPool::freeBlock(Arena& arena, uint32_t offset, uint32_t count)
+	{
+		if (count == 0) {
+			return;
+		}
+		auto next = std::lower_bound(arena.freeBlocks.begin(), arena.freeBlocks.end(), offset, [](const Block& block, uint32_t offset) { return block.offset < offset; });
+		auto it = arena.freeBlocks.insert(next, { offset, count });
+		if ((it + 1 != arena.freeBlocks.end()) && (it->offset + it->size == (it + 1)->offset)) {
+			it->size += (it + 1)->size;
+			arena.freeBlocks.erase(it + 1);
+		}
+		if ((it != arena.freeBlocks.begin()) && ((it - 1)->offset + (it - 1)->size == it->offset)) {
+			(it - 1)->size += it->size;
+			arena.freeBlocks.erase(it);
+		}
+	}
+
+	/*
+		Creates new buffers with the requested capacities and copies all live allocations tightly packed into them
+		The old buffers are retired instead of destroyed, as command buffers that are still in flight may reference them
+	*/
+	void GeometryPool::rebuild(uint32_t vertexCapacity, uint32_t indexCapacity)
+	{
+		Arena newVertexArena{};
+		newVertexArena.stride = vertexArena.stride;
+		newVertexArena.usageFlags = vertexArena.usageFlags;
+		createArenaBuffer(newVertexArena, vertexCapacity);
+		Arena newIndexArena{};
+		newIndexArena.stride = indexArena.stride;
+		newIndexArena.usageFlags = indexArena.usageFlags;
+		createArenaBuffer(newIndexArena, indexCapacity);
+
+		std::vector<VkBufferCopy> vertexCopies;
+		std::vector<VkBufferCopy> indexCopies;
+		uint32_t vertexOffset = 0;
+		uint32_t indexOffset = 0;
+		for (Allocation& allocation : allocations) {
+			if (!allocation.used) {
+				continue;
+			}
+			if (allocation.vertexCount > 0) {
+				const VkDeviceSize stride = vertexArena.stride;
+				vertexCopies.push_back({ allocation.vertexOffset * stride, vertexOffset * stride, allocation.vertexCount * stride });
+			}
+			if (allocation.indexCount > 0) {
+				const VkDeviceSize stride = indexArena.stride;
+				indexCopies.push_back({ allocation.firstIndex * stride, indexOffset * stride, allocation.indexCount * stride });
+			}
+			allocation.vertexOffset = vertexOffset;
+			allocation.firstIndex = indexOffset;
+			vertexOffset += allocation.vertexCount;
+			indexOffset += allocation.indexCount;
+		}
+		assert((vertexOffset <= newVertexArena.capacity) && (indexOffset <= newIndexArena.capacity));
+
+		if (!vertexCopies.empty() || !indexCopies.empty()) {
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			if (!vertexCopies.empty()) {
+				vkCmdCopyBuffer(copyCmd, vertexArena.buffer.buffer, newVertexArena.buffer.buffer, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+			}
+			if (!indexCopies.empty()) {
+				vkCmdCopyBuffer(copyCmd, indexArena.buffer.buffer, newIndexArena.buffer.buffer, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+			}
+			device->flushCommandBuffer(copyCmd, transferQueue, true);
+		}
+
+		retiredBuffers.push_back(vertexArena.buffer);
+		retiredBuffers.push_back(indexArena.buffer);
+		vertexArena = newVertexArena;
+		indexArena = newIndexArena;
+		vertexArena.freeBlocks.clear();
+		indexArena.freeBlocks.clear();
+		if (vertexOffset < vertexArena.capacity) {
+			vertexArena.freeBlocks.push_back({ vertexOffset, vertexArena.capacity - vertexOffset });
+		}
+		if (indexOffset < indexArena.capacity) {
+			indexArena.freeBlocks.push_back({ indexOffset, indexArena.capacity - indexOffset });
+		}
+		compactions++;
+		generation++;
+	}
+
+	uint32_t GeometryPool::grownCapacity(const Arena& arena, uint32_t count) const
+	{
+		// Done in 64 bits, doubling a large arena would otherwise wrap around and shrink it
+		const uint64_t required = static_cast<uint64_t>(arena.capacity) - freeCount(arena) + count;
+		if (required > UINT32_MAX) {
+			vks::tools::exitFatal("Geometry pool arenas can't hold more than 2^32 - 1 elements", VK_ERROR_OUT_OF_DEVICE_MEMORY);
+		}
+		return static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(static_cast<uint64_t>(arena.capacity) * 2, required), UINT32_MAX));
+	}
+
+	GeometryPool::Handle GeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount)
+	{
+		assert(device);
+		if (!fits(vertexArena, vertexCount) || !fits(indexArena, indexCount)) {
+			// Repacking is enough if the free space is only fragmented, otherwise the pool needs to grow
+			uint32_t vertexCapacity = vertexArena.capacity;
+			uint32_t indexCapacity = indexArena.capacity;
+			if (freeCount(vertexArena) < vertexCount) {
+				vertexCapacity = grownCapacity(vertexArena, vertexCount);
+			}
+			if (freeCount(indexArena) < indexCount) {
+				indexCapacity = grownCapacity(indexArena, indexCount);
+			}
+			rebuild(vertexCapacity, indexCapacity);
+		}
+
+		Allocation allocation{};
+		allocation.vertexCount = vertexCount;
+		allocation.indexCount = indexCount;
+		allocation.vertexOffset = allocateBlock(vertexArena, vertexCount);
+		allocation.firstIndex = allocateBlock(indexArena, indexCount);
+		allocation.used = true;
+
+		Handle handle;
+		if (!freeHandles.empty()) {
+			handle = freeHandles.back();
+			freeHandles.pop_back();
+			allocations[handle] = allocation;
+		} else {
+			handle = static_cast<Handle>(allocations.size());
+			allocations.push_back(allocation);
+		}
+		return handle;
+	}
+
+	void GeometryPool::upload(Handle handle, const void* vertexData, const void* indexData)
+	{
+		const Allocation& allocation = get(handle);
+		const VkDeviceSize vertexDataSize = static_cast<VkDeviceSize>(allocation.vertexCount) * vertexArena.stride;
+		const VkDeviceSize indexDataSize = static_cast<VkDeviceSize>(allocation.indexCount) * indexArena.stride;
+
+		vks::Buffer vertexStaging, indexStaging;
+		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		if ((vertexDataSize > 0) && vertexData) {
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vertexStaging, vertexDataSize, const_cast<void*>(vertexData)));
+			VkBufferCopy copyRegion = { 0, allocation.vertexOffset * static_cast<VkDeviceSize>(vertexArena.stride), vertexDataSize };
+			vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertexArena.buffer.buffer, 1, &copyRegion);
+		}
+		if ((indexDataSize > 0) && indexData) {
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indexStaging, indexDataSize, const_cast<void*>(indexData)));
+			VkBufferCopy copyRegion = { 0, allocation.firstIndex * static_cast<VkDeviceSize>(indexArena.stride), indexDataSize };
+			vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indexArena.buffer.buffer, 1, &copyRegion);
+		}
+		device->flushCommandBuffer(copyCmd, transferQueue, true);
+		vertexStaging.destroy();
+		indexStaging.destroy();
+	}
+
+	void GeometryPool::free(Handle handle)
+	{
+		Allocation& allocation = allocations[handle];
+		assert(allocation.used);
+		freeBlock(vertexArena, allocation.vertexOffset, allocation.vertexCount);
+		freeBlock(indexArena, allocation.firstIndex, allocation.indexCount);
+		allocation = {};
+		freeHandles.push_back(handle);
+	}
+
+	void GeometryPool::compact()
+	{
+		// Nothing to do if the only free block is at the end of the buffer
+		auto fragmented = [](const Arena& arena) {
+			return (arena.freeBlocks.size() > 1) || ((arena.freeBlocks.size() == 1) && (arena.freeBlocks[0].offset + arena.freeBlocks[0].size != arena.capacity));
+		};
+		if (fragmented(vertexArena) || fragmented(indexArena)) {
+			rebuild(vertexArena.capacity, indexArena.capacity);
+		}
+	}
+
+	void GeometryPool::releaseRetiredBuffers()
+	{
+		for (vks::Buffer& buffer : retiredBuffers) {
+			buffer.destroy();
+		}
+		retiredBuffers.clear();
+	}
+
+	uint32_t GeometryPool::getGeneration() const
+	{
+		return generation;
+	}
+
+	const GeometryPool::Allocation& GeometryPool::get(Handle handle) const
+	{
+		assert((handle < allocations.size()) && allocations[handle].used);
+		return allocations[handle];
+	}
+
+	void GeometryPool::bind(VkCommandBuffer commandBuffer) const
+	{
+		const VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexArena.buffer.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indexArena.buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+
+	VkBuffer GeometryPool::getVertexBuffer() const
+	{
+		return vertexArena.buffer.buffer;
+	}
+
+	VkBuffer GeometryPool::getIndexBuffer() const
+	{
+		return indexArena.buffer.buffer;
+	}
+
+	GeometryPool::Statistics GeometryPool::getStatistics() const
+	{
+		Statistics statistics{};
+		statistics.vertexCapacity = vertexArena.capacity;
+		statistics.vertexCount = vertexArena.capacity - freeCount(vertexArena);
+		statistics.indexCapacity = indexArena.capacity;
+		statistics.indexCount = indexArena.capacity - freeCount(indexArena);
+		statistics.allocationCount = static_cast<uint32_t>(allocations.size() - freeHandles.size());
+		statistics.freeBlockCount = static_cast<uint32_t>(vertexArena.freeBlocks.size() + indexArena.freeBlocks.size());
+		statistics.compactions = compactions;
+		statistics.retiredBuffers = static_cast<uint32_t>(retiredBuffers.size());
+		return statistics;
+	}
+}
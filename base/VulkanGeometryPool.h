@@ -0,0 +1,127 @@
+/*
+* Vulkan geometry pool
+*
+* Large shared vertex and index buffers that many models sub-allocate their geometry from
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Shared device local vertex and index buffers with free-list sub-allocation
+	*
+	* Allocations are addressed by handles, their vertex offset (base vertex) and first index are passed to the draw calls
+	* so that all models in the pool can be drawn after binding the pool's buffers once (and share one indirect draw stream).
+	* Freed ranges are merged with their neighbours, if a request doesn't fit into any free block the pool is repacked
+	* (and grown if required). Repacking moves allocations to new buffers, so offsets must be re-read after each allocation
+	* and command buffers recorded before a repack need to be recorded again (see getGeneration). The replaced buffers are kept
+	* alive until releaseRetiredBuffers is called, as pending command buffers may still read from them.
+	* Indices are always 32 bit.
+	*/
+	class GeometryPool
+	{
+	public:
+		typedef uint32_t Handle;
+		static const Handle invalidHandle = ~0u;
+
+		struct Allocation {
+			uint32_t vertexOffset = 0;
+			uint32_t vertexCount = 0;
+			uint32_t firstIndex = 0;
+			uint32_t indexCount = 0;
+			bool used = false;
+		};
+
+		struct Statistics {
+			uint32_t vertexCapacity = 0;
+			uint32_t vertexCount = 0;
+			uint32_t indexCapacity = 0;
+			uint32_t indexCount = 0;
+			uint32_t allocationCount = 0;
+			uint32_t freeBlockCount = 0;
+			uint32_t compactions = 0;
+			uint32_t retiredBuffers = 0;
+		};
+
+	private:
+		struct Block {
+			uint32_t offset;
+			uint32_t size;
+		};
+		struct Arena {
+			vks::Buffer buffer;
+			VkBufferUsageFlags usageFlags = 0;
+			uint32_t stride = 0;
+			uint32_t capacity = 0;
+			std::vector<Block> freeBlocks;
+		};
+		vks::VulkanDevice* device = nullptr;
+		VkQueue transferQueue = VK_NULL_HANDLE;
+		Arena vertexArena;
+		Arena indexArena;
+		std::vector<Allocation> allocations;
+		std::vector<Handle> freeHandles;
+		// Buffers replaced by a repack that may still be referenced by command buffers in flight
+		std::vector<vks::Buffer> retiredBuffers;
+		uint32_t compactions = 0;
+		uint32_t generation = 0;
+		void createArenaBuffer(Arena& arena, uint32_t capacity);
+		bool fits(const Arena& arena, uint32_t count) const;
+		uint32_t freeCount(const Arena& arena) const;
+		uint32_t grownCapacity(const Arena& arena, uint32_t count) const;
+		uint32_t allocateBlock(Arena& arena, uint32_t count);
+		void freeBlock(Arena& arena, uint32_t offset, uint32_t count);
+		void rebuild(uint32_t vertexCapacity, uint32_t indexCapacity);
+	public:
+		~GeometryPool();
+
+		/**
+		* Create the pool's buffers
+		*
+		* @param device Device to create the buffers on
+		* @param transferQueue Queue used for uploads and repacking
+		* @param vertexStride Size of a single vertex in bytes
+		* @param vertexCapacity Initial number of vertices
+		* @param indexCapacity Initial number of indices
+		* @param additionalUsageFlags Usage flags added to both buffers (e.g. storage or device address usage)
+		*/
+		void create(vks::VulkanDevice* device, VkQueue transferQueue, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, VkBufferUsageFlags additionalUsageFlags = 0);
+		void destroy();
+		/** @brief Reserves ranges for the given number of vertices and indices, may repack or grow the pool */
+		Handle allocate(uint32_t vertexCount, uint32_t indexCount);
+		/** @brief Copies vertex and (model relative) index data into an allocation via staging buffers */
+		void upload(Handle handle, const void* vertexData, const void* indexData);
+		/** @brief Returns the ranges of an allocation to the free lists */
+		void free(Handle handle);
+		/**
+		* Moves all allocations to the start of the buffers so that all free space forms a single block
+		* @note Must not be called while the pool's buffers are in use by the GPU
+		*/
+		void compact();
+		/**
+		* Destroys the buffers that have been replaced by repacking
+		* @note Must only be called once all command buffers submitted before the last repack have completed (e.g. after waiting on the frame's fence)
+		*/
+		void releaseRetiredBuffers();
+		/** @brief Incremented whenever allocations are moved to new buffers, command buffers recorded with an older generation refer to outdated buffers and offsets */
+		uint32_t getGeneration() const;
+		const Allocation& get(Handle handle) const;
+		/** @brief Binds the vertex buffer to binding 0 and the index buffer */
+		void bind(VkCommandBuffer commandBuffer) const;
+		VkBuffer getVertexBuffer() const;
+		VkBuffer getIndexBuffer() const;
+		Statistics getStatistics() const;
+	};
+}
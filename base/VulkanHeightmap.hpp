@@ -20,9 +20,9 @@ namespace vks
 	class HeightMap
 	{
 	private:
-		uint16_t *heightdata;
-		uint32_t dim;
-		uint32_t scale;
+		uint16_t *heightdata = nullptr;
+		uint32_t dim = 0;
+		uint32_t scale = 1;
 
 		vks::VulkanDevice *device = nullptr;
 		VkQueue copyQueue = VK_NULL_HANDLE;
@@ -67,6 +67,41 @@ namespace vks
 			return *(heightdata + (rpos.x + rpos.y * dim) * scale) / 65535.0f * heightScale;
 		}
 
+		/** @brief Copies height data from memory instead of loading it from a file, dim is the width and height of the (square) data */
+		void setHeightData(const uint16_t* data, uint32_t dim, uint32_t patchsize)
+		{
+			delete[] heightdata;
+			this->dim = dim;
+			this->scale = dim / patchsize;
+			heightdata = new uint16_t[dim * dim];
+			memcpy(heightdata, data, dim * dim * sizeof(uint16_t));
+		}
+
+		/** @brief Calculates the normals of a patch's vertices from the height differences of their neighbours */
+		void generateNormals(Vertex* vertices, uint32_t patchsize)
+		{
+			for (uint32_t y = 0; y < patchsize; y++)
+			{
+				for (uint32_t x = 0; x < patchsize; x++)
+				{
+					float dx = getHeight(x < patchsize - 1 ? x + 1 : x, y) - getHeight(x > 0 ? x - 1 : x, y);
+					if (x == 0 || x == patchsize - 1)
+						dx *= 2.0f;
+
+					float dy = getHeight(x, y < patchsize - 1 ? y + 1 : y) - getHeight(x, y > 0 ? y - 1 : y);
+					if (y == 0 || y == patchsize - 1)
+						dy *= 2.0f;
+
+					glm::vec3 A = glm::vec3(1.0f, 0.0f, dx);
+					glm::vec3 B = glm::vec3(0.0f, 1.0f, dy);
+
+					glm::vec3 normal = (glm::normalize(glm::cross(A, B)) + 1.0f) * 0.5f;
+
+					vertices[x + y * patchsize].normal = glm::vec3(normal.x, normal.z, normal.y);
+				}
+			}
+		}
+
 #if defined(__ANDROID__)
 		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, AAssetManager* assetManager)
 #else
@@ -89,14 +124,21 @@ namespace vks
 			result = ktxTexture_CreateFromMemory(textureData, size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, target);
 			free(textureData);
 #else
-			result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
+			result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_NO_FLAGS, &ktxTexture);
 #endif
 			assert(result == KTX_SUCCESS);
-			ktx_size_t ktxSize = ktxTexture_GetImageSize(ktxTexture, 0);
-			ktx_uint8_t* ktxImage = ktxTexture_GetData(ktxTexture);
 			dim = ktxTexture->baseWidth;
-			heightdata = new uint16_t[dim * dim];
-			memcpy(heightdata, ktxImage, ktxSize);
+			ktx_uint8_t* ktxImage = ktxTexture_GetData(ktxTexture);
+			if (ktxImage) {
+				heightdata = new uint16_t[dim * dim];
+				memcpy(heightdata, ktxImage, ktxTexture_GetImageSize(ktxTexture, 0));
+			} else {
+				// Level 0 comes first, so the file's image data is read straight into the height data, smaller levels are ignored
+				ktx_size_t ktxSize = ktxTexture_GetSize(ktxTexture);
+				heightdata = new uint16_t[(ktxSize + sizeof(uint16_t) - 1) / sizeof(uint16_t)];
+				result = ktxTexture_LoadImageData(ktxTexture, reinterpret_cast<ktx_uint8_t*>(heightdata), ktxSize);
+				assert(result == KTX_SUCCESS);
+			}
 			this->scale = dim / patchsize;
 			ktxTexture_Destroy(ktxTexture);
 
@@ -118,26 +160,7 @@ namespace vks
 				}
 			}
 
-			for (uint32_t y = 0; y < patchsize; y++)
-			{
-				for (uint32_t x = 0; x < patchsize; x++)
-				{
-					float dx = getHeight(x < patchsize - 1 ? x + 1 : x, y) - getHeight(x > 0 ? x - 1 : x, y);
-					if (x == 0 || x == patchsize - 1)
-						dx *= 2.0f;
-
-					float dy = getHeight(x, y < patchsize - 1 ? y + 1 : y) - getHeight(x, y > 0 ? y - 1 : y);
-					if (y == 0 || y == patchsize - 1)
-						dy *= 2.0f;
-
-					glm::vec3 A = glm::vec3(1.0f, 0.0f, dx);
-					glm::vec3 B = glm::vec3(0.0f, 1.0f, dy);
-
-					glm::vec3 normal = (glm::normalize(glm::cross(A, B)) + 1.0f) * 0.5f;
-
-					vertices[x + y * patchsize].normal = glm::vec3(normal.x, normal.z, normal.y);
-				}
-			}
+			generateNormals(vertices, patchsize);
 
 			// Generate indices
 
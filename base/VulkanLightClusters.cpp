@@ -0,0 +1,351 @@
+/*
+* Vulkan clustered light culling
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanLightClusters.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace vks
+{
+	namespace
+	{
+		struct ClusterBounds {
+			glm::vec3 min;
+			glm::vec3 max;
+		};
+
+		// Point on the view ray through the given pixel at the given linear depth
+		glm::vec3 viewRayPoint(const LightClusters::Params& params, const glm::vec2& pixel, float depth)
+		{
+			const glm::vec2 ndc = pixel / glm::vec2(params.screen.x, params.screen.y) * 2.0f - 1.0f;
+			glm::vec4 p = params.inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+			p /= p.w;
+			return glm::vec3(p) * (depth / -p.z);
+		}
+
+		// View space bounding box of a cluster, same computation as in lightcluster.comp
+		ClusterBounds clusterBounds(const LightClusters::Params& params, uint32_t x, uint32_t y, uint32_t z)
+		{
+			const float tileSize = params.screen.z;
+			const glm::vec2 tileMin = glm::vec2(x, y) * tileSize;
+			const glm::vec2 tileMax = glm::min(glm::vec2(x + 1, y + 1) * tileSize, glm::vec2(params.screen.x, params.screen.y));
+			const float zNear = params.depth.x;
+			const float zRatio = params.depth.y / params.depth.x;
+			const float sliceNear = zNear * std::pow(zRatio, static_cast<float>(z) / static_cast<float>(params.gridSize.z));
+			const float sliceFar = zNear * std::pow(zRatio, static_cast<float>(z + 1) / static_cast<float>(params.gridSize.z));
+			const glm::vec2 corners[4] = { tileMin, glm::vec2(tileMax.x, tileMin.y), glm::vec2(tileMin.x, tileMax.y), tileMax };
+			ClusterBounds bounds{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+			for (const glm::vec2& corner : corners) {
+				for (float depth : { sliceNear, sliceFar }) {
+					const glm::vec3 p = viewRayPoint(params, corner, depth);
+					bounds.min = glm::min(bounds.min, p);
+					bounds.max = glm::max(bounds.max, p);
+				}
+			}
+			return bounds;
+		}
+
+		bool sphereIntersectsBounds(const glm::vec3& center, float radius, const ClusterBounds& bounds)
+		{
+			const glm::vec3 d = center - glm::clamp(center, bounds.min, bounds.max);
+			return glm::dot(d, d) <= radius * radius;
+		}
+	}
+
+	LightClusters::~LightClusters()
+	{
+		destroy();
+	}
+
+	void LightClusters::prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, uint32_t maxLights, uint32_t width, uint32_t height)
+	{
+		assert(maxLights > 0);
+		assert(clusterShader.module != VK_NULL_HANDLE);
+		this->device = device;
+		this->queue = queue;
+		this->maxLights = maxLights;
+
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &paramsBuffer, sizeof(Params)));
+		VK_CHECK_RESULT(paramsBuffer.map());
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &lightBuffer, maxLights * sizeof(Light)));
+		VK_CHECK_RESULT(lightBuffer.map());
+		memset(lightBuffer.mapped, 0, maxLights * sizeof(Light));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &counterBuffer, sizeof(uint32_t)));
+
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Binding 0: Cluster mapping
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1: Lights
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2: Cluster grid (offset and count)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Binding 3: Light index lists
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// Binding 4: Global index list allocation counter
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayout));
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCI.stage = clusterShader;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &pipeline));
+
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+
+		resize(width, height);
+	}
+
+	void LightClusters::createClusterBuffers()
+	{
+		const VkDeviceSize clusterCount = getClusterCount();
+		// Every cluster may use its full capacity, so the global list can't overflow no matter how the lights are distributed
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &gridBuffer, clusterCount * sizeof(glm::uvec2)));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, clusterCount * maxLightsPerCluster * sizeof(uint32_t)));
+
+		// Shading may sample the grid before the first dispatch (e.g. with an empty light list), so start with empty clusters
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdFillBuffer(commandBuffer, gridBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		device->flushCommandBuffer(commandBuffer, queue);
+	}
+
+	void LightClusters::destroyClusterBuffers()
+	{
+		gridBuffer.destroy();
+		indexBuffer.destroy();
+	}
+
+	void LightClusters::updateDescriptorSet()
+	{
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &paramsBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &lightBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &gridBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &indexBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &counterBuffer.descriptor),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void LightClusters::resize(uint32_t width, uint32_t height)
+	{
+		params.gridSize.x = (width + tileSize - 1) / tileSize;
+		params.gridSize.y = (height + tileSize - 1) / tileSize;
+		params.gridSize.z = depthSlices;
+		params.screen = glm::vec4(static_cast<float>(width), static_cast<float>(height), static_cast<float>(tileSize), 0.0f);
+		destroyClusterBuffers();
+		createClusterBuffers();
+		updateDescriptorSet();
+		memcpy(paramsBuffer.mapped, &params, sizeof(Params));
+	}
+
+	void LightClusters::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		destroyClusterBuffers();
+		paramsBuffer.destroy();
+		lightBuffer.destroy();
+		counterBuffer.destroy();
+		vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+		pipeline = VK_NULL_HANDLE;
+		pipelineLayout = VK_NULL_HANDLE;
+		descriptorSetLayout = VK_NULL_HANDLE;
+		descriptorPool = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	LightClusters::Light* LightClusters::getLights()
+	{
+		return static_cast<Light*>(lightBuffer.mapped);
+	}
+
+	void LightClusters::setLightCount(uint32_t count)
+	{
+		params.gridSize.w = std::min(count, maxLights);
+	}
+
+	uint32_t LightClusters::getLightCount() const
+	{
+		return params.gridSize.w;
+	}
+
+	uint32_t LightClusters::getMaxLights() const
+	{
+		return maxLights;
+	}
+
+	void LightClusters::updateView(const glm::mat4& projection, const glm::mat4& view, float zNear, float zFar)
+	{
+		params.view = view;
+		params.inverseProjection = glm::inverse(projection);
+		// slice = floor(log(z) * scale - bias) distributes the slices exponentially, so clusters keep a similar aspect ratio at all distances
+		const float logRatio = std::log(zFar / zNear);
+		params.depth = glm::vec4(zNear, zFar, static_cast<float>(depthSlices) / logRatio, static_cast<float>(depthSlices) * std::log(zNear) / logRatio);
+		memcpy(paramsBuffer.mapped, &params, sizeof(Params));
+	}
+
+	void LightClusters::bin(VkCommandBuffer commandBuffer)
+	{
+		// Lists of the last frame may still be read by shading, the counter may still be in use by the last dispatch
+		VkBufferMemoryBarrier bufferBarriers[3];
+		bufferBarriers[0] = vks::initializers::bufferMemoryBarrier();
+		bufferBarriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		bufferBarriers[0].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarriers[0].buffer = gridBuffer.buffer;
+		bufferBarriers[0].size = VK_WHOLE_SIZE;
+		bufferBarriers[1] = bufferBarriers[0];
+		bufferBarriers[1].buffer = indexBuffer.buffer;
+		bufferBarriers[2] = bufferBarriers[0];
+		bufferBarriers[2].srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarriers[2].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarriers[2].buffer = counterBuffer.buffer;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 3, bufferBarriers, 0, nullptr);
+
+		vkCmdFillBuffer(commandBuffer, counterBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		bufferBarriers[2].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarriers[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarriers[2], 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdDispatch(commandBuffer, params.gridSize.x, params.gridSize.y, params.gridSize.z);
+
+		bufferBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		bufferBarriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 2, bufferBarriers, 0, nullptr);
+	}
+
+	VkDescriptorBufferInfo* LightClusters::getParamsDescriptor()
+	{
+		return &paramsBuffer.descriptor;
+	}
+
+	VkDescriptorBufferInfo* LightClusters::getLightsDescriptor()
+	{
+		return &lightBuffer.descriptor;
+	}
+
+	VkDescriptorBufferInfo* LightClusters::getGridDescriptor()
+	{
+		return &gridBuffer.descriptor;
+	}
+
+	VkDescriptorBufferInfo* LightClusters::getIndicesDescriptor()
+	{
+		return &indexBuffer.descriptor;
+	}
+
+	uint32_t LightClusters::getClusterCount() const
+	{
+		return params.gridSize.x * params.gridSize.y * params.gridSize.z;
+	}
+
+	glm::uvec3 LightClusters::getGridSize() const
+	{
+		return glm::uvec3(params.gridSize);
+	}
+
+	LightClusters::ClusterLists LightClusters::binReference(const Params& params, const Light* lights, float radiusScale)
+	{
+		ClusterLists clusterLists;
+		clusterLists.lights.resize(params.gridSize.x * params.gridSize.y * params.gridSize.z);
+		std::vector<glm::vec4> viewLights(params.gridSize.w);
+		for (uint32_t i = 0; i < params.gridSize.w; i++) {
+			viewLights[i] = glm::vec4(glm::vec3(params.view * glm::vec4(glm::vec3(lights[i].position), 1.0f)), lights[i].position.w * radiusScale);
+		}
+		uint32_t clusterIndex = 0;
+		for (uint32_t z = 0; z < params.gridSize.z; z++) {
+			for (uint32_t y = 0; y < params.gridSize.y; y++) {
+				for (uint32_t x = 0; x < params.gridSize.x; x++) {
+					const ClusterBounds bounds = clusterBounds(params, x, y, z);
+					for (uint32_t i = 0; i < params.gridSize.w; i++) {
+						if (sphereIntersectsBounds(glm::vec3(viewLights[i]), viewLights[i].w, bounds)) {
+							clusterLists.lights[clusterIndex].push_back(i);
+						}
+					}
+					clusterIndex++;
+				}
+			}
+		}
+		return clusterLists;
+	}
+
+	void LightClusters::readBuffer(const vks::Buffer& buffer, void* data, VkDeviceSize size)
+	{
+		vks::Buffer staging;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, size));
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion{ 0, 0, size };
+		vkCmdCopyBuffer(commandBuffer, buffer.buffer, staging.buffer, 1, &copyRegion);
+		device->flushCommandBuffer(commandBuffer, queue);
+		VK_CHECK_RESULT(staging.map());
+		memcpy(data, staging.mapped, size);
+		staging.destroy();
+	}
+
+	uint32_t LightClusters::validate()
+	{
+		vkDeviceWaitIdle(device->logicalDevice);
+
+		// Rebin with the current state, the lights and view may have changed since the last frame's dispatch
+		memcpy(paramsBuffer.mapped, &params, sizeof(Params));
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		bin(commandBuffer);
+		device->flushCommandBuffer(commandBuffer, queue);
+
+		const uint32_t clusterCount = getClusterCount();
+		std::vector<glm::uvec2> grid(clusterCount);
+		std::vector<uint32_t> indices(clusterCount * maxLightsPerCluster);
+		readBuffer(gridBuffer, grid.data(), grid.size() * sizeof(glm::uvec2));
+		readBuffer(indexBuffer, indices.data(), indices.size() * sizeof(uint32_t));
+
+		// The GPU has to find every light that clearly touches a cluster and may only add lights that touch it within tolerance
+		const Light* lights = static_cast<const Light*>(lightBuffer.mapped);
+		const ClusterLists required = binReference(params, lights, 0.999f);
+		const ClusterLists allowed = binReference(params, lights, 1.001f);
+		uint32_t mismatches = 0;
+		for (uint32_t i = 0; i < clusterCount; i++) {
+			const uint32_t offset = grid[i].x;
+			const uint32_t count = grid[i].y;
+			if (count > maxLightsPerCluster || offset + count > indices.size()) {
+				mismatches++;
+				continue;
+			}
+			std::vector<uint32_t> gpuLights(indices.begin() + offset, indices.begin() + offset + count);
+			std::sort(gpuLights.begin(), gpuLights.end());
+			const bool duplicates = std::adjacent_find(gpuLights.begin(), gpuLights.end()) != gpuLights.end();
+			const bool superset = std::includes(allowed.lights[i].begin(), allowed.lights[i].end(), gpuLights.begin(), gpuLights.end());
+			// Full clusters drop lights in arbitrary order
+			const bool truncated = count == maxLightsPerCluster;
+			const bool complete = truncated || std::includes(gpuLights.begin(), gpuLights.end(), required.lights[i].begin(), required.lights[i].end());
+			if (duplicates || !superset || !complete) {
+				mismatches++;
+			}
+		}
+		return mismatches;
+	}
+}
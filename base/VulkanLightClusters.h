@@ -0,0 +1,154 @@
+/*
+* Vulkan clustered light culling
+*
+* Bins point lights into screen space tiles times depth slices with a compute shader
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/**
+	* @brief Clustered light culling on the GPU
+	*
+	* The view frustum is split into tileSize x tileSize pixel tiles and depthSlices exponentially distributed depth slices.
+	* Every frame a compute dispatch (one work group per cluster) tests all lights against the cluster's view space bounding box
+	* and writes a compact list of light indices per cluster. Shading (deferred or forward) then only loops over the lights of
+	* the fragment's cluster:
+	*   grid[cluster] = (offset, count) into the light index list
+	*   lightIndices[offset + i] = index into the light buffer
+	* Lookup in shaders needs to match the cluster mapping of lightcluster.comp, all required parameters are in the params uniform block.
+	*
+	* binReference() implements the same binning on the CPU, validate() compares the GPU lists of the last frame against it.
+	*/
+	class LightClusters
+	{
+	public:
+		/** @brief Cluster size in screen space (pixels) */
+		static const uint32_t tileSize = 64;
+		/** @brief Number of depth slices between the near and far plane */
+		static const uint32_t depthSlices = 24;
+		/** @brief Lights beyond this count are dropped from a cluster */
+		static const uint32_t maxLightsPerCluster = 128;
+
+		/** @brief Point light, layout matches the shaders' storage buffer */
+		struct Light {
+			/** @brief World space position (xyz) and radius of influence (w) */
+			glm::vec4 position;
+			glm::vec4 color;
+		};
+
+		/** @brief Cluster mapping parameters, layout matches the shaders' uniform block */
+		struct Params {
+			glm::mat4 view;
+			glm::mat4 inverseProjection;
+			/** @brief Tiles in x and y, depth slices, light count */
+			glm::uvec4 gridSize;
+			/** @brief Width, height and tile size in pixels */
+			glm::vec4 screen;
+			/** @brief zNear, zFar, slice scale and slice bias */
+			glm::vec4 depth;
+		};
+
+		/** @brief Light index lists of all clusters (in grid order) */
+		struct ClusterLists {
+			std::vector<std::vector<uint32_t>> lights;
+		};
+
+		/** @brief Compute shader stage for the binning, needs to be set before calling prepare */
+		VkPipelineShaderStageCreateInfo clusterShader{};
+
+	private:
+		vks::VulkanDevice* device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t maxLights = 0;
+		Params params{};
+
+		vks::Buffer paramsBuffer;
+		vks::Buffer lightBuffer;
+		vks::Buffer gridBuffer;
+		vks::Buffer indexBuffer;
+		vks::Buffer counterBuffer;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		void createClusterBuffers();
+		void destroyClusterBuffers();
+		void updateDescriptorSet();
+		void readBuffer(const vks::Buffer& buffer, void* data, VkDeviceSize size);
+	public:
+		~LightClusters();
+
+		/**
+		* Create all buffers and the compute pipeline
+		*
+		* @param device Device to create the resources on
+		* @param queue Queue used for the validation readback
+		* @param pipelineCache Pipeline cache for the compute pipeline
+		* @param maxLights Capacity of the light buffer
+		* @param width Width of the render target in pixels
+		* @param height Height of the render target in pixels
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, uint32_t maxLights, uint32_t width, uint32_t height);
+		void destroy();
+		/**
+		* Recreates the cluster grid for a new render target size
+		* @note Recreates the grid buffers, so descriptors of consumers need to be updated afterwards
+		*/
+		void resize(uint32_t width, uint32_t height);
+		/** @brief Persistently mapped light buffer with space for maxLights lights */
+		Light* getLights();
+		void setLightCount(uint32_t count);
+		uint32_t getLightCount() const;
+		uint32_t getMaxLights() const;
+		/** @brief Updates the matrices and depth range the clusters are built for, call once per frame */
+		void updateView(const glm::mat4& projection, const glm::mat4& view, float zNear, float zFar);
+		/** @brief Records the binning dispatch, must be recorded outside of a render pass and before any shader reads the lists */
+		void bin(VkCommandBuffer commandBuffer);
+
+		/** @brief Cluster mapping uniform block */
+		VkDescriptorBufferInfo* getParamsDescriptor();
+		/** @brief Light storage buffer */
+		VkDescriptorBufferInfo* getLightsDescriptor();
+		/** @brief Per-cluster offset and count into the light index list */
+		VkDescriptorBufferInfo* getGridDescriptor();
+		/** @brief Compact light index lists of all clusters */
+		VkDescriptorBufferInfo* getIndicesDescriptor();
+		uint32_t getClusterCount() const;
+		glm::uvec3 getGridSize() const;
+
+		/**
+		* Bins the lights on the CPU using the same cluster bounds and intersection test as the compute shader
+		*
+		* @param params Cluster mapping
+		* @param lights Lights to bin, only the first params.gridSize.w lights are used
+		* @param radiusScale Scale applied to the light radii, used to build a conservative superset for validation
+		* @return Light indices per cluster in ascending order (not limited to maxLightsPerCluster)
+		*/
+		static ClusterLists binReference(const Params& params, const Light* lights, float radiusScale = 1.0f);
+		/**
+		* Reads back the cluster lists of the last completed dispatch and compares them against the CPU reference
+		* Lights that only touch a cluster within floating point tolerance may or may not be present
+		* @note Waits for the device to become idle
+		* @return Number of clusters with a mismatching light list
+		*/
+		uint32_t validate();
+	};
+}
@@ -0,0 +1,130 @@
+/*
+* Material permutations
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanMaterialPermutations.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "VulkanInitializers.hpp"
+
+namespace vks
+{
+	namespace
+	{
+		void addSpecializationConstant(PipelineManager::ShaderStage& stage, uint32_t constantID, const void* data, size_t size)
+		{
+			const uint32_t offset = static_cast<uint32_t>(stage.specializationData.size());
+			stage.specializationData.resize(offset + size);
+			memcpy(stage.specializationData.data() + offset, data, size);
+			stage.specializationMapEntries.push_back(vks::initializers::specializationMapEntry(constantID, offset, size));
+		}
+	}
+
+	void MaterialPermutations::prepare(PipelineManager* pipelineManager, const PipelineManager::GraphicsPipelineDesc& desc)
+	{
+		this->pipelineManager = pipelineManager;
+		this->desc = desc;
+		featureConstants.clear();
+		alphaCutoffConstant = false;
+		relevantFeatures = AlphaBlend | DoubleSided;
+		pipelines.clear();
+	}
+
+	void MaterialPermutations::addFeatureConstant(uint32_t feature, VkShaderStageFlagBits stage, uint32_t constantID)
+	{
+		assert(stage == VK_SHADER_STAGE_VERTEX_BIT || stage == VK_SHADER_STAGE_FRAGMENT_BIT);
+		// Pipelines requested before would have been keyed without this feature
+		assert(pipelines.empty());
+		featureConstants.push_back({ feature, stage, constantID });
+		relevantFeatures |= feature;
+	}
+
+	void MaterialPermutations::setAlphaCutoffConstant(uint32_t constantID)
+	{
+		assert(pipelines.empty());
+		alphaCutoffConstant = true;
+		alphaCutoffConstantID = constantID;
+	}
+
+	MaterialPermutations::Permutation MaterialPermutations::normalize(const Permutation& permutation) const
+	{
+		Permutation normalized{};
+		normalized.features = permutation.features & relevantFeatures;
+		// The cutoff only distinguishes permutations if the shader actually does alpha masking with it
+		normalized.alphaCutoff = (alphaCutoffConstant && (normalized.features & AlphaMask)) ? permutation.alphaCutoff : 0.0f;
+		return normalized;
+	}
+
+	uint64_t MaterialPermutations::getKey(const Permutation& permutation)
+	{
+		uint32_t alphaCutoff;
+		memcpy(&alphaCutoff, &permutation.alphaCutoff, sizeof(float));
+		return (static_cast<uint64_t>(alphaCutoff) << 32) | permutation.features;
+	}
+
+	PipelineManager::GraphicsPipelineDesc MaterialPermutations::getPipelineDesc(const Permutation& permutation) const
+	{
+		PipelineManager::GraphicsPipelineDesc permutationDesc = desc;
+		for (const FeatureConstant& featureConstant : featureConstants) {
+			const VkBool32 enabled = (permutation.features & featureConstant.feature) ? VK_TRUE : VK_FALSE;
+			PipelineManager::ShaderStage& stage = (featureConstant.stage == VK_SHADER_STAGE_VERTEX_BIT) ? permutationDesc.vertexShader : permutationDesc.fragmentShader;
+			addSpecializationConstant(stage, featureConstant.constantID, &enabled, sizeof(VkBool32));
+		}
+		if (alphaCutoffConstant) {
+			addSpecializationConstant(permutationDesc.fragmentShader, alphaCutoffConstantID, &permutation.alphaCutoff, sizeof(float));
+		}
+		if (permutation.features & DoubleSided) {
+			permutationDesc.cullMode = VK_CULL_MODE_NONE;
+		}
+		if (permutation.features & AlphaBlend) {
+			for (VkPipelineColorBlendAttachmentState& blendAttachment : permutationDesc.blendAttachments) {
+				blendAttachment.blendEnable = VK_TRUE;
+				blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+				blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+				blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+				blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+				blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+				blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+			}
+			permutationDesc.depthWrite = VK_FALSE;
+		}
+		return permutationDesc;
+	}
+
+	PipelineManager::Pipeline MaterialPermutations::request(const Permutation& permutation)
+	{
+		assert(pipelineManager);
+		const Permutation normalized = normalize(permutation);
+		const uint64_t key = getKey(normalized);
+		auto it = pipelines.find(key);
+		if (it != pipelines.end()) {
+			return it->second;
+		}
+		const PipelineManager::Pipeline pipeline = pipelineManager->request(getPipelineDesc(normalized));
+		pipelines[key] = pipeline;
+		return pipeline;
+	}
+
+	void MaterialPermutations::precompile(const std::vector<Permutation>& permutations)
+	{
+		for (const Permutation& permutation : permutations) {
+			request(permutation);
+		}
+	}
+
+	VkPipeline MaterialPermutations::get(const Permutation& permutation)
+	{
+		return pipelineManager->get(request(permutation));
+	}
+
+	uint32_t MaterialPermutations::getPipelineCount() const
+	{
+		return static_cast<uint32_t>(pipelines.size());
+	}
+}
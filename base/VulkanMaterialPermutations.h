@@ -0,0 +1,92 @@
+/*
+* Material permutations
+*
+* Turns material feature bits into specialization constants and pipeline state, so each material gets a pipeline specialized
+* for the features it actually uses instead of branching in an uber shader. Permutations are deduplicated, so materials with
+* the same relevant features share a pipeline
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanPipelineManager.h"
+
+namespace vks
+{
+	/**
+	* @brief Creates and caches the pipeline permutations of a material shader
+	*
+	* Features that are neither mapped to a specialization constant nor change pipeline state (AlphaBlend, DoubleSided) are ignored,
+	* so they don't create redundant pipelines. Pipelines are compiled by a vks::PipelineManager, either lazily when a permutation
+	* is first used or upfront with precompile (e.g. with the permutations of all materials of a glTF file).
+	*/
+	class MaterialPermutations
+	{
+	public:
+		enum FeatureFlags {
+			AlphaMask = 0x00000001,
+			// Enables alpha blending and disables depth writes
+			AlphaBlend = 0x00000002,
+			// Disables back face culling
+			DoubleSided = 0x00000004,
+			NormalMap = 0x00000008,
+			VertexColor = 0x00000010,
+			Skinning = 0x00000020,
+			EmissiveMap = 0x00000040,
+			OcclusionMap = 0x00000080
+		};
+
+		struct Permutation {
+			uint32_t features = 0;
+			/** @brief Only used for AlphaMask permutations */
+			float alphaCutoff = 0.5f;
+		};
+
+		/**
+		* @param pipelineManager Manager that compiles the pipelines, has to stay valid as long as the permutations are used
+		* @param desc State and shaders shared by all permutations, specialization constants of the shaders are kept
+		*/
+		void prepare(PipelineManager* pipelineManager, const PipelineManager::GraphicsPipelineDesc& desc);
+		/** @brief Maps a feature to a VkBool32 specialization constant of the vertex or fragment shader */
+		void addFeatureConstant(uint32_t feature, VkShaderStageFlagBits stage, uint32_t constantID);
+		/** @brief Passes the alpha cutoff of AlphaMask permutations as a float specialization constant of the fragment shader */
+		void setAlphaCutoffConstant(uint32_t constantID);
+
+		/** @brief Requests the pipeline of a permutation, compilation starts in the background if it hasn't been requested before */
+		PipelineManager::Pipeline request(const Permutation& permutation);
+		/** @brief Requests the pipelines of all given permutations, wait on the pipeline manager to have them available for the first frame */
+		void precompile(const std::vector<Permutation>& permutations);
+		/** @return Pipeline for the permutation, VK_NULL_HANDLE while it's being compiled (requested lazily if necessary) */
+		VkPipeline get(const Permutation& permutation);
+		/** @brief Number of distinct pipelines requested so far */
+		uint32_t getPipelineCount() const;
+
+	private:
+		struct FeatureConstant {
+			uint32_t feature;
+			VkShaderStageFlagBits stage;
+			uint32_t constantID;
+		};
+
+		PipelineManager* pipelineManager = nullptr;
+		PipelineManager::GraphicsPipelineDesc desc;
+		std::vector<FeatureConstant> featureConstants;
+		bool alphaCutoffConstant = false;
+		uint32_t alphaCutoffConstantID = 0;
+		// Features that change the pipeline
+		uint32_t relevantFeatures = AlphaBlend | DoubleSided;
+		std::unordered_map<uint64_t, PipelineManager::Pipeline> pipelines;
+
+		Permutation normalize(const Permutation& permutation) const;
+		static uint64_t getKey(const Permutation& permutation);
+		PipelineManager::GraphicsPipelineDesc getPipelineDesc(const Permutation& permutation) const;
+	};
+}
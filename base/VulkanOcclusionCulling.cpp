@@ -0,0 +1,426 @@
+/*
+* Vulkan GPU occlusion culling
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanOcclusionCulling.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "frustum.hpp"
+
+namespace vks
+{
+	namespace
+	{
+		// Each pyramid work group reduces a 64x64 texel tile of level 0 down to a single texel in level 6
+		const uint32_t pyramidTileSize = 64;
+		const uint32_t pyramidTileLevels = 7;
+		const uint32_t cullWorkGroupSize = 64;
+	}
+
+	OcclusionCuller::~OcclusionCuller()
+	{
+		destroy();
+	}
+
+	bool OcclusionCuller::isPrepared() const
+	{
+		return device != nullptr;
+	}
+
+	uint32_t OcclusionCuller::getObjectCount() const
+	{
+		return objectCount;
+	}
+
+	uint32_t OcclusionCuller::getPyramidLevelCount() const
+	{
+		return pyramid.levelCount;
+	}
+
+	void OcclusionCuller::prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, const std::vector<Object>& objects, VkImage depthImage, VkFormat depthFormat, uint32_t width, uint32_t height)
+	{
+		assert(!objects.empty());
+		assert(pyramidShader.module != VK_NULL_HANDLE && cullShader.module != VK_NULL_HANDLE);
+		this->device = device;
+		this->queue = queue;
+		objectCount = static_cast<uint32_t>(objects.size());
+
+		// Pyramid texels are always fetched explicitly, so a nearest sampler is sufficient
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_NEAREST;
+		samplerCI.minFilter = VK_FILTER_NEAREST;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.maxLod = static_cast<float>(maxPyramidLevels);
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+
+		createBuffers(objects);
+		createDescriptorSetLayouts();
+		createPipelines(pipelineCache);
+
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxPyramidLevels),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.pyramid, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSets.pyramid));
+		allocInfo.pSetLayouts = &descriptorSetLayouts.cull;
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSets.cull));
+
+		setDepthSource(depthImage, depthFormat, width, height);
+	}
+
+	void OcclusionCuller::createBuffers(const std::vector<Object>& objects)
+	{
+		const VkDeviceSize objectsSize = objects.size() * sizeof(Object);
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &objectBuffer, objectsSize, (void*)objects.data()));
+		VK_CHECK_RESULT(objectBuffer.map());
+
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &visibilityBuffer, objectCount * sizeof(uint32_t)));
+		// Early and late draw commands are stored back to back
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &drawCommandBuffer, 2 * objectCount * sizeof(VkDrawIndexedIndirectCommand)));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &statisticsBuffer, sizeof(Statistics)));
+		VK_CHECK_RESULT(statisticsBuffer.map());
+		memset(statisticsBuffer.mapped, 0, sizeof(Statistics));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffer, sizeof(UniformData)));
+		VK_CHECK_RESULT(uniformBuffer.map());
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &counterBuffer, sizeof(uint32_t)));
+
+		// Nothing has been visible before the first frame, so the first late phase draws everything inside the frustum
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdFillBuffer(commandBuffer, visibilityBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		vkCmdFillBuffer(commandBuffer, counterBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		device->flushCommandBuffer(commandBuffer, queue);
+	}
+
+	void OcclusionCuller::createDescriptorSetLayouts()
+	{
+		// Pyramid build
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Binding 0: Depth attachment
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1: One storage image per pyramid level
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1, maxPyramidLevels),
+			// Binding 2: Work group counter used to find the last work group
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.pyramid));
+
+		// Culling
+		setLayoutBindings = {
+			// Binding 0: Matrices and frustum
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1: Objects
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2: Visibility of the last frame
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Binding 3: Indirect draw commands
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// Binding 4: Depth pyramid
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			// Binding 5: Statistics
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+		};
+		descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.cull));
+	}
+
+	void OcclusionCuller::createPipelines(VkPipelineCache pipelineCache)
+	{
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PyramidPushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.pyramid, 1);
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayouts.pyramid));
+
+		// Phase and occlusion toggle
+		pushConstantRange.size = 2 * sizeof(uint32_t);
+		pipelineLayoutCI.pSetLayouts = &descriptorSetLayouts.cull;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayouts.cull));
+
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayouts.pyramid, 0);
+		computePipelineCI.stage = pyramidShader;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &pipelines.pyramid));
+		computePipelineCI.layout = pipelineLayouts.cull;
+		computePipelineCI.stage = cullShader;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &pipelines.cull));
+	}
+
+	void OcclusionCuller::createDepthPyramid()
+	{
+		// Level 0 is half the size of the depth attachment, odd sizes are rounded up so every level fully covers the one below
+		pyramid.width = std::max(1u, (depthWidth + 1) / 2);
+		pyramid.height = std::max(1u, (depthHeight + 1) / 2);
+		pyramid.levelCount = 1;
+		for (uint32_t size = std::max(pyramid.width, pyramid.height); size > 1; size = (size + 1) / 2) {
+			pyramid.levelCount++;
+		}
+		// Levels above the tile can only be built by the last work group if they fit into a single tile, larger objects are then never culled
+		const uint32_t tileLevelSize = (std::max(pyramid.width, pyramid.height) + pyramidTileSize - 1) / pyramidTileSize;
+		if (tileLevelSize > pyramidTileSize) {
+			pyramid.levelCount = std::min(pyramid.levelCount, pyramidTileLevels);
+		}
+		pyramid.levelCount = std::min(pyramid.levelCount, maxPyramidLevels);
+
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = VK_FORMAT_R32_SFLOAT;
+		imageCI.extent = { pyramid.width, pyramid.height, 1 };
+		imageCI.mipLevels = pyramid.levelCount;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &pyramid.image));
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, pyramid.image, &memReqs);
+		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+		memAllocInfo.allocationSize = memReqs.size;
+		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &pyramid.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, pyramid.image, pyramid.memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = VK_FORMAT_R32_SFLOAT;
+		viewCI.image = pyramid.image;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levelCount, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &pyramid.view));
+		pyramid.levelViews.resize(pyramid.levelCount);
+		for (uint32_t i = 0; i < pyramid.levelCount; i++) {
+			viewCI.subresourceRange.baseMipLevel = i;
+			viewCI.subresourceRange.levelCount = 1;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &pyramid.levelViews[i]));
+		}
+
+		// Separate view of the depth aspect for sampling
+		viewCI.image = depthImage;
+		viewCI.format = depthFormat;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &depthView));
+
+		// The pyramid stays in the general layout as it's written as a storage image and read through a sampler every frame
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(commandBuffer, pyramid.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levelCount, 0, 1 });
+		device->flushCommandBuffer(commandBuffer, queue);
+	}
+
+	void OcclusionCuller::destroyDepthPyramid()
+	{
+		for (VkImageView view : pyramid.levelViews) {
+			vkDestroyImageView(device->logicalDevice, view, nullptr);
+		}
+		pyramid.levelViews.clear();
+		if (pyramid.view) {
+			vkDestroyImageView(device->logicalDevice, pyramid.view, nullptr);
+			pyramid.view = VK_NULL_HANDLE;
+		}
+		if (pyramid.image) {
+			vkDestroyImage(device->logicalDevice, pyramid.image, nullptr);
+			pyramid.image = VK_NULL_HANDLE;
+		}
+		if (pyramid.memory) {
+			vkFreeMemory(device->logicalDevice, pyramid.memory, nullptr);
+			pyramid.memory = VK_NULL_HANDLE;
+		}
+		if (depthView) {
+			vkDestroyImageView(device->logicalDevice, depthView, nullptr);
+			depthView = VK_NULL_HANDLE;
+		}
+	}
+
+	void OcclusionCuller::updateDescriptorSets()
+	{
+		VkDescriptorImageInfo depthDescriptor = vks::initializers::descriptorImageInfo(sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+		VkDescriptorImageInfo pyramidDescriptor = vks::initializers::descriptorImageInfo(sampler, pyramid.view, VK_IMAGE_LAYOUT_GENERAL);
+		// All array elements need a valid descriptor, unused ones point to the last level and are never written
+		std::vector<VkDescriptorImageInfo> levelDescriptors(maxPyramidLevels);
+		for (uint32_t i = 0; i < maxPyramidLevels; i++) {
+			levelDescriptors[i] = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, pyramid.levelViews[std::min(i, pyramid.levelCount - 1)], VK_IMAGE_LAYOUT_GENERAL);
+		}
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.pyramid, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &depthDescriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.pyramid, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, levelDescriptors.data(), maxPyramidLevels),
+			vks::initializers::writeDescriptorSet(descriptorSets.pyramid, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &counterBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.cull, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.cull, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &objectBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.cull, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &visibilityBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.cull, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &drawCommandBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.cull, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &pyramidDescriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.cull, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &statisticsBuffer.descriptor),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void OcclusionCuller::setDepthSource(VkImage depthImage, VkFormat depthFormat, uint32_t width, uint32_t height)
+	{
+		destroyDepthPyramid();
+		this->depthImage = depthImage;
+		this->depthFormat = depthFormat;
+		depthWidth = width;
+		depthHeight = height;
+		depthAspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (vks::tools::formatHasStencil(depthFormat)) {
+			depthAspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+		createDepthPyramid();
+		updateDescriptorSets();
+	}
+
+	void OcclusionCuller::updateView(const glm::mat4& projection, const glm::mat4& view, float zNear)
+	{
+		vks::Frustum frustum;
+		frustum.update(projection * view);
+		uniformData.projection = projection;
+		uniformData.view = view;
+		for (uint32_t i = 0; i < 6; i++) {
+			uniformData.frustumPlanes[i] = frustum.planes[i];
+		}
+		uniformData.depthSize = glm::vec2(static_cast<float>(depthWidth), static_cast<float>(depthHeight));
+		uniformData.zNear = zNear;
+		uniformData.objectCount = objectCount;
+		uniformData.levelCount = pyramid.levelCount;
+		memcpy(uniformBuffer.mapped, &uniformData, sizeof(UniformData));
+	}
+
+	void OcclusionCuller::updateObject(uint32_t index, const Object& object)
+	{
+		assert(index < objectCount);
+		memcpy(static_cast<Object*>(objectBuffer.mapped) + index, &object, sizeof(Object));
+	}
+
+	void OcclusionCuller::cull(VkCommandBuffer commandBuffer, Phase phase)
+	{
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		if (phase == Phase::Early) {
+			vkCmdFillBuffer(commandBuffer, statisticsBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+			VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.buffer = statisticsBuffer.buffer;
+			barrier.size = VK_WHOLE_SIZE;
+			bufferBarriers.push_back(barrier);
+			srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+		// Draw commands of the last frame may still be read by the indirect draws
+		VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+		barrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.buffer = drawCommandBuffer.buffer;
+		barrier.size = VK_WHOLE_SIZE;
+		bufferBarriers.push_back(barrier);
+		vkCmdPipelineBarrier(commandBuffer, srcStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
+
+		const uint32_t pushConstants[2] = { static_cast<uint32_t>(phase), occlusionCulling ? 1u : 0u };
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.cull);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.cull, 0, 1, &descriptorSets.cull, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayouts.cull, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), pushConstants);
+		vkCmdDispatch(commandBuffer, (objectCount + cullWorkGroupSize - 1) / cullWorkGroupSize, 1, 1);
+
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
+
+	void OcclusionCuller::buildDepthPyramid(VkCommandBuffer commandBuffer)
+	{
+		VkImageMemoryBarrier imageBarriers[2];
+		// Depth attachment written by the early phase
+		imageBarriers[0] = vks::initializers::imageMemoryBarrier();
+		imageBarriers[0].image = depthImage;
+		imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		imageBarriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		imageBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarriers[0].subresourceRange = { depthAspectMask, 0, 1, 0, 1 };
+		// Pyramid may still be read by the culling of the last frame
+		imageBarriers[1] = vks::initializers::imageMemoryBarrier();
+		imageBarriers[1].image = pyramid.image;
+		imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levelCount, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, imageBarriers);
+
+		PyramidPushConstants pushConstants{};
+		pushConstants.depthSize = glm::ivec2(depthWidth, depthHeight);
+		pushConstants.levelCount = pyramid.levelCount;
+		const uint32_t groupCountX = (pyramid.width + pyramidTileSize - 1) / pyramidTileSize;
+		const uint32_t groupCountY = (pyramid.height + pyramidTileSize - 1) / pyramidTileSize;
+		pushConstants.workGroupCount = groupCountX * groupCountY;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.pyramid);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.pyramid, 0, 1, &descriptorSets.pyramid, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayouts.pyramid, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidPushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+		// Hand the depth attachment back to the late phase (depth writes happen in the late fragment tests stage) and make the pyramid visible to the culling
+		imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		imageBarriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		imageBarriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, imageBarriers);
+	}
+
+	void OcclusionCuller::draw(VkCommandBuffer commandBuffer, Phase phase)
+	{
+		const VkDeviceSize offset = static_cast<uint32_t>(phase) * objectCount * sizeof(VkDrawIndexedIndirectCommand);
+		if (device->enabledFeatures.multiDrawIndirect) {
+			vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer.buffer, offset, objectCount, sizeof(VkDrawIndexedIndirectCommand));
+		} else {
+			for (uint32_t i = 0; i < objectCount; i++) {
+				vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer.buffer, offset + i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+			}
+		}
+	}
+
+	OcclusionCuller::Statistics OcclusionCuller::getStatistics() const
+	{
+		Statistics statistics;
+		if (statisticsBuffer.mapped) {
+			memcpy(&statistics, statisticsBuffer.mapped, sizeof(Statistics));
+		}
+		return statistics;
+	}
+
+	void OcclusionCuller::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		destroyDepthPyramid();
+		objectBuffer.destroy();
+		visibilityBuffer.destroy();
+		drawCommandBuffer.destroy();
+		statisticsBuffer.destroy();
+		uniformBuffer.destroy();
+		counterBuffer.destroy();
+		vkDestroySampler(device->logicalDevice, sampler, nullptr);
+		vkDestroyPipeline(device->logicalDevice, pipelines.pyramid, nullptr);
+		vkDestroyPipeline(device->logicalDevice, pipelines.cull, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, pipelineLayouts.pyramid, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, pipelineLayouts.cull, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayouts.pyramid, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayouts.cull, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+		device = nullptr;
+	}
+}
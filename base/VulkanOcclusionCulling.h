@@ -0,0 +1,180 @@
+/*
+* Vulkan GPU occlusion culling
+*
+* Two phase hierarchical depth (Hi-Z) culling that writes indexed indirect draw commands
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/**
+	* @brief Hierarchical depth buffer occlusion culling on the GPU
+	*
+	* Every frame is split into two phases:
+	*   Early: objects that were visible in the previous frame (and are inside the frustum) are drawn
+	*   The depth pyramid is built from the depth buffer written by the early phase in a single compute dispatch
+	*   Late: all objects are tested against the pyramid, those that became visible are drawn and the visibility is stored for the next frame
+	* This never stalls on query results and never shows objects popping in a frame late, as disocclusions are caught by the late phase.
+	*
+	* The depth attachment must have been created with VK_IMAGE_USAGE_SAMPLED_BIT and needs to be stored by the early render pass.
+	* The depth pyramid uses the max reduction (depth cleared to 1.0, less or equal depth test).
+	*/
+	class OcclusionCuller
+	{
+	public:
+		/** @brief Levels of the pyramid that can be built in a single dispatch (depth buffers up to 8192 pixels) */
+		static const uint32_t maxPyramidLevels = 13;
+
+		enum class Phase : uint32_t {
+			Early = 0,
+			Late = 1
+		};
+
+		/** @brief Culling input for a single draw, layout matches the shader's storage buffer */
+		struct Object {
+			/** @brief World space center (xyz) and radius (w) */
+			glm::vec4 boundingSphere;
+			uint32_t indexCount;
+			uint32_t firstIndex;
+			int32_t vertexOffset;
+			uint32_t firstInstance;
+		};
+
+		struct Statistics {
+			uint32_t drawnEarly = 0;
+			uint32_t drawnLate = 0;
+			uint32_t frustumCulled = 0;
+			uint32_t occlusionCulled = 0;
+		};
+
+		/** @brief Shader stages for the pyramid build and the culling compute shaders, need to be set before calling prepare */
+		VkPipelineShaderStageCreateInfo pyramidShader{};
+		VkPipelineShaderStageCreateInfo cullShader{};
+		/** @brief Disables the depth pyramid test (frustum culling only) */
+		bool occlusionCulling = true;
+
+	private:
+		struct UniformData {
+			glm::mat4 projection;
+			glm::mat4 view;
+			glm::vec4 frustumPlanes[6];
+			glm::vec2 depthSize;
+			float zNear;
+			uint32_t objectCount;
+			uint32_t levelCount;
+		} uniformData;
+
+		struct PyramidPushConstants {
+			glm::ivec2 depthSize;
+			uint32_t levelCount;
+			uint32_t workGroupCount;
+		};
+
+		struct DepthPyramid {
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			std::vector<VkImageView> levelViews;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t levelCount = 0;
+		} pyramid;
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t objectCount = 0;
+
+		VkImage depthImage = VK_NULL_HANDLE;
+		VkImageView depthView = VK_NULL_HANDLE;
+		VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+		VkImageAspectFlags depthAspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		uint32_t depthWidth = 0;
+		uint32_t depthHeight = 0;
+
+		vks::Buffer objectBuffer;
+		vks::Buffer visibilityBuffer;
+		vks::Buffer drawCommandBuffer;
+		vks::Buffer statisticsBuffer;
+		vks::Buffer uniformBuffer;
+		vks::Buffer counterBuffer;
+
+		VkSampler sampler = VK_NULL_HANDLE;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		struct {
+			VkDescriptorSetLayout pyramid = VK_NULL_HANDLE;
+			VkDescriptorSetLayout cull = VK_NULL_HANDLE;
+		} descriptorSetLayouts;
+		struct {
+			VkDescriptorSet pyramid = VK_NULL_HANDLE;
+			VkDescriptorSet cull = VK_NULL_HANDLE;
+		} descriptorSets;
+		struct {
+			VkPipelineLayout pyramid = VK_NULL_HANDLE;
+			VkPipelineLayout cull = VK_NULL_HANDLE;
+		} pipelineLayouts;
+		struct {
+			VkPipeline pyramid = VK_NULL_HANDLE;
+			VkPipeline cull = VK_NULL_HANDLE;
+		} pipelines;
+
+		void createBuffers(const std::vector<Object>& objects);
+		void createDescriptorSetLayouts();
+		void createPipelines(VkPipelineCache pipelineCache);
+		void createDepthPyramid();
+		void destroyDepthPyramid();
+		void updateDescriptorSets();
+	public:
+		~OcclusionCuller();
+
+		/**
+		* Create all buffers and pipelines
+		*
+		* @param device Device to create the resources on
+		* @param queue Queue used for the initial buffer and image setup
+		* @param pipelineCache Pipeline cache for the compute pipelines
+		* @param objects Bounding spheres and draw ranges, one indirect draw is written per object
+		* @param depthImage Depth attachment the pyramid is built from
+		* @param depthFormat Format of the depth attachment
+		* @param width Width of the depth attachment
+		* @param height Height of the depth attachment
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, const std::vector<Object>& objects, VkImage depthImage, VkFormat depthFormat, uint32_t width, uint32_t height);
+		void destroy();
+		bool isPrepared() const;
+		/** @brief Recreates the depth pyramid for a new depth attachment (e.g. after a resize) */
+		void setDepthSource(VkImage depthImage, VkFormat depthFormat, uint32_t width, uint32_t height);
+		/** @brief Updates the culling matrices, call once per frame before submitting */
+		void updateView(const glm::mat4& projection, const glm::mat4& view, float zNear);
+		/** @brief Replaces the culling data of an object, e.g. for moving objects */
+		void updateObject(uint32_t index, const Object& object);
+
+		/** @brief Records the culling dispatch for a phase, must be recorded outside of a render pass */
+		void cull(VkCommandBuffer commandBuffer, Phase phase);
+		/**
+		* Records the single pass depth pyramid build, must be recorded outside of a render pass
+		* @note Expects the depth attachment in VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL and returns it in that layout
+		*/
+		void buildDepthPyramid(VkCommandBuffer commandBuffer);
+		/** @brief Draws all objects that passed the culling for the given phase with a single indirect draw, geometry needs to be bound by the caller */
+		void draw(VkCommandBuffer commandBuffer, Phase phase);
+
+		/** @brief Returns the culling results of the last completed frame (doesn't wait on the GPU) */
+		Statistics getStatistics() const;
+		uint32_t getObjectCount() const;
+		uint32_t getPyramidLevelCount() const;
+	};
+}
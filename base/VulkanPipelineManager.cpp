@@ -0,0 +1,546 @@
+/*
+* Asynchronous graphics pipeline manager
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanPipelineManager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "VulkanInitializers.hpp"
+#include "VulkanTools.h"
+#include "VulkanTrace.h"
+
+namespace vks
+{
+	namespace
+	{
+		// Serialized pipeline state, all Vulkan structures added only consist of 32 bit members (and size_t) and contain no padding
+		struct Key {
+			std::vector<uint8_t> bytes;
+
+			void add(const void* data, size_t size)
+			{
+				const uint8_t* first = static_cast<const uint8_t*>(data);
+				bytes.insert(bytes.end(), first, first + size);
+			}
+
+			template<typename T>
+			void add(const T& data)
+			{
+				add(&data, sizeof(T));
+			}
+
+			template<typename T>
+			void add(const std::vector<T>& data)
+			{
+				add(data.size());
+				if (!data.empty()) {
+					add(data.data(), data.size() * sizeof(T));
+				}
+			}
+
+			void add(const PipelineManager::ShaderStage& stage)
+			{
+				add(stage.module);
+				add(stage.specializationMapEntries);
+				add(stage.specializationData);
+			}
+		};
+
+		// FNV-1a
+		uint64_t hashKey(const std::vector<uint8_t>& key)
+		{
+			uint64_t value = 14695981039346656037ull;
+			for (uint8_t byte : key) {
+				value ^= byte;
+				value *= 1099511628211ull;
+			}
+			return value;
+		}
+
+		// Create infos for all states of a pipeline description, pointing into the description
+		struct PipelineState {
+			VkPipelineVertexInputStateCreateInfo vertexInputState;
+			VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+			VkPipelineViewportStateCreateInfo viewportState;
+			VkPipelineRasterizationStateCreateInfo rasterizationState;
+			VkPipelineMultisampleStateCreateInfo multisampleState;
+			VkPipelineDepthStencilStateCreateInfo depthStencilState;
+			VkPipelineColorBlendStateCreateInfo colorBlendState;
+			VkPipelineDynamicStateCreateInfo dynamicState;
+			VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+			VkSpecializationInfo specializationInfos[2];
+			// Vertex and fragment shader stage
+			VkPipelineShaderStageCreateInfo shaderStages[2];
+
+			explicit PipelineState(const PipelineManager::GraphicsPipelineDesc& desc)
+			{
+				vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo(desc.vertexBindings, desc.vertexAttributes);
+				inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(desc.topology, 0, VK_FALSE);
+				viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
+				rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(desc.polygonMode, desc.cullMode, desc.frontFace, 0);
+				multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(desc.rasterizationSamples, 0);
+				depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(desc.depthTest, desc.depthWrite, desc.depthCompareOp);
+				colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(static_cast<uint32_t>(desc.blendAttachments.size()), desc.blendAttachments.data());
+				dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStates, 2, 0);
+				setShaderStage(0, desc.vertexShader, VK_SHADER_STAGE_VERTEX_BIT);
+				setShaderStage(1, desc.fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT);
+			}
+			PipelineState(const PipelineState&) = delete;
+			PipelineState& operator=(const PipelineState&) = delete;
+
+			void setShaderStage(uint32_t index, const PipelineManager::ShaderStage& shader, VkShaderStageFlagBits stage)
+			{
+				VkSpecializationInfo& specializationInfo = specializationInfos[index];
+				specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(shader.specializationMapEntries.size()), shader.specializationMapEntries.data(), shader.specializationData.size(), shader.specializationData.data());
+				VkPipelineShaderStageCreateInfo& shaderStage = shaderStages[index];
+				shaderStage = {};
+				shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+				shaderStage.stage = stage;
+				shaderStage.module = shader.module;
+				shaderStage.pName = "main";
+				shaderStage.pSpecializationInfo = shader.specializationMapEntries.empty() ? nullptr : &specializationInfo;
+			}
+		};
+
+		double elapsedMs(std::chrono::steady_clock::time_point start)
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+
+	PipelineManager::~PipelineManager()
+	{
+		destroy();
+	}
+
+	bool PipelineManager::enableGraphicsPipelineLibrary(VkPhysicalDevice physicalDevice, std::vector<const char*>& deviceExtensions, VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT& features, void*& pNextChain)
+	{
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+		auto supported = [&extensions](const char* name) {
+			return std::find_if(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& extension) { return strcmp(extension.extensionName, name) == 0; }) != extensions.end();
+		};
+		// The graphicsPipelineLibrary feature is required to be supported along with the extension
+		if (!supported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) || !supported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+			return false;
+		}
+		deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+		features.graphicsPipelineLibrary = VK_TRUE;
+		features.pNext = pNextChain;
+		pNextChain = &features;
+		return true;
+	}
+
+	void PipelineManager::prepare(VkDevice device, VkPipelineCache pipelineCache, bool useLibraries, uint32_t threadCount)
+	{
+		this->device = device;
+		this->pipelineCache = pipelineCache;
+		this->useLibraries = useLibraries;
+		this->threadCount = threadCount;
+	}
+
+	std::vector<uint8_t> PipelineManager::libraryPartKey(const GraphicsPipelineDesc& desc, LibraryPart part)
+	{
+		Key key;
+		key.add(part);
+		switch (part) {
+		case VertexInput:
+			key.add(desc.vertexBindings);
+			key.add(desc.vertexAttributes);
+			key.add(desc.topology);
+			break;
+		case PreRasterization:
+			key.add(desc.layout);
+			key.add(desc.renderPass);
+			key.add(desc.subpass);
+			key.add(desc.vertexShader);
+			key.add(desc.polygonMode);
+			key.add(desc.cullMode);
+			key.add(desc.frontFace);
+			break;
+		case FragmentShader:
+			key.add(desc.layout);
+			key.add(desc.renderPass);
+			key.add(desc.subpass);
+			key.add(desc.fragmentShader);
+			key.add(desc.depthTest);
+			key.add(desc.depthWrite);
+			key.add(desc.depthCompareOp);
+			key.add(desc.rasterizationSamples);
+			break;
+		case FragmentOutput:
+			key.add(desc.renderPass);
+			key.add(desc.subpass);
+			key.add(desc.rasterizationSamples);
+			key.add(desc.blendAttachments);
+			break;
+		default:
+			break;
+		}
+		return key.bytes;
+	}
+
+	PipelineManager::Pipeline PipelineManager::request(const GraphicsPipelineDesc& desc)
+	{
+		VKS_TRACE_FUNCTION();
+		assert(device != VK_NULL_HANDLE);
+		std::shared_ptr<Request> request = std::make_shared<Request>();
+		request->desc = desc;
+		// The part keys are self-delimiting, so their concatenation identifies the complete state
+		std::vector<uint8_t> key;
+		for (uint32_t part = 0; part < LibraryPartCount; part++) {
+			request->partKeys[part] = libraryPartKey(desc, static_cast<LibraryPart>(part));
+			key.insert(key.end(), request->partKeys[part].begin(), request->partKeys[part].end());
+		}
+
+		// Different states may share a hash, so a hit only counts if the stored state matches
+		const uint64_t hash = hashKey(key);
+		auto range = requestedPipelines.equal_range(hash);
+		for (auto it = range.first; it != range.second; it++) {
+			if (entries[it->second].key == key) {
+				std::lock_guard<std::mutex> lock(mutex);
+				statistics.duplicateRequests++;
+				return it->second;
+			}
+		}
+		request->pipeline = static_cast<Pipeline>(entries.size());
+		entries.push_back({});
+		entries.back().key = std::move(key);
+		requestedPipelines.emplace(hash, request->pipeline);
+
+		if (workers.empty()) {
+			startWorkers();
+		}
+		if (useLibraries) {
+			const bool optimize = linkTimeOptimization;
+			addJob([this, request, optimize]() {
+				addResult({ request->pipeline, link(*request, false), false });
+				if (optimize) {
+					addJob([this, request]() { addResult({ request->pipeline, link(*request, true), true }); }, true);
+				}
+			}, false);
+		} else {
+			addJob([this, request]() { addResult({ request->pipeline, createPipeline(request->desc), true }); }, false);
+		}
+		return request->pipeline;
+	}
+
+	VkPipeline PipelineManager::get(Pipeline pipeline) const
+	{
+		return entries[pipeline].pipeline;
+	}
+
+	bool PipelineManager::isOptimized(Pipeline pipeline) const
+	{
+		return entries[pipeline].optimized;
+	}
+
+	bool PipelineManager::update()
+	{
+		// Pipelines replaced by the last update are no longer used by any command buffer that may still be executing
+		for (VkPipeline pipeline : retiredPipelines) {
+			vkDestroyPipeline(device, pipeline, nullptr);
+		}
+		retiredPipelines.clear();
+
+		std::vector<Result> finished;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.swap(results);
+		}
+		for (const Result& result : finished) {
+			Entry& entry = entries[result.pipeline];
+			if (entry.optimized) {
+				// Never replace an optimized pipeline with a fast-linked one
+				retiredPipelines.push_back(result.handle);
+				continue;
+			}
+			if (entry.pipeline != VK_NULL_HANDLE) {
+				retiredPipelines.push_back(entry.pipeline);
+			}
+			entry.pipeline = result.handle;
+			entry.optimized = result.optimized;
+		}
+		return !finished.empty();
+	}
+
+	void PipelineManager::setLinkTimeOptimization(bool enabled)
+	{
+		linkTimeOptimization = enabled;
+	}
+
+	void PipelineManager::wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idleCondition.wait(lock, [this] { return fastJobs.empty() && optimizeJobs.empty() && runningJobs == 0; });
+	}
+
+	void PipelineManager::destroy()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			// Jobs that have not been started yet are dropped, running ones are finished
+			fastJobs.clear();
+			optimizeJobs.clear();
+		}
+		condition.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+		stopping = false;
+
+		for (const Result& result : results) {
+			vkDestroyPipeline(device, result.handle, nullptr);
+		}
+		results.clear();
+		for (const Entry& entry : entries) {
+			if (entry.pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(device, entry.pipeline, nullptr);
+			}
+		}
+		entries.clear();
+		requestedPipelines.clear();
+		for (VkPipeline pipeline : retiredPipelines) {
+			vkDestroyPipeline(device, pipeline, nullptr);
+		}
+		retiredPipelines.clear();
+		for (auto& library : libraries) {
+			if (library.second->pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(device, library.second->pipeline, nullptr);
+			}
+		}
+		libraries.clear();
+	}
+
+	bool PipelineManager::usesLibraries() const
+	{
+		return useLibraries;
+	}
+
+	PipelineManager::Statistics PipelineManager::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return statistics;
+	}
+
+	void PipelineManager::startWorkers()
+	{
+		uint32_t count = threadCount;
+		if (count == 0) {
+			// Leave one hardware thread for rendering, hardware_concurrency may return 0 if the count is unknown
+			const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+			count = std::max(1u, hardwareThreads > 1 ? hardwareThreads - 1 : 1u);
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			workers.emplace_back(&PipelineManager::workerLoop, this);
+		}
+	}
+
+	void PipelineManager::workerLoop()
+	{
+		VKS_TRACE_THREAD_NAME("Pipeline compiler");
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			condition.wait(lock, [this] { return stopping || !fastJobs.empty() || !optimizeJobs.empty(); });
+			if (stopping) {
+				break;
+			}
+			std::deque<std::function<void()>>& queue = !fastJobs.empty() ? fastJobs : optimizeJobs;
+			std::function<void()> job = std::move(queue.front());
+			queue.pop_front();
+			runningJobs++;
+			lock.unlock();
+
+			job();
+
+			lock.lock();
+			runningJobs--;
+			idleCondition.notify_all();
+		}
+	}
+
+	void PipelineManager::addJob(std::function<void()> job, bool optimize)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		(optimize ? optimizeJobs : fastJobs).push_back(std::move(job));
+		condition.notify_one();
+	}
+
+	void PipelineManager::addResult(const Result& result)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		results.push_back(result);
+	}
+
+	VkPipeline PipelineManager::getLibrary(const Request& request, LibraryPart part)
+	{
+		Library* library;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const std::vector<uint8_t>& key = request.partKeys[part];
+			const uint64_t hash = hashKey(key);
+			library = nullptr;
+			auto range = libraries.equal_range(hash);
+			for (auto it = range.first; it != range.second; it++) {
+				if (it->second->key == key) {
+					library = it->second.get();
+					break;
+				}
+			}
+			if (!library) {
+				std::unique_ptr<Library> newLibrary = std::make_unique<Library>();
+				newLibrary->key = key;
+				library = newLibrary.get();
+				libraries.emplace(hash, std::move(newLibrary));
+			}
+		}
+
+		// Variants sharing a part that is still being compiled wait for it instead of compiling it again
+		std::lock_guard<std::mutex> libraryLock(library->mutex);
+		if (library->pipeline != VK_NULL_HANDLE) {
+			std::lock_guard<std::mutex> lock(mutex);
+			statistics.reusedLibraries++;
+			return library->pipeline;
+		}
+		const auto start = std::chrono::steady_clock::now();
+		library->pipeline = createLibrary(request.desc, part);
+		const double time = elapsedMs(start);
+		std::lock_guard<std::mutex> lock(mutex);
+		statistics.libraries++;
+		statistics.libraryTime += time;
+		return library->pipeline;
+	}
+
+	VkPipeline PipelineManager::createLibrary(const GraphicsPipelineDesc& desc, LibraryPart part)
+	{
+		VKS_TRACE_SCOPE("Create pipeline library");
+		PipelineState state(desc);
+
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+		libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+
+		VkGraphicsPipelineCreateInfo pipelineCI{};
+		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCI.pNext = &libraryInfo;
+		// Link time optimization information has to be retained for the optimized pipeline linked from the libraries later on
+		pipelineCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+		switch (part) {
+		case VertexInput:
+			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+			pipelineCI.pVertexInputState = &state.vertexInputState;
+			pipelineCI.pInputAssemblyState = &state.inputAssemblyState;
+			break;
+		case PreRasterization:
+			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+			pipelineCI.layout = desc.layout;
+			pipelineCI.renderPass = desc.renderPass;
+			pipelineCI.subpass = desc.subpass;
+			pipelineCI.stageCount = 1;
+			pipelineCI.pStages = &state.shaderStages[0];
+			pipelineCI.pViewportState = &state.viewportState;
+			pipelineCI.pRasterizationState = &state.rasterizationState;
+			pipelineCI.pDynamicState = &state.dynamicState;
+			break;
+		case FragmentShader:
+			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+			pipelineCI.layout = desc.layout;
+			pipelineCI.renderPass = desc.renderPass;
+			pipelineCI.subpass = desc.subpass;
+			pipelineCI.stageCount = 1;
+			pipelineCI.pStages = &state.shaderStages[1];
+			pipelineCI.pDepthStencilState = &state.depthStencilState;
+			pipelineCI.pMultisampleState = &state.multisampleState;
+			break;
+		case FragmentOutput:
+			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+			pipelineCI.layout = desc.layout;
+			pipelineCI.renderPass = desc.renderPass;
+			pipelineCI.subpass = desc.subpass;
+			pipelineCI.pColorBlendState = &state.colorBlendState;
+			pipelineCI.pMultisampleState = &state.multisampleState;
+			break;
+		default:
+			break;
+		}
+		VkPipeline library;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &library));
+		return library;
+	}
+
+	VkPipeline PipelineManager::link(const Request& request, bool optimize)
+	{
+		VkPipeline parts[LibraryPartCount];
+		for (uint32_t part = 0; part < LibraryPartCount; part++) {
+			parts[part] = getLibrary(request, static_cast<LibraryPart>(part));
+		}
+
+		VKS_TRACE_SCOPE("Link pipeline");
+		const auto start = std::chrono::steady_clock::now();
+		VkPipelineLibraryCreateInfoKHR libraryCI{};
+		libraryCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+		libraryCI.libraryCount = LibraryPartCount;
+		libraryCI.pLibraries = parts;
+
+		VkGraphicsPipelineCreateInfo pipelineCI{};
+		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCI.pNext = &libraryCI;
+		pipelineCI.layout = request.desc.layout;
+		// Without this flag the libraries are only linked, which is fast but may result in less efficient code
+		if (optimize) {
+			pipelineCI.flags = VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+		}
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+
+		const double time = elapsedMs(start);
+		std::lock_guard<std::mutex> lock(mutex);
+		if (optimize) {
+			statistics.optimizedPipelines++;
+			statistics.optimizedTime += time;
+		} else {
+			statistics.fastLinkedPipelines++;
+			statistics.fastLinkTime += time;
+		}
+		return pipeline;
+	}
+
+	VkPipeline PipelineManager::createPipeline(const GraphicsPipelineDesc& desc)
+	{
+		VKS_TRACE_SCOPE("Create pipeline");
+		const auto start = std::chrono::steady_clock::now();
+		PipelineState state(desc);
+		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(desc.layout, desc.renderPass, 0);
+		pipelineCI.subpass = desc.subpass;
+		pipelineCI.stageCount = 2;
+		pipelineCI.pStages = state.shaderStages;
+		pipelineCI.pVertexInputState = &state.vertexInputState;
+		pipelineCI.pInputAssemblyState = &state.inputAssemblyState;
+		pipelineCI.pViewportState = &state.viewportState;
+		pipelineCI.pRasterizationState = &state.rasterizationState;
+		pipelineCI.pMultisampleState = &state.multisampleState;
+		pipelineCI.pDepthStencilState = &state.depthStencilState;
+		pipelineCI.pColorBlendState = &state.colorBlendState;
+		pipelineCI.pDynamicState = &state.dynamicState;
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+
+		const double time = elapsedMs(start);
+		std::lock_guard<std::mutex> lock(mutex);
+		statistics.optimizedPipelines++;
+		statistics.optimizedTime += time;
+		return pipeline;
+	}
+}
@@ -0,0 +1,200 @@
+/*
+* Asynchronous graphics pipeline manager
+*
+* Compiles graphics pipelines on worker threads. With VK_EXT_graphics_pipeline_library, pipelines are split into vertex input,
+* pre-rasterization, fragment shader and fragment output libraries that are cached and shared between variants. A new variant is
+* first fast-linked from these libraries so it can be used right away, the link time optimized pipeline replaces it once it
+* has been compiled in the background
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+namespace vks
+{
+	/**
+	* @brief Creates graphics pipeline variants without stalling the thread that renders
+	*
+	* request, get and update are meant to be called from the render thread only, the compilation itself runs on worker threads that
+	* are started with the first request. Without pipeline library support, variants are compiled as complete pipelines on the workers.
+	* Devices need VK_KHR_pipeline_library and VK_EXT_graphics_pipeline_library enabled for library based compilation,
+	* see enableGraphicsPipelineLibrary.
+	*/
+	class PipelineManager
+	{
+	public:
+		typedef uint32_t Pipeline;
+
+		struct ShaderStage {
+			VkShaderModule module = VK_NULL_HANDLE;
+			std::vector<VkSpecializationMapEntry> specializationMapEntries;
+			std::vector<uint8_t> specializationData;
+		};
+
+		/**
+		* @brief State of a graphics pipeline, grouped by the library part it belongs to
+		* @note Viewport and scissor are always dynamic
+		*/
+		struct GraphicsPipelineDesc {
+			VkPipelineLayout layout = VK_NULL_HANDLE;
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			uint32_t subpass = 0;
+			// Vertex input interface
+			std::vector<VkVertexInputBindingDescription> vertexBindings;
+			std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+			VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			// Pre-rasterization shaders
+			ShaderStage vertexShader;
+			VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+			VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+			VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+			// Fragment shader
+			ShaderStage fragmentShader;
+			VkBool32 depthTest = VK_TRUE;
+			VkBool32 depthWrite = VK_TRUE;
+			VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+			// Fragment output interface
+			VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+			std::vector<VkPipelineColorBlendAttachmentState> blendAttachments = { { VK_FALSE, VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ZERO, VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ZERO, VK_BLEND_OP_ADD, 0xf } };
+		};
+
+		struct Statistics {
+			/** @brief Requests answered with an already requested pipeline */
+			uint32_t duplicateRequests = 0;
+			uint32_t libraries = 0;
+			/** @brief Library parts that were shared with a previously compiled variant */
+			uint32_t reusedLibraries = 0;
+			uint32_t fastLinkedPipelines = 0;
+			uint32_t optimizedPipelines = 0;
+			/** @brief Accumulated compile times in ms, complete pipelines count as optimized ones */
+			double libraryTime = 0.0;
+			double fastLinkTime = 0.0;
+			double optimizedTime = 0.0;
+		};
+
+		PipelineManager() = default;
+		PipelineManager(const PipelineManager&) = delete;
+		PipelineManager& operator=(const PipelineManager&) = delete;
+		~PipelineManager();
+
+		/**
+		* Adds the extensions and the feature structure required for pipeline libraries if the device supports them
+		* @param physicalDevice Device to check for support
+		* @param deviceExtensions Extensions to enable, the required extensions are appended
+		* @param features Feature structure that is put in front of pNextChain, has to stay valid until the device has been created
+		* @param pNextChain pNext chain of the device create info
+		* @return True if the extensions are supported, VK_KHR_get_physical_device_properties2 also needs to be enabled on the instance
+		*/
+		static bool enableGraphicsPipelineLibrary(VkPhysicalDevice physicalDevice, std::vector<const char*>& deviceExtensions, VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT& features, void*& pNextChain);
+
+		/**
+		* @param device Device the pipelines are created on
+		* @param pipelineCache Cache used for all pipelines, has to be internally synchronized (the default)
+		* @param useLibraries If true, pipelines are built from pipeline libraries
+		* @param threadCount Number of worker threads, 0 uses all hardware threads but one
+		*/
+		void prepare(VkDevice device, VkPipelineCache pipelineCache, bool useLibraries, uint32_t threadCount = 0);
+		/**
+		* Requests a pipeline for the given state, compilation starts in the background if it has not been requested before
+		* @return Handle for get, identical states always return the same handle
+		*/
+		Pipeline request(const GraphicsPipelineDesc& desc);
+		/** @return Best pipeline compiled for the handle so far, VK_NULL_HANDLE if none is available yet */
+		VkPipeline get(Pipeline pipeline) const;
+		/** @return True if the final (link time optimized) pipeline is available for the handle */
+		bool isOptimized(Pipeline pipeline) const;
+		/**
+		* Makes pipelines finished by the workers available through get, to be called once per frame
+		* Pipelines replaced by optimized ones are destroyed with the next call, so all submissions made before this call need to have completed by then
+		* @return True if a pipeline returned by get has changed, command buffers using them need to be recorded again
+		*/
+		bool update();
+		/** @brief If disabled, pipelines requested afterwards are only fast-linked and never replaced by link time optimized ones */
+		void setLinkTimeOptimization(bool enabled);
+		/** @brief Waits until all requested pipelines have been compiled, a following update makes them available */
+		void wait();
+		/** @brief Stops the workers and destroys all pipelines and libraries */
+		void destroy();
+		bool usesLibraries() const;
+		Statistics getStatistics() const;
+
+	private:
+		enum LibraryPart { VertexInput, PreRasterization, FragmentShader, FragmentOutput, LibraryPartCount };
+
+		struct Request {
+			Pipeline pipeline;
+			GraphicsPipelineDesc desc;
+			std::vector<uint8_t> partKeys[LibraryPartCount];
+		};
+
+		struct Library {
+			std::mutex mutex;
+			// Serialized state of the library part, compared on lookups as different parts may share a hash
+			std::vector<uint8_t> key;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+		};
+
+		struct Entry {
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			bool optimized = false;
+			// Serialized state of the requested pipeline
+			std::vector<uint8_t> key;
+		};
+
+		struct Result {
+			Pipeline pipeline;
+			VkPipeline handle;
+			bool optimized;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		bool useLibraries = false;
+		uint32_t threadCount = 0;
+		bool linkTimeOptimization = true;
+
+		// Render thread state
+		std::vector<Entry> entries;
+		std::unordered_multimap<uint64_t, Pipeline> requestedPipelines;
+		std::vector<VkPipeline> retiredPipelines;
+
+		// State shared with the workers
+		mutable std::mutex mutex;
+		std::condition_variable condition;
+		std::condition_variable idleCondition;
+		std::vector<std::thread> workers;
+		// Fast links are preferred over link time optimization, so new variants become available as soon as possible
+		std::deque<std::function<void()>> fastJobs;
+		std::deque<std::function<void()>> optimizeJobs;
+		uint32_t runningJobs = 0;
+		bool stopping = false;
+		std::vector<Result> results;
+		std::unordered_multimap<uint64_t, std::unique_ptr<Library>> libraries;
+		Statistics statistics;
+
+		static std::vector<uint8_t> libraryPartKey(const GraphicsPipelineDesc& desc, LibraryPart part);
+		void startWorkers();
+		void workerLoop();
+		void addJob(std::function<void()> job, bool optimize);
+		void addResult(const Result& result);
+		VkPipeline getLibrary(const Request& request, LibraryPart part);
+		VkPipeline createLibrary(const GraphicsPipelineDesc& desc, LibraryPart part);
+		VkPipeline link(const Request& request, bool optimize);
+		VkPipeline createPipeline(const GraphicsPipelineDesc& desc);
+	};
+}
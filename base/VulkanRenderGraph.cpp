@@ -0,0 +1,569 @@
+/*
+* Vulkan render graph
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanRenderGraph.h"
+
+#include <algorithm>
+
+namespace vks
+{
+	namespace
+	{
+		// The memory of an image may still be accessed when it's first written in a frame, either by the previous frame (incl. passes outside
+		// of the graph sampling exported images) or by another image aliasing the same memory
+		const VkPipelineStageFlags firstUseSrcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		const VkAccessFlags firstUseSrcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		const VkPipelineStageFlags depthStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+		bool formatIsDepth(VkFormat format)
+		{
+			switch (format) {
+			case VK_FORMAT_D16_UNORM:
+			case VK_FORMAT_X8_D24_UNORM_PACK32:
+			case VK_FORMAT_D32_SFLOAT:
+			case VK_FORMAT_D16_UNORM_S8_UINT:
+			case VK_FORMAT_D24_UNORM_S8_UINT:
+			case VK_FORMAT_D32_SFLOAT_S8_UINT:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		bool lifetimesOverlap(int32_t firstA, int32_t lastA, int32_t firstB, int32_t lastB)
+		{
+			return !(lastA < firstB || lastB < firstA);
+		}
+	}
+
+	RenderGraph::RenderGraph(vks::VulkanDevice* device) : device(device)
+	{
+		assert(device);
+	}
+
+	RenderGraph::~RenderGraph()
+	{
+		destroy();
+	}
+
+	RenderGraph::ImageHandle RenderGraph::addImage(const std::string& name, VkFormat format, uint32_t width, uint32_t height)
+	{
+		assert(!compiled);
+		Image image{};
+		image.name = name;
+		image.format = format;
+		image.width = width;
+		image.height = height;
+		images.push_back(image);
+		return static_cast<ImageHandle>(images.size() - 1);
+	}
+
+	RenderGraph::PassHandle RenderGraph::addPass(const std::string& name, RecordFunction record)
+	{
+		assert(!compiled);
+		Pass pass{};
+		pass.name = name;
+		pass.record = record;
+		passes.push_back(pass);
+		return static_cast<PassHandle>(passes.size() - 1);
+	}
+
+	void RenderGraph::writeColor(PassHandle pass, ImageHandle image, VkAttachmentLoadOp loadOp, VkClearColorValue clearColor)
+	{
+		assert(!compiled && pass < passes.size() && image < images.size());
+		assert(!formatIsDepth(images[image].format));
+		Attachment attachment{};
+		attachment.image = image;
+		attachment.loadOp = loadOp;
+		attachment.clearValue.color = clearColor;
+		passes[pass].colorAttachments.push_back(attachment);
+	}
+
+	void RenderGraph::writeDepth(PassHandle pass, ImageHandle image, VkAttachmentLoadOp loadOp, VkClearDepthStencilValue clearDepthStencil)
+	{
+		assert(!compiled && pass < passes.size() && image < images.size());
+		assert(formatIsDepth(images[image].format) && passes[pass].depthAttachment.empty());
+		Attachment attachment{};
+		attachment.image = image;
+		attachment.loadOp = loadOp;
+		attachment.clearValue.depthStencil = clearDepthStencil;
+		passes[pass].depthAttachment.push_back(attachment);
+	}
+
+	void RenderGraph::read(PassHandle pass, ImageHandle image)
+	{
+		assert(!compiled && pass < passes.size() && image < images.size());
+		passes[pass].reads.push_back(image);
+	}
+
+	void RenderGraph::setExported(ImageHandle image, bool exported)
+	{
+		assert(image < images.size());
+		images[image].exported = exported;
+	}
+
+	void RenderGraph::addExternalUsage(ImageHandle image, VkImageUsageFlags usage)
+	{
+		assert(image < images.size());
+		images[image].externalUsage |= usage;
+	}
+
+	bool RenderGraph::isCulled(PassHandle pass) const
+	{
+		return passes[pass].culled;
+	}
+
+	VkRenderPass RenderGraph::getRenderPass(PassHandle pass) const
+	{
+		assert(compiled);
+		return passes[pass].renderPass;
+	}
+
+	VkImageView RenderGraph::getView(ImageHandle image) const
+	{
+		assert(compiled);
+		return images[image].view;
+	}
+
+	VkImage RenderGraph::getImage(ImageHandle image) const
+	{
+		assert(compiled);
+		return images[image].image;
+	}
+
+	VkImageLayout RenderGraph::getReadLayout(ImageHandle image) const
+	{
+		return formatIsDepth(images[image].format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+
+	const RenderGraph::Statistics& RenderGraph::getStatistics() const
+	{
+		return statistics;
+	}
+
+	void RenderGraph::cullPasses()
+	{
+		// Walk the passes back to front, a pass is required if it writes an image that is exported or read by a later required pass
+		std::vector<bool> required(images.size(), false);
+		for (size_t i = 0; i < images.size(); i++) {
+			required[i] = images[i].exported;
+		}
+		statistics.culledPassCount = 0;
+		for (auto pass = passes.rbegin(); pass != passes.rend(); ++pass) {
+			pass->culled = true;
+			for (auto& attachment : pass->colorAttachments) {
+				pass->culled &= !required[attachment.image];
+			}
+			for (auto& attachment : pass->depthAttachment) {
+				pass->culled &= !required[attachment.image];
+			}
+			if (pass->culled) {
+				statistics.culledPassCount++;
+				continue;
+			}
+			for (auto image : pass->reads) {
+				required[image] = true;
+			}
+		}
+	}
+
+	void RenderGraph::computeLifetimes()
+	{
+		for (auto& image : images) {
+			image.usage = 0;
+			image.firstPass = -1;
+			image.lastPass = -1;
+		}
+		auto use = [this](ImageHandle handle, int32_t passIndex, VkImageUsageFlags usage) {
+			Image& image = images[handle];
+			image.usage |= usage;
+			if (image.firstPass < 0) {
+				image.firstPass = passIndex;
+			}
+			image.lastPass = passIndex;
+		};
+		for (int32_t i = 0; i < static_cast<int32_t>(passes.size()); i++) {
+			const Pass& pass = passes[i];
+			if (pass.culled) {
+				continue;
+			}
+			for (auto image : pass.reads) {
+				// Reading an image that has not been written before in this frame would return undefined contents
+				assert(images[image].firstPass >= 0);
+				use(image, i, VK_IMAGE_USAGE_SAMPLED_BIT);
+			}
+			for (auto& attachment : pass.colorAttachments) {
+				use(attachment.image, i, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+			}
+			for (auto& attachment : pass.depthAttachment) {
+				use(attachment.image, i, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+			}
+		}
+		// Exported images need to stay alive after the last pass
+		for (auto& image : images) {
+			if (image.exported && image.firstPass >= 0) {
+				image.usage |= VK_IMAGE_USAGE_SAMPLED_BIT | image.externalUsage;
+				image.lastPass = static_cast<int32_t>(passes.size());
+			}
+		}
+	}
+
+	void RenderGraph::createImages()
+	{
+		statistics.imageCount = 0;
+		statistics.unaliasedMemory = 0;
+		for (auto& image : images) {
+			if (image.firstPass < 0) {
+				continue;
+			}
+			image.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			if (formatIsDepth(image.format)) {
+				image.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+				if (vks::tools::formatHasStencil(image.format)) {
+					image.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+				}
+			}
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = image.format;
+			imageCI.extent = { image.width, image.height, 1 };
+			imageCI.mipLevels = 1;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = image.usage;
+			imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image.image));
+			vkGetImageMemoryRequirements(device->logicalDevice, image.image, &image.memReqs);
+			statistics.imageCount++;
+			statistics.unaliasedMemory += image.memReqs.size;
+		}
+	}
+
+	void RenderGraph::allocateMemory()
+	{
+		// Images are placed largest first at the lowest offset that doesn't overlap the memory of an already placed image with an overlapping lifetime
+		// Images with different memory types (e.g. depth on some implementations) are placed in separate heaps
+		std::vector<ImageHandle> order;
+		for (ImageHandle i = 0; i < images.size(); i++) {
+			if (images[i].image != VK_NULL_HANDLE) {
+				order.push_back(i);
+			}
+		}
+		std::stable_sort(order.begin(), order.end(), [this](ImageHandle a, ImageHandle b) { return images[a].memReqs.size > images[b].memReqs.size; });
+
+		std::vector<ImageHandle> placed;
+		for (auto handle : order) {
+			Image& image = images[handle];
+			const uint32_t memoryTypeIndex = device->getMemoryType(image.memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			auto heap = std::find_if(heaps.begin(), heaps.end(), [memoryTypeIndex](const Heap& heap) { return heap.memoryTypeIndex == memoryTypeIndex; });
+			if (heap == heaps.end()) {
+				Heap newHeap{};
+				newHeap.memoryTypeIndex = memoryTypeIndex;
+				heaps.push_back(newHeap);
+				heap = heaps.end() - 1;
+			}
+			image.heap = static_cast<uint32_t>(std::distance(heaps.begin(), heap));
+
+			// Collect the memory ranges that are in use during this image's lifetime
+			std::vector<std::pair<VkDeviceSize, VkDeviceSize>> ranges;
+			for (auto other : placed) {
+				const Image& otherImage = images[other];
+				if (otherImage.heap == image.heap && lifetimesOverlap(image.firstPass, image.lastPass, otherImage.firstPass, otherImage.lastPass)) {
+					ranges.push_back({ otherImage.offset, otherImage.offset + otherImage.memReqs.size });
+				}
+			}
+			std::sort(ranges.begin(), ranges.end());
+			const VkDeviceSize alignment = image.memReqs.alignment;
+			VkDeviceSize offset = 0;
+			for (auto& range : ranges) {
+				if (offset + image.memReqs.size <= range.first) {
+					break;
+				}
+				offset = std::max(offset, (range.second + alignment - 1) / alignment * alignment);
+			}
+			image.offset = offset;
+			heap->size = std::max(heap->size, offset + image.memReqs.size);
+			placed.push_back(handle);
+		}
+
+		statistics.transientMemory = 0;
+		for (auto& heap : heaps) {
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.allocationSize = heap.size;
+			memAlloc.memoryTypeIndex = heap.memoryTypeIndex;
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &heap.memory));
+			statistics.transientMemory += heap.size;
+		}
+
+		for (auto handle : placed) {
+			Image& image = images[handle];
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image.image, heaps[image.heap].memory, image.offset));
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = image.format;
+			// Sampling a combined depth stencil image requires a view with a single aspect
+			viewCI.subresourceRange.aspectMask = (image.aspectMask & VK_IMAGE_ASPECT_DEPTH_BIT) ? VK_IMAGE_ASPECT_DEPTH_BIT : image.aspectMask;
+			viewCI.subresourceRange.levelCount = 1;
+			viewCI.subresourceRange.layerCount = 1;
+			viewCI.image = image.image;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &image.view));
+		}
+	}
+
+	void RenderGraph::createRenderPasses()
+	{
+		for (int32_t i = 0; i < static_cast<int32_t>(passes.size()); i++) {
+			Pass& pass = passes[i];
+			assert(!pass.colorAttachments.empty() || !pass.depthAttachment.empty());
+
+			// Attachments keep their layout during the render pass, all transitions are done by the barriers in front of the pass
+			std::vector<VkAttachmentDescription> attachmentDescriptions;
+			std::vector<VkAttachmentReference> colorReferences;
+			VkAttachmentReference depthReference{};
+			pass.clearValues.clear();
+			auto addAttachment = [&](const Attachment& attachment, VkImageLayout layout) {
+				const Image& image = images[attachment.image];
+				// Contents only need to be stored if they are consumed by a later pass or outside of the graph
+				bool consumed = image.exported;
+				for (size_t j = i + 1; j < passes.size() && !consumed; j++) {
+					const Pass& laterPass = passes[j];
+					if (laterPass.culled) {
+						continue;
+					}
+					consumed |= std::find(laterPass.reads.begin(), laterPass.reads.end(), attachment.image) != laterPass.reads.end();
+					for (auto& laterAttachment : laterPass.colorAttachments) {
+						consumed |= (laterAttachment.image == attachment.image) && (laterAttachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD);
+					}
+					for (auto& laterAttachment : laterPass.depthAttachment) {
+						consumed |= (laterAttachment.image == attachment.image) && (laterAttachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD);
+					}
+				}
+				const VkAttachmentStoreOp storeOp = consumed ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				VkAttachmentDescription description{};
+				description.format = image.format;
+				description.samples = VK_SAMPLE_COUNT_1_BIT;
+				description.loadOp = attachment.loadOp;
+				description.storeOp = storeOp;
+				description.stencilLoadOp = vks::tools::formatHasStencil(image.format) ? attachment.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+				description.stencilStoreOp = vks::tools::formatHasStencil(image.format) ? storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				description.initialLayout = layout;
+				description.finalLayout = layout;
+				attachmentDescriptions.push_back(description);
+				pass.clearValues.push_back(attachment.clearValue);
+				if (pass.width == 0) {
+					pass.width = image.width;
+					pass.height = image.height;
+				}
+				assert(pass.width == image.width && pass.height == image.height);
+				return VkAttachmentReference{ static_cast<uint32_t>(attachmentDescriptions.size() - 1), layout };
+			};
+			for (auto& attachment : pass.colorAttachments) {
+				colorReferences.push_back(addAttachment(attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+			}
+			for (auto& attachment : pass.depthAttachment) {
+				depthReference = addAttachment(attachment, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+			}
+
+			VkSubpassDescription subpass{};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+			subpass.pColorAttachments = colorReferences.data();
+			subpass.pDepthStencilAttachment = pass.depthAttachment.empty() ? nullptr : &depthReference;
+
+			VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+			renderPassCI.attachmentCount = static_cast<uint32_t>(attachmentDescriptions.size());
+			renderPassCI.pAttachments = attachmentDescriptions.data();
+			renderPassCI.subpassCount = 1;
+			renderPassCI.pSubpasses = &subpass;
+			VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassCI, nullptr, &pass.renderPass));
+
+			if (pass.culled) {
+				continue;
+			}
+
+			std::vector<VkImageView> views;
+			for (auto& attachment : pass.colorAttachments) {
+				views.push_back(images[attachment.image].view);
+			}
+			for (auto& attachment : pass.depthAttachment) {
+				views.push_back(images[attachment.image].view);
+			}
+			VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+			framebufferCI.renderPass = pass.renderPass;
+			framebufferCI.attachmentCount = static_cast<uint32_t>(views.size());
+			framebufferCI.pAttachments = views.data();
+			framebufferCI.width = pass.width;
+			framebufferCI.height = pass.height;
+			framebufferCI.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &framebufferCI, nullptr, &pass.framebuffer));
+		}
+	}
+
+	void RenderGraph::buildBarriers()
+	{
+		// Simulate the execution of the graph, tracking layout and last access of every image
+		struct State {
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags stageMask = 0;
+			VkAccessFlags accessMask = 0;
+		};
+		std::vector<State> states(images.size());
+
+		auto transition = [this, &states](Barriers& barriers, ImageHandle handle, VkImageLayout layout, VkPipelineStageFlags stageMask, VkAccessFlags accessMask, bool write) {
+			State& state = states[handle];
+			// Read after read in the same layout needs no barrier
+			if (!write && state.layout == layout && !(state.accessMask & (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT))) {
+				state.stageMask |= stageMask;
+				return;
+			}
+			const Image& image = images[handle];
+			VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+			barrier.image = image.image;
+			barrier.subresourceRange = { image.aspectMask, 0, 1, 0, 1 };
+			barrier.newLayout = layout;
+			barrier.dstAccessMask = accessMask;
+			if (state.layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+				// First use in this frame, previous contents are discarded
+				barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				barrier.srcAccessMask = firstUseSrcAccessMask;
+				barriers.srcStageMask |= firstUseSrcStageMask;
+			} else {
+				barrier.oldLayout = state.layout;
+				barrier.srcAccessMask = state.accessMask & (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+				barriers.srcStageMask |= state.stageMask;
+			}
+			barriers.dstStageMask |= stageMask;
+			barriers.images.push_back(barrier);
+			state.layout = layout;
+			state.stageMask = stageMask;
+			state.accessMask = accessMask;
+		};
+
+		statistics.barrierCount = 0;
+		for (auto& pass : passes) {
+			pass.barriers = Barriers();
+			if (pass.culled) {
+				continue;
+			}
+			for (auto image : pass.reads) {
+				transition(pass.barriers, image, getReadLayout(image), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, false);
+			}
+			for (auto& attachment : pass.colorAttachments) {
+				VkAccessFlags accessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (attachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0);
+				transition(pass.barriers, attachment.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, accessMask, true);
+			}
+			for (auto& attachment : pass.depthAttachment) {
+				VkAccessFlags accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+				transition(pass.barriers, attachment.image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depthStageMask, accessMask, true);
+			}
+			statistics.barrierCount += static_cast<uint32_t>(pass.barriers.images.size());
+		}
+
+		// Exported images are handed over in a shader read only layout
+		exportBarriers = Barriers();
+		for (ImageHandle i = 0; i < images.size(); i++) {
+			if (images[i].exported && images[i].image != VK_NULL_HANDLE) {
+				transition(exportBarriers, i, getReadLayout(i), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, false);
+			}
+		}
+		statistics.barrierCount += static_cast<uint32_t>(exportBarriers.images.size());
+	}
+
+	void RenderGraph::compile()
+	{
+		release();
+		statistics.passCount = static_cast<uint32_t>(passes.size());
+		cullPasses();
+		computeLifetimes();
+		createImages();
+		allocateMemory();
+		createRenderPasses();
+		buildBarriers();
+		compiled = true;
+	}
+
+	void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const Barriers& barriers) const
+	{
+		if (barriers.images.empty()) {
+			return;
+		}
+		vkCmdPipelineBarrier(commandBuffer, barriers.srcStageMask, barriers.dstStageMask, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.images.size()), barriers.images.data());
+	}
+
+	void RenderGraph::execute(VkCommandBuffer commandBuffer) const
+	{
+		assert(compiled);
+		for (auto& pass : passes) {
+			if (pass.culled) {
+				continue;
+			}
+			recordBarriers(commandBuffer, pass.barriers);
+
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = pass.renderPass;
+			renderPassBeginInfo.framebuffer = pass.framebuffer;
+			renderPassBeginInfo.renderArea.extent.width = pass.width;
+			renderPassBeginInfo.renderArea.extent.height = pass.height;
+			renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+			renderPassBeginInfo.pClearValues = pass.clearValues.data();
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			VkViewport viewport = vks::initializers::viewport((float)pass.width, (float)pass.height, 0.0f, 1.0f);
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			VkRect2D scissor = vks::initializers::rect2D(pass.width, pass.height, 0, 0);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+			pass.record(commandBuffer);
+
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		recordBarriers(commandBuffer, exportBarriers);
+	}
+
+	void RenderGraph::release()
+	{
+		VkDevice logicalDevice = device->logicalDevice;
+		for (auto& pass : passes) {
+			if (pass.framebuffer != VK_NULL_HANDLE) {
+				vkDestroyFramebuffer(logicalDevice, pass.framebuffer, nullptr);
+			}
+			if (pass.renderPass != VK_NULL_HANDLE) {
+				vkDestroyRenderPass(logicalDevice, pass.renderPass, nullptr);
+			}
+			pass.framebuffer = VK_NULL_HANDLE;
+			pass.renderPass = VK_NULL_HANDLE;
+			pass.width = 0;
+			pass.height = 0;
+		}
+		for (auto& image : images) {
+			if (image.view != VK_NULL_HANDLE) {
+				vkDestroyImageView(logicalDevice, image.view, nullptr);
+			}
+			if (image.image != VK_NULL_HANDLE) {
+				vkDestroyImage(logicalDevice, image.image, nullptr);
+			}
+			image.view = VK_NULL_HANDLE;
+			image.image = VK_NULL_HANDLE;
+		}
+		for (auto& heap : heaps) {
+			vkFreeMemory(logicalDevice, heap.memory, nullptr);
+		}
+		heaps.clear();
+		compiled = false;
+	}
+
+	void RenderGraph::destroy()
+	{
+		release();
+		passes.clear();
+		images.clear();
+		statistics = Statistics();
+	}
+}
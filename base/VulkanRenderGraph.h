@@ -0,0 +1,171 @@
+/*
+* Vulkan render graph
+*
+* Builds render passes, framebuffers, barriers and aliased attachment memory from declared pass inputs and outputs
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	/**
+	* @brief Frame graph for chains of offscreen render passes
+	*
+	* Passes declare the images they render to (color and depth attachments) and the images they sample in their fragment shaders.
+	* Images that are sampled after the graph has been executed (e.g. by the example's final composition pass) are marked as exported.
+	* compile() then:
+	*   culls all passes that don't contribute to an exported image
+	*   derives usage flags, load and store ops and the lifetime (first to last pass) of every image
+	*   places all images in shared device memory, images whose lifetimes don't overlap alias the same memory
+	*   creates one render pass and framebuffer per pass and precomputes the (batched) barriers and layout transitions between passes
+	* execute() records all passes, the record callback of a pass only needs to bind and draw, the render pass, viewport and scissor are set by the graph.
+	*
+	* Image contents are undefined at their first use in a frame (memory may have been used by another image), so the first pass writing
+	* an image must clear it or fully overwrite it (VK_ATTACHMENT_LOAD_OP_DONT_CARE). Exported images are left in a shader read only layout.
+	*/
+	class RenderGraph
+	{
+	public:
+		typedef uint32_t ImageHandle;
+		typedef uint32_t PassHandle;
+		typedef std::function<void(VkCommandBuffer commandBuffer)> RecordFunction;
+
+		struct Statistics {
+			uint32_t passCount = 0;
+			uint32_t culledPassCount = 0;
+			uint32_t imageCount = 0;
+			/** @brief Number of image barriers recorded per execution */
+			uint32_t barrierCount = 0;
+			/** @brief Device memory allocated for all images of the graph (with aliasing) */
+			VkDeviceSize transientMemory = 0;
+			/** @brief Device memory that would be required with a dedicated allocation per image */
+			VkDeviceSize unaliasedMemory = 0;
+		};
+
+	private:
+		struct Image {
+			std::string name;
+			VkFormat format;
+			uint32_t width;
+			uint32_t height;
+			bool exported = false;
+			VkImageUsageFlags externalUsage = 0;
+			// Derived by compile
+			VkImageUsageFlags usage = 0;
+			VkImageAspectFlags aspectMask = 0;
+			int32_t firstPass = -1;
+			int32_t lastPass = -1;
+			VkMemoryRequirements memReqs{};
+			uint32_t heap = 0;
+			VkDeviceSize offset = 0;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+		};
+
+		struct Attachment {
+			ImageHandle image;
+			VkAttachmentLoadOp loadOp;
+			VkClearValue clearValue;
+		};
+
+		struct Barriers {
+			std::vector<VkImageMemoryBarrier> images;
+			VkPipelineStageFlags srcStageMask = 0;
+			VkPipelineStageFlags dstStageMask = 0;
+		};
+
+		struct Pass {
+			std::string name;
+			RecordFunction record;
+			std::vector<Attachment> colorAttachments;
+			std::vector<Attachment> depthAttachment;
+			std::vector<ImageHandle> reads;
+			// Derived by compile
+			bool culled = false;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			VkFramebuffer framebuffer = VK_NULL_HANDLE;
+			std::vector<VkClearValue> clearValues;
+			Barriers barriers;
+		};
+
+		struct Heap {
+			uint32_t memoryTypeIndex;
+			VkDeviceSize size = 0;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		std::vector<Image> images;
+		std::vector<Pass> passes;
+		std::vector<Heap> heaps;
+		Barriers exportBarriers;
+		Statistics statistics;
+		bool compiled = false;
+
+		void cullPasses();
+		void computeLifetimes();
+		void createImages();
+		void allocateMemory();
+		void createRenderPasses();
+		void buildBarriers();
+		void recordBarriers(VkCommandBuffer commandBuffer, const Barriers& barriers) const;
+		/** @brief Frees all GPU objects but keeps the declared passes and images */
+		void release();
+	public:
+		explicit RenderGraph(vks::VulkanDevice* device);
+		~RenderGraph();
+
+		/** @brief Declares an image that is owned (and aliased) by the graph */
+		ImageHandle addImage(const std::string& name, VkFormat format, uint32_t width, uint32_t height);
+		/** @brief Adds a pass, passes are executed in the order they have been added */
+		PassHandle addPass(const std::string& name, RecordFunction record);
+		/** @brief Pass renders to the image as a color attachment, attachments are numbered in the order they are added */
+		void writeColor(PassHandle pass, ImageHandle image, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, VkClearColorValue clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } });
+		/** @brief Pass uses the image as its depth (stencil) attachment */
+		void writeDepth(PassHandle pass, ImageHandle image, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, VkClearDepthStencilValue clearDepthStencil = { 1.0f, 0 });
+		/** @brief Pass samples the image in its fragment shader */
+		void read(PassHandle pass, ImageHandle image);
+		/** @brief Exported images are kept alive until the end of the graph and can be sampled by passes outside of the graph */
+		void setExported(ImageHandle image, bool exported);
+		/** @brief Additional usage of an exported image outside of the graph, e.g. VK_IMAGE_USAGE_TRANSFER_SRC_BIT to copy from it after execution */
+		void addExternalUsage(ImageHandle image, VkImageUsageFlags usage);
+
+		/**
+		* Culls unused passes and creates all images, memory, render passes and framebuffers
+		* @note Can be called again after changing the exported images, the caller has to make sure the GPU objects of the previous compilation are no longer in use
+		*/
+		void compile();
+		/** @brief Records all passes that survived culling */
+		void execute(VkCommandBuffer commandBuffer) const;
+		/** @brief Destroys all GPU objects and declarations */
+		void destroy();
+
+		bool isCulled(PassHandle pass) const;
+		/**
+		* Render pass of a pass for pipeline creation
+		* @note Render passes are also created for culled passes, so pipelines can be created independent of the current culling state
+		*/
+		VkRenderPass getRenderPass(PassHandle pass) const;
+		/** @brief Image view of an image, VK_NULL_HANDLE if the image is not used by any pass that survived culling */
+		VkImageView getView(ImageHandle image) const;
+		/** @brief Image of an image handle, VK_NULL_HANDLE if the image is not used by any pass that survived culling */
+		VkImage getImage(ImageHandle image) const;
+		/** @brief Layout an exported image is left in after execution */
+		VkImageLayout getReadLayout(ImageHandle image) const;
+		const Statistics& getStatistics() const;
+	};
+}
@@ -0,0 +1,261 @@
+/*
+* Vulkan sort-key render queue
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanRenderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "threadpool.hpp"
+
+namespace vks
+{
+	namespace
+	{
+		const uint32_t depthBits = 28;
+		const uint32_t pipelineBits = 12;
+		const uint32_t materialBits = 20;
+		const uint32_t radixBits = 8;
+		const uint32_t radixSize = 1 << radixBits;
+
+		template<typename T>
+		uint64_t handleValue(T handle)
+		{
+			return (uint64_t)handle;
+		}
+
+		uint32_t denseId(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t value, uint32_t bits)
+		{
+			auto it = ids.find(value);
+			if (it != ids.end()) {
+				return it->second;
+			}
+			// Ids wrap around if a frame uses more distinct values than the key has room for, which only degrades batching
+			const uint32_t id = static_cast<uint32_t>(ids.size()) & ((1u << bits) - 1);
+			ids[value] = id;
+			return id;
+		}
+	}
+
+	RenderQueue::RenderQueue(uint32_t threadCount)
+	{
+		this->threadCount = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+		if (this->threadCount > 1) {
+			threadPool = std::make_unique<vks::ThreadPool>();
+			threadPool->setThreadCount(this->threadCount);
+		}
+	}
+
+	RenderQueue::~RenderQueue() = default;
+
+	void RenderQueue::begin(float zNear, float zFar)
+	{
+		this->zNear = zNear;
+		this->zFar = zFar;
+		packets.clear();
+		entries.clear();
+		pushConstantArena.clear();
+		pipelineIds.clear();
+		materialIds.clear();
+	}
+
+	uint64_t RenderQueue::makeKey(RenderBucket bucket, uint32_t pipelineId, uint32_t materialId, float depth)
+	{
+		const uint64_t depthMask = (1ull << depthBits) - 1;
+		const uint64_t quantizedDepth = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(depthMask)) & depthMask;
+		const uint64_t pipeline = pipelineId & ((1u << pipelineBits) - 1);
+		const uint64_t material = materialId & ((1u << materialBits) - 1);
+		uint64_t key = static_cast<uint64_t>(bucket) << 60;
+		if (bucket == RenderBucket::AlphaBlend || bucket == RenderBucket::Overlay) {
+			// Back-to-front, state only breaks ties
+			key |= (depthMask - quantizedDepth) << 32;
+			key |= pipeline << 20;
+			key |= material;
+		} else {
+			// State first to minimize binds, front-to-back within each run to maximize early depth rejection
+			key |= pipeline << 48;
+			key |= material << 28;
+			key |= quantizedDepth;
+		}
+		return key;
+	}
+
+	DrawPacket& RenderQueue::push(RenderBucket bucket, float viewDepth, const DrawPacket& packet)
+	{
+		uint64_t materialHash = 0;
+		for (uint32_t i = 0; i < DrawPacket::maxDescriptorSets; i++) {
+			materialHash = (materialHash ^ handleValue(packet.descriptorSets[i])) * 0x100000001b3ull;
+		}
+		const uint32_t pipelineId = denseId(pipelineIds, handleValue(packet.pipeline), pipelineBits);
+		const uint32_t materialId = denseId(materialIds, materialHash, materialBits);
+		const float depth = (viewDepth - zNear) / (zFar - zNear);
+		entries.push_back({ makeKey(bucket, pipelineId, materialId, depth), static_cast<uint32_t>(packets.size()) });
+		packets.push_back(packet);
+		return packets.back();
+	}
+
+	uint32_t RenderQueue::pushConstants(const void* data, uint32_t size)
+	{
+		const uint32_t offset = static_cast<uint32_t>(pushConstantArena.size());
+		pushConstantArena.resize(offset + size);
+		memcpy(pushConstantArena.data() + offset, data, size);
+		return offset;
+	}
+
+	uint32_t RenderQueue::size() const
+	{
+		return static_cast<uint32_t>(packets.size());
+	}
+
+	bool RenderQueue::empty() const
+	{
+		return packets.empty();
+	}
+
+	template<typename F>
+	void RenderQueue::parallelFor(uint32_t jobCount, F&& function)
+	{
+		if (jobCount == 1) {
+			function(0);
+			return;
+		}
+		for (uint32_t i = 0; i < jobCount; i++) {
+			threadPool->threads[i]->addJob([&function, i] { function(i); });
+		}
+		threadPool->wait();
+	}
+
+	/*
+		Least significant digit radix sort over 8 bit digits
+		Every pass builds one histogram per job, turns them into per job scatter offsets and scatters each job's range in order, which keeps the sort stable
+		Passes where all keys share the same digit (e.g. the bucket bits in a single bucket queue) are skipped
+	*/
+	void RenderQueue::radixSort()
+	{
+		const size_t count = entries.size();
+		const uint32_t jobCount = (count < parallelSortThreshold || !threadPool) ? 1 : threadCount;
+		const size_t jobSize = (count + jobCount - 1) / jobCount;
+		scratch.resize(count);
+		histograms.resize(jobCount * radixSize);
+
+		SortEntry* src = entries.data();
+		SortEntry* dst = scratch.data();
+
+		for (uint32_t shift = 0; shift < 64; shift += radixBits) {
+			parallelFor(jobCount, [&](uint32_t job) {
+				uint32_t* histogram = &histograms[job * radixSize];
+				std::fill(histogram, histogram + radixSize, 0);
+				const size_t end = std::min(count, (job + 1) * jobSize);
+				for (size_t i = job * jobSize; i < end; i++) {
+					histogram[(src[i].key >> shift) & (radixSize - 1)]++;
+				}
+			});
+
+			// Convert the histograms into exclusive scatter offsets, ordered by digit first and job second
+			bool uniform = false;
+			uint32_t offset = 0;
+			for (uint32_t digit = 0; digit < radixSize; digit++) {
+				uint32_t digitCount = 0;
+				for (uint32_t job = 0; job < jobCount; job++) {
+					uint32_t& value = histograms[job * radixSize + digit];
+					const uint32_t jobDigitCount = value;
+					value = offset;
+					offset += jobDigitCount;
+					digitCount += jobDigitCount;
+				}
+				if (digitCount == count) {
+					uniform = true;
+					break;
+				}
+			}
+			if (uniform) {
+				continue;
+			}
+
+			parallelFor(jobCount, [&](uint32_t job) {
+				uint32_t* offsets = &histograms[job * radixSize];
+				const size_t end = std::min(count, (job + 1) * jobSize);
+				for (size_t i = job * jobSize; i < end; i++) {
+					dst[offsets[(src[i].key >> shift) & (radixSize - 1)]++] = src[i];
+				}
+			});
+			std::swap(src, dst);
+		}
+
+		if (src != entries.data()) {
+			entries.swap(scratch);
+		}
+	}
+
+	void RenderQueue::sort()
+	{
+		if (entries.size() > 1) {
+			radixSort();
+		}
+	}
+
+	void RenderQueue::record(VkCommandBuffer commandBuffer)
+	{
+		stats = {};
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+		VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+		VkDescriptorSet boundSets[DrawPacket::maxDescriptorSets] = {};
+		VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+		VkDeviceSize boundVertexBufferOffset = 0;
+		VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+		VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
+		const DrawPacket* lastPushConstants = nullptr;
+
+		for (const SortEntry& entry : entries) {
+			const DrawPacket& packet = packets[entry.index];
+			if (packet.pipeline != boundPipeline) {
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline);
+				boundPipeline = packet.pipeline;
+				stats.pipelineBinds++;
+			}
+			if (packet.pipelineLayout != boundLayout) {
+				// Sets bound with a different layout may get disturbed, so don't rely on them
+				std::fill(std::begin(boundSets), std::end(boundSets), VkDescriptorSet(VK_NULL_HANDLE));
+				boundLayout = packet.pipelineLayout;
+				lastPushConstants = nullptr;
+			}
+			for (uint32_t set = 0; set < DrawPacket::maxDescriptorSets; set++) {
+				if ((packet.descriptorSets[set] != VK_NULL_HANDLE) && (packet.descriptorSets[set] != boundSets[set])) {
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipelineLayout, set, 1, &packet.descriptorSets[set], 0, nullptr);
+					boundSets[set] = packet.descriptorSets[set];
+					stats.descriptorSetBinds++;
+				}
+			}
+			if ((packet.vertexBuffer != boundVertexBuffer) || (packet.vertexBufferOffset != boundVertexBufferOffset)) {
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &packet.vertexBuffer, &packet.vertexBufferOffset);
+				boundVertexBuffer = packet.vertexBuffer;
+				boundVertexBufferOffset = packet.vertexBufferOffset;
+				stats.vertexBufferBinds++;
+			}
+			if ((packet.indexBuffer != boundIndexBuffer) || (packet.indexType != boundIndexType)) {
+				vkCmdBindIndexBuffer(commandBuffer, packet.indexBuffer, 0, packet.indexType);
+				boundIndexBuffer = packet.indexBuffer;
+				boundIndexType = packet.indexType;
+				stats.indexBufferBinds++;
+			}
+			if (packet.pushConstantSize > 0) {
+				const bool changed = !lastPushConstants ||
+					(lastPushConstants->pushConstantStages != packet.pushConstantStages) ||
+					(lastPushConstants->pushConstantSize != packet.pushConstantSize) ||
+					(memcmp(&pushConstantArena[lastPushConstants->pushConstantOffset], &pushConstantArena[packet.pushConstantOffset], packet.pushConstantSize) != 0);
+				if (changed) {
+					vkCmdPushConstants(commandBuffer, packet.pipelineLayout, packet.pushConstantStages, 0, packet.pushConstantSize, &pushConstantArena[packet.pushConstantOffset]);
+					lastPushConstants = &packet;
+					stats.pushConstantUpdates++;
+				}
+			}
+			vkCmdDrawIndexed(commandBuffer, packet.indexCount, packet.instanceCount, packet.firstIndex, packet.vertexOffset, packet.firstInstance);
+			stats.draws++;
+		}
+	}
+}
@@ -0,0 +1,120 @@
+/*
+* Vulkan sort-key render queue
+*
+* Collects draw packets tagged with 64-bit sort keys, orders them with a (parallel) radix sort
+* and records them with redundant state changes removed
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class ThreadPool;
+
+	/** @brief Coarse ordering of the queue, buckets are always recorded in this order */
+	enum class RenderBucket : uint32_t {
+		Opaque = 0,
+		AlphaMask = 1,
+		AlphaBlend = 2,
+		Overlay = 3
+	};
+
+	/**
+	* @brief A single indexed draw including all state it requires
+	* @note Descriptor sets are stored by set number, VK_NULL_HANDLE entries leave the set untouched
+	*/
+	struct DrawPacket
+	{
+		static const uint32_t maxDescriptorSets = 4;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSets[maxDescriptorSets] = {};
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		VkDeviceSize vertexBufferOffset = 0;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+		uint32_t indexCount = 0;
+		uint32_t instanceCount = 1;
+		uint32_t firstIndex = 0;
+		int32_t vertexOffset = 0;
+		uint32_t firstInstance = 0;
+		/** @brief Push constant data is stored in the queue's arena, see RenderQueue::pushConstants */
+		VkShaderStageFlags pushConstantStages = 0;
+		uint32_t pushConstantOffset = 0;
+		uint32_t pushConstantSize = 0;
+	};
+
+	/**
+	* @brief Sort-key based render queue
+	*
+	* Key layout for opaque and alpha masked buckets (front-to-back within a pipeline/material run):
+	*   [63..60] bucket | [59..48] pipeline | [47..28] material | [27..0] depth
+	* Key layout for blended and overlay buckets (strictly back-to-front):
+	*   [63..60] bucket | [59..32] inverted depth | [31..20] pipeline | [19..0] material
+	*/
+	class RenderQueue
+	{
+	private:
+		struct SortEntry {
+			uint64_t key;
+			uint32_t index;
+		};
+		std::vector<DrawPacket> packets;
+		std::vector<SortEntry> entries;
+		std::vector<SortEntry> scratch;
+		std::vector<uint8_t> pushConstantArena;
+		std::vector<uint32_t> histograms;
+		std::unordered_map<uint64_t, uint32_t> pipelineIds;
+		std::unordered_map<uint64_t, uint32_t> materialIds;
+		std::unique_ptr<vks::ThreadPool> threadPool;
+		uint32_t threadCount = 1;
+		float zNear = 0.1f;
+		float zFar = 256.0f;
+		void radixSort();
+		template<typename F> void parallelFor(uint32_t jobCount, F&& function);
+	public:
+		/** @brief Number of packets below which sorting stays on the calling thread */
+		uint32_t parallelSortThreshold = 4096;
+
+		/** @brief Statistics of the last record call */
+		struct Statistics {
+			uint32_t draws = 0;
+			uint32_t pipelineBinds = 0;
+			uint32_t descriptorSetBinds = 0;
+			uint32_t vertexBufferBinds = 0;
+			uint32_t indexBufferBinds = 0;
+			uint32_t pushConstantUpdates = 0;
+		} stats;
+
+		/** @brief Creates the queue, a thread count of zero uses the number of hardware threads */
+		explicit RenderQueue(uint32_t threadCount = 0);
+		~RenderQueue();
+
+		/** @brief Clears all packets, depth values passed to push are normalized against the given clip range */
+		void begin(float zNear, float zFar);
+		/** @brief Adds a packet and computes its sort key from the bucket, its pipeline, its descriptor sets and the linear view space depth */
+		DrawPacket& push(RenderBucket bucket, float viewDepth, const DrawPacket& packet);
+		/** @brief Copies push constant data into the queue's arena and returns the offset to be stored in the packet */
+		uint32_t pushConstants(const void* data, uint32_t size);
+		/** @brief Sorts all packets by key */
+		void sort();
+		/** @brief Records the sorted packets into the given command buffer, only state that differs from the previous packet is bound */
+		void record(VkCommandBuffer commandBuffer);
+		uint32_t size() const;
+		bool empty() const;
+
+		static uint64_t makeKey(RenderBucket bucket, uint32_t pipelineId, uint32_t materialId, float depth);
+	};
+}
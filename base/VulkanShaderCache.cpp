@@ -0,0 +1,329 @@
+/*
+* Shader module cache
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanShaderCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "VulkanTools.h"
+#include "VulkanTrace.h"
+
+namespace vks
+{
+	namespace
+	{
+		struct ArchiveHeader {
+			char magic[4];
+			uint32_t version;
+			uint32_t entryCount;
+			uint32_t reserved;
+		};
+
+		struct ArchiveEntryHeader {
+			uint32_t nameOffset;
+			uint32_t nameLength;
+			uint32_t dataOffset;
+			uint32_t dataSize;
+		};
+
+		const uint32_t archiveVersion = 1;
+
+		// FNV-1a over 32 bit words, SPIR-V is always a multiple of four bytes
+		uint64_t hashCode(const uint32_t* code, size_t size)
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size / sizeof(uint32_t); i++) {
+				hash ^= code[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		std::string normalizePath(std::string path)
+		{
+			std::replace(path.begin(), path.end(), '\\', '/');
+			return path;
+		}
+	}
+
+	ShaderCache::~ShaderCache()
+	{
+		destroy();
+	}
+
+	void ShaderCache::setDevice(VkDevice device)
+	{
+		this->device = device;
+	}
+
+#if defined(__ANDROID__)
+	void ShaderCache::setAssetManager(AAssetManager* assetManager)
+	{
+		this->assetManager = assetManager;
+	}
+#endif
+
+	bool ShaderCache::openArchive(const std::string& fileName, const std::string& rootPath)
+	{
+		VKS_TRACE_FUNCTION();
+		closeArchive();
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!data) {
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			return false;
+		}
+		archiveFile = file;
+		archiveMapping = mapping;
+		archiveData = data;
+		archiveSize = static_cast<size_t>(fileSize.QuadPart);
+#elif defined(__ANDROID__)
+		// Assets are compressed inside the apk and can't be mapped, shaders are always read from their files
+		return false;
+#else
+		int file = open(fileName.c_str(), O_RDONLY);
+		if (file < 0) {
+			return false;
+		}
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+			close(file);
+			return false;
+		}
+		void* data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		// The mapping stays valid after the file has been closed
+		close(file);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+		archiveData = data;
+		archiveSize = static_cast<size_t>(fileStat.st_size);
+#endif
+
+		const uint8_t* bytes = static_cast<const uint8_t*>(archiveData);
+		const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(bytes);
+		if (archiveSize < sizeof(ArchiveHeader) || memcmp(header->magic, "VKSP", 4) != 0 || header->version != archiveVersion
+			|| archiveSize < sizeof(ArchiveHeader) + static_cast<size_t>(header->entryCount) * sizeof(ArchiveEntryHeader)) {
+			std::cerr << "Error: Invalid shader archive \"" << fileName << "\"\n";
+			closeArchive();
+			return false;
+		}
+		const ArchiveEntryHeader* entries = reinterpret_cast<const ArchiveEntryHeader*>(bytes + sizeof(ArchiveHeader));
+		for (uint32_t i = 0; i < header->entryCount; i++) {
+			const ArchiveEntryHeader& entry = entries[i];
+			if (static_cast<size_t>(entry.nameOffset) + entry.nameLength > archiveSize || static_cast<size_t>(entry.dataOffset) + entry.dataSize > archiveSize
+				|| (entry.dataOffset % sizeof(uint32_t)) != 0 || (entry.dataSize % sizeof(uint32_t)) != 0) {
+				std::cerr << "Error: Invalid entry in shader archive \"" << fileName << "\"\n";
+				closeArchive();
+				return false;
+			}
+			const std::string name(reinterpret_cast<const char*>(bytes + entry.nameOffset), entry.nameLength);
+			archiveEntries[name] = { reinterpret_cast<const uint32_t*>(bytes + entry.dataOffset), entry.dataSize };
+		}
+		archiveRoot = normalizePath(rootPath);
+		return true;
+	}
+
+	void ShaderCache::closeArchive()
+	{
+		archiveEntries.clear();
+		if (!archiveData) {
+			return;
+		}
+#if defined(_WIN32)
+		UnmapViewOfFile(archiveData);
+		CloseHandle(archiveMapping);
+		CloseHandle(archiveFile);
+		archiveMapping = nullptr;
+		archiveFile = nullptr;
+#elif !defined(__ANDROID__)
+		munmap(archiveData, archiveSize);
+#endif
+		archiveData = nullptr;
+		archiveSize = 0;
+	}
+
+	bool ShaderCache::findArchiveEntry(const std::string& fileName, ArchiveEntry& entry) const
+	{
+		if (archiveEntries.empty()) {
+			return false;
+		}
+		const std::string path = normalizePath(fileName);
+		if (path.compare(0, archiveRoot.size(), archiveRoot) != 0) {
+			return false;
+		}
+		auto it = archiveEntries.find(path.substr(archiveRoot.size()));
+		if (it == archiveEntries.end()) {
+			return false;
+		}
+		entry = it->second;
+		return true;
+	}
+
+	bool ShaderCache::readFile(const std::string& fileName, std::vector<uint32_t>& code) const
+	{
+#if defined(__ANDROID__)
+		AAsset* asset = AAssetManager_open(assetManager, fileName.c_str(), AASSET_MODE_STREAMING);
+		if (!asset) {
+			return false;
+		}
+		const size_t size = AAsset_getLength(asset);
+		code.resize((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+		AAsset_read(asset, code.data(), size);
+		AAsset_close(asset);
+		return size > 0;
+#else
+		std::ifstream is(fileName, std::ios::binary | std::ios::in | std::ios::ate);
+		if (!is.is_open()) {
+			return false;
+		}
+		const size_t size = is.tellg();
+		is.seekg(0, std::ios::beg);
+		// Read straight into the word buffer, so the code is aligned as required by vkCreateShaderModule
+		code.resize((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+		is.read(reinterpret_cast<char*>(code.data()), size);
+		return size > 0;
+#endif
+	}
+
+	VkShaderModule ShaderCache::getModule(const std::string& fileName)
+	{
+		VKS_TRACE_FUNCTION();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = fileModules.find(fileName);
+			if (it != fileModules.end()) {
+				statistics.hits++;
+				return it->second;
+			}
+		}
+
+		// Loading and module creation are done without holding the lock, so multiple threads can load shaders concurrently
+		ArchiveEntry entry{};
+		std::vector<uint32_t> code;
+		const bool fromArchive = findArchiveEntry(fileName, entry);
+		if (!fromArchive) {
+			if (!readFile(fileName, code)) {
+				std::cerr << "Error: Could not open shader file \"" << fileName << "\"" << "\n";
+				return VK_NULL_HANDLE;
+			}
+			entry = { code.data(), code.size() * sizeof(uint32_t) };
+		}
+
+		bool created = false;
+		VkShaderModule shaderModule = findOrCreateModule(entry.code, entry.size, created);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (fromArchive) {
+			statistics.archiveLoads++;
+		} else {
+			statistics.fileLoads++;
+		}
+		if (!created) {
+			statistics.duplicates++;
+		}
+		fileModules[fileName] = shaderModule;
+		return shaderModule;
+	}
+
+	VkShaderModule ShaderCache::getModule(const uint32_t* code, size_t size)
+	{
+		bool created = false;
+		return findOrCreateModule(code, size, created);
+	}
+
+	VkShaderModule ShaderCache::findOrCreateModule(const uint32_t* code, size_t size, bool& created)
+	{
+		assert(device != VK_NULL_HANDLE);
+		// Modules are matched by hash and size, a collision of both for different code is not a practical concern
+		const uint64_t hash = hashCode(code, size);
+		auto findModule = [&]() -> VkShaderModule {
+			auto it = contentModules.find(hash);
+			if (it != contentModules.end()) {
+				for (auto& module : it->second) {
+					if (module.first == size) {
+						return module.second;
+					}
+				}
+			}
+			return VK_NULL_HANDLE;
+		};
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			VkShaderModule shaderModule = findModule();
+			if (shaderModule != VK_NULL_HANDLE) {
+				created = false;
+				return shaderModule;
+			}
+		}
+
+		VkShaderModuleCreateInfo moduleCreateInfo{};
+		moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleCreateInfo.codeSize = size;
+		moduleCreateInfo.pCode = code;
+		VkShaderModule shaderModule;
+		VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, nullptr, &shaderModule));
+
+		std::lock_guard<std::mutex> lock(mutex);
+		// Another thread may have created a module for the same code in the meantime
+		VkShaderModule existingModule = findModule();
+		if (existingModule != VK_NULL_HANDLE) {
+			vkDestroyShaderModule(device, shaderModule, nullptr);
+			created = false;
+			return existingModule;
+		}
+		contentModules[hash].push_back({ size, shaderModule });
+		modules.push_back(shaderModule);
+		created = true;
+		return shaderModule;
+	}
+
+	void ShaderCache::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (VkShaderModule shaderModule : modules) {
+			vkDestroyShaderModule(device, shaderModule, nullptr);
+		}
+		modules.clear();
+		fileModules.clear();
+		contentModules.clear();
+		closeArchive();
+	}
+
+	ShaderCache::Statistics ShaderCache::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return statistics;
+	}
+}
@@ -0,0 +1,103 @@
+/*
+* Shader module cache
+*
+* Creates each SPIR-V shader module only once, deduplicated by file name and by content, optionally reading the
+* SPIR-V from a single memory mapped archive instead of individual files
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#if defined(__ANDROID__)
+#include <android/asset_manager.h>
+#endif
+
+namespace vks
+{
+	/**
+	* @brief Owns all shader modules loaded through it, modules are destroyed with the cache
+	*
+	* Shader archives are created with data/shaders/packshaders.py and contain all .spv files below the asset directory,
+	* stored by their path relative to it. Layout (little endian):
+	*   Header                    magic "VKSP", version, entry count, reserved
+	*   Entry[entry count]        name offset, name length, data offset, data size (offsets from the start of the file)
+	*   Names and SPIR-V data     SPIR-V data is 16 byte aligned, so modules are created straight from the mapping
+	*/
+	class ShaderCache
+	{
+	public:
+		struct Statistics {
+			/** @brief Requests answered from the cache without any I/O */
+			uint32_t hits = 0;
+			uint32_t archiveLoads = 0;
+			uint32_t fileLoads = 0;
+			/** @brief Loads whose content matched an already created module (e.g. the same shader stored twice) */
+			uint32_t duplicates = 0;
+		};
+
+		ShaderCache() = default;
+		ShaderCache(const ShaderCache&) = delete;
+		ShaderCache& operator=(const ShaderCache&) = delete;
+		~ShaderCache();
+
+		void setDevice(VkDevice device);
+#if defined(__ANDROID__)
+		void setAssetManager(AAssetManager* assetManager);
+#endif
+		/**
+		* Maps a shader archive, shaders found in it are no longer read from their files
+		* @param fileName Archive file
+		* @param rootPath Path the names stored in the archive are relative to (i.e. the asset path)
+		* @return False if the archive could not be opened or is invalid, shaders are then loaded from files
+		*/
+		bool openArchive(const std::string& fileName, const std::string& rootPath);
+		/** @return Shader module for the given file, VK_NULL_HANDLE if the file could not be found */
+		VkShaderModule getModule(const std::string& fileName);
+		/** @return Shader module for the given SPIR-V code, code is only read and can be freed afterwards */
+		VkShaderModule getModule(const uint32_t* code, size_t size);
+		/** @brief Destroys all modules and unmaps the archive */
+		void destroy();
+		Statistics getStatistics() const;
+
+	private:
+		struct ArchiveEntry {
+			const uint32_t* code;
+			size_t size;
+		};
+		VkDevice device = VK_NULL_HANDLE;
+#if defined(__ANDROID__)
+		AAssetManager* assetManager = nullptr;
+#endif
+		mutable std::mutex mutex;
+		std::unordered_map<std::string, VkShaderModule> fileModules;
+		// Content hash and size of the SPIR-V
+		std::unordered_map<uint64_t, std::vector<std::pair<size_t, VkShaderModule>>> contentModules;
+		std::vector<VkShaderModule> modules;
+		Statistics statistics;
+
+		std::string archiveRoot;
+		std::unordered_map<std::string, ArchiveEntry> archiveEntries;
+		void* archiveData = nullptr;
+		size_t archiveSize = 0;
+#if defined(_WIN32)
+		void* archiveFile = nullptr;
+		void* archiveMapping = nullptr;
+#endif
+
+		void closeArchive();
+		bool findArchiveEntry(const std::string& fileName, ArchiveEntry& entry) const;
+		bool readFile(const std::string& fileName, std::vector<uint32_t>& code) const;
+		VkShaderModule findOrCreateModule(const uint32_t* code, size_t size, bool& created);
+	};
+}
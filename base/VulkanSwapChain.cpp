@@ -231,6 +231,11 @@ void VulkanSwapChain::connect(VkInstance instance, VkPhysicalDevice physicalDevi
 */
 void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync, bool fullscreen)
 {
+	if (offscreen) {
+		createOffscreenImages(*width, *height);
+		return;
+	}
+
 	// Store the current swap chain handle so we can use it later on to ease up recreation
 	VkSwapchainKHR oldSwapchain = swapChain;
 
@@ -381,34 +386,7 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync, bool
 	images.resize(imageCount);
 	VK_CHECK_RESULT(fpGetSwapchainImagesKHR(device, swapChain, &imageCount, images.data()));
 
-	// Get the swap chain buffers containing the image and imageview
-	buffers.resize(imageCount);
-	for (uint32_t i = 0; i < imageCount; i++)
-	{
-		VkImageViewCreateInfo colorAttachmentView = {};
-		colorAttachmentView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		colorAttachmentView.pNext = NULL;
-		colorAttachmentView.format = colorFormat;
-		colorAttachmentView.components = {
-			VK_COMPONENT_SWIZZLE_R,
-			VK_COMPONENT_SWIZZLE_G,
-			VK_COMPONENT_SWIZZLE_B,
-			VK_COMPONENT_SWIZZLE_A
-		};
-		colorAttachmentView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		colorAttachmentView.subresourceRange.baseMipLevel = 0;
-		colorAttachmentView.subresourceRange.levelCount = 1;
-		colorAttachmentView.subresourceRange.baseArrayLayer = 0;
-		colorAttachmentView.subresourceRange.layerCount = 1;
-		colorAttachmentView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		colorAttachmentView.flags = 0;
-
-		buffers[i].image = images[i];
-
-		colorAttachmentView.image = buffers[i].image;
-
-		VK_CHECK_RESULT(vkCreateImageView(device, &colorAttachmentView, nullptr, &buffers[i].view));
-	}
+	createImageViews();
 }
 
 /** 
@@ -423,6 +401,18 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync, bool
 */
 VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t *imageIndex)
 {
+	if (offscreen) {
+		// Images are used round robin, the semaphore is signaled right away as there is no presentation engine holding on to them
+		*imageIndex = offscreenImageIndex;
+		offscreenImageIndex = (offscreenImageIndex + 1) % imageCount;
+		if (presentCompleteSemaphore == VK_NULL_HANDLE) {
+			return VK_SUCCESS;
+		}
+		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &presentCompleteSemaphore;
+		return vkQueueSubmit(offscreenQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	}
 	// By setting timeout to UINT64_MAX we will always wait until the next image has been acquired or an actual error is thrown
 	// With that we don't have to handle VK_NOT_READY
 	return fpAcquireNextImageKHR(device, swapChain, UINT64_MAX, presentCompleteSemaphore, (VkFence)nullptr, imageIndex);
@@ -439,6 +429,18 @@ VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore,
 */
 VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore)
 {
+	if (offscreen) {
+		// Nothing is presented, but the semaphore still needs to be waited on so it can be signaled again by the next frame
+		if (waitSemaphore == VK_NULL_HANDLE) {
+			return VK_SUCCESS;
+		}
+		const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &waitSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	}
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.pNext = NULL;
@@ -460,6 +462,10 @@ VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSem
 */
 void VulkanSwapChain::cleanup()
 {
+	if (offscreen) {
+		destroyOffscreenImages();
+		return;
+	}
 	if (swapChain != VK_NULL_HANDLE)
 	{
 		for (uint32_t i = 0; i < imageCount; i++)
@@ -476,6 +482,121 @@ void VulkanSwapChain::cleanup()
 	swapChain = VK_NULL_HANDLE;
 }
 
+/**
+* Creates the image views for all swap chain (or offscreen) images
+*/
+void VulkanSwapChain::createImageViews()
+{
+	buffers.resize(imageCount);
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		VkImageViewCreateInfo colorAttachmentView = {};
+		colorAttachmentView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		colorAttachmentView.pNext = NULL;
+		colorAttachmentView.format = colorFormat;
+		colorAttachmentView.components = {
+			VK_COMPONENT_SWIZZLE_R,
+			VK_COMPONENT_SWIZZLE_G,
+			VK_COMPONENT_SWIZZLE_B,
+			VK_COMPONENT_SWIZZLE_A
+		};
+		colorAttachmentView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		colorAttachmentView.subresourceRange.baseMipLevel = 0;
+		colorAttachmentView.subresourceRange.levelCount = 1;
+		colorAttachmentView.subresourceRange.baseArrayLayer = 0;
+		colorAttachmentView.subresourceRange.layerCount = 1;
+		colorAttachmentView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		colorAttachmentView.flags = 0;
+
+		buffers[i].image = images[i];
+
+		colorAttachmentView.image = buffers[i].image;
+
+		VK_CHECK_RESULT(vkCreateImageView(device, &colorAttachmentView, nullptr, &buffers[i].view));
+	}
+}
+
+void VulkanSwapChain::initOffscreen(VkQueue queue, uint32_t queueFamilyIndex)
+{
+	offscreen = true;
+	offscreenQueue = queue;
+	queueNodeIndex = queueFamilyIndex;
+	colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	// Prefer the format most surfaces offer, so render passes and pipelines match the windowed version
+	colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, colorFormat, &formatProperties);
+	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) {
+		colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+bool VulkanSwapChain::isOffscreen() const
+{
+	return offscreen;
+}
+
+void VulkanSwapChain::createOffscreenImages(uint32_t width, uint32_t height)
+{
+	destroyOffscreenImages();
+
+	// Same number of images as a typical swapchain, so examples allocate the same number of per image resources
+	imageCount = 3;
+	offscreenImageIndex = 0;
+	images.resize(imageCount);
+	offscreenMemory.resize(imageCount);
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	for (uint32_t i = 0; i < imageCount; i++) {
+		VkImageCreateInfo imageCI = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = colorFormat;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// Same usage as swapchain images, including the transfer usages some examples rely on (e.g. screenshots)
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &images[i]));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, images[i], &memReqs);
+		VkMemoryAllocateInfo memAlloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = UINT32_MAX;
+		for (uint32_t j = 0; j < memoryProperties.memoryTypeCount; j++) {
+			if ((memReqs.memoryTypeBits & (1 << j)) && (memoryProperties.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+				memAlloc.memoryTypeIndex = j;
+				break;
+			}
+		}
+		if (memAlloc.memoryTypeIndex == UINT32_MAX) {
+			vks::tools::exitFatal("Could not find a memory type for the offscreen images!", -1);
+		}
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &offscreenMemory[i]));
+		VK_CHECK_RESULT(vkBindImageMemory(device, images[i], offscreenMemory[i], 0));
+	}
+
+	createImageViews();
+}
+
+void VulkanSwapChain::destroyOffscreenImages()
+{
+	for (uint32_t i = 0; i < images.size(); i++) {
+		vkDestroyImageView(device, buffers[i].view, nullptr);
+		vkDestroyImage(device, images[i], nullptr);
+		vkFreeMemory(device, offscreenMemory[i], nullptr);
+	}
+	images.clear();
+	buffers.clear();
+	offscreenMemory.clear();
+}
+
 #if defined(_DIRECT2DISPLAY)
 /**
 * Create direct to display surface
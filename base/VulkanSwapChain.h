@@ -38,7 +38,7 @@ private:
 	VkInstance instance;
 	VkDevice device;
 	VkPhysicalDevice physicalDevice;
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 	// Function pointers
 	PFN_vkGetPhysicalDeviceSurfaceSupportKHR fpGetPhysicalDeviceSurfaceSupportKHR;
 	PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR fpGetPhysicalDeviceSurfaceCapabilitiesKHR; 
@@ -49,6 +49,14 @@ private:
 	PFN_vkGetSwapchainImagesKHR fpGetSwapchainImagesKHR;
 	PFN_vkAcquireNextImageKHR fpAcquireNextImageKHR;
 	PFN_vkQueuePresentKHR fpQueuePresentKHR;
+	// Headless mode renders to plain images owned by this class instead of swapchain images
+	bool offscreen = false;
+	VkQueue offscreenQueue = VK_NULL_HANDLE;
+	std::vector<VkDeviceMemory> offscreenMemory;
+	uint32_t offscreenImageIndex = 0;
+	void createOffscreenImages(uint32_t width, uint32_t height);
+	void destroyOffscreenImages();
+	void createImageViews();
 public:
 	VkFormat colorFormat;
 	VkColorSpaceKHR colorSpace;
@@ -76,6 +84,12 @@ public:
 	void createDirect2DisplaySurface(uint32_t width, uint32_t height);
 #endif
 #endif
+	/**
+	* Uses offscreen images instead of a surface and a swapchain, e.g. for running without a window on CI machines with a software implementation like lavapipe
+	* Called instead of initSurface, the other functions then work on the offscreen images and nothing is presented
+	*/
+	void initOffscreen(VkQueue queue, uint32_t queueFamilyIndex);
+	bool isOffscreen() const;
 	void connect(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device);
 	void create(uint32_t* width, uint32_t* height, bool vsync = false, bool fullscreen = false);
 	VkResult acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex);
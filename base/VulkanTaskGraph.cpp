@@ -0,0 +1,204 @@
+/*
+* Startup task graph
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanTaskGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+
+#include "VulkanTrace.h"
+
+namespace vks
+{
+	TaskGraph::Task TaskGraph::add(const std::string& name, std::function<void()> function, const std::vector<Task>& dependencies, bool mainThread)
+	{
+		const Task task = static_cast<Task>(nodes.size());
+		Node node{};
+		node.name = name;
+		node.function = std::move(function);
+		node.dependencies = dependencies;
+		node.mainThread = mainThread;
+		nodes.push_back(std::move(node));
+		for (Task dependency : dependencies) {
+			// Dependencies always have to be added first, so the graph can't contain cycles
+			assert(dependency < task);
+			nodes[dependency].dependents.push_back(task);
+		}
+		return task;
+	}
+
+	void TaskGraph::execute(uint32_t threadCount)
+	{
+		VKS_TRACE_SCOPE("Execute task graph");
+		if (threadCount == 0) {
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		readyTasks.clear();
+		readyMainThreadTasks.clear();
+		finishedTasks = 0;
+		exception = nullptr;
+		for (Task task = 0; task < nodes.size(); task++) {
+			Node& node = nodes[task];
+			node.pendingDependencies = static_cast<uint32_t>(node.dependencies.size());
+			node.start = node.end = 0.0;
+			if (node.pendingDependencies == 0) {
+				(node.mainThread ? readyMainThreadTasks : readyTasks).push_back(task);
+			}
+		}
+
+		const auto startTime = std::chrono::steady_clock::now();
+		// No point in starting more workers than there are tasks that may run on them
+		const uint32_t workerCount = std::min(threadCount - 1, static_cast<uint32_t>(nodes.size()));
+		std::vector<std::thread> workers;
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers.emplace_back(&TaskGraph::workerLoop, this, i + 1, false, startTime);
+		}
+		workerLoop(0, true, startTime);
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		wallTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+
+	void TaskGraph::workerLoop(uint32_t thread, bool mainThread, std::chrono::steady_clock::time_point startTime)
+	{
+		if (!mainThread) {
+			VKS_TRACE_THREAD_NAME("Task graph worker");
+		}
+		const uint32_t taskCount = static_cast<uint32_t>(nodes.size());
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			condition.wait(lock, [&] { return finishedTasks == taskCount || !readyTasks.empty() || (mainThread && !readyMainThreadTasks.empty()); });
+			if (finishedTasks == taskCount) {
+				break;
+			}
+			// The calling thread prefers its own tasks, as no other thread can pick them up
+			std::deque<Task>& queue = (mainThread && !readyMainThreadTasks.empty()) ? readyMainThreadTasks : readyTasks;
+			const Task task = queue.front();
+			queue.pop_front();
+			Node& node = nodes[task];
+			const bool skip = (exception != nullptr);
+			lock.unlock();
+
+			node.thread = thread;
+			node.start = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			if (!skip) {
+				VKS_TRACE_SCOPE("Startup task");
+				try {
+					node.function();
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> exceptionLock(mutex);
+					if (!exception) {
+						exception = std::current_exception();
+					}
+				}
+			}
+			node.end = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+			lock.lock();
+			finishedTasks++;
+			for (Task dependent : node.dependents) {
+				Node& dependentNode = nodes[dependent];
+				if (--dependentNode.pendingDependencies == 0) {
+					(dependentNode.mainThread ? readyMainThreadTasks : readyTasks).push_back(dependent);
+				}
+			}
+			condition.notify_all();
+		}
+	}
+
+	std::vector<TaskGraph::Task> TaskGraph::getCriticalPath() const
+	{
+		// Tasks can only depend on tasks added before them, so the order they were added in is a topological order
+		std::vector<double> pathTime(nodes.size(), 0.0);
+		std::vector<int64_t> predecessor(nodes.size(), -1);
+		int64_t last = -1;
+		for (Task task = 0; task < nodes.size(); task++) {
+			const Node& node = nodes[task];
+			for (Task dependency : node.dependencies) {
+				if (pathTime[dependency] > pathTime[task]) {
+					pathTime[task] = pathTime[dependency];
+					predecessor[task] = dependency;
+				}
+			}
+			pathTime[task] += node.end - node.start;
+			if (last < 0 || pathTime[task] > pathTime[last]) {
+				last = task;
+			}
+		}
+		std::vector<Task> path;
+		for (int64_t task = last; task >= 0; task = predecessor[task]) {
+			path.push_back(static_cast<Task>(task));
+		}
+		std::reverse(path.begin(), path.end());
+		return path;
+	}
+
+	void TaskGraph::printReport(std::ostream& stream) const
+	{
+		std::ios state(nullptr);
+		state.copyfmt(stream);
+		stream << std::fixed << std::setprecision(2);
+		stream << "Startup tasks: " << nodes.size() << " tasks, " << getWallTime() << " ms (serial " << getSerialTime() << " ms, critical path " << getCriticalPathTime() << " ms)\n";
+
+		std::vector<Task> order(nodes.size());
+		for (Task task = 0; task < nodes.size(); task++) {
+			order[task] = task;
+		}
+		std::sort(order.begin(), order.end(), [this](Task a, Task b) { return nodes[a].start < nodes[b].start; });
+		stream << std::setw(10) << "start" << std::setw(10) << "ms" << std::setw(8) << "thread" << "  task\n";
+		for (Task task : order) {
+			const Node& node = nodes[task];
+			stream << std::setw(10) << node.start << std::setw(10) << node.end - node.start << std::setw(8) << node.thread << "  " << node.name << "\n";
+		}
+
+		stream << "Critical path:\n";
+		for (Task task : getCriticalPath()) {
+			const Node& node = nodes[task];
+			stream << std::setw(10) << node.end - node.start << " ms  " << node.name << "\n";
+		}
+		stream.copyfmt(state);
+	}
+
+	void TaskGraph::clear()
+	{
+		nodes.clear();
+		wallTime = 0.0;
+	}
+
+	double TaskGraph::getWallTime() const
+	{
+		return wallTime;
+	}
+
+	double TaskGraph::getCriticalPathTime() const
+	{
+		double time = 0.0;
+		for (Task task : getCriticalPath()) {
+			time += nodes[task].end - nodes[task].start;
+		}
+		return time;
+	}
+
+	double TaskGraph::getSerialTime() const
+	{
+		double time = 0.0;
+		for (const Node& node : nodes) {
+			time += node.end - node.start;
+		}
+		return time;
+	}
+}
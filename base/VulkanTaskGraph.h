@@ -0,0 +1,93 @@
+/*
+* Startup task graph
+*
+* Runs named tasks (asset loads, shader loads, pipeline creation, ...) with explicit dependencies concurrently on a set of
+* worker threads and reports the critical path that bounds the startup time
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vks
+{
+	/**
+	* @brief Dependency graph of tasks executed on a worker pool
+	*
+	* Tasks only start once all of their dependencies have finished, everything else may run concurrently. Tasks are responsible
+	* for the synchronization of the Vulkan objects they share: submissions and command buffers through vks::VulkanDevice are
+	* safe to use from tasks, descriptor pools, command pools and queues used directly are not.
+	* Tasks added with mainThread set are only run on the thread calling execute, e.g. for work touching the window or the swapchain.
+	*/
+	class TaskGraph
+	{
+	public:
+		typedef uint32_t Task;
+
+		/**
+		* Adds a task to the graph
+		* @param name Name used in the report
+		* @param function Work of the task
+		* @param dependencies Tasks that need to finish before this task is started
+		* @param mainThread If true, the task is run on the thread calling execute
+		* @return Handle that can be used as a dependency of tasks added later
+		*/
+		Task add(const std::string& name, std::function<void()> function, const std::vector<Task>& dependencies = {}, bool mainThread = false);
+		/**
+		* Runs all tasks and returns once they have finished, the calling thread works on tasks too
+		* @param threadCount Number of threads including the calling one, 0 uses all hardware threads, 1 runs the tasks serially
+		* @note Exceptions thrown by a task are rethrown after all running tasks have finished, tasks that were not started yet are skipped
+		*/
+		void execute(uint32_t threadCount = 0);
+		/** @brief Prints the timings of the last execution and the critical path (the chain of dependent tasks that bounds the total time) */
+		void printReport(std::ostream& stream = std::cout) const;
+		/** @brief Removes all tasks, e.g. to build a new graph after a previous one has been executed */
+		void clear();
+
+		/** @brief Durations of the last execution in ms */
+		double getWallTime() const;
+		double getCriticalPathTime() const;
+		/** @brief Sum of all task durations, i.e. the time a serial execution would take */
+		double getSerialTime() const;
+
+	private:
+		struct Node {
+			std::string name;
+			std::function<void()> function;
+			std::vector<Task> dependencies;
+			std::vector<Task> dependents;
+			bool mainThread = false;
+			uint32_t pendingDependencies = 0;
+			uint32_t thread = 0;
+			// Times in ms relative to the start of the execution
+			double start = 0.0;
+			double end = 0.0;
+		};
+		std::vector<Node> nodes;
+		double wallTime = 0.0;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<Task> readyTasks;
+		std::deque<Task> readyMainThreadTasks;
+		uint32_t finishedTasks = 0;
+		std::exception_ptr exception;
+
+		void workerLoop(uint32_t thread, bool mainThread, std::chrono::steady_clock::time_point startTime);
+		/** @return Tasks of the critical path, ordered from the first to the last */
+		std::vector<Task> getCriticalPath() const;
+	};
+}
@@ -0,0 +1,469 @@
+/*
+* Vulkan temporal anti-aliasing and upsampling
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanTemporalAA.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace vks
+{
+	namespace
+	{
+		// Jitter positions per output pixel, upsampling needs proportionally more to cover every output pixel
+		const uint32_t jitterPhasesPerPixel = 8;
+		const uint32_t workGroupSize = 8;
+
+		// Low discrepancy sequence, evenly distributes the jitter over a pixel for any number of frames
+		float halton(uint32_t index, uint32_t base)
+		{
+			float result = 0.0f;
+			float fraction = 1.0f;
+			while (index > 0) {
+				fraction /= (float)base;
+				result += fraction * (float)(index % base);
+				index /= base;
+			}
+			return result;
+		}
+	}
+
+	TemporalAA::~TemporalAA()
+	{
+		destroy();
+	}
+
+	VkRenderPass TemporalAA::getRenderPass() const
+	{
+		return renderPass;
+	}
+
+	glm::vec2 TemporalAA::getJitter() const
+	{
+		return jitter;
+	}
+
+	VkExtent2D TemporalAA::getRenderExtent() const
+	{
+		VkExtent2D extent;
+		extent.width = std::max(static_cast<uint32_t>(std::round(outputWidth * renderScale)), 1u);
+		extent.height = std::max(static_cast<uint32_t>(std::round(outputHeight * renderScale)), 1u);
+		return extent;
+	}
+
+	uint32_t TemporalAA::getJitterPhaseCount() const
+	{
+		return static_cast<uint32_t>(std::ceil(jitterPhasesPerPixel / (renderScale * renderScale)));
+	}
+
+	void TemporalAA::prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, VkRenderPass outputRenderPass, uint32_t width, uint32_t height)
+	{
+		assert(resolveShader.module != VK_NULL_HANDLE);
+		assert(presentShaders[0].module != VK_NULL_HANDLE && presentShaders[1].module != VK_NULL_HANDLE);
+		assert(renderScale > 0.0f && renderScale <= 1.0f);
+		this->device = device;
+		this->queue = queue;
+		outputWidth = width;
+		outputHeight = height;
+
+		// Bilinear filtering for the color target and the history, the velocity buffer is only fetched
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_LINEAR;
+		samplerCI.minFilter = VK_FILTER_LINEAR;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.maxLod = 1.0f;
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &linearSampler));
+		samplerCI.magFilter = VK_FILTER_NEAREST;
+		samplerCI.minFilter = VK_FILTER_NEAREST;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &nearestSampler));
+
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &paramsBuffer, sizeof(Params)));
+		VK_CHECK_RESULT(paramsBuffer.map());
+
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Binding 0: Color target (render resolution)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1: Velocity buffer (render resolution)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2: History (output resolution)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Binding 3: Resolved output
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// Binding 4: Frame parameters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.resolve));
+		VkDescriptorSetLayoutBinding presentBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+		descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(&presentBinding, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.present));
+
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.resolve, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSets.resolve));
+		allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.present, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSets.present));
+
+		createRenderPass();
+		createPipelines(pipelineCache, outputRenderPass);
+		createTargets();
+	}
+
+	void TemporalAA::createRenderPass()
+	{
+		VkAttachmentDescription attachmentDescription{};
+		attachmentDescription.format = colorFormat;
+		attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpassDescription{};
+		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpassDescription.colorAttachmentCount = 1;
+		subpassDescription.pColorAttachments = &colorReference;
+
+		// The resolve of the previous frame must have finished sampling before the target is written again
+		std::array<VkSubpassDependency, 2> dependencies{};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+		renderPassCI.attachmentCount = 1;
+		renderPassCI.pAttachments = &attachmentDescription;
+		renderPassCI.subpassCount = 1;
+		renderPassCI.pSubpasses = &subpassDescription;
+		renderPassCI.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassCI.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassCI, nullptr, &renderPass));
+	}
+
+	void TemporalAA::createPipelines(VkPipelineCache pipelineCache, VkRenderPass outputRenderPass)
+	{
+		// Resolve
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.resolve, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayouts.resolve));
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayouts.resolve, 0);
+		computePipelineCI.stage = resolveShader;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &computePipelineCI, nullptr, &pipelines.resolve));
+
+		// Present, the output has the size of the output render pass so the full texture is drawn
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(PushConstants), 0);
+		pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.present, 1);
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayouts.present));
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
+		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
+		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
+		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
+		VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
+		VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+
+		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayouts.present, outputRenderPass, 0);
+		pipelineCI.pVertexInputState = &emptyInputState;
+		pipelineCI.pInputAssemblyState = &inputAssemblyState;
+		pipelineCI.pRasterizationState = &rasterizationState;
+		pipelineCI.pColorBlendState = &colorBlendState;
+		pipelineCI.pMultisampleState = &multisampleState;
+		pipelineCI.pViewportState = &viewportState;
+		pipelineCI.pDepthStencilState = &depthStencilState;
+		pipelineCI.pDynamicState = &dynamicState;
+		pipelineCI.stageCount = static_cast<uint32_t>(presentShaders.size());
+		pipelineCI.pStages = presentShaders.data();
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.present));
+	}
+
+	void TemporalAA::createAttachment(uint32_t width, uint32_t height, VkImageUsageFlags usage, Attachment& attachment)
+	{
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = colorFormat;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = usage;
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &attachment.image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, attachment.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &attachment.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, attachment.image, attachment.memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = colorFormat;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		viewCI.image = attachment.image;
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &attachment.view));
+	}
+
+	void TemporalAA::destroyAttachment(Attachment& attachment)
+	{
+		vkDestroyImageView(device->logicalDevice, attachment.view, nullptr);
+		vkDestroyImage(device->logicalDevice, attachment.image, nullptr);
+		vkFreeMemory(device->logicalDevice, attachment.memory, nullptr);
+		attachment = Attachment();
+	}
+
+	void TemporalAA::createTargets()
+	{
+		const VkExtent2D renderExtent = getRenderExtent();
+		createAttachment(renderExtent.width, renderExtent.height, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, color);
+		// The output is written by the resolve, copied into the history and sampled by the present pass
+		createAttachment(outputWidth, outputHeight, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, output);
+		createAttachment(outputWidth, outputHeight, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, history);
+
+		VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+		framebufferCI.renderPass = renderPass;
+		framebufferCI.attachmentCount = 1;
+		framebufferCI.pAttachments = &color.view;
+		framebufferCI.width = renderExtent.width;
+		framebufferCI.height = renderExtent.height;
+		framebufferCI.layers = 1;
+		VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &framebufferCI, nullptr, &framebuffer));
+
+		// The output stays in the general layout for all its uses, the history is only left for the copy
+		// Its contents are never read before the first resolve (reset), so no clear is required
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vks::tools::setImageLayout(commandBuffer, output.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
+		vks::tools::setImageLayout(commandBuffer, history.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		device->flushCommandBuffer(commandBuffer, queue);
+
+		historyValid = false;
+		frameIndex = 0;
+		updateDescriptorSets();
+	}
+
+	void TemporalAA::destroyTargets()
+	{
+		vkDestroyFramebuffer(device->logicalDevice, framebuffer, nullptr);
+		framebuffer = VK_NULL_HANDLE;
+		destroyAttachment(color);
+		destroyAttachment(output);
+		destroyAttachment(history);
+		velocityView = VK_NULL_HANDLE;
+	}
+
+	void TemporalAA::updateDescriptorSets()
+	{
+		VkDescriptorImageInfo colorDescriptor = vks::initializers::descriptorImageInfo(linearSampler, color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkDescriptorImageInfo historyDescriptor = vks::initializers::descriptorImageInfo(linearSampler, history.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkDescriptorImageInfo outputStorageDescriptor = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, output.view, VK_IMAGE_LAYOUT_GENERAL);
+		VkDescriptorImageInfo outputDescriptor = vks::initializers::descriptorImageInfo(linearSampler, output.view, VK_IMAGE_LAYOUT_GENERAL);
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.resolve, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &colorDescriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.resolve, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &historyDescriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.resolve, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3, &outputStorageDescriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.resolve, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &paramsBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.present, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &outputDescriptor),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
+	void TemporalAA::setVelocityView(VkImageView view)
+	{
+		velocityView = view;
+		VkDescriptorImageInfo velocityDescriptor = vks::initializers::descriptorImageInfo(nearestSampler, velocityView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSets.resolve, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &velocityDescriptor);
+		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+		historyValid = false;
+	}
+
+	void TemporalAA::resize(uint32_t width, uint32_t height)
+	{
+		assert(renderScale > 0.0f && renderScale <= 1.0f);
+		outputWidth = width;
+		outputHeight = height;
+		destroyTargets();
+		createTargets();
+	}
+
+	void TemporalAA::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		destroyTargets();
+		paramsBuffer.destroy();
+		vkDestroyPipeline(device->logicalDevice, pipelines.resolve, nullptr);
+		vkDestroyPipeline(device->logicalDevice, pipelines.present, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, pipelineLayouts.resolve, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, pipelineLayouts.present, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayouts.resolve, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayouts.present, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+		vkDestroyRenderPass(device->logicalDevice, renderPass, nullptr);
+		vkDestroySampler(device->logicalDevice, linearSampler, nullptr);
+		vkDestroySampler(device->logicalDevice, nearestSampler, nullptr);
+		pipelines = {};
+		pipelineLayouts = {};
+		descriptorSetLayouts = {};
+		descriptorSets = {};
+		descriptorPool = VK_NULL_HANDLE;
+		renderPass = VK_NULL_HANDLE;
+		linearSampler = VK_NULL_HANDLE;
+		nearestSampler = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	void TemporalAA::getRenderPassBeginInfo(VkRenderPassBeginInfo& renderPassBeginInfo, VkViewport& viewport, VkRect2D& scissor) const
+	{
+		const VkExtent2D extent = getRenderExtent();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = framebuffer;
+		renderPassBeginInfo.renderArea.offset = { 0, 0 };
+		renderPassBeginInfo.renderArea.extent = extent;
+		viewport = vks::initializers::viewport((float)extent.width, (float)extent.height, 0.0f, 1.0f);
+		scissor = vks::initializers::rect2D(extent.width, extent.height, 0, 0);
+	}
+
+	void TemporalAA::nextFrame()
+	{
+		const VkExtent2D renderExtent = getRenderExtent();
+		const glm::vec2 renderSize = glm::vec2((float)renderExtent.width, (float)renderExtent.height);
+		frameIndex = (frameIndex + 1) % getJitterPhaseCount();
+		// Offset in pixels of the render resolution, centered around the pixel center
+		glm::vec2 jitterPixels = glm::vec2(0.0f);
+		if (enabled) {
+			jitterPixels = glm::vec2(halton(frameIndex + 1, 2), halton(frameIndex + 1, 3)) - 0.5f;
+		}
+		jitter = jitterPixels * 2.0f / renderSize;
+
+		Params params{};
+		params.jitter = glm::vec4(jitterPixels / renderSize, 0.0f, 0.0f);
+		params.renderSize = glm::vec4(renderSize, 1.0f / renderSize);
+		params.outputSize = glm::vec4((float)outputWidth, (float)outputHeight, 1.0f / (float)outputWidth, 1.0f / (float)outputHeight);
+		params.feedback = feedback;
+		params.reset = (!enabled || !historyValid) ? 1 : 0;
+		memcpy(paramsBuffer.mapped, &params, sizeof(Params));
+		historyValid = enabled;
+	}
+
+	void TemporalAA::reset()
+	{
+		historyValid = false;
+	}
+
+	void TemporalAA::resolve(VkCommandBuffer commandBuffer)
+	{
+		assert(velocityView != VK_NULL_HANDLE);
+		const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		// The velocity buffer may come from a different pass or submission, the output must no longer be read by the previous copy and present
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			1, &memoryBarrier,
+			0, nullptr,
+			0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.resolve);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.resolve, 0, 1, &descriptorSets.resolve, 0, nullptr);
+		vkCmdDispatch(commandBuffer, (outputWidth + workGroupSize - 1) / workGroupSize, (outputHeight + workGroupSize - 1) / workGroupSize, 1);
+
+		// Output: resolve writes -> copy and present reads, history: resolve reads -> copy writes
+		std::array<VkImageMemoryBarrier, 2> imageBarriers;
+		imageBarriers[0] = vks::initializers::imageMemoryBarrier();
+		imageBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarriers[0].image = output.image;
+		imageBarriers[0].subresourceRange = subresourceRange;
+		imageBarriers[1] = vks::initializers::imageMemoryBarrier();
+		imageBarriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarriers[1].image = history.image;
+		imageBarriers[1].subresourceRange = subresourceRange;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+		VkImageCopy copyRegion{};
+		copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.extent = { outputWidth, outputHeight, 1 };
+		vkCmdCopyImage(commandBuffer, output.image, VK_IMAGE_LAYOUT_GENERAL, history.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+		// History is read by the next frame's resolve
+		VkImageMemoryBarrier historyBarrier = vks::initializers::imageMemoryBarrier();
+		historyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		historyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		historyBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		historyBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		historyBarrier.image = history.image;
+		historyBarrier.subresourceRange = subresourceRange;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &historyBarrier);
+	}
+
+	void TemporalAA::present(VkCommandBuffer commandBuffer)
+	{
+		PushConstants pushConstants = { { 1.0f, 1.0f }, { 1.0f, 1.0f } };
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.present);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.present, 0, 1, &descriptorSets.present, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayouts.present, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	}
+}
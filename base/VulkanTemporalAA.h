@@ -0,0 +1,172 @@
+/*
+* Vulkan temporal anti-aliasing and upsampling
+*
+* Accumulates jittered frames rendered at full or reduced resolution into a full resolution history using motion vectors
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/**
+	* @brief Temporal anti-aliasing with optional upsampling
+	*
+	* The scene is rendered at renderScale times the output size with a sub-pixel jitter applied to the projection (see Camera::setJitter),
+	* a different jitter for every frame taken from a Halton (2, 3) sequence. Its shaded color goes into the color target of getRenderPass().
+	*
+	* Velocity buffer convention: a render resolution RG16F image that stores the screen space motion of every pixel in UV units,
+	* i.e. (current - previous) position, both computed with the unjittered projection. uvPrevious = uv - velocity.
+	* Its view is passed with setVelocityView() and it must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when the resolve runs.
+	*
+	* resolve() runs a compute shader at output resolution that reprojects the history with the (dilated) velocity, clamps it to the
+	* YCoCg bounding box of the current frame's 3x3 neighbourhood to reject stale history and blends the current frame into it.
+	* present() then draws the result as a fullscreen triangle into the current (output) render pass.
+	*
+	* Frame parameters (jitter, history reset) live in a host visible uniform buffer updated by nextFrame(), so command buffers can be
+	* prerecorded. For the same reason there's only one history image: the resolved frame is copied into it instead of ping-ponging.
+	*/
+	class TemporalAA
+	{
+	public:
+		/** @brief Format of the color target and the history */
+		static const VkFormat colorFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		/** @brief Format of the velocity buffer, see convention above */
+		static const VkFormat velocityFormat = VK_FORMAT_R16G16_SFLOAT;
+
+		/** @brief Compute shader stage for the resolve, needs to be set before calling prepare */
+		VkPipelineShaderStageCreateInfo resolveShader{};
+		/** @brief Shader stages for the present pass (fullscreen triangle), need to be set before calling prepare */
+		std::array<VkPipelineShaderStageCreateInfo, 2> presentShaders{};
+		/** @brief Render resolution relative to the output per axis, values below 1 upsample, call resize after changing it */
+		float renderScale = 1.0f;
+		/** @brief Weight of the history in the blend, higher values are smoother but take longer to converge */
+		float feedback = 0.9f;
+		/** @brief Jitters the projection and accumulates frames, if disabled the current frame is only (bilinearly) upscaled */
+		bool enabled = true;
+
+	private:
+		struct Attachment {
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+		};
+
+		/** @brief Layout matches the resolve shader's uniform block */
+		struct Params {
+			/** @brief Jitter of the current frame in UV units (xy) */
+			glm::vec4 jitter;
+			/** @brief Render resolution (xy) and its reciprocal (zw) */
+			glm::vec4 renderSize;
+			/** @brief Output resolution (xy) and its reciprocal (zw) */
+			glm::vec4 outputSize;
+			float feedback;
+			/** @brief Ignores the history (first frame after a resize or reset) */
+			uint32_t reset;
+		};
+
+		struct PushConstants {
+			float uvScale[2];
+			float uvClamp[2];
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t outputWidth = 0;
+		uint32_t outputHeight = 0;
+		uint32_t frameIndex = 0;
+		bool historyValid = false;
+		glm::vec2 jitter = glm::vec2(0.0f);
+
+		Attachment color;
+		Attachment output;
+		Attachment history;
+		VkImageView velocityView = VK_NULL_HANDLE;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		VkSampler linearSampler = VK_NULL_HANDLE;
+		VkSampler nearestSampler = VK_NULL_HANDLE;
+		vks::Buffer paramsBuffer;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		struct {
+			VkDescriptorSetLayout resolve = VK_NULL_HANDLE;
+			VkDescriptorSetLayout present = VK_NULL_HANDLE;
+		} descriptorSetLayouts;
+		struct {
+			VkDescriptorSet resolve = VK_NULL_HANDLE;
+			VkDescriptorSet present = VK_NULL_HANDLE;
+		} descriptorSets;
+		struct {
+			VkPipelineLayout resolve = VK_NULL_HANDLE;
+			VkPipelineLayout present = VK_NULL_HANDLE;
+		} pipelineLayouts;
+		struct {
+			VkPipeline resolve = VK_NULL_HANDLE;
+			VkPipeline present = VK_NULL_HANDLE;
+		} pipelines;
+
+		void createAttachment(uint32_t width, uint32_t height, VkImageUsageFlags usage, Attachment& attachment);
+		void destroyAttachment(Attachment& attachment);
+		void createTargets();
+		void destroyTargets();
+		void createRenderPass();
+		void createPipelines(VkPipelineCache pipelineCache, VkRenderPass outputRenderPass);
+		void updateDescriptorSets();
+		uint32_t getJitterPhaseCount() const;
+	public:
+		~TemporalAA();
+
+		/**
+		* Create the render targets, history, resolve and present pipelines
+		*
+		* @param device Device to create the resources on
+		* @param queue Queue used to initialize the image layouts
+		* @param pipelineCache Pipeline cache for the resolve and present pipelines
+		* @param outputRenderPass Render pass the present pass is recorded in (e.g. the swapchain render pass)
+		* @param width Width of the output in pixels
+		* @param height Height of the output in pixels
+		*/
+		void prepare(vks::VulkanDevice* device, VkQueue queue, VkPipelineCache pipelineCache, VkRenderPass outputRenderPass, uint32_t width, uint32_t height);
+		void destroy();
+		/**
+		* Recreates all images for a new output size (or render scale) and resets the history
+		* @note The velocity view needs to be set again and command buffers need to be rebuilt afterwards
+		*/
+		void resize(uint32_t width, uint32_t height);
+
+		/** @brief Render pass for the shaded scene, a single color attachment that is cleared and left ready for sampling */
+		VkRenderPass getRenderPass() const;
+		/** @brief Sets the render pass begin info, viewport and scissor for the render resolution color target */
+		void getRenderPassBeginInfo(VkRenderPassBeginInfo& renderPassBeginInfo, VkViewport& viewport, VkRect2D& scissor) const;
+		/** @brief Resolution the scene (and velocity buffer) need to be rendered at */
+		VkExtent2D getRenderExtent() const;
+		/** @brief Sets the velocity buffer sampled by the resolve, see the velocity buffer convention */
+		void setVelocityView(VkImageView view);
+
+		/** @brief Advances the jitter sequence and updates the frame parameters, call once per frame before updating the camera matrices */
+		void nextFrame();
+		/** @brief Jitter of the current frame in normalized device coordinates, to be passed to Camera::setJitter (zero if disabled) */
+		glm::vec2 getJitter() const;
+		/** @brief Discards the history, e.g. after a camera cut */
+		void reset();
+
+		/** @brief Records the resolve into the output and the history update, must be recorded outside of a render pass after the scene has been rendered */
+		void resolve(VkCommandBuffer commandBuffer);
+		/** @brief Draws the resolved frame into the current (output) render pass */
+		void present(VkCommandBuffer commandBuffer);
+	};
+}
@@ -7,6 +7,7 @@
 */
 
 #include <VulkanTexture.h>
+#include <VulkanTrace.h>
 
 namespace vks
 {
@@ -47,11 +48,34 @@ namespace vks
 		if (!vks::tools::fileExists(filename)) {
 			vks::tools::exitFatal("Could not load texture from " + filename + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.", -1);
 		}
-		result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, target);			
+		// Only the header and level index are read here, the image data is streamed from the file by loadKTXImageData
+		result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_NO_FLAGS, target);
 #endif		
 		return result;
 	}
 
+	/**
+	* Writes the image data of a texture opened with loadKTXFile to the given memory (usually a mapped staging buffer)
+	*
+	* @param ktxTexture Texture returned by loadKTXFile
+	* @param target Memory to write the image data to, laid out as reported by ktxTexture_GetImageOffset
+	* @param size Size of the target memory, must be at least ktxTexture_GetSize
+	*
+	* @note File based textures are read level by level straight into the target, so the image data is never held in an intermediate
+	* buffer. Textures created from memory (Android assets) already hold their image data, which is copied instead.
+	*/
+	ktxResult Texture::loadKTXImageData(ktxTexture *ktxTexture, void *target, size_t size)
+	{
+		ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
+		ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
+		if (ktxTextureData) {
+			assert(size >= ktxTextureSize);
+			memcpy(target, ktxTextureData, ktxTextureSize);
+			return KTX_SUCCESS;
+		}
+		return ktxTexture_LoadImageData(ktxTexture, static_cast<ktx_uint8_t*>(target), size);
+	}
+
 	/**
 	* Load a 2D texture including all mip levels
 	*
@@ -66,6 +90,7 @@ namespace vks
 	*/
 	void Texture2D::loadFromFile(std::string filename, VkFormat format, vks::VulkanDevice *device, VkQueue copyQueue, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout, bool forceLinear)
 	{
+		VKS_TRACE_SCOPE("Load texture");
 		ktxTexture* ktxTexture;
 		ktxResult result = loadKTXFile(filename, &ktxTexture);
 		assert(result == KTX_SUCCESS);
@@ -75,7 +100,6 @@ namespace vks
 		height = ktxTexture->baseHeight;
 		mipLevels = ktxTexture->numLevels;
 
-		ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
 		ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
 
 		// Get device properties for the requested texture format
@@ -119,10 +143,11 @@ namespace vks
 			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
 			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
-			// Copy texture data into staging buffer
+			// Read texture data into staging buffer
 			uint8_t *data;
 			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, ktxTextureData, ktxTextureSize);
+			result = loadKTXImageData(ktxTexture, data, ktxTextureSize);
+			assert(result == KTX_SUCCESS);
 			vkUnmapMemory(device->logicalDevice, stagingMemory);
 
 			// Setup buffer copy regions for each mip level
@@ -273,7 +298,12 @@ namespace vks
 			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, mappableMemory, 0, memReqs.size, 0, &data));
 
 			// Copy image data into memory
-			memcpy(data, ktxTextureData, memReqs.size);
+			// The linear image only holds the first level, this path reads the image data to host memory first
+			if (!ktxTexture_GetData(ktxTexture)) {
+				result = ktxTexture_LoadImageData(ktxTexture, nullptr, 0);
+				assert(result == KTX_SUCCESS);
+			}
+			memcpy(data, ktxTexture_GetData(ktxTexture), memReqs.size);
 
 			vkUnmapMemory(device->logicalDevice, mappableMemory);
 
@@ -346,6 +376,7 @@ namespace vks
 	*/
 	void Texture2D::fromBuffer(void* buffer, VkDeviceSize bufferSize, VkFormat format, uint32_t texWidth, uint32_t texHeight, vks::VulkanDevice *device, VkQueue copyQueue, VkFilter filter, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout)
 	{
+		VKS_TRACE_SCOPE("Upload texture");
 		assert(buffer);
 
 		this->device = device;
@@ -508,6 +539,7 @@ namespace vks
 	*/
 	void Texture2DArray::loadFromFile(std::string filename, VkFormat format, vks::VulkanDevice *device, VkQueue copyQueue, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout)
 	{
+		VKS_TRACE_SCOPE("Load texture");
 		ktxTexture* ktxTexture;
 		ktxResult result = loadKTXFile(filename, &ktxTexture);
 		assert(result == KTX_SUCCESS);
@@ -518,7 +550,6 @@ namespace vks
 		layerCount = ktxTexture->numLayers;
 		mipLevels = ktxTexture->numLevels;
 
-		ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
 		ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
 
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
@@ -546,10 +577,11 @@ namespace vks
 		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
 		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
-		// Copy texture data into staging buffer
+		// Read texture data into staging buffer
 		uint8_t *data;
 		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
+		result = loadKTXImageData(ktxTexture, data, ktxTextureSize);
+		assert(result == KTX_SUCCESS);
 		vkUnmapMemory(device->logicalDevice, stagingMemory);
 
 		// Setup buffer copy regions for each layer including all of its miplevels
@@ -692,6 +724,7 @@ namespace vks
 	*/
 	void TextureCubeMap::loadFromFile(std::string filename, VkFormat format, vks::VulkanDevice *device, VkQueue copyQueue, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout)
 	{
+		VKS_TRACE_SCOPE("Load texture");
 		ktxTexture* ktxTexture;
 		ktxResult result = loadKTXFile(filename, &ktxTexture);
 		assert(result == KTX_SUCCESS);
@@ -701,7 +734,6 @@ namespace vks
 		height = ktxTexture->baseHeight;
 		mipLevels = ktxTexture->numLevels;
 
-		ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
 		ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
 
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
@@ -729,10 +761,11 @@ namespace vks
 		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
 		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
-		// Copy texture data into staging buffer
+		// Read texture data into staging buffer
 		uint8_t *data;
 		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
+		result = loadKTXImageData(ktxTexture, data, ktxTextureSize);
+		assert(result == KTX_SUCCESS);
 		vkUnmapMemory(device->logicalDevice, stagingMemory);
 
 		// Setup buffer copy regions for each face including all of its mip levels
@@ -45,6 +45,7 @@ class Texture
 	void      updateDescriptor();
 	void      destroy();
 	ktxResult loadKTXFile(std::string filename, ktxTexture **target);
+	ktxResult loadKTXImageData(ktxTexture *ktxTexture, void *target, size_t size);
 };
 
 class Texture2D : public Texture
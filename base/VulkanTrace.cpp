@@ -0,0 +1,192 @@
+/*
+* CPU tracing
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanTrace.h"
+
+#if defined(VKS_TRACING)
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vks
+{
+	namespace trace
+	{
+		namespace
+		{
+			/*
+				Ring buffer written by its owning thread only. The head is published with release semantics after an event has been
+				written, so the exporting thread sees complete events up to the head it loads. Only the oldest events may be
+				overwritten while exporting, which is detected by reloading the head afterwards.
+			*/
+			struct ThreadBuffer {
+				std::unique_ptr<Event[]> events;
+				std::atomic<uint64_t> head{ 0 };
+				std::atomic<const char*> name{ nullptr };
+				uint32_t threadId = 0;
+			};
+
+			// Buffers are kept after their thread has exited, so its events are still exported
+			std::mutex registryMutex;
+			std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+			std::atomic<uint64_t> frameIndex{ 0 };
+			thread_local ThreadBuffer* localBuffer = nullptr;
+
+			ThreadBuffer* getThreadBuffer()
+			{
+				if (!localBuffer) {
+					std::unique_ptr<ThreadBuffer> buffer = std::make_unique<ThreadBuffer>();
+					buffer->events.reset(new Event[eventsPerThread]);
+					std::lock_guard<std::mutex> lock(registryMutex);
+					buffer->threadId = static_cast<uint32_t>(threadBuffers.size());
+					localBuffer = buffer.get();
+					threadBuffers.push_back(std::move(buffer));
+				}
+				return localBuffer;
+			}
+
+			void record(const char* name, EventType type, uint64_t timestamp, uint64_t value, double counter)
+			{
+				ThreadBuffer* buffer = getThreadBuffer();
+				const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+				Event& event = buffer->events[head % eventsPerThread];
+				event.name = name;
+				event.type = type;
+				event.timestamp = timestamp;
+				event.value = value;
+				event.counter = counter;
+				buffer->head.store(head + 1, std::memory_order_release);
+			}
+
+			void writeString(std::ofstream& stream, const char* string)
+			{
+				stream << "\"";
+				for (const char* c = string; *c; c++) {
+					if (*c == '"' || *c == '\\') {
+						stream << '\\';
+					}
+					stream << *c;
+				}
+				stream << "\"";
+			}
+
+			void writeEvent(std::ofstream& stream, const Event& event, uint32_t threadId)
+			{
+				// Chrome trace timestamps are in microseconds
+				const double timestamp = event.timestamp / 1000.0;
+				stream << "{\"name\":";
+				writeString(stream, event.name);
+				stream << ",\"pid\":0,\"tid\":" << threadId << ",\"ts\":" << timestamp;
+				switch (event.type) {
+				case EventType::Zone:
+					stream << ",\"ph\":\"X\",\"dur\":" << event.value / 1000.0;
+					break;
+				case EventType::Counter:
+					stream << ",\"ph\":\"C\",\"args\":{\"value\":" << event.counter << "}";
+					break;
+				case EventType::Frame:
+					stream << ",\"ph\":\"i\",\"s\":\"g\",\"args\":{\"frame\":" << event.value << "}";
+					break;
+				case EventType::FlowBegin:
+					stream << ",\"ph\":\"s\",\"cat\":\"flow\",\"id\":" << event.value;
+					break;
+				case EventType::FlowEnd:
+					// Binds to the enclosing zone instead of the next one starting after it
+					stream << ",\"ph\":\"f\",\"bp\":\"e\",\"cat\":\"flow\",\"id\":" << event.value;
+					break;
+				}
+				stream << "}";
+			}
+		}
+
+		uint64_t now()
+		{
+			static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+		}
+
+		void zone(const char* name, uint64_t start, uint64_t end)
+		{
+			record(name, EventType::Zone, start, end - start, 0.0);
+		}
+
+		void counter(const char* name, double value)
+		{
+			record(name, EventType::Counter, now(), 0, value);
+		}
+
+		void frame()
+		{
+			record("Frame", EventType::Frame, now(), frameIndex.fetch_add(1, std::memory_order_relaxed), 0.0);
+		}
+
+		void flowBegin(const char* name, uint64_t id)
+		{
+			record(name, EventType::FlowBegin, now(), id, 0.0);
+		}
+
+		void flowEnd(const char* name, uint64_t id)
+		{
+			record(name, EventType::FlowEnd, now(), id, 0.0);
+		}
+
+		void setThreadName(const char* name)
+		{
+			getThreadBuffer()->name.store(name, std::memory_order_relaxed);
+		}
+
+		bool exportChromeTrace(const std::string& filename)
+		{
+			std::ofstream stream(filename);
+			if (!stream.is_open()) {
+				return false;
+			}
+			stream << std::fixed << std::setprecision(3);
+			stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			bool first = true;
+			std::vector<Event> events;
+			std::lock_guard<std::mutex> lock(registryMutex);
+			for (const std::unique_ptr<ThreadBuffer>& buffer : threadBuffers) {
+				const char* name = buffer->name.load(std::memory_order_relaxed);
+				if (name) {
+					stream << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":";
+					writeString(stream, name);
+					stream << "}}";
+					first = false;
+				}
+
+				const uint64_t head = buffer->head.load(std::memory_order_acquire);
+				const uint64_t begin = (head > eventsPerThread) ? head - eventsPerThread : 0;
+				events.clear();
+				for (uint64_t i = begin; i < head; i++) {
+					events.push_back(buffer->events[i % eventsPerThread]);
+				}
+				// The owning thread may have overwritten the oldest copied events (and may be writing the next slot) in the meantime
+				const uint64_t currentHead = buffer->head.load(std::memory_order_acquire);
+				const uint64_t valid = (currentHead >= eventsPerThread) ? currentHead - eventsPerThread + 1 : 0;
+				for (uint64_t i = begin; i < head; i++) {
+					if (i < valid) {
+						continue;
+					}
+					stream << (first ? "" : ",\n");
+					writeEvent(stream, events[i - begin], buffer->threadId);
+					first = false;
+				}
+			}
+			stream << "\n]}\n";
+			return stream.good();
+		}
+	}
+}
+
+#endif
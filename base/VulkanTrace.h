@@ -0,0 +1,106 @@
+/*
+* CPU tracing
+*
+* Scoped zones, counters, frame markers and flow events recorded to per-thread ring buffers and exported as Chrome trace JSON
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+/*
+	Tracing is only compiled in if VKS_TRACING is defined (CMake option USE_CPU_TRACING), otherwise all macros expand to nothing.
+	Traces are written with the --trace <file> command line argument and can be opened in chrome://tracing or ui.perfetto.dev.
+
+	All names need to be string literals (or otherwise outlive the trace), only their pointers are recorded.
+
+	VKS_TRACE_SCOPE("name")             Zone from this line to the end of the enclosing scope
+	VKS_TRACE_FUNCTION()                Zone named after the enclosing function
+	VKS_TRACE_COUNTER("name", value)    Counter track sample
+	VKS_TRACE_FRAME()                   Frame boundary marker
+	VKS_TRACE_FLOW_BEGIN("name", id)    Start of an arrow from the enclosing zone...
+	VKS_TRACE_FLOW_END("name", id)      ...to the enclosing zone of the matching end, e.g. command buffer recording to its submission
+	VKS_TRACE_THREAD_NAME("name")       Name of the calling thread in the trace
+*/
+
+#if defined(VKS_TRACING)
+
+#include <cstdint>
+#include <string>
+
+namespace vks
+{
+	namespace trace
+	{
+		enum class EventType : uint8_t { Zone, Counter, Frame, FlowBegin, FlowEnd };
+
+		/** @brief Single entry of a thread's ring buffer */
+		struct Event {
+			const char* name;
+			/** @brief Start time in ns since the first traced event */
+			uint64_t timestamp;
+			/** @brief Zone duration in ns, flow id or frame index */
+			uint64_t value;
+			/** @brief Counter value */
+			double counter;
+			EventType type;
+		};
+
+		/** @brief Number of events each thread keeps, older events are overwritten */
+		static const uint32_t eventsPerThread = 1 << 16;
+
+		/** @brief Current time in ns since the first traced event */
+		uint64_t now();
+		void zone(const char* name, uint64_t start, uint64_t end);
+		void counter(const char* name, double value);
+		void frame();
+		void flowBegin(const char* name, uint64_t id);
+		void flowEnd(const char* name, uint64_t id);
+		void setThreadName(const char* name);
+
+		/**
+		* Writes the events of all threads to a Chrome trace JSON file
+		* @note Threads may keep recording while exporting, events overwritten during the export are dropped
+		* @return False if the file could not be written
+		*/
+		bool exportChromeTrace(const std::string& filename);
+
+		/** @brief Records a zone on destruction, see VKS_TRACE_SCOPE */
+		class Scope
+		{
+		private:
+			const char* name;
+			uint64_t start;
+		public:
+			explicit Scope(const char* name) : name(name), start(now()) {}
+			~Scope() { zone(name, start, now()); }
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		};
+	}
+}
+
+#define VKS_TRACE_CONCAT_INNER(a, b) a##b
+#define VKS_TRACE_CONCAT(a, b) VKS_TRACE_CONCAT_INNER(a, b)
+#define VKS_TRACE_SCOPE(name) vks::trace::Scope VKS_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define VKS_TRACE_FUNCTION() VKS_TRACE_SCOPE(__func__)
+#define VKS_TRACE_COUNTER(name, value) vks::trace::counter(name, static_cast<double>(value))
+#define VKS_TRACE_FRAME() vks::trace::frame()
+// Ids may be Vulkan handles, which are pointers on 64 bit platforms
+#define VKS_TRACE_FLOW_BEGIN(name, id) vks::trace::flowBegin(name, (uint64_t)(id))
+#define VKS_TRACE_FLOW_END(name, id) vks::trace::flowEnd(name, (uint64_t)(id))
+#define VKS_TRACE_THREAD_NAME(name) vks::trace::setThreadName(name)
+
+#else
+
+#define VKS_TRACE_SCOPE(name)
+#define VKS_TRACE_FUNCTION()
+#define VKS_TRACE_COUNTER(name, value)
+#define VKS_TRACE_FRAME()
+#define VKS_TRACE_FLOW_BEGIN(name, id)
+#define VKS_TRACE_FLOW_END(name, id)
+#define VKS_TRACE_THREAD_NAME(name)
+
+#endif
@@ -8,6 +8,7 @@
 */
 
 #include "VulkanUIOverlay.h"
+#include "VulkanTrace.h"
 
 namespace vks 
 {
@@ -59,6 +60,7 @@ namespace vks
 	/** Prepare all vulkan resources required to render the UI overlay */
 	void UIOverlay::prepareResources()
 	{
+		VKS_TRACE_FUNCTION();
 		ImGuiIO& io = ImGui::GetIO();
 
 		// Create font texture
@@ -219,6 +221,7 @@ namespace vks
 	/** Prepare a separate pipeline for the UI overlay rendering decoupled from the main application */
 	void UIOverlay::preparePipeline(const VkPipelineCache pipelineCache, const VkRenderPass renderPass, const VkFormat colorFormat, const VkFormat depthFormat)
 	{
+		VKS_TRACE_SCOPE("Create UI overlay pipeline");
 		// Pipeline layout
 		// Push constants for UI rendering parameters
 		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(PushConstBlock), 0);
@@ -313,6 +316,7 @@ namespace vks
 	/** Update vertex and index buffer containing the imGui elements when required */
 	bool UIOverlay::update()
 	{
+		VKS_TRACE_SCOPE("Upload UI overlay buffers");
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		bool updateCmdBuffers = false;
 
@@ -12,11 +12,20 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "VulkanglTFModel.h"
+#include "VulkanTrace.h"
+
+#include <mutex>
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
+VkDescriptorSetLayout vkglTF::descriptorSetLayoutInstances = VK_NULL_HANDLE;
 VkMemoryPropertyFlags vkglTF::memoryPropertyFlags = 0;
 uint32_t vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageBaseColor;
+vks::GeometryPool* vkglTF::geometryPool = nullptr;
+vks::DescriptorAllocator* vkglTF::descriptorAllocator = nullptr;
+
+// The global descriptor set layouts and the geometry pool are shared by all models, which may be loaded from multiple threads (e.g. startup tasks)
+static std::mutex sharedStateMutex;
 
 /*
 	We use a custom image loading function with tinyglTF, so we can do custom stuff loading ktx textures
@@ -62,8 +71,21 @@ void vkglTF::Texture::destroy()
 	}
 }
 
+void vkglTF::Texture::convertRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; ++i) {
+		rgba[0] = rgb[0];
+		rgba[1] = rgb[1];
+		rgba[2] = rgb[2];
+		rgba[3] = 255;
+		rgba += 4;
+		rgb += 3;
+	}
+}
+
 void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path, vks::VulkanDevice *device, VkQueue copyQueue)
 {
+	VKS_TRACE_SCOPE("Load glTF image");
 	this->device = device;
 
 	bool isKtx = false;
@@ -87,15 +109,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 			// TODO: Check actual format support and transform only if required
 			bufferSize = gltfimage.width * gltfimage.height * 4;
 			buffer = new unsigned char[bufferSize];
-			unsigned char* rgba = buffer;
-			unsigned char* rgb = &gltfimage.image[0];
-			for (size_t i = 0; i < gltfimage.width * gltfimage.height; ++i) {
-				for (int32_t j = 0; j < 3; ++j) {
-					rgba[j] = rgb[j];
-				}
-				rgba += 4;
-				rgb += 3;
-			}
+			convertRGBToRGBA(&gltfimage.image[0], buffer, static_cast<size_t>(gltfimage.width) * gltfimage.height);
 			deleteBuffer = true;
 		}
 		else {
@@ -302,7 +316,8 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		if (!vks::tools::fileExists(filename)) {
 			vks::tools::exitFatal("Could not load texture from " + filename + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.", -1);
 		}
-		result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
+		// Image data is read straight into the staging buffer below
+		result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_NO_FLAGS, &ktxTexture);
 #endif		
 		assert(result == KTX_SUCCESS);
 
@@ -311,7 +326,6 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		height = ktxTexture->baseHeight;
 		mipLevels = ktxTexture->numLevels;
 
-		ktx_uint8_t* ktxTextureData = ktxTexture_GetData(ktxTexture);
 		ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
 		// @todo: Use ktxTexture_GetVkFormat(ktxTexture)
 		format = VK_FORMAT_R8G8B8A8_UNORM;
@@ -341,7 +355,12 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 
 		uint8_t* data;
 		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
+		if (ktxTexture_GetData(ktxTexture)) {
+			memcpy(data, ktxTexture_GetData(ktxTexture), ktxTextureSize);
+		} else {
+			result = ktxTexture_LoadImageData(ktxTexture, data, ktxTextureSize);
+			assert(result == KTX_SUCCESS);
+		}
 		vkUnmapMemory(device->logicalDevice, stagingMemory);
 
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -443,6 +462,11 @@ void vkglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDe
 	descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
 	descriptorSetAllocInfo.descriptorSetCount = 1;
 	VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &descriptorSet));
+	updateDescriptorSet(descriptorBindingFlags);
+}
+
+void vkglTF::Material::updateDescriptorSet(uint32_t descriptorBindingFlags)
+{
 	std::vector<VkDescriptorImageInfo> imageDescriptors{};
 	std::vector<VkWriteDescriptorSet> writeDescriptorSets{};
 	if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
@@ -488,6 +512,11 @@ void vkglTF::Primitive::setDimensions(glm::vec3 min, glm::vec3 max) {
 vkglTF::Mesh::Mesh(vks::VulkanDevice *device, glm::mat4 matrix) {
 	this->device = device;
 	this->uniformBlock.matrix = matrix;
+	if (!device) {
+		// Host only mesh (e.g. for benchmarks), node updates write to a plain allocation instead of a mapped uniform buffer
+		uniformBuffer.mapped = new UniformBlock{};
+		return;
+	}
 	VK_CHECK_RESULT(device->createBuffer(
 		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
@@ -500,8 +529,12 @@ vkglTF::Mesh::Mesh(vks::VulkanDevice *device, glm::mat4 matrix) {
 };
 
 vkglTF::Mesh::~Mesh() {
-	vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
+	if (device) {
+		vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
+	} else {
+		delete static_cast<UniformBlock*>(uniformBuffer.mapped);
+	}
     for(auto primitive : primitives)
     {
         delete primitive;
@@ -563,9 +596,9 @@ vkglTF::Node::~Node() {
 	glTF default vertex layout with easy Vulkan mapping functions
 */
 
-VkVertexInputBindingDescription vkglTF::Vertex::vertexInputBindingDescription;
-std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::vertexInputAttributeDescriptions;
-VkPipelineVertexInputStateCreateInfo vkglTF::Vertex::pipelineVertexInputStateCreateInfo;
+thread_local VkVertexInputBindingDescription vkglTF::Vertex::vertexInputBindingDescription;
+thread_local std::vector<VkVertexInputAttributeDescription> vkglTF::Vertex::vertexInputAttributeDescriptions;
+thread_local VkPipelineVertexInputStateCreateInfo vkglTF::Vertex::pipelineVertexInputStateCreateInfo;
 
 VkVertexInputBindingDescription vkglTF::Vertex::inputBindingDescription(uint32_t binding) {
 	return VkVertexInputBindingDescription({ binding, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX });
@@ -731,10 +764,6 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 */
 vkglTF::Model::~Model()
 {
-	vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
 	for (auto texture : textures) {
 		texture.destroy();
 	}
@@ -744,6 +773,19 @@ vkglTF::Model::~Model()
     for (auto skin : skins) {
         delete skin;
     }
+	// Models assembled on the host only (e.g. for benchmarks) have never been loaded and own no device resources
+	if (!device) {
+		return;
+	}
+	if (geometryPool) {
+		std::lock_guard<std::mutex> lock(sharedStateMutex);
+		geometryPool->free(geometryHandle);
+	} else {
+		vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
+		vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
+	}
 	if (descriptorSetLayoutUbo != VK_NULL_HANDLE) {
 		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutUbo, nullptr);
 		descriptorSetLayoutUbo = VK_NULL_HANDLE;
@@ -752,10 +794,111 @@ vkglTF::Model::~Model()
 		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutImage, nullptr);
 		descriptorSetLayoutImage = VK_NULL_HANDLE;
 	}
-	vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+	if (descriptorSetLayoutInstances != VK_NULL_HANDLE) {
+		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutInstances, nullptr);
+		descriptorSetLayoutInstances = VK_NULL_HANDLE;
+	}
+	instances.buffer.destroy();
+	if (descriptorAllocator) {
+		for (VkDescriptorSet descriptorSet : allocatedDescriptorSets) {
+			descriptorAllocator->free(descriptorSet);
+		}
+	} else {
+		vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+	}
 	emptyTexture.destroy();
 }
 
+uint32_t vkglTF::Model::loadVertices(const tinygltf::Model& model, const tinygltf::Primitive& primitive, std::vector<Vertex>& vertexBuffer, glm::vec3& posMin, glm::vec3& posMax)
+{
+	const float *bufferPos = nullptr;
+	const float *bufferNormals = nullptr;
+	const float *bufferTexCoords = nullptr;
+	const float* bufferColors = nullptr;
+	const float *bufferTangents = nullptr;
+	uint32_t numColorComponents = 4;
+	const uint16_t *bufferJoints = nullptr;
+	const float *bufferWeights = nullptr;
+
+	// Position attribute is required
+	assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
+
+	const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+	const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
+	bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
+	posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
+	posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
+
+	if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
+		const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
+		const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
+		bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
+	}
+
+	if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
+		const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
+		const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
+		bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+	}
+
+	if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
+	{
+		const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
+		const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
+		// Color buffer are either of type vec3 or vec4
+		numColorComponents = colorAccessor.type == TINYGLTF_TYPE_VEC3 ? 3 : 4;
+		bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
+	}
+
+	if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
+	{
+		const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
+		const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
+		bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
+	}
+
+	// Skinning
+	// Joints
+	if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
+		const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
+		const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
+		bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
+	}
+
+	if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
+		const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
+		const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
+		bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+	}
+
+	const bool hasSkin = (bufferJoints && bufferWeights);
+
+	for (size_t v = 0; v < posAccessor.count; v++) {
+		Vertex vert{};
+		vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
+		vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
+		vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
+		if (bufferColors) {
+			switch (numColorComponents) {
+				case 3:
+					vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
+					break;
+				case 4:
+					vert.color = glm::make_vec4(&bufferColors[v * 4]);
+					break;
+			}
+		}
+		else {
+			vert.color = glm::vec4(1.0f);
+		}
+		vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(0.0f);
+		vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
+		vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
+		vertexBuffer.push_back(vert);
+	}
+	return static_cast<uint32_t>(posAccessor.count);
+}
+
 void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale)
 {
 	vkglTF::Node *newNode = new Node{};
@@ -800,152 +943,77 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 		const tinygltf::Mesh mesh = model.meshes[node.mesh];
 		Mesh *newMesh = new Mesh(device, newNode->matrix);
 		newMesh->name = mesh.name;
-		for (size_t j = 0; j < mesh.primitives.size(); j++) {
-			const tinygltf::Primitive &primitive = mesh.primitives[j];
-			if (primitive.indices < 0) {
-				continue;
+		newMesh->index = node.mesh;
+		auto loadedMesh = loadedMeshes.find(node.mesh);
+		if (loadedMesh != loadedMeshes.end()) {
+			// The glTF mesh has already been loaded for another node, so only reference its vertex and index ranges
+			for (Primitive* primitive : loadedMesh->second->primitives) {
+				newMesh->primitives.push_back(new Primitive(*primitive));
 			}
-			uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
-			uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
-			uint32_t indexCount = 0;
-			uint32_t vertexCount = 0;
-			glm::vec3 posMin{};
-			glm::vec3 posMax{};
-			bool hasSkin = false;
-			// Vertices
-			{
-				const float *bufferPos = nullptr;
-				const float *bufferNormals = nullptr;
-				const float *bufferTexCoords = nullptr;
-				const float* bufferColors = nullptr;
-				const float *bufferTangents = nullptr;
-				uint32_t numColorComponents;
-				const uint16_t *bufferJoints = nullptr;
-				const float *bufferWeights = nullptr;
-
-				// Position attribute is required
-				assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
-				const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-				const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-				bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-				posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-				posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-
-				if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-					const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-					const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-					bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
-					const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
-					// Color buffer are either of type vec3 or vec4
-					numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-					bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
+		} else {
+			for (size_t j = 0; j < mesh.primitives.size(); j++) {
+				const tinygltf::Primitive &primitive = mesh.primitives[j];
+				if (primitive.indices < 0) {
+					continue;
 				}
-
-				if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
+				uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
+				uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
+				uint32_t indexCount = 0;
+				uint32_t vertexCount = 0;
+				glm::vec3 posMin{};
+				glm::vec3 posMax{};
+				vertexCount = loadVertices(model, primitive, vertexBuffer, posMin, posMax);
+				// Indices
 				{
-					const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
-					const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
-					bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
-				}
-
-				// Skinning
-				// Joints
-				if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
-					const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-					bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
-
-				hasSkin = (bufferJoints && bufferWeights);
-
-				vertexCount = static_cast<uint32_t>(posAccessor.count);
-
-				for (size_t v = 0; v < posAccessor.count; v++) {
-					Vertex vert{};
-					vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
-					vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
-					vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
-					if (bufferColors) {
-						switch (numColorComponents) {
-							case 3: 
-								vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
-							case 4:
-								vert.color = glm::make_vec4(&bufferColors[v * 4]);
+					const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
+					const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+					const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+
+					indexCount = static_cast<uint32_t>(accessor.count);
+
+					switch (accessor.componentType) {
+					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
+						uint32_t *buf = new uint32_t[accessor.count];
+						memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
+						for (size_t index = 0; index < accessor.count; index++) {
+							indexBuffer.push_back(buf[index] + vertexStart);
 						}
+						delete[] buf;
+						break;
 					}
-					else {
-						vert.color = glm::vec4(1.0f);
-					}
-					vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(0.0f);
-					vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
-					vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
-					vertexBuffer.push_back(vert);
-				}
-			}
-			// Indices
-			{
-				const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
-				const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-
-				indexCount = static_cast<uint32_t>(accessor.count);
-
-				switch (accessor.componentType) {
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-					uint32_t *buf = new uint32_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
+					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
+						uint16_t *buf = new uint16_t[accessor.count];
+						memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
+						for (size_t index = 0; index < accessor.count; index++) {
+							indexBuffer.push_back(buf[index] + vertexStart);
+						}
+						delete[] buf;
+						break;
 					}
-                    delete[] buf;
-					break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-					uint16_t *buf = new uint16_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
+					case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
+						uint8_t *buf = new uint8_t[accessor.count];
+						memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
+						for (size_t index = 0; index < accessor.count; index++) {
+							indexBuffer.push_back(buf[index] + vertexStart);
+						}
+						delete[] buf;
+						break;
 					}
-                    delete[] buf;
-                    break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-					uint8_t *buf = new uint8_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
+					default:
+						std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
+						return;
 					}
-                    delete[] buf;
-                    break;
-				}
-				default:
-					std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
-					return;
 				}
+				Primitive *newPrimitive = new Primitive(indexStart, indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
+				newPrimitive->firstVertex = vertexStart;
+				newPrimitive->vertexCount = vertexCount;
+				newPrimitive->setDimensions(posMin, posMax);
+				newMesh->primitives.push_back(newPrimitive);
+			}
+			// Pre-transformed vertices are unique to each node and can't be shared
+			if (!(fileLoadingFlags & FileLoadingFlags::PreTransformVertices)) {
+				loadedMeshes[node.mesh] = newMesh;
 			}
-			Primitive *newPrimitive = new Primitive(indexStart, indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
-			newPrimitive->firstVertex = vertexStart;
-			newPrimitive->vertexCount = vertexCount;
-			newPrimitive->setDimensions(posMin, posMax);
-			newMesh->primitives.push_back(newPrimitive);
 		}
 		newNode->mesh = newMesh;
 	}
@@ -1166,6 +1234,7 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 
 void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
 {
+	VKS_TRACE_SCOPE("Load glTF model");
 	tinygltf::Model gltfModel;
 	tinygltf::TinyGLTF gltfContext;
 	if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
@@ -1184,6 +1253,8 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	std::string error, warning;
 
 	this->device = device;
+	this->fileLoadingFlags = fileLoadingFlags;
+	loadedMeshes.clear();
 
 #if defined(__ANDROID__)
 	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
@@ -1232,10 +1303,16 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
 		const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
 		const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
+		// Vertex ranges shared by multiple nodes must only be processed once
+		std::vector<bool> processedVertices(vertexBuffer.size(), false);
 		for (Node* node : linearNodes) {
 			if (node->mesh) {
 				const glm::mat4 localMatrix = node->getMatrix();
 				for (Primitive* primitive : node->mesh->primitives) {
+					if ((primitive->vertexCount == 0) || processedVertices[primitive->firstVertex]) {
+						continue;
+					}
+					processedVertices[primitive->firstVertex] = true;
 					for (uint32_t i = 0; i < primitive->vertexCount; i++) {
 						Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
 						// Pre-transform vertex positions by node-hierarchy
@@ -1272,99 +1349,123 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 
 	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
 
-	struct StagingBuffer {
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-	} vertexStaging, indexStaging;
-
-	// Create staging buffers
-	// Vertex data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBufferSize,
-		&vertexStaging.buffer,
-		&vertexStaging.memory,
-		vertexBuffer.data()));
-	// Index data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBufferSize,
-		&indexStaging.buffer,
-		&indexStaging.memory,
-		indexBuffer.data()));
-
-	// Create device local buffers
-	// Vertex buffer
-	VK_CHECK_RESULT(device->createBuffer(
-	    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		vertexBufferSize,
-		&vertices.buffer,
-		&vertices.memory));
-	// Index buffer
-	VK_CHECK_RESULT(device->createBuffer(
-	    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		indexBufferSize,
-		&indices.buffer,
-		&indices.memory));
-
-	// Copy from staging buffers
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	if (vkglTF::geometryPool) {
+		// Indices are relative to the model's first vertex, the pool's base vertex is applied at draw time
+		geometryPool = vkglTF::geometryPool;
+		std::lock_guard<std::mutex> lock(sharedStateMutex);
+		geometryHandle = geometryPool->allocate(vertices.count, indices.count);
+		geometryPool->upload(geometryHandle, vertexBuffer.data(), indexBuffer.data());
+		vertices.buffer = VK_NULL_HANDLE;
+		vertices.memory = VK_NULL_HANDLE;
+		indices.buffer = VK_NULL_HANDLE;
+		indices.memory = VK_NULL_HANDLE;
+	} else {
+		struct StagingBuffer {
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+		} vertexStaging, indexStaging;
+
+		// Create staging buffers
+		// Vertex data
+		VK_CHECK_RESULT(device->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			vertexBufferSize,
+			&vertexStaging.buffer,
+			&vertexStaging.memory,
+			vertexBuffer.data()));
+		// Index data
+		VK_CHECK_RESULT(device->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			indexBufferSize,
+			&indexStaging.buffer,
+			&indexStaging.memory,
+			indexBuffer.data()));
+
+		// Create device local buffers
+		// Vertex buffer
+		VK_CHECK_RESULT(device->createBuffer(
+		    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			vertexBufferSize,
+			&vertices.buffer,
+			&vertices.memory));
+		// Index buffer
+		VK_CHECK_RESULT(device->createBuffer(
+		    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indexBufferSize,
+			&indices.buffer,
+			&indices.memory));
+
+		// Copy from staging buffers
+		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
-	VkBufferCopy copyRegion = {};
+		VkBufferCopy copyRegion = {};
 
-	copyRegion.size = vertexBufferSize;
-	vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
+		copyRegion.size = vertexBufferSize;
+		vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
 
-	copyRegion.size = indexBufferSize;
-	vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
+		copyRegion.size = indexBufferSize;
+		vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
 
-	device->flushCommandBuffer(copyCmd, transferQueue, true);
+		device->flushCommandBuffer(copyCmd, transferQueue, true);
 
-	vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+		vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
+		vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
+		vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+	}
 
 	getSceneDimensions();
 
 	// Setup descriptors
-	uint32_t uboCount{ 0 };
-	uint32_t imageCount{ 0 };
-	for (auto node : linearNodes) {
-		if (node->mesh) {
-			uboCount++;
+	// With an allocator, sets are allocated from its pools and the model doesn't need an exactly sized pool of its own
+	descriptorAllocator = vkglTF::descriptorAllocator;
+	if (!descriptorAllocator) {
+		uint32_t uboCount{ 0 };
+		uint32_t imageCount{ 0 };
+		uint32_t instanceSetCount{ 0 };
+		for (auto node : linearNodes) {
+			if (node->mesh) {
+				uboCount++;
+				if ((fileLoadingFlags & FileLoadingFlags::PrepareInstancing) && (node->skinIndex < 0)) {
+					instanceSetCount = 1;
+				}
+			}
 		}
-	}
-	for (auto material : materials) {
-		if (material.baseColorTexture != nullptr) {
-			imageCount++;
+		for (auto material : materials) {
+			if (material.baseColorTexture != nullptr) {
+				imageCount++;
+			}
 		}
-	}
-	std::vector<VkDescriptorPoolSize> poolSizes = {
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uboCount },
-	};
-	if (imageCount > 0) {
-		if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
-			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uboCount },
+		};
+		if (instanceSetCount > 0) {
+			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceSetCount });
 		}
-		if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
-			poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+		if (imageCount > 0) {
+			if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
+				poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+			}
+			if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
+				poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount });
+			}
 		}
+		VkDescriptorPoolCreateInfo descriptorPoolCI{};
+		descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		descriptorPoolCI.pPoolSizes = poolSizes.data();
+		descriptorPoolCI.maxSets = uboCount + imageCount + instanceSetCount;
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
 	}
-	VkDescriptorPoolCreateInfo descriptorPoolCI{};
-	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-	descriptorPoolCI.pPoolSizes = poolSizes.data();
-	descriptorPoolCI.maxSets = uboCount + imageCount;
-	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
 
 	// Descriptors for per-node uniform buffers
 	{
 		// Layout is global, so only create if it hasn't already been created before
+		std::lock_guard<std::mutex> lock(sharedStateMutex);
 		if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
@@ -1383,6 +1484,7 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	// Descriptors for per-material images
 	{
 		// Layout is global, so only create if it hasn't already been created before
+		std::lock_guard<std::mutex> lock(sharedStateMutex);
 		if (descriptorSetLayoutImage == VK_NULL_HANDLE) {
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
 			if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
@@ -1399,40 +1501,94 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		}
 		for (auto& material : materials) {
 			if (material.baseColorTexture != nullptr) {
-				material.createDescriptorSet(descriptorPool, vkglTF::descriptorSetLayoutImage, descriptorBindingFlags);
+				material.descriptorSet = allocateDescriptorSet(vkglTF::descriptorSetLayoutImage);
+				material.updateDescriptorSet(descriptorBindingFlags);
 			}
 		}
 	}
+
+	if (fileLoadingFlags & FileLoadingFlags::PrepareInstancing) {
+		prepareInstancing();
+	}
+}
+
+static bool skipPrimitive(const vkglTF::Material& material, uint32_t renderFlags)
+{
+	bool skip = false;
+	if (renderFlags & vkglTF::RenderFlags::RenderOpaqueNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_OPAQUE);
+	}
+	if (renderFlags & vkglTF::RenderFlags::RenderAlphaMaskedNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_MASK);
+	}
+	if (renderFlags & vkglTF::RenderFlags::RenderAlphaBlendedNodes) {
+		skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_BLEND);
+	}
+	return skip;
 }
 
 void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
 {
 	const VkDeviceSize offsets[1] = {0};
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+	const VkBuffer vertexBuffer = getVertexBuffer();
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
 	buffersBound = true;
 }
 
+VkBuffer vkglTF::Model::getVertexBuffer() const
+{
+	return geometryPool ? geometryPool->getVertexBuffer() : vertices.buffer;
+}
+
+VkBuffer vkglTF::Model::getIndexBuffer() const
+{
+	return geometryPool ? geometryPool->getIndexBuffer() : indices.buffer;
+}
+
+uint32_t vkglTF::Model::getFirstIndex() const
+{
+	return geometryPool ? geometryPool->get(geometryHandle).firstIndex : 0;
+}
+
+int32_t vkglTF::Model::getVertexOffset() const
+{
+	return geometryPool ? static_cast<int32_t>(geometryPool->get(geometryHandle).vertexOffset) : 0;
+}
+
+void vkglTF::Model::getDrawCommands(std::vector<VkDrawIndexedIndirectCommand>& commands, uint32_t renderFlags)
+{
+	const uint32_t firstIndex = getFirstIndex();
+	const int32_t vertexOffset = getVertexOffset();
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		for (Primitive* primitive : node->mesh->primitives) {
+			if (skipPrimitive(primitive->material, renderFlags)) {
+				continue;
+			}
+			VkDrawIndexedIndirectCommand command{};
+			command.indexCount = primitive->indexCount;
+			command.instanceCount = 1;
+			command.firstIndex = firstIndex + primitive->firstIndex;
+			command.vertexOffset = vertexOffset;
+			command.firstInstance = 0;
+			commands.push_back(command);
+		}
+	}
+}
+
 void vkglTF::Model::drawNode(Node *node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
 {
 	if (node->mesh) {
 		for (Primitive* primitive : node->mesh->primitives) {
-			bool skip = false;
 			const vkglTF::Material& material = primitive->material;
-			if (renderFlags & RenderFlags::RenderOpaqueNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_OPAQUE);
-			}
-			if (renderFlags & RenderFlags::RenderAlphaMaskedNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_MASK);
-			}
-			if (renderFlags & RenderFlags::RenderAlphaBlendedNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_BLEND);
-			}
-			if (!skip) {
+			if (!skipPrimitive(material, renderFlags)) {
 				if (renderFlags & RenderFlags::BindImages) {
 					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
 				}
-				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, getFirstIndex() + primitive->firstIndex, getVertexOffset(), 0);
 			}
 		}
 	}
@@ -1445,14 +1601,152 @@ void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, Vk
 {
 	if (!buffersBound) {
 		const VkDeviceSize offsets[1] = {0};
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		const VkBuffer vertexBuffer = getVertexBuffer();
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
 	}
 	for (auto& node : nodes) {
 		drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
 	}
 }
 
+/*
+	Automatic instancing
+	Non-skinned nodes referencing the same glTF mesh are grouped into batches, their matrices are stored consecutively in a host visible storage buffer
+*/
+void vkglTF::Model::prepareInstancing()
+{
+	instanceBatches.clear();
+	std::unordered_map<int32_t, size_t> batchIndices;
+	for (Node* node : linearNodes) {
+		if (!node->mesh || (node->skinIndex > -1)) {
+			continue;
+		}
+		// Meshes that weren't shared (e.g. pre-transformed ones) get a batch of their own
+		const int32_t key = (node->mesh->index > -1) && !(fileLoadingFlags & FileLoadingFlags::PreTransformVertices) ? node->mesh->index : -static_cast<int32_t>(node->index) - 2;
+		auto it = batchIndices.find(key);
+		if (it == batchIndices.end()) {
+			batchIndices[key] = instanceBatches.size();
+			instanceBatches.push_back({ node->mesh, { node }, 0 });
+		} else {
+			instanceBatches[it->second].nodes.push_back(node);
+		}
+	}
+	instances.count = 0;
+	for (InstanceBatch& batch : instanceBatches) {
+		batch.firstInstance = instances.count;
+		instances.count += static_cast<uint32_t>(batch.nodes.size());
+	}
+	if (instances.count == 0) {
+		return;
+	}
+
+	VK_CHECK_RESULT(device->createBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&instances.buffer,
+		instances.count * sizeof(glm::mat4)));
+	VK_CHECK_RESULT(instances.buffer.map());
+	updateInstances();
+
+	// Layout is global, so only create if it hasn't already been created before
+	{
+		std::lock_guard<std::mutex> lock(sharedStateMutex);
+		if (descriptorSetLayoutInstances == VK_NULL_HANDLE) {
+			VkDescriptorSetLayoutBinding setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
+			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(&setLayoutBinding, 1);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutInstances));
+		}
+	}
+	instances.descriptorSet = allocateDescriptorSet(descriptorSetLayoutInstances);
+	VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(instances.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &instances.buffer.descriptor);
+	vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+}
+
+void vkglTF::Model::updateInstances()
+{
+	// Pre-transformed vertices already are in model space
+	const bool preTransformed = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
+	glm::mat4* instanceMatrices = reinterpret_cast<glm::mat4*>(instances.buffer.mapped);
+	for (const InstanceBatch& batch : instanceBatches) {
+		for (size_t i = 0; i < batch.nodes.size(); i++) {
+			instanceMatrices[batch.firstInstance + i] = preTransformed ? glm::mat4(1.0f) : batch.nodes[i]->getMatrix();
+		}
+	}
+}
+
+void vkglTF::Model::drawInstanced(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet, uint32_t bindInstanceSet)
+{
+	if (instances.count == 0) {
+		return;
+	}
+	if (!buffersBound) {
+		const VkDeviceSize offsets[1] = {0};
+		const VkBuffer vertexBuffer = getVertexBuffer();
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	}
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindInstanceSet, 1, &instances.descriptorSet, 0, nullptr);
+	const uint32_t firstIndex = getFirstIndex();
+	const int32_t vertexOffset = getVertexOffset();
+	for (const InstanceBatch& batch : instanceBatches) {
+		for (Primitive* primitive : batch.mesh->primitives) {
+			const vkglTF::Material& material = primitive->material;
+			if (skipPrimitive(material, renderFlags)) {
+				continue;
+			}
+			if (renderFlags & RenderFlags::BindImages) {
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+			}
+			vkCmdDrawIndexed(commandBuffer, primitive->indexCount, static_cast<uint32_t>(batch.nodes.size()), firstIndex + primitive->firstIndex, vertexOffset, batch.firstInstance);
+		}
+	}
+}
+
+void vkglTF::Model::enqueue(vks::RenderQueue& renderQueue, const glm::mat4& view, const RenderPipelines& pipelines, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageSet)
+{
+	vks::DrawPacket packet{};
+	packet.pipelineLayout = pipelineLayout;
+	packet.vertexBuffer = getVertexBuffer();
+	packet.indexBuffer = getIndexBuffer();
+	packet.vertexOffset = getVertexOffset();
+	const uint32_t firstIndex = getFirstIndex();
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		const glm::mat4 modelView = view * node->getMatrix();
+		for (Primitive* primitive : node->mesh->primitives) {
+			const vkglTF::Material& material = primitive->material;
+			vks::RenderBucket bucket;
+			switch (material.alphaMode) {
+			case Material::ALPHAMODE_MASK:
+				bucket = vks::RenderBucket::AlphaMask;
+				packet.pipeline = pipelines.masked;
+				break;
+			case Material::ALPHAMODE_BLEND:
+				bucket = vks::RenderBucket::AlphaBlend;
+				packet.pipeline = pipelines.blended;
+				break;
+			default:
+				bucket = vks::RenderBucket::Opaque;
+				packet.pipeline = pipelines.opaque;
+			}
+			if ((packet.pipeline == VK_NULL_HANDLE) || (primitive->indexCount == 0)) {
+				continue;
+			}
+			if ((renderFlags & RenderFlags::BindImages) && (bindImageSet < vks::DrawPacket::maxDescriptorSets)) {
+				packet.descriptorSets[bindImageSet] = material.descriptorSet;
+			}
+			packet.indexCount = primitive->indexCount;
+			packet.firstIndex = firstIndex + primitive->firstIndex;
+			// View space looks down the negative z-axis
+			const float viewDepth = -(modelView * glm::vec4(primitive->dimensions.center, 1.0f)).z;
+			renderQueue.push(bucket, viewDepth, packet);
+		}
+	}
+}
+
 void vkglTF::Model::getNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max)
 {
 	if (node->mesh) {
@@ -1486,6 +1780,7 @@ void vkglTF::Model::getSceneDimensions()
 
 void vkglTF::Model::updateAnimation(uint32_t index, float time)
 {
+	VKS_TRACE_SCOPE("Update animation");
 	if (index > static_cast<uint32_t>(animations.size()) - 1) {
 		std::cout << "No animation with index " << index << std::endl;
 		return;
@@ -1538,6 +1833,9 @@ void vkglTF::Model::updateAnimation(uint32_t index, float time)
 		for (auto &node : nodes) {
 			node->update();
 		}
+		if (instances.count > 0) {
+			updateInstances();
+		}
 	}
 }
 
@@ -1571,12 +1869,7 @@ vkglTF::Node* vkglTF::Model::nodeFromIndex(uint32_t index) {
 
 void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout) {
 	if (node->mesh) {
-		VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		descriptorSetAllocInfo.descriptorPool = descriptorPool;
-		descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-		descriptorSetAllocInfo.descriptorSetCount = 1;
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet));
+		node->mesh->uniformBuffer.descriptorSet = allocateDescriptorSet(descriptorSetLayout);
 
 		VkWriteDescriptorSet writeDescriptorSet{};
 		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -1592,3 +1885,16 @@ void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLay
 		prepareNodeDescriptor(child, descriptorSetLayout);
 	}
 }
+
+VkDescriptorSet vkglTF::Model::allocateDescriptorSet(VkDescriptorSetLayout descriptorSetLayout)
+{
+	VkDescriptorSet descriptorSet;
+	if (descriptorAllocator) {
+		descriptorSet = descriptorAllocator->allocate(descriptorSetLayout);
+		allocatedDescriptorSets.push_back(descriptorSet);
+	} else {
+		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &descriptorSet));
+	}
+	return descriptorSet;
+}
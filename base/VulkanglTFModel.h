@@ -12,9 +12,13 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <unordered_map>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "VulkanRenderQueue.h"
+#include "VulkanGeometryPool.h"
+#include "VulkanDescriptorAllocator.h"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -44,8 +48,13 @@ namespace vkglTF
 
 	extern VkDescriptorSetLayout descriptorSetLayoutImage;
 	extern VkDescriptorSetLayout descriptorSetLayoutUbo;
+	extern VkDescriptorSetLayout descriptorSetLayoutInstances;
 	extern VkMemoryPropertyFlags memoryPropertyFlags;
 	extern uint32_t descriptorBindingFlags;
+	/** @brief If set, models loaded afterwards sub-allocate their geometry from this pool instead of creating their own buffers */
+	extern vks::GeometryPool* geometryPool;
+	/** @brief If set, models loaded afterwards allocate their descriptor sets from this allocator instead of creating their own pool, so they can be loaded and unloaded at runtime */
+	extern vks::DescriptorAllocator* descriptorAllocator;
 
 	struct Node;
 
@@ -66,6 +75,8 @@ namespace vkglTF
 		void updateDescriptor();
 		void destroy();
 		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, VkQueue copyQueue);
+		/** @brief Expands tightly packed RGB pixels to RGBA with opaque alpha, as most devices don't support RGB only formats */
+		static void convertRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount);
 	};
 
 	/*
@@ -92,6 +103,8 @@ namespace vkglTF
 
 		Material(vks::VulkanDevice* device) : device(device) {};
 		void createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
+		/** @brief Writes the material's images to its descriptor set */
+		void updateDescriptorSet(uint32_t descriptorBindingFlags);
 	};
 
 	/*
@@ -124,6 +137,8 @@ namespace vkglTF
 
 		std::vector<Primitive*> primitives;
 		std::string name;
+		/** @brief Index of the glTF mesh this was created from, nodes referencing the same glTF mesh share their vertex and index ranges */
+		int32_t index = -1;
 
 		struct UniformBuffer {
 			VkBuffer buffer;
@@ -139,6 +154,7 @@ namespace vkglTF
 			float jointcount{ 0 };
 		} uniformBlock;
 
+		/** @brief Without a device the uniform block is only kept in host memory */
 		Mesh(vks::VulkanDevice* device, glm::mat4 matrix);
 		~Mesh();
 	};
@@ -218,9 +234,10 @@ namespace vkglTF
 		glm::vec4 joint0;
 		glm::vec4 weight0;
 		glm::vec4 tangent;
-		static VkVertexInputBindingDescription vertexInputBindingDescription;
-		static std::vector<VkVertexInputAttributeDescription> vertexInputAttributeDescriptions;
-		static VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo;
+		// Per thread, so pipelines can be created concurrently (e.g. by startup tasks)
+		static thread_local VkVertexInputBindingDescription vertexInputBindingDescription;
+		static thread_local std::vector<VkVertexInputAttributeDescription> vertexInputAttributeDescriptions;
+		static thread_local VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo;
 		static VkVertexInputBindingDescription inputBindingDescription(uint32_t binding);
 		static VkVertexInputAttributeDescription inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component);
 		static std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components);
@@ -233,7 +250,8 @@ namespace vkglTF
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		PrepareInstancing = 0x00000010
 	};
 
 	enum RenderFlags {
@@ -243,6 +261,24 @@ namespace vkglTF
 		RenderAlphaBlendedNodes = 0x00000008
 	};
 
+	/*
+		Pipelines used when submitting a model to a render queue, primitives with an alpha mode that has no pipeline are skipped
+	*/
+	struct RenderPipelines {
+		VkPipeline opaque = VK_NULL_HANDLE;
+		VkPipeline masked = VK_NULL_HANDLE;
+		VkPipeline blended = VK_NULL_HANDLE;
+	};
+
+	/*
+		Nodes referencing the same glTF mesh, drawn with a single instanced draw per primitive
+	*/
+	struct InstanceBatch {
+		Mesh* mesh;
+		std::vector<Node*> nodes;
+		uint32_t firstInstance;
+	};
+
 	/*
 		glTF model loading and rendering class
 	*/
@@ -251,9 +287,18 @@ namespace vkglTF
 		vkglTF::Texture* getTexture(uint32_t index);
 		vkglTF::Texture emptyTexture;
 		void createEmptyTexture(VkQueue transferQueue);
+		uint32_t fileLoadingFlags = FileLoadingFlags::None;
+		std::unordered_map<int32_t, Mesh*> loadedMeshes;
+		std::vector<VkDescriptorSet> allocatedDescriptorSets;
 	public:
-		vks::VulkanDevice* device;
-		VkDescriptorPool descriptorPool;
+		vks::VulkanDevice* device = nullptr;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+		/** @brief Pool the geometry has been allocated from, vertices and indices don't own any buffers in that case */
+		vks::GeometryPool* geometryPool = nullptr;
+		vks::GeometryPool::Handle geometryHandle = vks::GeometryPool::invalidHandle;
+		/** @brief Allocator the descriptor sets have been allocated from, they are returned to it when the model is destroyed */
+		vks::DescriptorAllocator* descriptorAllocator = nullptr;
 
 		struct Vertices {
 			int count;
@@ -271,6 +316,14 @@ namespace vkglTF
 
 		std::vector<Skin*> skins;
 
+		/** @brief Batches of non-skinned nodes sharing a mesh, instance data is stored in a storage buffer with one model matrix per instance */
+		std::vector<InstanceBatch> instanceBatches;
+		struct Instances {
+			uint32_t count = 0;
+			vks::Buffer buffer;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		} instances;
+
 		std::vector<Texture> textures;
 		std::vector<Material> materials;
 		std::vector<Animation> animations;
@@ -289,6 +342,14 @@ namespace vkglTF
 
 		Model() {};
 		~Model();
+		/**
+		* Converts the vertex attributes of a glTF primitive to the default vertex layout
+		* @param vertexBuffer Vertex buffer the converted vertices are appended to
+		* @param posMin Minimum of the position accessor
+		* @param posMax Maximum of the position accessor
+		* @return Number of vertices appended
+		*/
+		static uint32_t loadVertices(const tinygltf::Model& model, const tinygltf::Primitive& primitive, std::vector<Vertex>& vertexBuffer, glm::vec3& posMin, glm::vec3& posMax);
 		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale);
 		void loadSkins(tinygltf::Model& gltfModel);
 		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue);
@@ -296,13 +357,29 @@ namespace vkglTF
 		void loadAnimations(tinygltf::Model& gltfModel);
 		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
 		void bindBuffers(VkCommandBuffer commandBuffer);
+		VkBuffer getVertexBuffer() const;
+		VkBuffer getIndexBuffer() const;
+		/** @brief Offsets of this model's geometry inside the buffers, only non-zero for pooled geometry */
+		uint32_t getFirstIndex() const;
+		int32_t getVertexOffset() const;
+		/** @brief Appends one indexed indirect draw command per primitive, pooled models can share a single indirect buffer */
+		void getDrawCommands(std::vector<VkDrawIndexedIndirectCommand>& commands, uint32_t renderFlags = 0);
 		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		/** @brief Groups nodes into instance batches and sets up the instance buffer, only done for models loaded with FileLoadingFlags::PrepareInstancing */
+		void prepareInstancing();
+		/** @brief Writes the current node matrices to the instance buffer, called after animation updates */
+		void updateInstances();
+		/** @brief Draws all instance batches, the instance buffer is bound at bindInstanceSet and indexed with the instance index in the vertex shader (skinned nodes are not included) */
+		void drawInstanced(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, uint32_t bindInstanceSet = 2);
+		/** @brief Adds all primitives to a render queue in a single pass over the node hierarchy, sorted by alpha mode, pipeline, material and view depth */
+		void enqueue(vks::RenderQueue& renderQueue, const glm::mat4& view, const RenderPipelines& pipelines, VkPipelineLayout pipelineLayout, uint32_t renderFlags = 0, uint32_t bindImageSet = 1);
 		void getNodeDimensions(Node* node, glm::vec3& min, glm::vec3& max);
 		void getSceneDimensions();
 		void updateAnimation(uint32_t index, float time);
 		Node* findNode(Node* parent, uint32_t index);
 		Node* nodeFromIndex(uint32_t index);
 		void prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout);
+		VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout descriptorSetLayout);
 	};
 }
\ No newline at end of file
@@ -13,6 +13,10 @@
 #include <functional>
 #include <chrono>
 #include <iomanip>
+#include <sstream>
+#include <cmath>
+
+#include "camerapath.hpp"
 
 namespace vks
 {
@@ -32,6 +36,33 @@ namespace vks
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
+		/** @brief Fixed time between two frames of a camera path run in seconds */
+		float pathTimeStep = 1.0f / 60.0f;
+
+		/** @brief Frame timings of a named part of a camera path run */
+		struct PathSegment {
+			std::string name;
+			uint32_t firstFrame = 0;
+			uint32_t frames = 0;
+			double total = 0.0;
+			double min = std::numeric_limits<double>::max();
+			double max = 0.0;
+		};
+		std::vector<PathSegment> pathSegments;
+
+		// Example specific results (name, value) reported along with the frame rate
+		std::vector<std::pair<std::string, std::string>> results;
+
+		void addResult(const std::string& name, const std::string& value) {
+			results.push_back({ name, value });
+		}
+
+		void addResult(const std::string& name, double value) {
+			std::ostringstream stream;
+			stream << std::fixed << std::setprecision(3) << value;
+			results.push_back({ name, stream.str() });
+		}
+
 		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps) {
 			active = true;
 			this->deviceProps = deviceProps;
@@ -64,11 +95,76 @@ namespace vks
 					frameCount++;
 					if (outputFrames != -1 && outputFrames == frameCount) break;
 				};
-				std::cout << "Benchmark finished" << "\n";
-				std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << "\n";
-				std::cout << "runtime: " << (runtime / 1000.0) << "\n";
-				std::cout << "frames : " << frameCount << "\n";
-				std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
+				printSummary();
+			}
+		}
+
+		/**
+		* Renders every frame of a camera path once, with a fixed time step instead of the measured frame time
+		* Each run renders the same sequence of frames, so results of different runs (drivers, builds) are comparable
+		* @param path Camera path, timings are reported per segment of the path
+		* @param frameFunc Sets up and renders the frame at the given path time
+		*/
+		void runPath(const vks::CameraPath& path, std::function<void(float time)> frameFunc, VkPhysicalDeviceProperties deviceProps) {
+			active = true;
+			this->deviceProps = deviceProps;
+#if defined(_WIN32)
+			AttachConsole(ATTACH_PARENT_PROCESS);
+			freopen_s(&stream, "CONOUT$", "w+", stdout);
+			freopen_s(&stream, "CONOUT$", "w+", stderr);
+#endif
+			std::cout << std::fixed << std::setprecision(3);
+
+			// Warm up phase repeats the first frame, so the time (and with it the frame sequence) doesn't depend on the warm up
+			{
+				double tMeasured = 0.0;
+				while (tMeasured < (warmup * 1000)) {
+					auto tStart = std::chrono::high_resolution_clock::now();
+					frameFunc(0.0f);
+					tMeasured += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+				};
+			}
+
+			// Benchmark phase
+			{
+				pathSegments.clear();
+				const uint32_t pathFrames = static_cast<uint32_t>(std::floor(path.duration() / pathTimeStep)) + 1;
+				for (uint32_t i = 0; i < pathFrames; i++) {
+					const float time = i * pathTimeStep;
+					auto tStart = std::chrono::high_resolution_clock::now();
+					frameFunc(time);
+					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+					runtime += tDiff;
+					frameTimes.push_back(tDiff);
+					frameCount++;
+
+					const std::string segmentName = path.segmentName(path.segmentIndex(time));
+					if (pathSegments.empty() || pathSegments.back().name != segmentName) {
+						pathSegments.push_back({ segmentName, i });
+					}
+					PathSegment& segment = pathSegments.back();
+					segment.frames++;
+					segment.total += tDiff;
+					segment.min = std::min(segment.min, tDiff);
+					segment.max = std::max(segment.max, tDiff);
+					if (outputFrames != -1 && outputFrames == frameCount) break;
+				}
+				printSummary();
+				std::cout << "\n" << std::left << std::setw(24) << "segment" << std::right << std::setw(8) << "frames" << std::setw(10) << "avg ms" << std::setw(10) << "min ms" << std::setw(10) << "max ms" << "\n";
+				for (auto& segment : pathSegments) {
+					std::cout << std::left << std::setw(24) << segment.name << std::right << std::setw(8) << segment.frames << std::setw(10) << segment.total / segment.frames << std::setw(10) << segment.min << std::setw(10) << segment.max << "\n";
+				}
+			}
+		}
+
+		void printSummary() {
+			std::cout << "Benchmark finished" << "\n";
+			std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << "\n";
+			std::cout << "runtime: " << (runtime / 1000.0) << "\n";
+			std::cout << "frames : " << frameCount << "\n";
+			std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
+			for (auto& result : results) {
+				std::cout << result.first << ": " << result.second << "\n";
 			}
 		}
 
@@ -80,6 +176,20 @@ namespace vks
 				result << "device,driverversion,duration (ms),frames,fps" << "\n";
 				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
 
+				if (!results.empty()) {
+					result << "\n" << "result,value" << "\n";
+					for (auto& customResult : results) {
+						result << customResult.first << "," << customResult.second << "\n";
+					}
+				}
+
+				if (!pathSegments.empty()) {
+					result << "\n" << "segment,first frame,frames,avg (ms),min (ms),max (ms)" << "\n";
+					for (auto& segment : pathSegments) {
+						result << segment.name << "," << segment.firstFrame << "," << segment.frames << "," << segment.total / segment.frames << "," << segment.min << "," << segment.max << "\n";
+					}
+				}
+
 				if (outputFrameTimes) {
 					result << "\n" << "frame,ms" << "\n";
 					for (size_t i = 0; i < frameTimes.size(); i++) {
@@ -6,6 +6,8 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
@@ -60,6 +62,9 @@ public:
 	bool updated = false;
 	bool flipY = false;
 
+	// Sub-pixel offset of the projection in normalized device coordinates, used for temporal anti-aliasing
+	glm::vec2 jitter = glm::vec2(0.0f);
+
 	struct
 	{
 		glm::mat4 perspective;
@@ -106,6 +111,17 @@ public:
 		}
 	}
 
+	void setJitter(glm::vec2 jitter)
+	{
+		this->jitter = jitter;
+	}
+
+	// Perspective with the jitter applied, the unjittered matrices.perspective should be used for motion vectors
+	glm::mat4 getJitteredPerspective()
+	{
+		return glm::translate(glm::mat4(1.0f), glm::vec3(jitter, 0.0f)) * matrices.perspective;
+	}
+
 	void setPosition(glm::vec3 position)
 	{
 		this->position = position;
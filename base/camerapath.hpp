@@ -0,0 +1,191 @@
+/*
+* Camera path recording and playback
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "camera.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Camera positions and rotations over time, recorded from an interactive session and replayed in benchmark mode
+	*
+	* Paths are stored as text files, one entry per line:
+	*   animation <timer> <paused>              State of the global animation timer when the recording started
+	*   segment <start time> <name>             Named part of the path, timings are reported per segment
+	*   key <time> <position xyz> <rotation xyz>
+	* Lines starting with # are ignored, so paths can be edited by hand.
+	*/
+	class CameraPath
+	{
+	public:
+		struct Keyframe {
+			float time;
+			glm::vec3 position;
+			glm::vec3 rotation;
+		};
+
+		/** @brief Part of the path from its start time up to the start of the next segment (or the end of the path) */
+		struct Segment {
+			float start;
+			std::string name;
+		};
+
+		std::vector<Keyframe> keyframes;
+		std::vector<Segment> segments;
+		/** @brief Animation timer and pause state at the start of the path */
+		float timerStart = 0.0f;
+		bool paused = false;
+
+		/** @brief Time between two recorded keyframes in seconds */
+		float recordInterval = 0.1f;
+
+		bool empty() const
+		{
+			return keyframes.empty();
+		}
+
+		/** @brief Duration of the path in seconds */
+		float duration() const
+		{
+			return keyframes.empty() ? 0.0f : keyframes.back().time;
+		}
+
+		/** @brief Interpolates the camera position and rotation (in degrees) at the given time */
+		void sample(float time, glm::vec3& position, glm::vec3& rotation) const
+		{
+			assert(!keyframes.empty());
+			auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time, [](float t, const Keyframe& keyframe) { return t < keyframe.time; });
+			if (next == keyframes.begin()) {
+				position = next->position;
+				rotation = next->rotation;
+				return;
+			}
+			if (next == keyframes.end()) {
+				position = keyframes.back().position;
+				rotation = keyframes.back().rotation;
+				return;
+			}
+			auto prev = next - 1;
+			const float t = (time - prev->time) / std::max(next->time - prev->time, 1.0e-6f);
+			position = glm::mix(prev->position, next->position, t);
+			rotation = glm::mix(prev->rotation, next->rotation, t);
+		}
+
+		/** @brief Index of the segment the given time falls into, paths without segments consist of a single segment */
+		uint32_t segmentIndex(float time) const
+		{
+			uint32_t index = 0;
+			for (uint32_t i = 1; i < segments.size(); i++) {
+				if (time >= segments[i].start) {
+					index = i;
+				}
+			}
+			return index;
+		}
+
+		std::string segmentName(uint32_t index) const
+		{
+			return (index < segments.size()) ? segments[index].name : "path";
+		}
+
+		/** @brief Starts a new recording with the current animation state */
+		void beginRecording(const Camera& camera, float timer, bool paused)
+		{
+			keyframes.clear();
+			segments.clear();
+			recordTime = 0.0f;
+			timerStart = timer;
+			this->paused = paused;
+			keyframes.push_back({ 0.0f, camera.position, camera.rotation });
+			addSegment();
+		}
+
+		/** @brief Advances the recording by the time of the last frame, keyframes are added every recordInterval seconds */
+		void record(const Camera& camera, float deltaTime)
+		{
+			recordTime += deltaTime;
+			if (keyframes.empty() || recordTime - keyframes.back().time >= recordInterval) {
+				keyframes.push_back({ recordTime, camera.position, camera.rotation });
+			}
+		}
+
+		/** @brief Starts a new segment at the current recording time */
+		void addSegment(const std::string& name = "")
+		{
+			const float start = keyframes.empty() ? 0.0f : keyframes.back().time;
+			segments.push_back({ start, name.empty() ? "segment " + std::to_string(segments.size()) : name });
+		}
+
+		bool loadFromFile(const std::string& filename)
+		{
+			std::ifstream file(filename);
+			if (!file.is_open()) {
+				return false;
+			}
+			keyframes.clear();
+			segments.clear();
+			std::string line;
+			while (std::getline(file, line)) {
+				std::istringstream stream(line);
+				std::string type;
+				stream >> type;
+				if (type == "animation") {
+					stream >> timerStart >> paused;
+				} else if (type == "segment") {
+					Segment segment{};
+					stream >> segment.start;
+					std::getline(stream >> std::ws, segment.name);
+					segments.push_back(segment);
+				} else if (type == "key") {
+					Keyframe keyframe{};
+					stream >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.rotation.x >> keyframe.rotation.y >> keyframe.rotation.z;
+					if (!stream.fail()) {
+						keyframes.push_back(keyframe);
+					}
+				}
+			}
+			std::sort(keyframes.begin(), keyframes.end(), [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+			std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) { return a.start < b.start; });
+			return !keyframes.empty();
+		}
+
+		bool saveToFile(const std::string& filename) const
+		{
+			std::ofstream file(filename);
+			if (!file.is_open()) {
+				return false;
+			}
+			file << std::fixed << std::setprecision(4);
+			file << "# Camera path: key <time> <position xyz> <rotation xyz>\n";
+			file << "animation " << timerStart << " " << paused << "\n";
+			for (const Segment& segment : segments) {
+				file << "segment " << segment.start << " " << segment.name << "\n";
+			}
+			for (const Keyframe& keyframe : keyframes) {
+				file << "key " << keyframe.time << " "
+					<< keyframe.position.x << " " << keyframe.position.y << " " << keyframe.position.z << " "
+					<< keyframe.rotation.x << " " << keyframe.rotation.y << " " << keyframe.rotation.z << "\n";
+			}
+			return file.good();
+		}
+
+	private:
+		float recordTime = 0.0f;
+	};
+}
@@ -212,8 +212,13 @@ void VulkanExampleBase::prepare()
 	setupDepthStencil();
 	setupRenderPass();
 	createPipelineCache();
+	// Pipeline variants are built from pipeline libraries if the example enabled VK_EXT_graphics_pipeline_library
+	const bool pipelineLibraries = std::find_if(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(), [](const char* extension) { return strcmp(extension, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) == 0; }) != enabledDeviceExtensions.end();
+	pipelineManager.prepare(device, pipelineCache, pipelineLibraries);
+	descriptorAllocator.prepare(device);
 	setupFrameBuffer();
 	settings.overlay = settings.overlay && (!benchmark.active);
+	VKS_TRACE_SCOPE("Prepare UI overlay");
 	if (settings.overlay) {
 		UIOverlay.device = vulkanDevice;
 		UIOverlay.queue = queue;
@@ -228,13 +233,13 @@ void VulkanExampleBase::prepare()
 
 VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileName, VkShaderStageFlagBits stage)
 {
+	VKS_TRACE_SCOPE("Load shader");
 	VkPipelineShaderStageCreateInfo shaderStage = {};
 	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	shaderStage.stage = stage;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-	shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
-#else
-	shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
+	// Modules are owned by the cache, so loading the same shader again (e.g. when rebuilding pipelines) doesn't create a new module
+	shaderStage.module = shaderCache.getModule(fileName);
+#if !defined(VK_USE_PLATFORM_ANDROID_KHR)
 	if (shaderStage.module == VK_NULL_HANDLE)
 	{
 		const std::string oldshaderdir("hlsl");
@@ -242,18 +247,33 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 		if (size_t pos = fileName.find(oldshaderdir); pos != std::string::npos)
 		{
 			fileName.replace(pos, oldshaderdir.length(), newshaderdir);
-			shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
+			shaderStage.module = shaderCache.getModule(fileName);
 		}
 	}
 #endif
 	shaderStage.pName = "main";
 	assert(shaderStage.module != VK_NULL_HANDLE);
-	shaderModules.push_back(shaderStage.module);
 	return shaderStage;
 }
 
+void VulkanExampleBase::executeStartupTasks()
+{
+	startupTasks.execute(startupThreadCount);
+	startupTasks.printReport();
+	startupTasks.clear();
+}
+
+void VulkanExampleBase::updatePipelines()
+{
+	// Pipelines compiled in the background are swapped in between frames, submitFrame waits for the queue so the previous frame has finished
+	if (prepared && pipelineManager.update()) {
+		recordCommandBuffers();
+	}
+}
+
 void VulkanExampleBase::nextFrame()
 {
+	VKS_TRACE_FRAME();
 	auto tStart = std::chrono::high_resolution_clock::now();
 	if (viewUpdated)
 	{
@@ -261,7 +281,12 @@ void VulkanExampleBase::nextFrame()
 		viewChanged();
 	}
 
-	render();
+	updatePipelines();
+
+	{
+		VKS_TRACE_SCOPE("Render");
+		render();
+	}
 	frameCounter++;
 	auto tEnd = std::chrono::high_resolution_clock::now();
 #if (defined(VK_USE_PLATFORM_IOS_MVK) || (defined(VK_USE_PLATFORM_MACOS_MVK) && !defined(VK_EXAMPLE_XCODE_GENERATED)))
@@ -271,11 +296,20 @@ void VulkanExampleBase::nextFrame()
 	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 #endif
 	frameTimer = (float)tDiff / 1000.0f;
+	VKS_TRACE_COUNTER("Frame time (ms)", tDiff);
 	camera.update(frameTimer);
 	if (camera.moving())
 	{
 		viewUpdated = true;
 	}
+	if (!cameraPathRecordFile.empty())
+	{
+		if (cameraPath.empty()) {
+			cameraPath.beginRecording(camera, timer, paused);
+		} else {
+			cameraPath.record(camera, frameTimer);
+		}
+	}
 	// Convert to clamped timer value
 	if (!paused)
 	{
@@ -304,13 +338,30 @@ void VulkanExampleBase::nextFrame()
 	updateOverlay();
 }
 
+void VulkanExampleBase::applyCameraPath(float time)
+{
+	glm::vec3 position, rotation;
+	cameraPath.sample(time, position, rotation);
+	camera.setPosition(position);
+	camera.setRotation(rotation);
+	// Time based values are derived from the path time instead of being accumulated, so every run gets the same values
+	frameTimer = benchmark.pathTimeStep;
+	paused = cameraPath.paused;
+	timer = paused ? cameraPath.timerStart : fmodf(cameraPath.timerStart + timerSpeed * time, 1.0f);
+	viewChanged();
+}
+
 void VulkanExampleBase::renderLoop()
 {
 // SRS - for non-apple plaforms, handle benchmarking here within VulkanExampleBase::renderLoop()
 //     - for macOS, handle benchmarking within NSApp rendering loop via displayLinkOutputCb()
 #if !(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
 	if (benchmark.active) {
-		benchmark.run([=] { render(); }, vulkanDevice->properties);
+		if (!cameraPath.empty()) {
+			benchmark.runPath(cameraPath, [this](float time) { applyCameraPath(time); updatePipelines(); render(); }, vulkanDevice->properties);
+		} else {
+			benchmark.run([this] { updatePipelines(); render(); }, vulkanDevice->properties);
+		}
 		vkDeviceWaitIdle(device);
 		if (benchmark.filename != "") {
 			benchmark.saveResults();
@@ -679,6 +730,7 @@ void VulkanExampleBase::updateOverlay()
 	if (!settings.overlay)
 		return;
 
+	VKS_TRACE_SCOPE("Update UI overlay");
 	ImGuiIO& io = ImGui::GetIO();
 
 	io.DisplaySize = ImVec2((float)width, (float)height);
@@ -704,6 +756,13 @@ void VulkanExampleBase::updateOverlay()
 #endif
 	ImGui::PushItemWidth(110.0f * UIOverlay.scale);
 	OnUpdateUIOverlay(&UIOverlay);
+	if (!cameraPathRecordFile.empty() && UIOverlay.header("Camera path")) {
+		UIOverlay.text("Recording %d keyframes (%.1f s)", (int32_t)cameraPath.keyframes.size(), cameraPath.duration());
+		UIOverlay.text("Segment: %s", cameraPath.segmentName((uint32_t)cameraPath.segments.size() - 1).c_str());
+		if (UIOverlay.button("New segment")) {
+			cameraPath.addSegment();
+		}
+	}
 	ImGui::PopItemWidth();
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PopStyleVar();
@@ -714,7 +773,7 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::Render();
 
 	if (UIOverlay.update() || UIOverlay.updated) {
-		buildCommandBuffers();
+		recordCommandBuffers();
 		UIOverlay.updated = false;
 	}
 
@@ -752,10 +811,18 @@ void VulkanExampleBase::prepareFrame()
 	else {
 		VK_CHECK_RESULT(result);
 	}
+	// Frames are separated by a queue wait idle, so the transient descriptor sets of the last use of this image are no longer in use
+	descriptorAllocator.beginFrame(currentBuffer);
 }
 
 void VulkanExampleBase::submitFrame()
 {
+	VKS_TRACE_SCOPE("Present");
+	// Links the submission (done by the caller right before) to the recording of the command buffer, only the first submit after recording is linked
+	if ((currentBuffer < drawCmdBuffersRecorded.size()) && drawCmdBuffersRecorded[currentBuffer]) {
+		VKS_TRACE_FLOW_END("Command buffer", drawCmdBuffers[currentBuffer]);
+		drawCmdBuffersRecorded[currentBuffer] = false;
+	}
 	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
@@ -805,6 +872,16 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	commandLineParser.add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	commandLineParser.add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	commandLineParser.add("benchmarkpath", { "-bp", "--benchpath" }, 1, "Replay the camera path from the given file in benchmark mode");
+	commandLineParser.add("benchmarkpathfps", { "-bpf", "--benchpathfps" }, 1, "Set the fixed frame rate camera paths are replayed at in benchmark mode");
+	commandLineParser.add("startupthreads", { "-st", "--startupthreads" }, 1, "Set the number of threads used to load assets and create pipelines at startup (1 = serial)");
+	commandLineParser.add("recordpath", { "-rp", "--recordpath" }, 1, "Record the camera path to the given file on exit");
+#if !(defined(VK_USE_PLATFORM_ANDROID_KHR) || defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
+	commandLineParser.add("headless", { "-hl", "--headless" }, 0, "Run the benchmark without a window, rendering to offscreen images instead of a swapchain");
+#endif
+#if defined(VKS_TRACING)
+	commandLineParser.add("trace", { "-tr", "--trace" }, 1, "Write a Chrome trace (JSON) of CPU zones to the given file on exit");
+#endif
 
 	commandLineParser.parse(args);
 	if (commandLineParser.isSet("help")) {
@@ -858,6 +935,40 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	if (commandLineParser.isSet("benchmarkframes")) {
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
 	}
+	if (commandLineParser.isSet("benchmarkpath")) {
+		std::string pathFile = commandLineParser.getValueAsString("benchmarkpath", "");
+		if (!cameraPath.loadFromFile(pathFile)) {
+			std::cerr << "Could not load camera path from " << pathFile << "\n";
+		}
+	}
+	if (commandLineParser.isSet("benchmarkpathfps")) {
+		const int32_t pathFps = commandLineParser.getValueAsInt("benchmarkpathfps", 60);
+		if (pathFps > 0) {
+			benchmark.pathTimeStep = 1.0f / pathFps;
+		} else {
+			std::cerr << "Camera path frame rate must be greater than zero, using " << 1.0f / benchmark.pathTimeStep << "\n";
+		}
+	}
+	if (commandLineParser.isSet("startupthreads")) {
+		startupThreadCount = commandLineParser.getValueAsInt("startupthreads", 0);
+	}
+	if (commandLineParser.isSet("recordpath")) {
+		cameraPathRecordFile = commandLineParser.getValueAsString("recordpath", "");
+	}
+#if !(defined(VK_USE_PLATFORM_ANDROID_KHR) || defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
+	if (commandLineParser.isSet("headless")) {
+		// Without a window there is no way to interact with the example, so headless always runs the benchmark
+		headless = true;
+		benchmark.active = true;
+		vks::tools::errorModeSilent = true;
+	}
+#endif
+#if defined(VKS_TRACING)
+	VKS_TRACE_THREAD_NAME("Main thread");
+	if (commandLineParser.isSet("trace")) {
+		traceFileName = commandLineParser.getValueAsString("trace", traceFileName);
+	}
+#endif
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Vulkan library is loaded dynamically on Android
@@ -866,9 +977,13 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 #elif defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	initWaylandConnection();
+	if (!headless) {
+		initWaylandConnection();
+	}
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	initxcbConnection();
+	if (!headless) {
+		initxcbConnection();
+	}
 #endif
 
 #if defined(_WIN32)
@@ -883,7 +998,25 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 
 VulkanExampleBase::~VulkanExampleBase()
 {
+	if (!cameraPathRecordFile.empty()) {
+		if (cameraPath.saveToFile(cameraPathRecordFile)) {
+			std::cout << "Camera path written to " << cameraPathRecordFile << "\n";
+		} else {
+			std::cerr << "Could not write camera path to " << cameraPathRecordFile << "\n";
+		}
+	}
+#if defined(VKS_TRACING)
+	if (!traceFileName.empty()) {
+		if (vks::trace::exportChromeTrace(traceFileName)) {
+			std::cout << "CPU trace written to " << traceFileName << "\n";
+		} else {
+			std::cerr << "Could not write CPU trace to " << traceFileName << "\n";
+		}
+	}
+#endif
 	// Clean up Vulkan resources
+	// Pipeline compile workers may still reference the render pass, so they are stopped before anything else is destroyed
+	pipelineManager.destroy();
 	swapChain.cleanup();
 	if (descriptorPool != VK_NULL_HANDLE)
 	{
@@ -899,10 +1032,8 @@ VulkanExampleBase::~VulkanExampleBase()
 		vkDestroyFramebuffer(device, frameBuffers[i], nullptr);
 	}
 
-	for (auto& shaderModule : shaderModules)
-	{
-		vkDestroyShaderModule(device, shaderModule, nullptr);
-	}
+	descriptorAllocator.destroy();
+	shaderCache.destroy();
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.mem, nullptr);
@@ -930,6 +1061,10 @@ VulkanExampleBase::~VulkanExampleBase()
 
 	vkDestroyInstance(instance, nullptr);
 
+	if (headless) {
+		return;
+	}
+
 #if defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_DIRECTFB_EXT)
@@ -1064,6 +1199,16 @@ bool VulkanExampleBase::initVulkan()
 
 	swapChain.connect(instance, physicalDevice, device);
 
+	shaderCache.setDevice(device);
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	shaderCache.setAssetManager(androidApp->activity->assetManager);
+#else
+	// Shaders packed with data/shaders/packshaders.py are read from the archive instead of individual files
+	if (shaderCache.openArchive(getAssetPath() + "shaders/shaders.pak", getAssetPath())) {
+		std::cout << "Using shader archive " << getAssetPath() << "shaders/shaders.pak\n";
+	}
+#endif
+
 	// Create synchronization objects
 	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
 	// Create a semaphore used to synchronize image presentation
@@ -1121,6 +1266,9 @@ void VulkanExampleBase::setupDPIAwareness()
 HWND VulkanExampleBase::setupWindow(HINSTANCE hinstance, WNDPROC wndproc)
 {
 	this->windowInstance = hinstance;
+	if (headless) {
+		return nullptr;
+	}
 
 	WNDCLASSEX wndClass;
 
@@ -1881,7 +2029,11 @@ void VulkanExampleBase::displayLinkOutputCb()
 {
 #if defined(VK_EXAMPLE_XCODE_GENERATED)
 	if (benchmark.active) {
-		benchmark.run([=] { render(); }, vulkanDevice->properties);
+		if (!cameraPath.empty()) {
+			benchmark.runPath(cameraPath, [this](float time) { applyCameraPath(time); updatePipelines(); render(); }, vulkanDevice->properties);
+		} else {
+			benchmark.run([this] { updatePipelines(); render(); }, vulkanDevice->properties);
+		}
 		if (benchmark.filename != "") {
 			benchmark.saveResults();
 		}
@@ -1921,6 +2073,10 @@ IDirectFBSurface *VulkanExampleBase::setupWindow()
 	DFBResult ret;
 	int posx = 0, posy = 0;
 
+	if (headless) {
+		return nullptr;
+	}
+
 	ret = DirectFBInit(NULL, NULL);
 	if (ret)
 	{
@@ -2422,6 +2578,9 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 
 struct xdg_surface *VulkanExampleBase::setupWindow()
 {
+	if (headless) {
+		return nullptr;
+	}
 	surface = wl_compositor_create_surface(compositor);
 	xdg_surface = xdg_wm_base_get_xdg_surface(shell, surface);
 
@@ -2448,6 +2607,10 @@ xcb_window_t VulkanExampleBase::setupWindow()
 {
 	uint32_t value_mask, value_list[32];
 
+	if (headless) {
+		return 0;
+	}
+
 	window = xcb_generate_id(connection);
 
 	value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
@@ -2671,6 +2834,16 @@ void VulkanExampleBase::mouseMoved(double x, double y, bool & handled) {}
 
 void VulkanExampleBase::buildCommandBuffers() {}
 
+void VulkanExampleBase::recordCommandBuffers()
+{
+	VKS_TRACE_SCOPE("Build command buffers");
+	buildCommandBuffers();
+	for (VkCommandBuffer commandBuffer : drawCmdBuffers) {
+		VKS_TRACE_FLOW_BEGIN("Command buffer", commandBuffer);
+	}
+	drawCmdBuffersRecorded.assign(drawCmdBuffers.size(), true);
+}
+
 void VulkanExampleBase::createSynchronizationPrimitives()
 {
 	// Wait fences to sync command buffer access
@@ -2701,7 +2874,7 @@ void VulkanExampleBase::setupDepthStencil()
 	imageCI.arrayLayers = 1;
 	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageCI.usage = depthStencil.usage;
 
 	VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &depthStencil.image));
 	VkMemoryRequirements memReqs{};
@@ -2870,7 +3043,7 @@ void VulkanExampleBase::windowResize()
 	// references to the recreated frame buffer
 	destroyCommandBuffers();
 	createCommandBuffers();
-	buildCommandBuffers();
+	recordCommandBuffers();
 	
 	// SRS - Recreate fences in case number of swapchain images has changed on resize
 	for (auto& fence : waitFences) {
@@ -2928,6 +3101,10 @@ void VulkanExampleBase::windowResized() {}
 
 void VulkanExampleBase::initSwapchain()
 {
+	if (headless) {
+		swapChain.initOffscreen(queue, vulkanDevice->queueFamilyIndices.graphics);
+		return;
+	}
 #if defined(_WIN32)
 	swapChain.initSurface(windowInstance, window);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
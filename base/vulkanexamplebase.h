@@ -42,6 +42,7 @@
 #include <ctime>
 #include <iostream>
 #include <chrono>
+#include <mutex>
 #include <random>
 #include <algorithm>
 #include <sys/stat.h>
@@ -64,6 +65,11 @@
 #include "VulkanTools.h"
 #include "VulkanDebug.h"
 #include "VulkanUIOverlay.h"
+#include "VulkanTrace.h"
+#include "VulkanTaskGraph.h"
+#include "VulkanShaderCache.h"
+#include "VulkanPipelineManager.h"
+#include "VulkanDescriptorAllocator.h"
 #include "VulkanSwapChain.h"
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
@@ -92,6 +98,15 @@ private:
 	void createCommandBuffers();
 	void destroyCommandBuffers();
 	std::string shaderDir = "hlsl";
+#if defined(VKS_TRACING)
+	std::string traceFileName;
+#endif
+	/** @brief Camera path replayed in benchmark mode, or recorded from an interactive session if cameraPathRecordFile is set */
+	vks::CameraPath cameraPath;
+	std::string cameraPathRecordFile;
+	void applyCameraPath(float time);
+	/** @brief Swaps in pipelines compiled in the background and re-records the command buffers, run before every frame by the interactive and the benchmark loops */
+	void updatePipelines();
 protected:
 	// Returns the path to the root of the glsl or hlsl shader directory.
 	std::string getShadersPath() const;
@@ -133,6 +148,8 @@ protected:
 	VkSubmitInfo submitInfo;
 	// Command buffers used for rendering
 	std::vector<VkCommandBuffer> drawCmdBuffers;
+	// Set for each draw command buffer recorded by recordCommandBuffers and cleared by its next submission, so the trace flow is only ended once
+	std::vector<bool> drawCmdBuffersRecorded;
 	// Global render pass for frame buffer writes
 	VkRenderPass renderPass = VK_NULL_HANDLE;
 	// List of available frame buffers (same as number of swap chain images)
@@ -141,8 +158,16 @@ protected:
 	uint32_t currentBuffer = 0;
 	// Descriptor set pool
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-	// List of shader modules created (stored for cleanup)
-	std::vector<VkShaderModule> shaderModules;
+	// Shader modules loaded with loadShader, deduplicated and destroyed by the cache
+	vks::ShaderCache shaderCache;
+	// Compiles pipeline variants requested by the example in the background, finished pipelines are swapped in before a frame is rendered
+	vks::PipelineManager pipelineManager;
+	// Growable descriptor pools for sets that are added and removed at runtime, transient pools of the current frame are reset in prepareFrame
+	vks::DescriptorAllocator descriptorAllocator;
+	// Asset loads and pipeline builds of the example that can run concurrently at startup, see executeStartupTasks
+	vks::TaskGraph startupTasks;
+	// Number of threads used for the startup tasks (0 = all hardware threads)
+	uint32_t startupThreadCount = 0;
 	// Pipeline cache object
 	VkPipelineCache pipelineCache;
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
@@ -169,6 +194,8 @@ public:
 	float frameTimer = 1.0f;
 
 	vks::Benchmark benchmark;
+	/** @brief Run without a window, rendering to offscreen images instead of a swapchain (implies benchmark mode) */
+	bool headless = false;
 
 	/** @brief Encapsulated physical and logical vulkan device */
 	vks::VulkanDevice *vulkanDevice;
@@ -207,6 +234,8 @@ public:
 		VkImage image;
 		VkDeviceMemory mem;
 		VkImageView view;
+		/** @brief Usage flags of the depth stencil image, examples can add e.g. VK_IMAGE_USAGE_SAMPLED_BIT to read back depth */
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
 	} depthStencil;
 
 	struct {
@@ -360,6 +389,8 @@ public:
 	virtual void windowResized();
 	/** @brief (Virtual) Called when resources have been recreated that require a rebuild of the command buffers (e.g. frame buffer), to be implemented by the sample application */
 	virtual void buildCommandBuffers();
+	/** @brief Calls buildCommandBuffers in a trace zone and links the recording to the next submission of each draw command buffer */
+	void recordCommandBuffers();
 	/** @brief (Virtual) Setup default depth and stencil views */
 	virtual void setupDepthStencil();
 	/** @brief (Virtual) Setup default framebuffers for all requested swapchain images */
@@ -377,6 +408,9 @@ public:
 	/** @brief Loads a SPIR-V shader file for the given shader stage */
 	VkPipelineShaderStageCreateInfo loadShader(std::string fileName, VkShaderStageFlagBits stage);
 
+	/** @brief Runs the tasks added to startupTasks on a worker pool and prints the startup critical path report */
+	void executeStartupTasks();
+
 	/** @brief Entry point for the main render loop */
 	void renderLoop();
 
@@ -0,0 +1,344 @@
+/*
+* CPU micro benchmarks
+*
+* Host side hot paths of the base framework measured in isolation, no Vulkan device is created so this runs without a GPU
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "microbenchmark.hpp"
+#include "CommandLineParser.hpp"
+#include "VulkanglTFModel.h"
+#include "VulkanHeightmap.hpp"
+#include "frustum.hpp"
+#include "animator.h"
+#include "transform.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+namespace
+{
+	// Deterministic input data, so results of different runs are comparable
+	std::mt19937 randomEngine(1337);
+
+	float randomFloat(float min, float max)
+	{
+		return std::uniform_real_distribution<float>(min, max)(randomEngine);
+	}
+
+	/*
+		Host only model with a chain of joints and a skinned mesh node, similar to a character rig
+		Every joint is animated (rotation and translation), so updateAnimation touches every node
+	*/
+	void buildSkinnedModel(vkglTF::Model& model, uint32_t jointCount, uint32_t keyframeCount)
+	{
+		assert(jointCount <= 64);
+		vkglTF::Node* parent = nullptr;
+		for (uint32_t i = 0; i < jointCount; i++) {
+			vkglTF::Node* node = new vkglTF::Node{};
+			node->index = i;
+			node->parent = parent;
+			node->matrix = glm::mat4(1.0f);
+			node->translation = glm::vec3(0.0f, 0.1f, 0.0f);
+			if (parent) {
+				parent->children.push_back(node);
+			} else {
+				model.nodes.push_back(node);
+			}
+			model.linearNodes.push_back(node);
+			parent = node;
+		}
+
+		vkglTF::Skin* skin = new vkglTF::Skin{};
+		skin->joints = model.linearNodes;
+		skin->skeletonRoot = model.linearNodes.front();
+		skin->inverseBindMatrices.resize(jointCount, glm::mat4(1.0f));
+		model.skins.push_back(skin);
+
+		vkglTF::Node* meshNode = new vkglTF::Node{};
+		meshNode->index = jointCount;
+		meshNode->matrix = glm::mat4(1.0f);
+		meshNode->mesh = new vkglTF::Mesh(nullptr, glm::mat4(1.0f));
+		meshNode->skin = skin;
+		model.nodes.push_back(meshNode);
+		model.linearNodes.push_back(meshNode);
+
+		vkglTF::Animation animation{};
+		animation.name = "benchmark";
+		std::vector<float> inputs(keyframeCount);
+		for (uint32_t i = 0; i < keyframeCount; i++) {
+			inputs[i] = i / 30.0f;
+		}
+		animation.start = inputs.front();
+		animation.end = inputs.back();
+		for (uint32_t i = 0; i < jointCount; i++) {
+			vkglTF::AnimationSampler rotation{};
+			rotation.interpolation = vkglTF::AnimationSampler::LINEAR;
+			rotation.inputs = inputs;
+			vkglTF::AnimationSampler translation = rotation;
+			for (uint32_t k = 0; k < keyframeCount; k++) {
+				glm::quat q = glm::angleAxis(randomFloat(-0.5f, 0.5f), glm::normalize(glm::vec3(randomFloat(-1.0f, 1.0f), 1.0f, randomFloat(-1.0f, 1.0f))));
+				rotation.outputsVec4.push_back(glm::vec4(q.x, q.y, q.z, q.w));
+				translation.outputsVec4.push_back(glm::vec4(0.0f, 0.1f + randomFloat(-0.01f, 0.01f), 0.0f, 0.0f));
+			}
+			animation.channels.push_back({ vkglTF::AnimationChannel::ROTATION, model.linearNodes[i], static_cast<uint32_t>(animation.samplers.size()) });
+			animation.samplers.push_back(rotation);
+			animation.channels.push_back({ vkglTF::AnimationChannel::TRANSLATION, model.linearNodes[i], static_cast<uint32_t>(animation.samplers.size()) });
+			animation.samplers.push_back(translation);
+		}
+		model.animations.push_back(animation);
+	}
+
+	/** @brief Host only model with a single root and one non-skinned mesh node per child, similar to a static scene */
+	void buildSceneModel(vkglTF::Model& model, uint32_t meshNodeCount)
+	{
+		vkglTF::Node* root = new vkglTF::Node{};
+		root->matrix = glm::mat4(1.0f);
+		model.nodes.push_back(root);
+		model.linearNodes.push_back(root);
+		for (uint32_t i = 0; i < meshNodeCount; i++) {
+			vkglTF::Node* node = new vkglTF::Node{};
+			node->index = i + 1;
+			node->parent = root;
+			node->matrix = glm::mat4(1.0f);
+			node->translation = glm::vec3(randomFloat(-10.0f, 10.0f), 0.0f, randomFloat(-10.0f, 10.0f));
+			node->mesh = new vkglTF::Mesh(nullptr, glm::mat4(1.0f));
+			root->children.push_back(node);
+			model.linearNodes.push_back(node);
+		}
+	}
+
+	/** @brief Adds a tightly packed float attribute to a glTF model and returns its accessor index */
+	int addAttribute(tinygltf::Model& model, const std::vector<float>& data, int type, size_t count)
+	{
+		tinygltf::Buffer buffer;
+		buffer.data.resize(data.size() * sizeof(float));
+		memcpy(buffer.data.data(), data.data(), buffer.data.size());
+		model.buffers.push_back(buffer);
+
+		tinygltf::BufferView view;
+		view.buffer = static_cast<int>(model.buffers.size()) - 1;
+		view.byteLength = buffer.data.size();
+		model.bufferViews.push_back(view);
+
+		tinygltf::Accessor accessor;
+		accessor.bufferView = static_cast<int>(model.bufferViews.size()) - 1;
+		accessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+		accessor.type = type;
+		accessor.count = count;
+		model.accessors.push_back(accessor);
+		return static_cast<int>(model.accessors.size()) - 1;
+	}
+
+	std::vector<float> randomFloats(size_t count, float min, float max)
+	{
+		std::vector<float> values(count);
+		for (float& value : values) {
+			value = randomFloat(min, max);
+		}
+		return values;
+	}
+
+	void benchmarkFrustum(vks::MicroBenchmark& benchmark)
+	{
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 256.0f);
+		const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 5.0f, -20.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 viewProjection = projection * view;
+
+		vks::Frustum frustum;
+		benchmark.run("Frustum::update", 1, [&]() {
+			frustum.update(viewProjection);
+			vks::doNotOptimize(frustum.planes);
+		});
+
+		const uint32_t sphereCount = 4096;
+		std::vector<glm::vec4> spheres(sphereCount);
+		for (glm::vec4& sphere : spheres) {
+			sphere = glm::vec4(randomFloat(-100.0f, 100.0f), randomFloat(-10.0f, 10.0f), randomFloat(-100.0f, 100.0f), randomFloat(0.5f, 4.0f));
+		}
+		frustum.update(viewProjection);
+		benchmark.run("Frustum::checkSphere/4096", sphereCount, [&]() {
+			uint32_t visible = 0;
+			for (const glm::vec4& sphere : spheres) {
+				visible += frustum.checkSphere(glm::vec3(sphere), sphere.w) ? 1 : 0;
+			}
+			vks::doNotOptimize(visible);
+		});
+	}
+
+	void benchmarkNodes(vks::MicroBenchmark& benchmark)
+	{
+		const uint32_t jointCount = 64;
+		vkglTF::Model skinnedModel;
+		buildSkinnedModel(skinnedModel, jointCount, 60);
+
+		vkglTF::Node* leaf = skinnedModel.linearNodes[jointCount - 1];
+		benchmark.run("Node::getMatrix/depth 64", 1, [&]() {
+			vks::doNotOptimize(leaf->getMatrix());
+		});
+
+		vkglTF::Node* meshNode = skinnedModel.nodes.back();
+		benchmark.run("Node::update/skinned 64 joints", jointCount, [&]() {
+			meshNode->update();
+			vks::doNotOptimize(meshNode->mesh->uniformBlock);
+		});
+
+		const uint32_t meshNodeCount = 256;
+		vkglTF::Model sceneModel;
+		buildSceneModel(sceneModel, meshNodeCount);
+		vkglTF::Node* root = sceneModel.nodes.front();
+		benchmark.run("Node::update/256 mesh nodes", meshNodeCount, [&]() {
+			root->update();
+			vks::doNotOptimize(root->children.back()->mesh->uniformBuffer.mapped);
+		});
+
+		// Advances by an odd step so the sampled times don't repeat with a short period
+		float time = 0.0f;
+		const float end = skinnedModel.animations[0].end;
+		benchmark.run("Model::updateAnimation/64 joints", jointCount, [&]() {
+			time += 0.0137f;
+			if (time > end) {
+				time -= end;
+			}
+			skinnedModel.updateAnimation(0, time);
+		});
+	}
+
+	void benchmarkVertexConversion(vks::MicroBenchmark& benchmark)
+	{
+		const size_t vertexCount = 65536;
+		tinygltf::Model gltfModel;
+		tinygltf::Primitive primitive;
+		primitive.attributes["POSITION"] = addAttribute(gltfModel, randomFloats(vertexCount * 3, -1.0f, 1.0f), TINYGLTF_TYPE_VEC3, vertexCount);
+		gltfModel.accessors[primitive.attributes["POSITION"]].minValues = { -1.0, -1.0, -1.0 };
+		gltfModel.accessors[primitive.attributes["POSITION"]].maxValues = { 1.0, 1.0, 1.0 };
+		primitive.attributes["NORMAL"] = addAttribute(gltfModel, randomFloats(vertexCount * 3, -1.0f, 1.0f), TINYGLTF_TYPE_VEC3, vertexCount);
+		primitive.attributes["TEXCOORD_0"] = addAttribute(gltfModel, randomFloats(vertexCount * 2, 0.0f, 1.0f), TINYGLTF_TYPE_VEC2, vertexCount);
+		primitive.attributes["COLOR_0"] = addAttribute(gltfModel, randomFloats(vertexCount * 4, 0.0f, 1.0f), TINYGLTF_TYPE_VEC4, vertexCount);
+		primitive.attributes["TANGENT"] = addAttribute(gltfModel, randomFloats(vertexCount * 4, -1.0f, 1.0f), TINYGLTF_TYPE_VEC4, vertexCount);
+
+		std::vector<vkglTF::Vertex> vertexBuffer;
+		vertexBuffer.reserve(vertexCount);
+		benchmark.run("glTF loadVertices/65536", vertexCount, [&]() {
+			glm::vec3 posMin, posMax;
+			vertexBuffer.clear();
+			vkglTF::Model::loadVertices(gltfModel, primitive, vertexBuffer, posMin, posMax);
+			vks::doNotOptimize(vertexBuffer.data());
+		});
+	}
+
+	void benchmarkTextureConversion(vks::MicroBenchmark& benchmark)
+	{
+		const size_t pixelCount = 1024 * 1024;
+		std::vector<unsigned char> rgb(pixelCount * 3);
+		for (size_t i = 0; i < rgb.size(); i++) {
+			rgb[i] = static_cast<unsigned char>(i * 7);
+		}
+		std::vector<unsigned char> rgba(pixelCount * 4);
+		benchmark.run("glTF convertRGBToRGBA/1024x1024", pixelCount, [&]() {
+			vkglTF::Texture::convertRGBToRGBA(rgb.data(), rgba.data(), pixelCount);
+			vks::doNotOptimize(rgba.data());
+		});
+	}
+
+	void benchmarkHomework(vks::MicroBenchmark& benchmark)
+	{
+		const uint32_t keyframeCount = 60;
+		std::vector<float> times(keyframeCount);
+		std::vector<glm::vec3> translations(keyframeCount);
+		std::vector<glm::vec4> rotations(keyframeCount);
+		std::vector<glm::vec3> scales(keyframeCount);
+		for (uint32_t i = 0; i < keyframeCount; i++) {
+			times[i] = i / 30.0f;
+			translations[i] = glm::vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f));
+			glm::quat q = glm::angleAxis(randomFloat(-3.0f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			rotations[i] = glm::vec4(q.x, q.y, q.z, q.w);
+			scales[i] = glm::vec3(randomFloat(0.5f, 1.5f));
+		}
+		Animator animator;
+		animator.setTimes(0, times);
+		animator.setTranslation(translations);
+		animator.setRotation(rotations);
+		animator.setScales(scales);
+		benchmark.run("Animator::updateAnimationRetTransform", 1, [&]() {
+			Transform transform = animator.updateAnimationRetTransform(0.0137f);
+			vks::doNotOptimize(transform);
+		});
+
+		Transform transform(glm::vec3(1.5f), glm::angleAxis(0.7f, glm::normalize(glm::vec3(1.0f, 1.0f, 0.0f))), glm::vec3(1.0f, 2.0f, 3.0f));
+		benchmark.run("Transform::toMaterix4", 1, [&]() {
+			vks::doNotOptimize(transform.toMaterix4());
+		});
+	}
+
+	void benchmarkHeightMap(vks::MicroBenchmark& benchmark)
+	{
+		const uint32_t dim = 1024;
+		const uint32_t patchsize = 256;
+		std::vector<uint16_t> heights(dim * dim);
+		for (uint32_t y = 0; y < dim; y++) {
+			for (uint32_t x = 0; x < dim; x++) {
+				const float height = 0.5f + 0.25f * sinf(x * 0.02f) * cosf(y * 0.03f) + 0.1f * sinf((x + y) * 0.1f);
+				heights[x + y * dim] = static_cast<uint16_t>(height * 65535.0f);
+			}
+		}
+		vks::HeightMap heightMap(nullptr, VK_NULL_HANDLE);
+		heightMap.heightScale = 16.0f;
+		heightMap.setHeightData(heights.data(), dim, patchsize);
+		std::vector<vks::HeightMap::Vertex> vertices(patchsize * patchsize);
+		benchmark.run("HeightMap::generateNormals/256x256", patchsize * patchsize, [&]() {
+			heightMap.generateNormals(vertices.data(), patchsize);
+			vks::doNotOptimize(vertices.data());
+		});
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	CommandLineParser commandLineParser;
+	commandLineParser.add("help", { "--help" }, 0, "Show help");
+	commandLineParser.add("warmup", { "-w", "--warmup" }, 1, "Set warmup time per benchmark in ms");
+	commandLineParser.add("batchtime", { "-bt", "--batchtime" }, 1, "Set minimum duration of a measured batch in ms");
+	commandLineParser.add("repetitions", { "-r", "--repetitions" }, 1, "Set number of measured batches per benchmark");
+	commandLineParser.add("filter", { "-f", "--filter" }, 1, "Only run benchmarks whose name contains this string");
+	commandLineParser.add("json", { "-j", "--json" }, 1, "Write results to a JSON file");
+	commandLineParser.parse(argc, argv);
+	if (commandLineParser.isSet("help")) {
+		commandLineParser.printHelp();
+		return 0;
+	}
+
+	vks::MicroBenchmark benchmark;
+	benchmark.warmupTime = commandLineParser.getValueAsInt("warmup", benchmark.warmupTime);
+	benchmark.minBatchTime = commandLineParser.getValueAsInt("batchtime", benchmark.minBatchTime);
+	benchmark.repetitions = commandLineParser.getValueAsInt("repetitions", benchmark.repetitions);
+	benchmark.filter = commandLineParser.getValueAsString("filter", "");
+
+#if !defined(NDEBUG)
+	std::cout << "Warning: Benchmarks are running in a debug build, timings are not representative\n";
+#endif
+
+	benchmarkFrustum(benchmark);
+	benchmarkNodes(benchmark);
+	benchmarkVertexConversion(benchmark);
+	benchmarkTextureConversion(benchmark);
+	benchmarkHomework(benchmark);
+	benchmarkHeightMap(benchmark);
+
+	if (commandLineParser.isSet("json")) {
+		const std::string filename = commandLineParser.getValueAsString("json", "cpubenchmarks.json");
+		if (!benchmark.writeJSON(filename)) {
+			std::cerr << "Could not write benchmark results to " << filename << "\n";
+			return 1;
+		}
+		std::cout << "Results written to " << filename << "\n";
+	}
+	return 0;
+}
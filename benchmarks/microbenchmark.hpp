@@ -0,0 +1,190 @@
+/*
+* CPU micro benchmark harness
+*
+* Times small pieces of host code in isolation with warm up, repeated measurements and JSON output for tracking regressions
+*
+* Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace vks
+{
+	/** @brief Keeps the compiler from optimizing away a value that is computed but never used */
+	template <typename T>
+	inline void doNotOptimize(T const& value)
+	{
+#if defined(_MSC_VER)
+		static volatile const void* sink;
+		sink = &value;
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : "r,m"(value) : "memory");
+#endif
+	}
+
+	/**
+	* @brief Runs benchmark functions in batches and reports per operation timings
+	*
+	* Each benchmark is warmed up first, then the number of operations per batch is doubled until a batch takes at least
+	* minBatchTime, so timer resolution and loop overhead don't dominate short operations. The calibrated batch is then
+	* measured repetitions times and the statistics are taken across these measurements.
+	*/
+	class MicroBenchmark
+	{
+	public:
+		struct Result {
+			std::string name;
+			/** @brief Operations per measured batch */
+			uint64_t iterations;
+			/** @brief Elements processed by a single operation, e.g. vertices or pixels */
+			uint64_t items;
+			/** @brief Time per operation in ns for each repetition */
+			std::vector<double> samples;
+			double min;
+			double median;
+			double mean;
+			double stddev;
+		};
+
+		/** @brief Time spent running a benchmark before measuring, in ms */
+		uint32_t warmupTime = 100;
+		/** @brief Minimum duration of a measured batch, in ms */
+		uint32_t minBatchTime = 10;
+		uint32_t repetitions = 10;
+		/** @brief Only benchmarks whose name contains this string are run */
+		std::string filter;
+		std::vector<Result> results;
+
+		/**
+		* Measures a benchmark function
+		* @param name Unique name of the benchmark
+		* @param items Number of elements processed by a single call of func, used for the per item timings
+		* @param func Function performing a single operation
+		*/
+		template <typename Func>
+		void run(const std::string& name, uint64_t items, Func&& func)
+		{
+			if (!filter.empty() && name.find(filter) == std::string::npos) {
+				return;
+			}
+
+			const double minBatchNs = minBatchTime * 1.0e6;
+
+			// Warm up caches, branch predictors and clocks, batches only grow while they are short so slow operations don't overshoot
+			auto warmupStart = std::chrono::steady_clock::now();
+			uint64_t iterations = 1;
+			while (elapsedMs(warmupStart) < warmupTime) {
+				if (runBatch(func, iterations) < minBatchNs * 0.25) {
+					iterations *= 2;
+				}
+			}
+
+			// Calibrate the batch size
+			while (runBatch(func, iterations) < minBatchNs && iterations < (1ull << 40)) {
+				iterations *= 2;
+			}
+
+			Result result{};
+			result.name = name;
+			result.iterations = iterations;
+			result.items = std::max<uint64_t>(items, 1);
+			for (uint32_t i = 0; i < std::max(repetitions, 1u); i++) {
+				result.samples.push_back(runBatch(func, iterations) / static_cast<double>(iterations));
+			}
+
+			std::vector<double> sorted = result.samples;
+			std::sort(sorted.begin(), sorted.end());
+			const size_t count = sorted.size();
+			result.min = sorted.front();
+			result.median = (count % 2) ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) * 0.5;
+			result.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / count;
+			double variance = 0.0;
+			for (double sample : sorted) {
+				variance += (sample - result.mean) * (sample - result.mean);
+			}
+			result.stddev = (count > 1) ? std::sqrt(variance / (count - 1)) : 0.0;
+
+			std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(1)
+				<< std::setw(14) << result.median << " ns/op"
+				<< std::setw(12) << result.median / result.items << " ns/item"
+				<< "  (min " << result.min << ", stddev " << std::setprecision(2) << (result.mean > 0.0 ? result.stddev / result.mean * 100.0 : 0.0) << "%)\n";
+
+			results.push_back(result);
+		}
+
+		/** @brief Writes all results to a JSON file, times are in ns */
+		bool writeJSON(const std::string& filename) const
+		{
+			std::ofstream stream(filename);
+			if (!stream.is_open()) {
+				return false;
+			}
+			stream << std::fixed << std::setprecision(3);
+			stream << "{\n\t\"context\": {\n";
+#if defined(NDEBUG)
+			stream << "\t\t\"build\": \"release\",\n";
+#else
+			stream << "\t\t\"build\": \"debug\",\n";
+#endif
+			stream << "\t\t\"warmup_ms\": " << warmupTime << ",\n";
+			stream << "\t\t\"min_batch_ms\": " << minBatchTime << ",\n";
+			stream << "\t\t\"repetitions\": " << repetitions << "\n";
+			stream << "\t},\n\t\"benchmarks\": [\n";
+			for (size_t i = 0; i < results.size(); i++) {
+				const Result& result = results[i];
+				stream << "\t\t{\n";
+				stream << "\t\t\t\"name\": \"" << result.name << "\",\n";
+				stream << "\t\t\t\"iterations\": " << result.iterations << ",\n";
+				stream << "\t\t\t\"items\": " << result.items << ",\n";
+				stream << "\t\t\t\"min_ns\": " << result.min << ",\n";
+				stream << "\t\t\t\"median_ns\": " << result.median << ",\n";
+				stream << "\t\t\t\"mean_ns\": " << result.mean << ",\n";
+				stream << "\t\t\t\"stddev_ns\": " << result.stddev << ",\n";
+				stream << "\t\t\t\"median_ns_per_item\": " << result.median / result.items << ",\n";
+				stream << "\t\t\t\"samples_ns\": [";
+				for (size_t j = 0; j < result.samples.size(); j++) {
+					stream << (j > 0 ? ", " : "") << result.samples[j];
+				}
+				stream << "]\n";
+				stream << "\t\t}" << (i < results.size() - 1 ? "," : "") << "\n";
+			}
+			stream << "\t]\n}\n";
+			return stream.good();
+		}
+
+	private:
+		static double elapsedMs(std::chrono::steady_clock::time_point start)
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		/** @return Duration of the batch in ns */
+		template <typename Func>
+		static double runBatch(Func& func, uint64_t iterations)
+		{
+			auto start = std::chrono::steady_clock::now();
+			for (uint64_t i = 0; i < iterations; i++) {
+				func();
+			}
+			return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		}
+	};
+}
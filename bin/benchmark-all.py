@@ -1,4 +1,7 @@
 # Benchmark all examples
+# Results of all examples are collected into a single JSON report with --json, --headless runs without windows (e.g. on CI with lavapipe)
+import argparse
+import json
 import subprocess
 import sys
 import os
@@ -83,24 +86,96 @@ EXAMPLES = [
 	"vulkanscene"
 ]
 
-CURR_INDEX = 0
+def parse_value(value):
+	# Result values are usually numbers, but examples may also report settings (e.g. a G-Buffer layout) as plain text
+	try:
+		return float(value)
+	except ValueError:
+		return value
 
-ARGS = "-fullscreen -b"
+def read_results(filename):
+	# Benchmark result files consist of csv sections separated by empty lines, each starting with a header line
+	results = {}
+	with open(filename, "r") as file:
+		sections = [section.strip().splitlines() for section in file.read().split("\n\n") if section.strip()]
+	for section in sections:
+		header = section[0].split(",")
+		rows = [line.split(",") for line in section[1:]]
+		if header[0] == "device" and rows:
+			row = rows[0]
+			results["device"] = row[0]
+			results["driverversion"] = row[1]
+			results["duration_ms"] = float(row[2])
+			results["frames"] = int(row[3])
+			results["fps"] = float(row[4])
+		elif header[0] == "result":
+			results["results"] = {row[0]: parse_value(row[1]) for row in rows if len(row) == 2}
+		elif header[0] == "segment":
+			results["segments"] = [{"name": row[0], "first_frame": int(row[1]), "frames": int(row[2]), "avg_ms": float(row[3]), "min_ms": float(row[4]), "max_ms": float(row[5])} for row in rows if len(row) == 6]
+		elif header[0] == "frame":
+			results["frame_times_ms"] = [float(row[1]) for row in rows if len(row) == 2]
+	return results
+
+PARSER = argparse.ArgumentParser(description="Run all examples in benchmark mode")
+PARSER.add_argument("examples", nargs="*", help="Examples to run (defaults to all)")
+PARSER.add_argument("--headless", action="store_true", help="Run without windows, rendering to offscreen images")
+PARSER.add_argument("--json", help="Write the results of all examples to this file")
+PARSER.add_argument("--warmup", type=int, help="Warmup time in seconds")
+PARSER.add_argument("--duration", type=int, help="Benchmark duration in seconds")
+PARSER.add_argument("--timeout", type=int, default=120, help="Time in seconds after which an example is stopped")
+PARSER.add_argument("--args", default="", help="Additional arguments passed to all examples")
+OPTIONS = PARSER.parse_args()
+
+EXAMPLES = OPTIONS.examples if OPTIONS.examples else EXAMPLES
+
+ARGS = "--headless" if OPTIONS.headless else "-fullscreen -b"
+if OPTIONS.warmup is not None:
+	ARGS += " -bw %d" % OPTIONS.warmup
+if OPTIONS.duration is not None:
+	ARGS += " -br %d" % OPTIONS.duration
+if OPTIONS.args:
+	ARGS += " " + OPTIONS.args
+
+REPORT = {"platform": platform.platform(), "arguments": ARGS, "examples": {}}
+FAILED = 0
 
 print("Benchmarking all examples...")
 
 os.makedirs("./benchmark", exist_ok=True)
 
-for example in EXAMPLES:
+for CURR_INDEX, example in enumerate(EXAMPLES):
 	print("---- (%d/%d) Running %s in benchmark mode ----" % (CURR_INDEX+1, len(EXAMPLES), example))
+	RESULT_FILE = "./benchmark/%s.csv" % example
+	if os.path.exists(RESULT_FILE):
+		os.remove(RESULT_FILE)
 	if platform.system() == 'Linux' or platform.system() == 'Darwin':
-		RESULT_CODE = subprocess.call("./%s %s -bf ./benchmark/%s.csv 5" % (example, ARGS, example), shell=True)
+		COMMAND = "./%s %s -bf %s" % (example, ARGS, RESULT_FILE)
 	else:
-		RESULT_CODE = subprocess.call("%s %s -bf ./benchmark/%s.csv 5" % (example, ARGS, example))
-	if RESULT_CODE == 0:
-		print("Results written to ./benchmark/%s.csv" % example)
+		COMMAND = "%s %s -bf %s" % (example, ARGS, RESULT_FILE)
+	ENTRY = {}
+	try:
+		RESULT_CODE = subprocess.call(COMMAND, shell=True, timeout=OPTIONS.timeout)
+	except subprocess.TimeoutExpired:
+		RESULT_CODE = None
+	ENTRY["return_code"] = RESULT_CODE
+	if RESULT_CODE == 0 and os.path.exists(RESULT_FILE):
+		print("Results written to %s" % RESULT_FILE)
+		ENTRY["status"] = "ok"
+		ENTRY.update(read_results(RESULT_FILE))
 	else:
-		print("Error, result code = %d" % RESULT_CODE)
-	CURR_INDEX += 1
+		if RESULT_CODE is None:
+			print("Error, timed out after %d seconds" % OPTIONS.timeout)
+			ENTRY["status"] = "timeout"
+		else:
+			# Examples exit with an error if the device lacks required features, these are reported but not counted as results
+			print("Error, result code = %d" % RESULT_CODE)
+			ENTRY["status"] = "failed"
+		FAILED += 1
+	REPORT["examples"][example] = ENTRY
+
+if OPTIONS.json:
+	with open(OPTIONS.json, "w") as file:
+		json.dump(REPORT, file, indent="\t")
+	print("Report written to %s" % OPTIONS.json)
 
-print("Benchmark run finished")
+print("Benchmark run finished, %d of %d examples failed" % (FAILED, len(EXAMPLES)))
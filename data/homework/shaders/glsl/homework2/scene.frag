@@ -1,6 +1,6 @@
 #version 450
 
-#extension GL_NV_shading_rate_image : require
+#extension GL_EXT_fragment_shading_rate : require
 
 layout (set = 1, binding = 0) uniform sampler2D samplerColorMap;
 layout (set = 1, binding = 1) uniform sampler2D samplerNormalMap;
@@ -52,33 +52,35 @@ void main()
 	outFragColor = vec4(diffuse * color.rgb + specular, color.a);
 
 	if (uboScene.colorShadingRates == 1) {
-		if (gl_FragmentSizeNV.x == 1 && gl_FragmentSizeNV.y == 1) {
-			outFragColor.rgb *= vec3(0.0, 0.8, 0.4);
-			return;
-		}
-		if (gl_FragmentSizeNV.x == 2 && gl_FragmentSizeNV.y == 1) {
-			outFragColor.rgb *= vec3(0.2, 0.6, 1.0);
-			return;
-		}
-		if (gl_FragmentSizeNV.x == 1 && gl_FragmentSizeNV.y == 2) {
-			outFragColor.rgb *= vec3(0.0, 0.4, 0.8);
-			return;
-		}
-		if (gl_FragmentSizeNV.x == 2 && gl_FragmentSizeNV.y == 2) {
-			outFragColor.rgb *= vec3(1.0, 1.0, 0.2);
-			return;
-		}
-		if (gl_FragmentSizeNV.x == 4 && gl_FragmentSizeNV.y == 2) {
-			outFragColor.rgb *= vec3(0.8, 0.8, 0.0);
-			return;
-		}
-		if (gl_FragmentSizeNV.x == 2 && gl_FragmentSizeNV.y == 4) {
-			outFragColor.rgb *= vec3(1.0, 0.4, 0.2);
-			return;
-		}
-		if (gl_FragmentSizeNV.x == 4 && gl_FragmentSizeNV.y == 4) {
-			outFragColor.rgb *= vec3(0.8, 0.0, 0.0);
-			return;
+		// Combinations of the gl_ShadingRateFlag*EXT bits, same encoding as VK_KHR_fragment_shading_rate
+		const int SHADING_RATE_PER_PIXEL = 0x0;
+		const int SHADING_RATE_PER_2X1_PIXELS = 0x4;
+		const int SHADING_RATE_PER_1X2_PIXELS = 0x1;
+		const int SHADING_RATE_PER_2X2_PIXELS = 0x5;
+		const int SHADING_RATE_PER_4X2_PIXELS = 0x9;
+		const int SHADING_RATE_PER_2X4_PIXELS = 0x6;
+		switch (gl_ShadingRateEXT) {
+			case SHADING_RATE_PER_PIXEL:
+				outFragColor.rgb *= vec3(0.0, 0.8, 0.4);
+				break;
+			case SHADING_RATE_PER_2X1_PIXELS:
+				outFragColor.rgb *= vec3(0.2, 0.6, 1.0);
+				break;
+			case SHADING_RATE_PER_1X2_PIXELS:
+				outFragColor.rgb *= vec3(0.0, 0.4, 0.8);
+				break;
+			case SHADING_RATE_PER_2X2_PIXELS:
+				outFragColor.rgb *= vec3(1.0, 1.0, 0.2);
+				break;
+			case SHADING_RATE_PER_4X2_PIXELS:
+				outFragColor.rgb *= vec3(0.8, 0.8, 0.0);
+				break;
+			case SHADING_RATE_PER_2X4_PIXELS:
+				outFragColor.rgb *= vec3(1.0, 0.4, 0.2);
+				break;
+			default:
+				outFragColor.rgb *= vec3(0.8, 0.0, 0.0);
+				break;
 		}
 	}
 }
\ No newline at end of file
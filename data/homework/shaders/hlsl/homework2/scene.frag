@@ -53,12 +53,13 @@ float4 main(VSOutput input, uint shadingRate : SV_ShadingRate) : SV_TARGET
 	float3 specular = pow(max(dot(R, V), 0.0), 32.0);
 	color =  float4(diffuse * color.rgb + specular, color.a);
 
+    // (log2(width) << 2) | log2(height), same as VK_KHR_fragment_shading_rate
     const uint SHADING_RATE_PER_PIXEL = 0x0;
-    const uint SHADING_RATE_PER_2X1_PIXELS = 6;
-    const uint SHADING_RATE_PER_1X2_PIXELS = 7;
-    const uint SHADING_RATE_PER_2X2_PIXELS = 8;
-    const uint SHADING_RATE_PER_4X2_PIXELS = 9;
-    const uint SHADING_RATE_PER_2X4_PIXELS = 10;
+    const uint SHADING_RATE_PER_2X1_PIXELS = 0x4;
+    const uint SHADING_RATE_PER_1X2_PIXELS = 0x1;
+    const uint SHADING_RATE_PER_2X2_PIXELS = 0x5;
+    const uint SHADING_RATE_PER_4X2_PIXELS = 0x9;
+    const uint SHADING_RATE_PER_2X4_PIXELS = 0x6;
 
 	if (ubo.colorShadingRates == 1) {
 		switch(shadingRate) {
@@ -0,0 +1,19 @@
+#version 450
+
+// Samples the part of the dynamic resolution target that has been rendered to at the current scale
+
+layout (binding = 0) uniform sampler2D samplerColor;
+
+layout (push_constant) uniform PushConsts {
+	vec2 uvScale;
+	vec2 uvClamp;
+} pushConsts;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	outFragColor = texture(samplerColor, min(inUV * pushConsts.uvScale, pushConsts.uvClamp));
+}
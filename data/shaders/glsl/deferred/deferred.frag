@@ -8,25 +8,119 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragcolor;
 
-struct Light {
-	vec4 position;
-	vec3 color;
-	float radius;
-};
+layout (constant_id = 0) const bool CLUSTERED = true;
+// Compact layout: binding 1 is depth, binding 2 holds the octahedral normal and specular
+layout (constant_id = 1) const bool COMPACT_GBUFFER = false;
 
 layout (binding = 4) uniform UBO 
 {
-	Light lights[6];
+	mat4 inverseViewProjection;
 	vec4 viewPos;
 	int displayDebugTarget;
 } ubo;
 
+// Light cluster mapping, see VulkanLightClusters.h
+layout (binding = 5) uniform ClusterParams
+{
+	mat4 view;
+	mat4 inverseProjection;
+	uvec4 gridSize;
+	vec4 screen;
+	vec4 depth;
+} clusters;
+
+// position.w = range, color.w = intensity
+struct Light {
+	vec4 position;
+	vec4 color;
+};
+
+layout (binding = 6, std430) readonly buffer Lights
+{
+	Light lights[ ];
+};
+
+layout (binding = 7, std430) readonly buffer Grid
+{
+	uvec2 grid[ ];
+};
+
+layout (binding = 8, std430) readonly buffer LightIndices
+{
+	uint lightIndices[ ];
+};
+
+#define ambient 0.0
+
+uint clusterIndex(vec3 fragPos)
+{
+	float viewZ = -(clusters.view * vec4(fragPos, 1.0)).z;
+	uint slice = uint(clamp(floor(log(viewZ) * clusters.depth.z - clusters.depth.w), 0.0, float(clusters.gridSize.z - 1)));
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / clusters.screen.z), clusters.gridSize.xy - 1);
+	return tile.x + tile.y * clusters.gridSize.x + slice * clusters.gridSize.x * clusters.gridSize.y;
+}
+
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+vec3 shadeLight(Light light, vec3 fragPos, vec3 N, vec3 V, vec3 albedo, float specular)
+{
+	// Vector to light
+	vec3 L = light.position.xyz - fragPos;
+	// Distance from light to fragment position
+	float dist = length(L);
+	if (dist >= light.position.w) {
+		return vec3(0.0);
+	}
+
+	// Light to fragment
+	L = normalize(L);
+
+	// Attenuation, windowed to reach zero at the light's range
+	float window = clamp(1.0 - pow(dist / light.position.w, 4.0), 0.0, 1.0);
+	float atten = light.color.w / (pow(dist, 2.0) + 1.0) * window * window;
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	vec3 diff = light.color.rgb * albedo * NdotL * atten;
+
+	// Specular part
+	vec3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	vec3 spec = light.color.rgb * specular * pow(NdotR, 16.0) * atten;
+
+	return diff + spec;
+}
+
 void main() 
 {
 	// Get G-Buffer values
-	vec3 fragPos = texture(samplerposition, inUV).rgb;
-	vec3 normal = texture(samplerNormal, inUV).rgb;
+	vec3 fragPos;
+	vec3 normal;
 	vec4 albedo = texture(samplerAlbedo, inUV);
+	// Specular map values are stored in alpha of albedo mrt (full layout) or the normal mrt (compact layout)
+	float specular;
+	bool covered = true;
+	if (COMPACT_GBUFFER) {
+		// Reconstruct the world space position from depth
+		float depth = texture(samplerposition, inUV).r;
+		vec4 position = ubo.inverseViewProjection * vec4(inUV * 2.0 - 1.0, depth, 1.0);
+		fragPos = position.xyz / position.w;
+		vec4 normalSpecular = texture(samplerNormal, inUV);
+		normal = octDecode(normalSpecular.xy * 2.0 - 1.0);
+		specular = normalSpecular.z;
+		covered = normalSpecular.w > 0.5;
+	} else {
+		fragPos = texture(samplerposition, inUV).rgb;
+		normal = texture(samplerNormal, inUV).rgb;
+		specular = albedo.a;
+	}
 	
 	// Debug display
 	if (ubo.displayDebugTarget > 0) {
@@ -41,8 +135,14 @@ void main()
 				outFragcolor.rgb = albedo.rgb;
 				break;
 			case 4: 
-				outFragcolor.rgb = albedo.aaa;
+				outFragcolor.rgb = vec3(specular);
 				break;
+			case 5: {
+					// Light count of the fragment's cluster relative to the cluster capacity
+					float load = float(grid[clusterIndex(fragPos)].y) / 128.0;
+					outFragcolor.rgb = mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), load) * step(0.001, load);
+					break;
+			}
 		}		
 		outFragcolor.a = 1.0;
 		return;
@@ -50,45 +150,29 @@ void main()
 
 	// Render-target composition
 
-	#define lightCount 6
-	#define ambient 0.0
-	
+	if (!covered) {
+		outFragcolor = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+
 	// Ambient part
 	vec3 fragcolor  = albedo.rgb * ambient;
-	
-	for(int i = 0; i < lightCount; ++i)
-	{
-		// Vector to light
-		vec3 L = ubo.lights[i].position.xyz - fragPos;
-		// Distance from light to fragment position
-		float dist = length(L);
-
-		// Viewer to fragment
-		vec3 V = ubo.viewPos.xyz - fragPos;
-		V = normalize(V);
-		
-		//if(dist < ubo.lights[i].radius)
-		{
-			// Light to fragment
-			L = normalize(L);
-
-			// Attenuation
-			float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
-
-			// Diffuse part
-			vec3 N = normalize(normal);
-			float NdotL = max(0.0, dot(N, L));
-			vec3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
-
-			// Specular part
-			// Specular map values are stored in alpha of albedo mrt
-			vec3 R = reflect(-L, N);
-			float NdotR = max(0.0, dot(R, V));
-			vec3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 16.0) * atten;
-
-			fragcolor += diff + spec;	
-		}	
-	}    	
+
+	vec3 N = normalize(normal);
+	// Viewer to fragment
+	vec3 V = normalize(ubo.viewPos.xyz - fragPos);
+
+	if (CLUSTERED) {
+		// Only lights binned into this fragment's cluster can reach it
+		uvec2 cluster = grid[clusterIndex(fragPos)];
+		for (uint i = 0; i < cluster.y; ++i) {
+			fragcolor += shadeLight(lights[lightIndices[cluster.x + i]], fragPos, N, V, albedo.rgb, specular);
+		}
+	} else {
+		for (uint i = 0; i < clusters.gridSize.w; ++i) {
+			fragcolor += shadeLight(lights[i], fragPos, N, V, albedo.rgb, specular);
+		}
+	}
    
-  outFragcolor = vec4(fragcolor, 1.0);	
-}
\ No newline at end of file
+	outFragcolor = vec4(fragcolor, 1.0);	
+}
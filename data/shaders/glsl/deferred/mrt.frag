@@ -8,10 +8,23 @@ layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec3 inColor;
 layout (location = 3) in vec3 inWorldPos;
 layout (location = 4) in vec3 inTangent;
+layout (location = 5) in vec4 inCurrentPos;
+layout (location = 6) in vec4 inPreviousPos;
 
 layout (location = 0) out vec4 outPosition;
 layout (location = 1) out vec4 outNormal;
 layout (location = 2) out vec4 outAlbedo;
+layout (location = 3) out vec2 outVelocity;
+
+// Compact layout: no position attachment (output 0 is discarded), octahedral normal and specular in 10:10:10:2
+layout (constant_id = 0) const bool COMPACT_GBUFFER = false;
+
+vec2 octEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+}
 
 void main() 
 {
@@ -23,7 +36,15 @@ void main()
 	vec3 B = cross(N, T);
 	mat3 TBN = mat3(T, B, N);
 	vec3 tnorm = TBN * normalize(texture(samplerNormalMap, inUV).xyz * 2.0 - vec3(1.0));
-	outNormal = vec4(tnorm, 1.0);
-
 	outAlbedo = texture(samplerColor, inUV);
+
+	if (COMPACT_GBUFFER) {
+		// Alpha marks covered pixels
+		outNormal = vec4(octEncode(normalize(tnorm)) * 0.5 + 0.5, outAlbedo.a, 1.0);
+	} else {
+		outNormal = vec4(tnorm, 1.0);
+	}
+
+	// Screen space motion in UV units, see VulkanTemporalAA.h
+	outVelocity = (inCurrentPos.xy / inCurrentPos.w - inPreviousPos.xy / inPreviousPos.w) * 0.5;
 }
\ No newline at end of file
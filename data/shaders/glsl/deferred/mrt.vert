@@ -12,6 +12,9 @@ layout (binding = 0) uniform UBO
 	mat4 model;
 	mat4 view;
 	vec4 instancePos[3];
+	// Unjittered, for the velocity buffer
+	mat4 currentViewProjection;
+	mat4 previousViewProjection;
 } ubo;
 
 layout (location = 0) out vec3 outNormal;
@@ -19,6 +22,8 @@ layout (location = 1) out vec2 outUV;
 layout (location = 2) out vec3 outColor;
 layout (location = 3) out vec3 outWorldPos;
 layout (location = 4) out vec3 outTangent;
+layout (location = 5) out vec4 outCurrentPos;
+layout (location = 6) out vec4 outPreviousPos;
 
 void main() 
 {
@@ -38,4 +43,8 @@ void main()
 	
 	// Currently just vertex color
 	outColor = inColor;
+
+	// The scene is static, so positions only move with the camera
+	outCurrentPos = ubo.currentViewProjection * vec4(outWorldPos, 1.0);
+	outPreviousPos = ubo.previousViewProjection * vec4(outWorldPos, 1.0);
 }
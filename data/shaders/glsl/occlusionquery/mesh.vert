@@ -11,25 +11,34 @@ layout (binding = 0) uniform UBO
 	mat4 model;
 	vec4 color;
 	vec4 lightPos;
-	float visible;
 } ubo;
 
+struct InstanceData
+{
+	mat4 model;
+	vec4 color;
+};
+
+// Indexed by the first instance of the indirect draw written by the culling
+layout (binding = 1, std430) readonly buffer Instances
+{
+	InstanceData instances[ ];
+};
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
-layout (location = 2) out float outVisible;
-layout (location = 3) out vec3 outViewVec;
-layout (location = 4) out vec3 outLightVec;
+layout (location = 2) out vec3 outViewVec;
+layout (location = 3) out vec3 outLightVec;
 
 void main() 
 {
-	outNormal = inNormal;
-	outColor = inColor * ubo.color.rgb;
-	outVisible = ubo.visible;
-	
-	gl_Position = ubo.projection * ubo.view * ubo.model * vec4(inPos.xyz, 1.0);
-	
-    vec4 pos = ubo.model * vec4(inPos, 1.0);
-    outNormal = mat3(ubo.model) * inNormal;
-    outLightVec = ubo.lightPos.xyz - pos.xyz;
-    outViewVec = -pos.xyz;
-}
\ No newline at end of file
+	InstanceData instance = instances[gl_InstanceIndex];
+	outColor = inColor * instance.color.rgb;
+
+	gl_Position = ubo.projection * ubo.view * instance.model * vec4(inPos.xyz, 1.0);
+
+	vec4 pos = instance.model * vec4(inPos, 1.0);
+	outNormal = mat3(instance.model) * inNormal;
+	outLightVec = ubo.lightPos.xyz - pos.xyz;
+	outViewVec = -pos.xyz;
+}
@@ -17,6 +17,39 @@ layout (binding = 1) uniform UBOShared {
 
 layout (location = 0) out vec4 outColor;
 
+layout (constant_id = 0) const bool CLUSTERED_LIGHTS = false;
+
+// Light cluster mapping, see VulkanLightClusters.h
+layout (binding = 2) uniform ClusterParams
+{
+	mat4 view;
+	mat4 inverseProjection;
+	uvec4 gridSize;
+	vec4 screen;
+	vec4 depth;
+} clusters;
+
+// position.w = range, color.w = intensity
+struct Light {
+	vec4 position;
+	vec4 color;
+};
+
+layout (binding = 3, std430) readonly buffer Lights
+{
+	Light lights[ ];
+};
+
+layout (binding = 4, std430) readonly buffer Grid
+{
+	uvec2 grid[ ];
+};
+
+layout (binding = 5, std430) readonly buffer LightIndices
+{
+	uint lightIndices[ ];
+};
+
 layout(push_constant) uniform PushConsts {
 	layout(offset = 12) float roughness;
 	layout(offset = 16) float metallic;
@@ -63,7 +96,7 @@ vec3 F_Schlick(float cosTheta, float metallic)
 
 // Specular BRDF composition --------------------------------------------
 
-vec3 BRDF(vec3 L, vec3 V, vec3 N, float metallic, float roughness)
+vec3 BRDF(vec3 L, vec3 V, vec3 N, float metallic, float roughness, vec3 lightColor)
 {
 	// Precalculate vectors and dot products	
 	vec3 H = normalize (V + L);
@@ -72,9 +105,6 @@ vec3 BRDF(vec3 L, vec3 V, vec3 N, float metallic, float roughness)
 	float dotLH = clamp(dot(L, H), 0.0, 1.0);
 	float dotNH = clamp(dot(N, H), 0.0, 1.0);
 
-	// Light color fixed
-	vec3 lightColor = vec3(1.0);
-
 	vec3 color = vec3(0.0);
 
 	if (dotNL > 0.0)
@@ -112,9 +142,25 @@ void main()
 	vec3 Lo = vec3(0.0);
 	for (int i = 0; i < uboParams.lights.length(); i++) {
 		vec3 L = normalize(uboParams.lights[i].xyz - inWorldPos);
-		Lo += BRDF(L, V, N, material.metallic, roughness);
+		Lo += BRDF(L, V, N, material.metallic, roughness, vec3(1.0));
 	};
 
+	if (CLUSTERED_LIGHTS) {
+		// Point lights binned into this fragment's cluster
+		float viewZ = -(clusters.view * vec4(inWorldPos, 1.0)).z;
+		uint slice = uint(clamp(floor(log(viewZ) * clusters.depth.z - clusters.depth.w), 0.0, float(clusters.gridSize.z - 1)));
+		uvec2 tile = min(uvec2(gl_FragCoord.xy / clusters.screen.z), clusters.gridSize.xy - 1);
+		uvec2 cluster = grid[tile.x + tile.y * clusters.gridSize.x + slice * clusters.gridSize.x * clusters.gridSize.y];
+		for (uint i = 0; i < cluster.y; i++) {
+			Light light = lights[lightIndices[cluster.x + i]];
+			vec3 L = light.position.xyz - inWorldPos;
+			float dist = length(L);
+			float window = clamp(1.0 - pow(dist / light.position.w, 4.0), 0.0, 1.0);
+			float atten = light.color.w / (dist * dist + 1.0) * window * window;
+			Lo += BRDF(L / dist, V, N, material.metallic, roughness, light.color.rgb * atten);
+		}
+	}
+
 	// Combine with ambient
 	vec3 color = materialcolor() * 0.02;
 	color += Lo;
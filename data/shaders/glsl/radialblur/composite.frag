@@ -0,0 +1,14 @@
+#version 450
+
+// Displays the radial blur computed on the async compute queue
+
+layout (binding = 1) uniform sampler2D samplerBlur;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	outFragColor = texture(samplerBlur, inUV);
+}
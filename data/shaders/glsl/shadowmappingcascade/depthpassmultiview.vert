@@ -0,0 +1,38 @@
+#version 450
+
+#extension GL_EXT_multiview : enable
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUV;
+
+// todo: pass via specialization constant
+#define SHADOW_MAP_CASCADE_COUNT 4
+
+layout(push_constant) uniform PushConsts {
+	vec4 position;
+	uint cascadeIndex;
+	uint cascadeMask;
+} pushConsts;
+
+layout (binding = 0) uniform UBO {
+	mat4[SHADOW_MAP_CASCADE_COUNT] cascadeViewProjMat;
+} ubo;
+
+layout (location = 0) out vec2 outUV;
+
+out gl_PerVertex {
+	vec4 gl_Position;   
+};
+
+void main()
+{
+	outUV = inUV;
+	// Each view renders one cascade
+	if ((pushConsts.cascadeMask & (1u << gl_ViewIndex)) == 0u) {
+		// Not visible in this cascade, move outside of the clip volume so the primitive is culled before rasterization
+		gl_Position = vec4(0.0, 0.0, -2.0, 1.0);
+		return;
+	}
+	vec3 pos = inPos + pushConsts.position.xyz;
+	gl_Position =  ubo.cascadeViewProjMat[gl_ViewIndex] * vec4(pos, 1.0);
+}
@@ -0,0 +1,41 @@
+#version 450
+
+// Reduces the G-Buffer positions and normals to the SSAO resolution
+// Picks the texel of each block closest to the camera instead of averaging, averaged positions wouldn't lie on any surface
+
+layout (binding = 0) uniform sampler2D samplerPositionDepth;
+layout (binding = 1) uniform sampler2D samplerNormal;
+
+layout (binding = 3) uniform UBO
+{
+	mat4 viewToPreviousView;
+	mat4 previousProjection;
+	float historyWeight;
+	int reset;
+	int factor;
+} ubo;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outPosition;
+layout (location = 1) out vec4 outNormal;
+
+void main()
+{
+	ivec2 origin = ivec2(gl_FragCoord.xy) * ubo.factor;
+	ivec2 maxCoord = textureSize(samplerPositionDepth, 0) - 1;
+	ivec2 closest = min(origin, maxCoord);
+	float closestDepth = texelFetch(samplerPositionDepth, closest, 0).w;
+	for (int y = 0; y < ubo.factor; y++) {
+		for (int x = 0; x < ubo.factor; x++) {
+			ivec2 coord = min(origin + ivec2(x, y), maxCoord);
+			float depth = texelFetch(samplerPositionDepth, coord, 0).w;
+			if (depth < closestDepth) {
+				closestDepth = depth;
+				closest = coord;
+			}
+		}
+	}
+	outPosition = texelFetch(samplerPositionDepth, closest, 0);
+	outNormal = texelFetch(samplerNormal, closest, 0);
+}
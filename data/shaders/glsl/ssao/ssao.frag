@@ -4,17 +4,24 @@ layout (binding = 0) uniform sampler2D samplerPositionDepth;
 layout (binding = 1) uniform sampler2D samplerNormal;
 layout (binding = 2) uniform sampler2D ssaoNoise;
 
+// Samples per pixel, the reduced resolution mode uses a different part of the kernel every frame
+#define SSAO_KERNEL_ARRAY_SIZE 64
 layout (constant_id = 0) const int SSAO_KERNEL_SIZE = 64;
 layout (constant_id = 1) const float SSAO_RADIUS = 0.5;
 
 layout (binding = 3) uniform UBOSSAOKernel
 {
-	vec4 samples[SSAO_KERNEL_SIZE];
+	vec4 samples[SSAO_KERNEL_ARRAY_SIZE];
 } uboSSAOKernel;
 
 layout (binding = 4) uniform UBO 
 {
 	mat4 projection;
+	int ssao;
+	int ssaoOnly;
+	int ssaoBlur;
+	int kernelOffset;
+	float kernelRotation;
 } ubo;
 
 layout (location = 0) in vec2 inUV;
@@ -36,7 +43,10 @@ void main()
 	// Create TBN matrix
 	vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
 	vec3 bitangent = cross(tangent, normal);
-	mat3 TBN = mat3(tangent, bitangent, normal);
+	// Rotating the kernel around the normal every frame lets temporal accumulation see different sample directions
+	vec3 rotatedTangent = cos(ubo.kernelRotation) * tangent + sin(ubo.kernelRotation) * bitangent;
+	bitangent = cross(rotatedTangent, normal);
+	mat3 TBN = mat3(rotatedTangent, bitangent, normal);
 
 	// Calculate occlusion value
 	float occlusion = 0.0f;
@@ -44,7 +54,7 @@ void main()
 	const float bias = 0.025f;
 	for(int i = 0; i < SSAO_KERNEL_SIZE; i++)
 	{		
-		vec3 samplePos = TBN * uboSSAOKernel.samples[i].xyz; 
+		vec3 samplePos = TBN * uboSSAOKernel.samples[(ubo.kernelOffset + i) % SSAO_KERNEL_ARRAY_SIZE].xyz; 
 		samplePos = fragPos + samplePos * SSAO_RADIUS; 
 		
 		// project
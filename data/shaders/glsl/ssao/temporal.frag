@@ -0,0 +1,46 @@
+#version 450
+
+// Accumulates the reduced resolution SSAO of the current frame into the reprojected history
+// The scene is static, so the camera matrices are enough to find a texel's position in the previous frame
+
+layout (binding = 0) uniform sampler2D samplerSSAO;
+layout (binding = 1) uniform sampler2D samplerPositionDepth;
+layout (binding = 2) uniform sampler2D samplerHistory;
+
+layout (binding = 3) uniform UBO
+{
+	mat4 viewToPreviousView;
+	mat4 previousProjection;
+	float historyWeight;
+	int reset;
+	int factor;
+} ubo;
+
+layout (location = 0) in vec2 inUV;
+
+// Accumulated occlusion and the linear depth it belongs to
+layout (location = 0) out vec2 outFragColor;
+
+void main()
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	float occlusion = texelFetch(samplerSSAO, coord, 0).r;
+	vec4 position = texelFetch(samplerPositionDepth, coord, 0);
+
+	float result = occlusion;
+	if (ubo.reset == 0) {
+		vec4 previousPosition = ubo.viewToPreviousView * vec4(position.xyz, 1.0);
+		vec4 previousClip = ubo.previousProjection * previousPosition;
+		vec2 previousUV = previousClip.xy / previousClip.w * 0.5 + 0.5;
+		if (all(greaterThanEqual(previousUV, vec2(0.0))) && all(lessThanEqual(previousUV, vec2(1.0)))) {
+			vec2 history = texture(samplerHistory, previousUV).rg;
+			// The history belongs to a different surface (disocclusion) if its depth doesn't match the reprojected depth
+			float expectedDepth = -previousPosition.z;
+			if (abs(history.g - expectedDepth) < 0.05 * expectedDepth) {
+				result = mix(occlusion, history.r, ubo.historyWeight);
+			}
+		}
+	}
+
+	outFragColor = vec2(result, position.w);
+}
@@ -0,0 +1,37 @@
+#version 450
+
+// Depth aware (bilateral) upsampling of the reduced resolution SSAO
+// Bilinear weights of the four nearest low resolution texels, scaled down for texels whose depth differs from the full resolution pixel
+
+layout (binding = 0) uniform sampler2D samplerPositionDepth;
+layout (binding = 1) uniform sampler2D samplerSSAO;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out float outFragColor;
+
+void main()
+{
+	float depth = texelFetch(samplerPositionDepth, ivec2(gl_FragCoord.xy), 0).w;
+
+	ivec2 lowSize = textureSize(samplerSSAO, 0);
+	vec2 lowPosition = inUV * vec2(lowSize) - 0.5;
+	ivec2 base = ivec2(floor(lowPosition));
+	vec2 f = lowPosition - vec2(base);
+
+	float result = 0.0;
+	float weightSum = 0.0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			ivec2 coord = clamp(base + ivec2(x, y), ivec2(0), lowSize - 1);
+			vec2 lowTexel = texelFetch(samplerSSAO, coord, 0).rg;
+			float bilinearWeight = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+			float depthWeight = 1.0 / (1.0e-3 + abs(depth - lowTexel.g) / max(depth, 1.0e-3));
+			float weight = bilinearWeight * depthWeight;
+			result += lowTexel.r * weight;
+			weightSum += weight;
+		}
+	}
+
+	outFragColor = (weightSum > 0.0) ? result / weightSum : texture(samplerSSAO, inUV).r;
+}
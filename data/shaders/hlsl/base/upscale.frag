@@ -0,0 +1,16 @@
+// Samples the part of the dynamic resolution target that has been rendered to at the current scale
+
+Texture2D textureColor : register(t0);
+SamplerState samplerColor : register(s0);
+
+struct PushConsts
+{
+	float2 uvScale;
+	float2 uvClamp;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
+{
+	return textureColor.Sample(samplerColor, min(inUV * pushConsts.uvScale, pushConsts.uvClamp));
+}
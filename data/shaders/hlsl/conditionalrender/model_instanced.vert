@@ -0,0 +1,47 @@
+// Copyright 2020 Google LLC
+
+struct VSInput
+{
+[[vk::location(0)]] float3 Pos : POSITION0;
+[[vk::location(1)]] float3 Normal : NORMAL0;
+[[vk::location(2)]] float3 Color : COLOR0;
+};
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float4x4 model;
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+// One node matrix per instance, written by the glTF model
+StructuredBuffer<float4x4> instances : register(t0, space1);
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+[[vk::location(0)]] float3 Normal : NORMAL0;
+[[vk::location(1)]] float3 Color : COLOR0;
+[[vk::location(2)]] float3 ViewVec : TEXCOORD1;
+[[vk::location(3)]] float3 LightVec : TEXCOORD2;
+};
+
+VSOutput main(VSInput input, uint InstanceIndex : SV_InstanceID)
+{
+	VSOutput output = (VSOutput)0;
+	// Material colors are pre-multiplied into the vertex colors at load time
+	output.Color = input.Color;
+	float4x4 nodeMatrix = instances[InstanceIndex];
+	float4 pos = float4(input.Pos, 1.0);
+	output.Pos = mul(ubo.projection, mul(ubo.view, mul(ubo.model, mul(nodeMatrix, pos))));
+
+	output.Normal = mul((float4x3)mul(ubo.view, mul(ubo.model, nodeMatrix)), input.Normal).xyz;
+
+	float4 localpos = mul(ubo.view, mul(ubo.model, mul(nodeMatrix, pos)));
+	float3 lightPos = float3(10.0f, -10.0f, 10.0f);
+	output.LightVec = lightPos.xyz - localpos.xyz;
+	output.ViewVec = -localpos.xyz;
+	return output;
+}
@@ -7,28 +7,112 @@ SamplerState samplerNormal : register(s2);
 Texture2D textureAlbedo : register(t3);
 SamplerState samplerAlbedo : register(s3);
 
-struct Light {
-	float4 position;
-	float3 color;
-	float radius;
-};
+[[vk::constant_id(0)]] const bool CLUSTERED = true;
+// Compact layout: binding 1 is depth, binding 2 holds the octahedral normal and specular
+[[vk::constant_id(1)]] const bool COMPACT_GBUFFER = false;
 
 struct UBO
 {
-	Light lights[6];
+	float4x4 inverseViewProjection;
 	float4 viewPos;
 	int displayDebugTarget;
 };
 
 cbuffer ubo : register(b4) { UBO ubo; }
 
+// Light cluster mapping, see VulkanLightClusters.h
+struct ClusterParams
+{
+	float4x4 view;
+	float4x4 inverseProjection;
+	uint4 gridSize;
+	float4 screen;
+	float4 depth;
+};
+
+cbuffer clusters : register(b5) { ClusterParams clusters; }
 
-float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
+// position.w = range, color.w = intensity
+struct Light {
+	float4 position;
+	float4 color;
+};
+
+StructuredBuffer<Light> lights : register(t6);
+StructuredBuffer<uint2> grid : register(t7);
+StructuredBuffer<uint> lightIndices : register(t8);
+
+#define ambient 0.0
+
+uint clusterIndex(float3 fragPos, float2 fragCoord)
+{
+	float viewZ = -mul(clusters.view, float4(fragPos, 1.0)).z;
+	uint slice = uint(clamp(floor(log(viewZ) * clusters.depth.z - clusters.depth.w), 0.0, float(clusters.gridSize.z - 1)));
+	uint2 tile = min(uint2(fragCoord / clusters.screen.z), clusters.gridSize.xy - 1);
+	return tile.x + tile.y * clusters.gridSize.x + slice * clusters.gridSize.x * clusters.gridSize.y;
+}
+
+float3 octDecode(float2 e)
+{
+	float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * float2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+float3 shadeLight(Light light, float3 fragPos, float3 N, float3 V, float3 albedo, float specular)
+{
+	// Vector to light
+	float3 L = light.position.xyz - fragPos;
+	// Distance from light to fragment position
+	float dist = length(L);
+	if (dist >= light.position.w) {
+		return float3(0.0, 0.0, 0.0);
+	}
+
+	// Light to fragment
+	L = normalize(L);
+
+	// Attenuation, windowed to reach zero at the light's range
+	float window = saturate(1.0 - pow(dist / light.position.w, 4.0));
+	float atten = light.color.w / (pow(dist, 2.0) + 1.0) * window * window;
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	float3 diff = light.color.rgb * albedo * NdotL * atten;
+
+	// Specular part
+	float3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	float3 spec = light.color.rgb * specular * pow(NdotR, 16.0) * atten;
+
+	return diff + spec;
+}
+
+float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0, float4 fragCoord : SV_Position) : SV_TARGET
 {
 	// Get G-Buffer values
-	float3 fragPos = textureposition.Sample(samplerposition, inUV).rgb;
-	float3 normal = textureNormal.Sample(samplerNormal, inUV).rgb;
+	float3 fragPos;
+	float3 normal;
 	float4 albedo = textureAlbedo.Sample(samplerAlbedo, inUV);
+	// Specular map values are stored in alpha of albedo mrt (full layout) or the normal mrt (compact layout)
+	float specular;
+	bool covered = true;
+	if (COMPACT_GBUFFER) {
+		// Reconstruct the world space position from depth
+		float depth = textureposition.Sample(samplerposition, inUV).r;
+		float4 position = mul(ubo.inverseViewProjection, float4(inUV * 2.0 - 1.0, depth, 1.0));
+		fragPos = position.xyz / position.w;
+		float4 normalSpecular = textureNormal.Sample(samplerNormal, inUV);
+		normal = octDecode(normalSpecular.xy * 2.0 - 1.0);
+		specular = normalSpecular.z;
+		covered = normalSpecular.w > 0.5;
+	} else {
+		fragPos = textureposition.Sample(samplerposition, inUV).rgb;
+		normal = textureNormal.Sample(samplerNormal, inUV).rgb;
+		specular = albedo.a;
+	}
 
 	float3 fragcolor;
 
@@ -45,51 +129,40 @@ float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 				fragcolor.rgb = albedo.rgb;
 				break;
 			case 4: 
-				fragcolor.rgb = albedo.aaa;
+				fragcolor.rgb = float3(specular, specular, specular);
 				break;
+			case 5: {
+					// Light count of the fragment's cluster relative to the cluster capacity
+					float load = float(grid[clusterIndex(fragPos, fragCoord.xy)].y) / 128.0;
+					fragcolor.rgb = lerp(float3(0.0, 0.0, 1.0), float3(1.0, 0.0, 0.0), load) * step(0.001, load);
+					break;
+			}
 		}		
 		return float4(fragcolor, 1.0);
 	}
 
-	#define lightCount 6
-	#define ambient 0.0
+	if (!covered) {
+		return float4(0.0, 0.0, 0.0, 1.0);
+	}
 
 	// Ambient part
 	fragcolor = albedo.rgb * ambient;
 
-	for(int i = 0; i < lightCount; ++i)
-	{
-		// Vector to light
-		float3 L = ubo.lights[i].position.xyz - fragPos;
-		// Distance from light to fragment position
-		float dist = length(L);
-
-		// Viewer to fragment
-		float3 V = ubo.viewPos.xyz - fragPos;
-		V = normalize(V);
-
-		//if(dist < ubo.lights[i].radius)
-		{
-			// Light to fragment
-			L = normalize(L);
-
-			// Attenuation
-			float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
-
-			// Diffuse part
-			float3 N = normalize(normal);
-			float NdotL = max(0.0, dot(N, L));
-			float3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
-
-			// Specular part
-			// Specular map values are stored in alpha of albedo mrt
-			float3 R = reflect(-L, N);
-			float NdotR = max(0.0, dot(R, V));
-			float3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 16.0) * atten;
-
-			fragcolor += diff + spec;
+	float3 N = normalize(normal);
+	// Viewer to fragment
+	float3 V = normalize(ubo.viewPos.xyz - fragPos);
+
+	if (CLUSTERED) {
+		// Only lights binned into this fragment's cluster can reach it
+		uint2 cluster = grid[clusterIndex(fragPos, fragCoord.xy)];
+		for (uint i = 0; i < cluster.y; ++i) {
+			fragcolor += shadeLight(lights[lightIndices[cluster.x + i]], fragPos, N, V, albedo.rgb, specular);
+		}
+	} else {
+		for (uint i = 0; i < clusters.gridSize.w; ++i) {
+			fragcolor += shadeLight(lights[i], fragPos, N, V, albedo.rgb, specular);
 		}
 	}
 
-  return float4(fragcolor, 1.0);
-}
\ No newline at end of file
+	return float4(fragcolor, 1.0);
+}
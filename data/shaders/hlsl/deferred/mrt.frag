@@ -12,13 +12,26 @@ struct VSOutput
 [[vk::location(2)]] float3 Color : COLOR0;
 [[vk::location(3)]] float3 WorldPos : POSITION0;
 [[vk::location(4)]] float3 Tangent : TEXCOORD1;
+[[vk::location(5)]] float4 CurrentPos : POSITION1;
+[[vk::location(6)]] float4 PreviousPos : POSITION2;
 };
 
+// Compact layout: no position attachment (output 0 is discarded), octahedral normal and specular in 10:10:10:2
+[[vk::constant_id(0)]] const bool COMPACT_GBUFFER = false;
+
+float2 octEncode(float3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	float2 signs = float2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+}
+
 struct FSOutput
 {
 	float4 Position : SV_TARGET0;
 	float4 Normal : SV_TARGET1;
 	float4 Albedo : SV_TARGET2;
+	float2 Velocity : SV_TARGET3;
 };
 
 FSOutput main(VSOutput input)
@@ -32,8 +45,16 @@ FSOutput main(VSOutput input)
 	float3 B = cross(N, T);
 	float3x3 TBN = float3x3(T, B, N);
 	float3 tnorm = mul(normalize(textureNormalMap.Sample(samplerNormalMap, input.UV).xyz * 2.0 - float3(1.0, 1.0, 1.0)), TBN);
-	output.Normal = float4(tnorm, 1.0);
-
 	output.Albedo = textureColor.Sample(samplerColor, input.UV);
+
+	if (COMPACT_GBUFFER) {
+		// Alpha marks covered pixels
+		output.Normal = float4(octEncode(normalize(tnorm)) * 0.5 + 0.5, output.Albedo.a, 1.0);
+	} else {
+		output.Normal = float4(tnorm, 1.0);
+	}
+
+	// Screen space motion in UV units, see VulkanTemporalAA.h
+	output.Velocity = (input.CurrentPos.xy / input.CurrentPos.w - input.PreviousPos.xy / input.PreviousPos.w) * 0.5;
 	return output;
 }
\ No newline at end of file
@@ -15,6 +15,9 @@ struct UBO
 	float4x4 model;
 	float4x4 view;
 	float4 instancePos[3];
+	// Unjittered, for the velocity buffer
+	float4x4 currentViewProjection;
+	float4x4 previousViewProjection;
 };
 
 cbuffer ubo : register(b0) { UBO ubo; }
@@ -27,6 +30,8 @@ struct VSOutput
 [[vk::location(2)]] float3 Color : COLOR0;
 [[vk::location(3)]] float3 WorldPos : POSITION0;
 [[vk::location(4)]] float3 Tangent : TEXCOORD1;
+[[vk::location(5)]] float4 CurrentPos : POSITION1;
+[[vk::location(6)]] float4 PreviousPos : POSITION2;
 };
 
 VSOutput main(VSInput input, uint InstanceIndex : SV_InstanceID)
@@ -47,5 +52,9 @@ VSOutput main(VSInput input, uint InstanceIndex : SV_InstanceID)
 
 	// Currently just vertex color
 	output.Color = input.Color;
+
+	// The scene is static, so positions only move with the camera
+	output.CurrentPos = mul(ubo.currentViewProjection, float4(output.WorldPos, 1.0));
+	output.PreviousPos = mul(ubo.previousViewProjection, float4(output.WorldPos, 1.0));
 	return output;
 }
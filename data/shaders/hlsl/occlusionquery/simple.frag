@@ -1,6 +0,0 @@
-// Copyright 2020 Google LLC
-
-float4 main([[vk::location(0)]] float3 Color : COLOR0) : SV_TARGET
-{
-    return float4(1.0, 1.0, 1.0, 1.0);
-}
\ No newline at end of file
@@ -32,6 +32,30 @@ struct PushConsts {
 
 [[vk::push_constant]] PushConsts material;
 
+[[vk::constant_id(0)]] const bool CLUSTERED_LIGHTS = false;
+
+// Light cluster mapping, see VulkanLightClusters.h
+struct ClusterParams
+{
+	float4x4 view;
+	float4x4 inverseProjection;
+	uint4 gridSize;
+	float4 screen;
+	float4 depth;
+};
+
+cbuffer clusters : register(b2) { ClusterParams clusters; }
+
+// position.w = range, color.w = intensity
+struct Light {
+	float4 position;
+	float4 color;
+};
+
+StructuredBuffer<Light> lights : register(t3);
+StructuredBuffer<uint2> grid : register(t4);
+StructuredBuffer<uint> lightIndices : register(t5);
+
 static const float PI = 3.14159265359;
 
 //#define ROUGHNESS_PATTERN 1
@@ -70,7 +94,7 @@ float3 F_Schlick(float cosTheta, float metallic)
 
 // Specular BRDF composition --------------------------------------------
 
-float3 BRDF(float3 L, float3 V, float3 N, float metallic, float roughness)
+float3 BRDF(float3 L, float3 V, float3 N, float metallic, float roughness, float3 lightColor)
 {
 	// Precalculate vectors and dot products
 	float3 H = normalize (V + L);
@@ -79,9 +103,6 @@ float3 BRDF(float3 L, float3 V, float3 N, float metallic, float roughness)
 	float dotLH = clamp(dot(L, H), 0.0, 1.0);
 	float dotNH = clamp(dot(N, H), 0.0, 1.0);
 
-	// Light color fixed
-	float3 lightColor = float3(1.0, 1.0, 1.0);
-
 	float3 color = float3(0.0, 0.0, 0.0);
 
 	if (dotNL > 0.0)
@@ -103,7 +124,7 @@ float3 BRDF(float3 L, float3 V, float3 N, float metallic, float roughness)
 }
 
 // ----------------------------------------------------------------------------
-float4 main(VSOutput input) : SV_TARGET
+float4 main(VSOutput input, float4 fragCoord : SV_Position) : SV_TARGET
 {
 	float3 N = normalize(input.Normal);
 	float3 V = normalize(ubo.camPos - input.WorldPos);
@@ -119,9 +140,25 @@ float4 main(VSOutput input) : SV_TARGET
 	float3 Lo = float3(0.0, 0.0, 0.0);
 	for (int i = 0; i < 4; i++) {
 		float3 L = normalize(uboParams.lights[i].xyz - input.WorldPos);
-		Lo += BRDF(L, V, N, material.metallic, roughness);
+		Lo += BRDF(L, V, N, material.metallic, roughness, float3(1.0, 1.0, 1.0));
 	};
 
+	if (CLUSTERED_LIGHTS) {
+		// Point lights binned into this fragment's cluster
+		float viewZ = -mul(clusters.view, float4(input.WorldPos, 1.0)).z;
+		uint slice = uint(clamp(floor(log(viewZ) * clusters.depth.z - clusters.depth.w), 0.0, float(clusters.gridSize.z - 1)));
+		uint2 tile = min(uint2(fragCoord.xy / clusters.screen.z), clusters.gridSize.xy - 1);
+		uint2 cluster = grid[tile.x + tile.y * clusters.gridSize.x + slice * clusters.gridSize.x * clusters.gridSize.y];
+		for (uint j = 0; j < cluster.y; j++) {
+			Light light = lights[lightIndices[cluster.x + j]];
+			float3 L = light.position.xyz - input.WorldPos;
+			float dist = length(L);
+			float window = saturate(1.0 - pow(dist / light.position.w, 4.0));
+			float atten = light.color.w / (dist * dist + 1.0) * window * window;
+			Lo += BRDF(L / dist, V, N, material.metallic, roughness, light.color.rgb * atten);
+		}
+	}
+
 	// Combine with ambient
 	float3 color = materialcolor() * 0.02;
 	color += Lo;
@@ -0,0 +1,9 @@
+// Displays the radial blur computed on the async compute queue
+
+Texture2D textureBlur : register(t1);
+SamplerState samplerBlur : register(s1);
+
+float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
+{
+	return textureBlur.Sample(samplerBlur, inUV);
+}
@@ -0,0 +1,42 @@
+// Copyright 2020 Google LLC
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+[[vk::location(0)]] float4 WorldPos : POSITION0;
+[[vk::location(1)]] float3 LightPos : POSITION1;
+};
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 view;
+	float4x4 model;
+	float4 lightPos;
+	float4x4 faceViews[6];
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+// Cube map faces the current primitive needs to be rendered to
+struct PushConsts
+{
+	uint faceMask;
+};
+[[vk::push_constant]] PushConsts pushConsts;
+
+VSOutput main([[vk::location(0)]] float3 Pos : POSITION0, uint ViewIndex : SV_ViewID)
+{
+	VSOutput output = (VSOutput)0;
+	// Each view renders one cube map face
+	if ((pushConsts.faceMask & (1u << ViewIndex)) == 0) {
+		// Move outside of the clip volume, so the primitive is culled before rasterization
+		output.Pos = float4(0.0, 0.0, -2.0, 1.0);
+	} else {
+		output.Pos = mul(ubo.projection, mul(ubo.faceViews[ViewIndex], mul(ubo.model, float4(Pos, 1.0))));
+	}
+
+	output.WorldPos = float4(Pos, 1.0);
+	output.LightPos = ubo.lightPos.xyz;
+	return output;
+}
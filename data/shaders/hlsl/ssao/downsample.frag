@@ -0,0 +1,47 @@
+// Reduces the G-Buffer positions and normals to the SSAO resolution
+// Picks the texel of each block closest to the camera instead of averaging, averaged positions wouldn't lie on any surface
+
+Texture2D texturePositionDepth : register(t0);
+SamplerState samplerPositionDepth : register(s0);
+Texture2D textureNormal : register(t1);
+SamplerState samplerNormal : register(s1);
+
+struct UBO
+{
+	float4x4 viewToPreviousView;
+	float4x4 previousProjection;
+	float historyWeight;
+	int reset;
+	int factor;
+};
+cbuffer ubo : register(b3) { UBO ubo; };
+
+struct FSOutput
+{
+	float4 Position : SV_TARGET0;
+	float4 Normal : SV_TARGET1;
+};
+
+FSOutput main([[vk::location(0)]] float2 inUV : TEXCOORD0, float4 fragCoord : SV_Position)
+{
+	int2 origin = int2(fragCoord.xy) * ubo.factor;
+	int2 textureSize;
+	texturePositionDepth.GetDimensions(textureSize.x, textureSize.y);
+	int2 maxCoord = textureSize - 1;
+	int2 closest = min(origin, maxCoord);
+	float closestDepth = texturePositionDepth.Load(int3(closest, 0)).w;
+	for (int y = 0; y < ubo.factor; y++) {
+		for (int x = 0; x < ubo.factor; x++) {
+			int2 coord = min(origin + int2(x, y), maxCoord);
+			float depth = texturePositionDepth.Load(int3(coord, 0)).w;
+			if (depth < closestDepth) {
+				closestDepth = depth;
+				closest = coord;
+			}
+		}
+	}
+	FSOutput output;
+	output.Position = texturePositionDepth.Load(int3(closest, 0));
+	output.Normal = textureNormal.Load(int3(closest, 0));
+	return output;
+}
@@ -7,6 +7,7 @@ SamplerState samplerNormal : register(s1);
 Texture2D ssaoNoiseTexture : register(t2);
 SamplerState ssaoNoiseSampler : register(s2);
 
+// Samples per pixel, the reduced resolution mode uses a different part of the kernel every frame
 #define SSAO_KERNEL_ARRAY_SIZE 64
 [[vk::constant_id(0)]] const int SSAO_KERNEL_SIZE = 64;
 [[vk::constant_id(1)]] const float SSAO_RADIUS = 0.5;
@@ -20,6 +21,11 @@ cbuffer uboSSAOKernel : register(b3) { UBOSSAOKernel uboSSAOKernel; };
 struct UBO
 {
 	float4x4 projection;
+	int ssao;
+	int ssaoOnly;
+	int ssaoBlur;
+	int kernelOffset;
+	float kernelRotation;
 };
 cbuffer ubo : register(b4) { UBO ubo; };
 
@@ -40,13 +46,16 @@ float main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_TARGET
 	// Create TBN matrix
 	float3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
 	float3 bitangent = cross(tangent, normal);
-	float3x3 TBN = transpose(float3x3(tangent, bitangent, normal));
+	// Rotating the kernel around the normal every frame lets temporal accumulation see different sample directions
+	float3 rotatedTangent = cos(ubo.kernelRotation) * tangent + sin(ubo.kernelRotation) * bitangent;
+	bitangent = cross(rotatedTangent, normal);
+	float3x3 TBN = transpose(float3x3(rotatedTangent, bitangent, normal));
 
 	// Calculate occlusion value
 	float occlusion = 0.0f;
 	for(int i = 0; i < SSAO_KERNEL_SIZE; i++)
 	{
-		float3 samplePos = mul(TBN, uboSSAOKernel.samples[i].xyz);
+		float3 samplePos = mul(TBN, uboSSAOKernel.samples[(ubo.kernelOffset + i) % SSAO_KERNEL_ARRAY_SIZE].xyz);
 		samplePos = fragPos + samplePos * SSAO_RADIUS;
 
 		// project
@@ -0,0 +1,44 @@
+// Accumulates the reduced resolution SSAO of the current frame into the reprojected history
+// The scene is static, so the camera matrices are enough to find a texel's position in the previous frame
+
+Texture2D textureSSAO : register(t0);
+SamplerState samplerSSAO : register(s0);
+Texture2D texturePositionDepth : register(t1);
+SamplerState samplerPositionDepth : register(s1);
+Texture2D textureHistory : register(t2);
+SamplerState samplerHistory : register(s2);
+
+struct UBO
+{
+	float4x4 viewToPreviousView;
+	float4x4 previousProjection;
+	float historyWeight;
+	int reset;
+	int factor;
+};
+cbuffer ubo : register(b3) { UBO ubo; };
+
+// Accumulated occlusion and the linear depth it belongs to
+float2 main([[vk::location(0)]] float2 inUV : TEXCOORD0, float4 fragCoord : SV_Position) : SV_TARGET
+{
+	int3 coord = int3(fragCoord.xy, 0);
+	float occlusion = textureSSAO.Load(coord).r;
+	float4 position = texturePositionDepth.Load(coord);
+
+	float result = occlusion;
+	if (ubo.reset == 0) {
+		float4 previousPosition = mul(ubo.viewToPreviousView, float4(position.xyz, 1.0));
+		float4 previousClip = mul(ubo.previousProjection, previousPosition);
+		float2 previousUV = previousClip.xy / previousClip.w * 0.5 + 0.5;
+		if (all(previousUV >= 0.0) && all(previousUV <= 1.0)) {
+			float2 history = textureHistory.Sample(samplerHistory, previousUV).rg;
+			// The history belongs to a different surface (disocclusion) if its depth doesn't match the reprojected depth
+			float expectedDepth = -previousPosition.z;
+			if (abs(history.g - expectedDepth) < 0.05 * expectedDepth) {
+				result = lerp(occlusion, history.r, ubo.historyWeight);
+			}
+		}
+	}
+
+	return float2(result, position.w);
+}
@@ -0,0 +1,34 @@
+// Depth aware (bilateral) upsampling of the reduced resolution SSAO
+// Bilinear weights of the four nearest low resolution texels, scaled down for texels whose depth differs from the full resolution pixel
+
+Texture2D texturePositionDepth : register(t0);
+SamplerState samplerPositionDepth : register(s0);
+Texture2D textureSSAO : register(t1);
+SamplerState samplerSSAO : register(s1);
+
+float main([[vk::location(0)]] float2 inUV : TEXCOORD0, float4 fragCoord : SV_Position) : SV_TARGET
+{
+	float depth = texturePositionDepth.Load(int3(fragCoord.xy, 0)).w;
+
+	int2 lowSize;
+	textureSSAO.GetDimensions(lowSize.x, lowSize.y);
+	float2 lowPosition = inUV * float2(lowSize) - 0.5;
+	int2 base = int2(floor(lowPosition));
+	float2 f = lowPosition - float2(base);
+
+	float result = 0.0;
+	float weightSum = 0.0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			int2 coord = clamp(base + int2(x, y), int2(0, 0), lowSize - 1);
+			float2 lowTexel = textureSSAO.Load(int3(coord, 0)).rg;
+			float bilinearWeight = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+			float depthWeight = 1.0 / (1.0e-3 + abs(depth - lowTexel.g) / max(depth, 1.0e-3));
+			float weight = bilinearWeight * depthWeight;
+			result += lowTexel.r * weight;
+			weightSum += weight;
+		}
+	}
+
+	return (weightSum > 0.0) ? result / weightSum : textureSSAO.Sample(samplerSSAO, inUV).r;
+}
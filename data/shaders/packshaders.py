@@ -0,0 +1,60 @@
+# Packs all compiled SPIR-V shaders into a single archive that the examples map at startup instead of opening each file
+# See base/VulkanShaderCache.h for the archive layout
+import argparse
+import os
+import struct
+import sys
+
+parser = argparse.ArgumentParser(description='Pack all SPIR-V shaders into a single archive')
+parser.add_argument('--output', type=str, help='archive file to write (defaults to shaders.pak next to this script)')
+args = parser.parse_args()
+
+MAGIC = b"VKSP"
+VERSION = 1
+HEADER_SIZE = 16
+ENTRY_SIZE = 16
+DATA_ALIGNMENT = 16
+
+shader_dir = os.path.dirname(os.path.realpath(__file__))
+# Names are stored relative to the asset (data) directory, as paths passed to loadShader start with the asset path
+data_dir = os.path.dirname(shader_dir)
+output_file = args.output if args.output != None else os.path.join(shader_dir, "shaders.pak")
+
+files = []
+for search_dir in [shader_dir, os.path.join(data_dir, "homework", "shaders")]:
+    for root, dirs, filenames in os.walk(search_dir):
+        for filename in filenames:
+            if filename.endswith(".spv"):
+                path = os.path.join(root, filename)
+                files.append((os.path.relpath(path, data_dir).replace('\\', '/'), path))
+files.sort()
+
+if len(files) == 0:
+    sys.exit("No SPIR-V files found, compile the shaders first")
+
+names = b""
+name_offsets = []
+for name, path in files:
+    name_offsets.append(len(names))
+    names += name.encode("utf-8")
+
+offset = HEADER_SIZE + ENTRY_SIZE * len(files) + len(names)
+entries = b""
+data = b""
+for index, (name, path) in enumerate(files):
+    with open(path, "rb") as file:
+        code = file.read()
+    padding = (-offset) % DATA_ALIGNMENT
+    data += b"\0" * padding
+    offset += padding
+    entries += struct.pack("<IIII", HEADER_SIZE + ENTRY_SIZE * len(files) + name_offsets[index], len(name.encode("utf-8")), offset, len(code))
+    data += code
+    offset += len(code)
+
+with open(output_file, "wb") as file:
+    file.write(MAGIC + struct.pack("<III", VERSION, len(files), 0))
+    file.write(entries)
+    file.write(names)
+    file.write(data)
+
+print("Packed %d shaders into %s (%d bytes)" % (len(files), output_file, offset))
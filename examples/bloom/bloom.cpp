@@ -1,5 +1,5 @@
 /*
-* Vulkan Example - Implements a separable two-pass fullscreen blur (also known as bloom)
+* Vulkan Example - Implements a separable two-pass fullscreen blur (also known as bloom) and a mip chain bloom for comparison
 *
 * Copyright (C) Sascha Willems - www.saschawillems.de
 *
@@ -8,6 +8,8 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanRenderGraph.h"
+#include "VulkanBloom.h"
 
 #define ENABLE_VALIDATION false
 
@@ -20,6 +22,11 @@ class VulkanExample : public VulkanExampleBase
 public:
 	bool bloom = true;
 
+	// The separable gaussian blur works on a fixed size glow target, the mip chain on a glow target at window resolution
+	enum BloomMethod { Gaussian = 0, MipChain = 1 };
+	int32_t bloomMethod = Gaussian;
+	vks::Bloom mipChainBloom;
+
 	vks::TextureCubeMap cubemap;
 
 	struct {
@@ -53,6 +60,7 @@ public:
 	struct {
 		VkPipeline blurVert;
 		VkPipeline blurHorz;
+		VkPipeline bloomComposite;
 		VkPipeline glowPass;
 		VkPipeline phongPass;
 		VkPipeline skyBox;
@@ -60,39 +68,53 @@ public:
 
 	struct {
 		VkPipelineLayout blur;
+		VkPipelineLayout bloomComposite;
 		VkPipelineLayout scene;
 	} pipelineLayouts;
 
 	struct {
 		VkDescriptorSet blurVert;
 		VkDescriptorSet blurHorz;
+		VkDescriptorSet bloomComposite;
 		VkDescriptorSet scene;
 		VkDescriptorSet skyBox;
 	} descriptorSets;
 
 	struct {
 		VkDescriptorSetLayout blur;
+		VkDescriptorSetLayout bloomComposite;
 		VkDescriptorSetLayout scene;
 	} descriptorSetLayouts;
 
-	// Framebuffer for offscreen rendering
-	struct FrameBufferAttachment {
-		VkImage image;
-		VkDeviceMemory mem;
-		VkImageView view;
-	};
-	struct FrameBuffer {
-		VkFramebuffer framebuffer;
-		FrameBufferAttachment color, depth;
-		VkDescriptorImageInfo descriptor;
-	};
+	// The glow and vertical blur passes are built by a render graph, which owns the offscreen attachments
+	// The glow depth buffer is only needed by the first pass, so it shares its memory with the vertical blur target
+	// Passes of the bloom method not in use are culled
+	vks::RenderGraph* renderGraph = nullptr;
 	struct OffscreenPass {
 		int32_t width, height;
-		VkRenderPass renderPass;
 		VkSampler sampler;
-		std::array<FrameBuffer, 2> framebuffers;
+		vks::RenderGraph::ImageHandle glow;
+		vks::RenderGraph::ImageHandle glowDepth;
+		vks::RenderGraph::ImageHandle blurVert;
+		vks::RenderGraph::ImageHandle glowFull;
+		vks::RenderGraph::ImageHandle glowFullDepth;
+		vks::RenderGraph::PassHandle glowPass;
+		vks::RenderGraph::PassHandle blurVertPass;
+		vks::RenderGraph::PassHandle glowFullPass;
 	} offscreenPass;
 
+	// GPU time of the bloom, measured with two timestamp pairs per command buffer:
+	// one around the offscreen work (glow, blur or mip chain) and one around the final blur or composition draw in the scene render pass
+	struct {
+		bool supported = false;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		float timestampPeriod = 1.0f;
+		uint64_t timestampMask = ~0ULL;
+		// Exponential moving average in ms
+		float bloomTime = 0.0f;
+		uint32_t sampleCount = 0;
+	} timing;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Bloom (offscreen rendering)";
@@ -110,31 +132,27 @@ public:
 
 		vkDestroySampler(device, offscreenPass.sampler, nullptr);
 
-		// Frame buffer
-		for (auto& framebuffer : offscreenPass.framebuffers)
-		{
-			// Attachments
-			vkDestroyImageView(device, framebuffer.color.view, nullptr);
-			vkDestroyImage(device, framebuffer.color.image, nullptr);
-			vkFreeMemory(device, framebuffer.color.mem, nullptr);
-			vkDestroyImageView(device, framebuffer.depth.view, nullptr);
-			vkDestroyImage(device, framebuffer.depth.image, nullptr);
-			vkFreeMemory(device, framebuffer.depth.mem, nullptr);
-
-			vkDestroyFramebuffer(device, framebuffer.framebuffer, nullptr);
+		// Attachments, render passes and framebuffers
+		delete renderGraph;
+		mipChainBloom.destroy();
+
+		if (timing.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, timing.queryPool, nullptr);
 		}
-		vkDestroyRenderPass(device, offscreenPass.renderPass, nullptr);
 
 		vkDestroyPipeline(device, pipelines.blurHorz, nullptr);
 		vkDestroyPipeline(device, pipelines.blurVert, nullptr);
+		vkDestroyPipeline(device, pipelines.bloomComposite, nullptr);
 		vkDestroyPipeline(device, pipelines.phongPass, nullptr);
 		vkDestroyPipeline(device, pipelines.glowPass, nullptr);
 		vkDestroyPipeline(device, pipelines.skyBox, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayouts.blur , nullptr);
+		vkDestroyPipelineLayout(device, pipelineLayouts.bloomComposite, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayouts.scene, nullptr);
 
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.blur, nullptr);
+		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.bloomComposite, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.scene, nullptr);
 
 		// Uniform buffers
@@ -145,168 +163,86 @@ public:
 		cubemap.destroy();
 	}
 
-	// Setup the offscreen framebuffer for rendering the mirrored scene
-	// The color attachment of this framebuffer will then be sampled from
-	void prepareOffscreenFramebuffer(FrameBuffer *frameBuf, VkFormat colorFormat, VkFormat depthFormat)
+	// Declares the offscreen passes used for the glow, the vertical blur and the full resolution glow of the mip chain bloom
+	void buildRenderGraph()
 	{
-		// Color attachment
-		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
-		image.imageType = VK_IMAGE_TYPE_2D;
-		image.format = colorFormat;
-		image.extent.width = FB_DIM;
-		image.extent.height = FB_DIM;
-		image.extent.depth = 1;
-		image.mipLevels = 1;
-		image.arrayLayers = 1;
-		image.samples = VK_SAMPLE_COUNT_1_BIT;
-		image.tiling = VK_IMAGE_TILING_OPTIMAL;
-		// We will sample directly from the color attachment
-		image.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		VkImageViewCreateInfo colorImageView = vks::initializers::imageViewCreateInfo();
-		colorImageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		colorImageView.format = colorFormat;
-		colorImageView.flags = 0;
-		colorImageView.subresourceRange = {};
-		colorImageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		colorImageView.subresourceRange.baseMipLevel = 0;
-		colorImageView.subresourceRange.levelCount = 1;
-		colorImageView.subresourceRange.baseArrayLayer = 0;
-		colorImageView.subresourceRange.layerCount = 1;
-
-		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &frameBuf->color.image));
-		vkGetImageMemoryRequirements(device, frameBuf->color.image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &frameBuf->color.mem));
-		VK_CHECK_RESULT(vkBindImageMemory(device, frameBuf->color.image, frameBuf->color.mem, 0));
-
-		colorImageView.image = frameBuf->color.image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &colorImageView, nullptr, &frameBuf->color.view));
-
-		// Depth stencil attachment
-		image.format = depthFormat;
-		image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-
-		VkImageViewCreateInfo depthStencilView = vks::initializers::imageViewCreateInfo();
-		depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		depthStencilView.format = depthFormat;
-		depthStencilView.flags = 0;
-		depthStencilView.subresourceRange = {};
-		depthStencilView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		if (vks::tools::formatHasStencil(depthFormat)) {
-			depthStencilView.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-		depthStencilView.subresourceRange.baseMipLevel = 0;
-		depthStencilView.subresourceRange.levelCount = 1;
-		depthStencilView.subresourceRange.baseArrayLayer = 0;
-		depthStencilView.subresourceRange.layerCount = 1;
-
-		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &frameBuf->depth.image));
-		vkGetImageMemoryRequirements(device, frameBuf->depth.image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &frameBuf->depth.mem));
-		VK_CHECK_RESULT(vkBindImageMemory(device, frameBuf->depth.image, frameBuf->depth.mem, 0));
-
-		depthStencilView.image = frameBuf->depth.image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &depthStencilView, nullptr, &frameBuf->depth.view));
-
-		VkImageView attachments[2];
-		attachments[0] = frameBuf->color.view;
-		attachments[1] = frameBuf->depth.view;
-
-		VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-		fbufCreateInfo.renderPass = offscreenPass.renderPass;
-		fbufCreateInfo.attachmentCount = 2;
-		fbufCreateInfo.pAttachments = attachments;
-		fbufCreateInfo.width = FB_DIM;
-		fbufCreateInfo.height = FB_DIM;
-		fbufCreateInfo.layers = 1;
-
-		VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuf->framebuffer));
-
-		// Fill a descriptor for later use in a descriptor set
-		frameBuf->descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		frameBuf->descriptor.imageView = frameBuf->color.view;
-		frameBuf->descriptor.sampler = offscreenPass.sampler;
+		// Find a suitable depth format
+		VkFormat fbDepthFormat;
+		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &fbDepthFormat);
+		assert(validDepthFormat);
+
+		renderGraph->destroy();
+		offscreenPass.glow = renderGraph->addImage("glow", FB_COLOR_FORMAT, FB_DIM, FB_DIM);
+		offscreenPass.glowDepth = renderGraph->addImage("glow depth", fbDepthFormat, FB_DIM, FB_DIM);
+		offscreenPass.blurVert = renderGraph->addImage("vertical blur", FB_COLOR_FORMAT, FB_DIM, FB_DIM);
+		offscreenPass.glowFull = renderGraph->addImage("glow (window size)", FB_COLOR_FORMAT, width, height);
+		offscreenPass.glowFullDepth = renderGraph->addImage("glow depth (window size)", fbDepthFormat, width, height);
+
+		/*
+			First render pass: Render glow parts of the model (separate mesh) to an offscreen frame buffer
+		*/
+		offscreenPass.glowPass = renderGraph->addPass("glow", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.glowPass);
+			models.ufoGlow.draw(commandBuffer);
+		});
+		renderGraph->writeColor(offscreenPass.glowPass, offscreenPass.glow);
+		renderGraph->writeDepth(offscreenPass.glowPass, offscreenPass.glowDepth);
+
+		/*
+			Second render pass: Vertical blur
+
+			Render contents of the first pass into a second framebuffer and apply a vertical blur
+			This is the first blur pass, the horizontal blur is applied when rendering on top of the scene
+		*/
+		offscreenPass.blurVertPass = renderGraph->addPass("vertical blur", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurVert, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurVert);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph->read(offscreenPass.blurVertPass, offscreenPass.glow);
+		renderGraph->writeColor(offscreenPass.blurVertPass, offscreenPass.blurVert);
+
+		/*
+			Mip chain bloom: Render the glow parts at window resolution, the mip chain is built from it by compute passes after the graph
+			Uses the same attachment formats as the first pass, so the glow pipeline is compatible with both
+		*/
+		offscreenPass.glowFullPass = renderGraph->addPass("glow (window size)", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.glowPass);
+			models.ufoGlow.draw(commandBuffer);
+		});
+		renderGraph->writeColor(offscreenPass.glowFullPass, offscreenPass.glowFull);
+		renderGraph->writeDepth(offscreenPass.glowFullPass, offscreenPass.glowFullDepth);
+
+		updateRenderGraphExports();
 	}
 
-	// Prepare the offscreen framebuffers used for the vertical- and horizontal blur
+	// Only the passes of the selected bloom method survive culling, with bloom disabled all offscreen passes are culled
+	void updateRenderGraphExports()
+	{
+		// The vertical blur is sampled by the horizontal blur in the scene render pass
+		renderGraph->setExported(offscreenPass.blurVert, bloom && (bloomMethod == Gaussian));
+		// The full resolution glow is the source of the mip chain
+		renderGraph->setExported(offscreenPass.glowFull, bloom && (bloomMethod == MipChain));
+		renderGraph->compile();
+	}
+
+	// Prepare the offscreen passes and the mip chain bloom
 	void prepareOffscreen()
 	{
 		offscreenPass.width = FB_DIM;
 		offscreenPass.height = FB_DIM;
 
-		// Find a suitable depth format
-		VkFormat fbDepthFormat;
-		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &fbDepthFormat);
-		assert(validDepthFormat);
+		renderGraph = new vks::RenderGraph(vulkanDevice);
+		buildRenderGraph();
 
-		// Create a separate render pass for the offscreen rendering as it may differ from the one used for scene rendering
-
-		std::array<VkAttachmentDescription, 2> attchmentDescriptions = {};
-		// Color attachment
-		attchmentDescriptions[0].format = FB_COLOR_FORMAT;
-		attchmentDescriptions[0].samples = VK_SAMPLE_COUNT_1_BIT;
-		attchmentDescriptions[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attchmentDescriptions[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attchmentDescriptions[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		attchmentDescriptions[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attchmentDescriptions[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attchmentDescriptions[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		// Depth attachment
-		attchmentDescriptions[1].format = fbDepthFormat;
-		attchmentDescriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
-		attchmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attchmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attchmentDescriptions[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		attchmentDescriptions[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attchmentDescriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attchmentDescriptions[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
-
-		VkSubpassDescription subpassDescription = {};
-		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpassDescription.colorAttachmentCount = 1;
-		subpassDescription.pColorAttachments = &colorReference;
-		subpassDescription.pDepthStencilAttachment = &depthReference;
-
-		// Use subpass dependencies for layout transitions
-		std::array<VkSubpassDependency, 2> dependencies;
-
-		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[0].dstSubpass = 0;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-		dependencies[1].srcSubpass = 0;
-		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-		// Create the actual renderpass
-		VkRenderPassCreateInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.attachmentCount = static_cast<uint32_t>(attchmentDescriptions.size());
-		renderPassInfo.pAttachments = attchmentDescriptions.data();
-		renderPassInfo.subpassCount = 1;
-		renderPassInfo.pSubpasses = &subpassDescription;
-		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
-		renderPassInfo.pDependencies = dependencies.data();
-
-		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &offscreenPass.renderPass));
+		mipChainBloom.downsampleShader = loadShader(getShadersPath() + "base/bloomdownsample.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		mipChainBloom.upsampleShader = loadShader(getShadersPath() + "base/bloomupsample.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		// The glow target only contains the glowing parts, so all of it blooms
+		mipChainBloom.threshold = 0.0f;
+		mipChainBloom.intensity = 1.5f;
+		mipChainBloom.prepare(vulkanDevice, queue, pipelineCache, width, height);
 
 		// Create sampler to sample from the color attachments
 		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
@@ -322,10 +258,52 @@ public:
 		sampler.maxLod = 1.0f;
 		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &offscreenPass.sampler));
+	}
+
+	// One query pair for the offscreen work and one for the draw in the scene render pass per command buffer
+	void prepareTimestamps()
+	{
+		if (timing.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, timing.queryPool, nullptr);
+			timing.queryPool = VK_NULL_HANDLE;
+		}
+		// Timestamps need to be supported by the graphics queue
+		const uint32_t validBits = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits;
+		timing.supported = validBits > 0;
+		timing.timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+		timing.timestampMask = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+		if (timing.supported) {
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCI.queryCount = static_cast<uint32_t>(drawCmdBuffers.size()) * 4;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolCI, nullptr, &timing.queryPool));
+		}
+		timing.sampleCount = 0;
+	}
+
+	void writeTimestamp(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t query)
+	{
+		if (bloom && timing.supported) {
+			vkCmdWriteTimestamp(commandBuffer, stage, timing.queryPool, query);
+		}
+	}
 
-		// Create two frame buffers
-		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[0], FB_COLOR_FORMAT, fbDepthFormat);
-		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[1], FB_COLOR_FORMAT, fbDepthFormat);
+	// Reads the bloom timestamps of a command buffer without waiting
+	void updateTiming(uint32_t commandBufferIndex)
+	{
+		if (!bloom || !timing.supported) {
+			return;
+		}
+		uint64_t timestamps[4] = {};
+		VkResult result = vkGetQueryPoolResults(device, timing.queryPool, commandBufferIndex * 4, 4, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return;
+		}
+		const uint64_t ticks = ((timestamps[1] - timestamps[0]) & timing.timestampMask) + ((timestamps[3] - timestamps[2]) & timing.timestampMask);
+		const float time = (float)ticks * timing.timestampPeriod / 1000000.0f;
+		timing.bloomTime = (timing.sampleCount == 0) ? time : timing.bloomTime + (time - timing.bloomTime) * 0.05f;
+		timing.sampleCount++;
 	}
 
 	void buildCommandBuffers()
@@ -333,8 +311,6 @@ public:
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		VkClearValue clearValues[2];
-		VkViewport viewport;
-		VkRect2D scissor;
 
 		/*
 			The blur method used in this example is multi pass and renders the vertical blur first and then the horizontal one
@@ -345,58 +321,20 @@ public:
 		{
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			if (bloom) {
-				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = offscreenPass.renderPass;
-				renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[0].framebuffer;
-				renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
-				renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues;
-
-				viewport = vks::initializers::viewport((float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				scissor = vks::initializers::rect2D(offscreenPass.width, offscreenPass.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				/*
-					First render pass: Render glow parts of the model (separate mesh) to an offscreen frame buffer
-				*/
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.glowPass);
-
-				models.ufoGlow.draw(drawCmdBuffers[i]);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
-
-				/*
-					Second render pass: Vertical blur
-
-					Render contents of the first pass into a second framebuffer and apply a vertical blur
-					This is the first blur pass, the horizontal blur is applied when rendering on top of the scene
-				*/
-
-				renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[1].framebuffer;
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			if (bloom && timing.supported) {
+				vkCmdResetQueryPool(drawCmdBuffers[i], timing.queryPool, i * 4, 4);
+			}
+			writeTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, i * 4);
 
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurVert, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurVert);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+			// Glow and vertical blur passes (or the full resolution glow), including the barriers between them and the scene render pass
+			renderGraph->execute(drawCmdBuffers[i]);
 
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+			// Downsample and upsample chains of the mip chain bloom
+			if (bloom && (bloomMethod == MipChain)) {
+				mipChainBloom.render(drawCmdBuffers[i]);
 			}
 
-			/*
-				Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
-			*/
+			writeTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, i * 4 + 1);
 
 			/*
 				Third render pass: Scene rendering with applied vertical blur
@@ -434,12 +372,24 @@ public:
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phongPass);
 				models.ufo.draw(drawCmdBuffers[i]);
 
-				if (bloom)
+				// Both timestamps wait for all previous commands, so only the bloom draw is measured
+				writeTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, i * 4 + 2);
+				if (bloom && (bloomMethod == Gaussian))
 				{
 					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurHorz, 0, NULL);
 					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurHorz);
 					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 				}
+				if (bloom && (bloomMethod == MipChain))
+				{
+					// Level 0 of the mip chain covers the whole screen
+					const glm::vec4 uvScaleClamp = glm::vec4(1.0f);
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.bloomComposite, 0, 1, &descriptorSets.bloomComposite, 0, NULL);
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.bloomComposite);
+					vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.bloomComposite, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glm::vec4), &uvScaleClamp);
+					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+				}
+				writeTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, i * 4 + 3);
 
 				drawUI(drawCmdBuffers[i]);
 
@@ -464,9 +414,9 @@ public:
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 7)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 5);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 6);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
 
@@ -486,6 +436,16 @@ public:
 		pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.blur, 1);
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.blur));
 
+		// Mip chain bloom composition, the push constants are the uv scale and clamp of the shared upscale shader
+		VkDescriptorSetLayoutBinding compositeBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+		descriptorSetLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(&compositeBinding, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, nullptr, &descriptorSetLayouts.bloomComposite));
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(glm::vec4), 0);
+		pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.bloomComposite, 1);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.bloomComposite));
+
 		// Scene rendering
 		setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),			// Binding 0 : Vertex shader uniform buffer
@@ -510,7 +470,6 @@ public:
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.blurVert));
 		writeDescriptorSets = {
 			vks::initializers::writeDescriptorSet(descriptorSets.blurVert, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.blurParams.descriptor),				// Binding 0: Fragment shader uniform buffer
-			vks::initializers::writeDescriptorSet(descriptorSets.blurVert, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &offscreenPass.framebuffers[0].descriptor),	// Binding 1: Fragment shader texture sampler
 		};
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 		// Horizontal
@@ -518,9 +477,12 @@ public:
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.blurHorz));
 		writeDescriptorSets = {
 			vks::initializers::writeDescriptorSet(descriptorSets.blurHorz, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.blurParams.descriptor),				// Binding 0: Fragment shader uniform buffer
-			vks::initializers::writeDescriptorSet(descriptorSets.blurHorz, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &offscreenPass.framebuffers[1].descriptor),	// Binding 1: Fragment shader texture sampler
 		};
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+		// Mip chain composition
+		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.bloomComposite, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.bloomComposite));
+		updateBlurDescriptors();
 
 		// Scene rendering
 		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.scene, 1);
@@ -539,6 +501,31 @@ public:
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 	}
 
+	// The offscreen attachments are recreated whenever the render graph is recompiled
+	void updateBlurDescriptors()
+	{
+		// The mip chain is recreated on resize, its source is only rendered if the mip chain bloom is selected
+		if (!renderGraph->isCulled(offscreenPass.glowFullPass)) {
+			mipChainBloom.setSource(renderGraph->getView(offscreenPass.glowFull));
+			VkDescriptorImageInfo bloomDescriptor = vks::initializers::descriptorImageInfo(offscreenPass.sampler, mipChainBloom.getView(), VK_IMAGE_LAYOUT_GENERAL);
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSets.bloomComposite, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &bloomDescriptor);
+			vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, NULL);
+		}
+		// Attachments only exist if the gaussian bloom is enabled, otherwise the blur descriptor sets are not used
+		if (renderGraph->isCulled(offscreenPass.blurVertPass)) {
+			return;
+		}
+		std::array<VkDescriptorImageInfo, 2> imageDescriptors = {
+			vks::initializers::descriptorImageInfo(offscreenPass.sampler, renderGraph->getView(offscreenPass.glow), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vks::initializers::descriptorImageInfo(offscreenPass.sampler, renderGraph->getView(offscreenPass.blurVert), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.blurVert, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),	// Binding 1: Fragment shader texture sampler
+			vks::initializers::writeDescriptorSet(descriptorSets.blurHorz, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),	// Binding 1: Fragment shader texture sampler
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+	}
+
 	void preparePipelines()
 	{
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
@@ -586,12 +573,17 @@ public:
 		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(uint32_t), &blurdirection);
 		shaderStages[1].pSpecializationInfo = &specializationInfo;
 		// Vertical blur pipeline
-		pipelineCI.renderPass = offscreenPass.renderPass;
+		pipelineCI.renderPass = renderGraph->getRenderPass(offscreenPass.blurVertPass);
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.blurVert));
 		// Horizontal blur pipeline
 		blurdirection = 1;
 		pipelineCI.renderPass = renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.blurHorz));
+		// Mip chain bloom composition, additively blends level 0 of the mip chain over the scene
+		shaderStages[0] = loadShader(getShadersPath() + "base/upscale.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+		shaderStages[1] = loadShader(getShadersPath() + "base/upscale.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		pipelineCI.layout = pipelineLayouts.bloomComposite;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.bloomComposite));
 
 		// Phong pass (3D model)
 		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal});
@@ -607,7 +599,7 @@ public:
 		// Color only pass (offscreen blur base)
 		shaderStages[0] = loadShader(getShadersPath() + "bloom/colorpass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "bloom/colorpass.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		pipelineCI.renderPass = offscreenPass.renderPass;
+		pipelineCI.renderPass = renderGraph->getRenderPass(offscreenPass.glowPass);
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.glowPass));
 
 		// Skybox (cubemap)
@@ -699,6 +691,7 @@ public:
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSet();
+		prepareTimestamps();
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -708,21 +701,70 @@ public:
 		if (!prepared)
 			return;
 		draw();
+		updateTiming(currentBuffer);
 		if (!paused || camera.updated)
 		{
 			updateUniformBuffersScene();
 		}
 	}
 
+	// Recompiles the render graph after the bloom has been toggled or its method has been changed
+	void updateBloom()
+	{
+		vkDeviceWaitIdle(device);
+		updateRenderGraphExports();
+		updateBlurDescriptors();
+		timing.sampleCount = 0;
+		buildCommandBuffers();
+	}
+
+	virtual void windowResized()
+	{
+		// The full resolution glow target and the mip chain follow the window size
+		buildRenderGraph();
+		mipChainBloom.resize(width, height);
+		updateBlurDescriptors();
+		// The number of command buffers may have changed with the swap chain
+		prepareTimestamps();
+		buildCommandBuffers();
+	}
+
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
 			if (overlay->checkBox("Bloom", &bloom)) {
-				buildCommandBuffers();
+				updateBloom();
 			}
-			if (overlay->inputFloat("Scale", &ubos.blurParams.blurScale, 0.1f, 2)) {
-				updateUniformBuffersBlur();
+			if (overlay->comboBox("Method", &bloomMethod, { "Separable gaussian", "Mip chain" })) {
+				updateBloom();
 			}
+			if (bloomMethod == Gaussian) {
+				if (overlay->inputFloat("Scale", &ubos.blurParams.blurScale, 0.1f, 2)) {
+					updateUniformBuffersBlur();
+				}
+			} else {
+				bool updateParams = false;
+				updateParams |= overlay->sliderFloat("Threshold", &mipChainBloom.threshold, 0.0f, 1.0f);
+				updateParams |= overlay->sliderFloat("Intensity", &mipChainBloom.intensity, 0.0f, 4.0f);
+				updateParams |= overlay->sliderFloat("Radius", &mipChainBloom.radius, 0.5f, 3.0f);
+				if (updateParams) {
+					mipChainBloom.updateParams();
+				}
+				overlay->text("Mip levels: %d", mipChainBloom.getMipLevels());
+			}
+		}
+		if (overlay->header("Timing")) {
+			if (!timing.supported) {
+				overlay->text("Timestamps not supported");
+			} else if (bloom) {
+				overlay->text("Bloom GPU time: %.3f ms", timing.bloomTime);
+			}
+		}
+		if (overlay->header("Render graph")) {
+			const vks::RenderGraph::Statistics& statistics = renderGraph->getStatistics();
+			overlay->text("Passes: %d (%d culled)", statistics.passCount - statistics.culledPassCount, statistics.culledPassCount);
+			overlay->text("Attachment memory: %.1f KB", (float)statistics.transientMemory / 1024.0f);
+			overlay->text("Without aliasing: %.1f KB", (float)statistics.unaliasedMemory / 1024.0f);
 		}
 	}
 };
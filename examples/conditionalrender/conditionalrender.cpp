@@ -5,6 +5,7 @@
 *
 * With conditional rendering it's possible to execute certain rendering commands based on a buffer value instead of having to rebuild the command buffers.
 * This example sets up a conditional buffer with one value per glTF part, that is used to toggle visibility of single model parts.
+* Nodes sharing a mesh can also be drawn with one instanced draw per primitive, per-part visibility doesn't apply to those draws.
 *
 * Copyright (C) 2018-2023 by Sascha Willems - www.saschawillems.de
 *
@@ -24,6 +25,8 @@ public:
 
 	vkglTF::Model scene;
 
+	bool instanced = false;
+
 	struct {
 		glm::mat4 projection;
 		glm::mat4 view;
@@ -37,6 +40,9 @@ public:
 
 	VkPipelineLayout pipelineLayout;
 	VkPipeline pipeline;
+	// Instanced draws fetch the node matrices from the model's instance buffer instead of per-node uniform buffers
+	VkPipelineLayout pipelineLayoutInstanced;
+	VkPipeline pipelineInstanced;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSet descriptorSet;
 
@@ -59,6 +65,8 @@ public:
 	{
 		vkDestroyPipeline(device, pipeline, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+		vkDestroyPipeline(device, pipelineInstanced, nullptr);
+		vkDestroyPipelineLayout(device, pipelineLayoutInstanced, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 		uniformBuffer.destroy();
 		conditionalBuffer.destroy();
@@ -131,15 +139,21 @@ public:
 			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
 			const VkDeviceSize offsets[1] = { 0 };
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &scene.vertices.buffer, offsets);
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], scene.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			for (auto node : scene.nodes) {
-				renderNode(node, drawCmdBuffers[i]);
+
+			if (instanced) {
+				// The instance buffer is bound to set 1 by the model, the material colors are pre-multiplied into the vertex colors
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayoutInstanced, 0, 1, &descriptorSet, 0, NULL);
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineInstanced);
+				scene.drawInstanced(drawCmdBuffers[i], 0, pipelineLayoutInstanced, 1, 1);
+			} else {
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				for (auto node : scene.nodes) {
+					renderNode(node, drawCmdBuffers[i]);
+				}
 			}
 
 			drawUI(drawCmdBuffers[i]);
@@ -152,7 +166,8 @@ public:
 
 	void loadAssets()
 	{
-		scene.loadFromFile(getAssetPath() + "models/gltf/glTF-Embedded/Buggy.gltf", vulkanDevice, queue);
+		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PrepareInstancing | vkglTF::FileLoadingFlags::PreMultiplyVertexColors;
+		scene.loadFromFile(getAssetPath() + "models/gltf/glTF-Embedded/Buggy.gltf", vulkanDevice, queue, glTFLoadingFlags);
 	}
 
 	void setupDescriptorSets()
@@ -181,6 +196,13 @@ public:
 		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
 
+		// Layout for the instanced draws, set 1 is the model's instance buffer
+		std::array<VkDescriptorSetLayout, 2> setLayoutsInstanced = {
+			descriptorSetLayout, vkglTF::descriptorSetLayoutInstances
+		};
+		pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(setLayoutsInstanced.data(), 2);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayoutInstanced));
+
 		VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &descriptorSet));
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
@@ -221,6 +243,16 @@ public:
 		pipelineCI.pStages = shaderStages.data();
 
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+
+		// Instanced pipeline
+		const std::array<VkPipelineShaderStageCreateInfo, 2> shaderStagesInstanced = {
+			loadShader(getShadersPath() + "conditionalrender/model_instanced.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+			loadShader(getShadersPath() + "conditionalrender/model.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+		};
+		pipelineCI.layout = pipelineLayoutInstanced;
+		pipelineCI.pStages = shaderStagesInstanced.data();
+		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color });
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelineInstanced));
 	}
 
 	void prepareUniformBuffers()
@@ -332,6 +364,11 @@ public:
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
+		if (overlay->header("Settings")) {
+			if (overlay->checkBox("Instanced draws", &instanced)) {
+				buildCommandBuffers();
+			}
+		}
 		if (overlay->header("Visibility")) {
 
 			if (overlay->button("All")) {
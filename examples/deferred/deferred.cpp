@@ -6,8 +6,12 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <random>
+
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanLightClusters.h"
+#include "VulkanTemporalAA.h"
 
 #define ENABLE_VALIDATION false
 
@@ -15,13 +19,23 @@
 #define TEX_DIM 2048
 #define TEX_FILTER VK_FILTER_LINEAR
 
-// Offscreen frame buffer properties
-#define FB_DIM TEX_DIM
+// Capacity of the light buffer, the first six lights are the animated scene lights
+#define MAX_LIGHT_COUNT 4096
+#define SCENE_LIGHT_COUNT 6
 
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	int32_t debugDisplayTarget = 0;
+	// Shade each fragment with the lights of its cluster only, brute force loops over all lights
+	bool clusteredShading = true;
+	int32_t lightCount = 1024;
+	int32_t clusterValidationResult = -1;
+	// Compact G-buffer: positions are reconstructed from depth, normals are octahedral encoded into 10:10:10:2 along with the specular intensity
+	bool compactGBuffer = false;
+	// The scene is rendered at a fraction of the window size per axis and reconstructed to full resolution by the temporal resolve
+	const std::vector<float> renderScales = { 1.0f, 0.75f, 2.0f / 3.0f, 0.5f };
+	int32_t renderScaleIndex = 0;
 
 	struct {
 		struct {
@@ -44,16 +58,31 @@ public:
 		glm::mat4 model;
 		glm::mat4 view;
 		glm::vec4 instancePos[3];
+		// Unjittered, for the velocity buffer
+		glm::mat4 currentViewProjection;
+		glm::mat4 previousViewProjection;
 	} uboOffscreenVS;
-
-	struct Light {
-		glm::vec4 position;
-		glm::vec3 color;
-		float radius;
+	// View projection the last frame has been rendered with
+	glm::mat4 previousViewProjection;
+
+	// Temporal anti-aliasing, the composition is rendered to its (render resolution) target with a jittered projection
+	vks::TemporalAA temporalAA;
+
+	// Lights are culled against the clusters, so they need a finite range (position.w)
+	// Attenuation follows the former radius / (dist^2 + 1) scaled by color.w and is windowed to zero at the range
+	vks::LightClusters lightClusters;
+
+	// Fill lights orbit around their origin
+	struct FillLight {
+		glm::vec3 origin;
+		float orbitRadius;
+		float phase;
+		float speed;
 	};
+	std::vector<FillLight> fillLights;
 
 	struct {
-		Light lights[6];
+		glm::mat4 inverseViewProjection;
 		glm::vec4 viewPos;
 		int debugDisplayTarget = 0;
 	} uboComposition;
@@ -66,6 +95,7 @@ public:
 	struct {
 		VkPipeline offscreen;
 		VkPipeline composition;
+		VkPipeline compositionBruteForce;
 	} pipelines;
 	VkPipelineLayout pipelineLayout;
 
@@ -79,16 +109,21 @@ public:
 
 	// Framebuffer for offscreen rendering
 	struct FrameBufferAttachment {
-		VkImage image;
-		VkDeviceMemory mem;
-		VkImageView view;
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory mem = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
 		VkFormat format;
 	};
 	struct FrameBuffer {
 		int32_t width, height;
 		VkFramebuffer frameBuffer;
+		// The position attachment is not used with the compact layout
 		FrameBufferAttachment position, normal, albedo;
+		// Screen space motion for the temporal resolve
+		FrameBufferAttachment velocity;
 		FrameBufferAttachment depth;
+		// Depth aspect only view for sampling depth in the composition pass
+		VkImageView depthSampleView = VK_NULL_HANDLE;
 		VkRenderPass renderPass;
 	} offScreenFrameBuf;
 
@@ -111,6 +146,12 @@ public:
 		camera.position = { 2.15f, 0.3f, -8.75f };
 		camera.setRotation(glm::vec3(-0.75f, 12.5f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
+		// The G-buffer layout can be selected from the command line, e.g. to compare both layouts in benchmark mode
+		for (const char* arg : args) {
+			if (std::string(arg) == "--compactgbuffer") {
+				compactGBuffer = true;
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -118,32 +159,8 @@ public:
 		// Clean up used Vulkan resources
 		// Note : Inherited destructor cleans up resources stored in base class
 
-		vkDestroySampler(device, colorSampler, nullptr);
-
-		// Frame buffer
-
-		// Color attachments
-		vkDestroyImageView(device, offScreenFrameBuf.position.view, nullptr);
-		vkDestroyImage(device, offScreenFrameBuf.position.image, nullptr);
-		vkFreeMemory(device, offScreenFrameBuf.position.mem, nullptr);
-
-		vkDestroyImageView(device, offScreenFrameBuf.normal.view, nullptr);
-		vkDestroyImage(device, offScreenFrameBuf.normal.image, nullptr);
-		vkFreeMemory(device, offScreenFrameBuf.normal.mem, nullptr);
-
-		vkDestroyImageView(device, offScreenFrameBuf.albedo.view, nullptr);
-		vkDestroyImage(device, offScreenFrameBuf.albedo.image, nullptr);
-		vkFreeMemory(device, offScreenFrameBuf.albedo.mem, nullptr);
-
-		// Depth attachment
-		vkDestroyImageView(device, offScreenFrameBuf.depth.view, nullptr);
-		vkDestroyImage(device, offScreenFrameBuf.depth.image, nullptr);
-		vkFreeMemory(device, offScreenFrameBuf.depth.mem, nullptr);
-
-		vkDestroyFramebuffer(device, offScreenFrameBuf.frameBuffer, nullptr);
-
-		vkDestroyPipeline(device, pipelines.composition, nullptr);
-		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+		destroyOffscreenFramebuffer();
+		destroyPipelines();
 
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
@@ -152,8 +169,8 @@ public:
 		// Uniform buffers
 		uniformBuffers.offscreen.destroy();
 		uniformBuffers.composition.destroy();
-
-		vkDestroyRenderPass(device, offScreenFrameBuf.renderPass, nullptr);
+		lightClusters.destroy();
+		temporalAA.destroy();
 
 		textures.model.colorMap.destroy();
 		textures.model.normalMap.destroy();
@@ -163,6 +180,51 @@ public:
 		vkDestroySemaphore(device, offscreenSemaphore, nullptr);
 	}
 
+	void destroyAttachment(FrameBufferAttachment& attachment)
+	{
+		vkDestroyImageView(device, attachment.view, nullptr);
+		vkDestroyImage(device, attachment.image, nullptr);
+		vkFreeMemory(device, attachment.mem, nullptr);
+		attachment = FrameBufferAttachment();
+	}
+
+	void destroyOffscreenFramebuffer()
+	{
+		vkDestroySampler(device, colorSampler, nullptr);
+		// Color attachments
+		destroyAttachment(offScreenFrameBuf.position);
+		destroyAttachment(offScreenFrameBuf.normal);
+		destroyAttachment(offScreenFrameBuf.albedo);
+		destroyAttachment(offScreenFrameBuf.velocity);
+		// Depth attachment
+		vkDestroyImageView(device, offScreenFrameBuf.depthSampleView, nullptr);
+		offScreenFrameBuf.depthSampleView = VK_NULL_HANDLE;
+		destroyAttachment(offScreenFrameBuf.depth);
+		vkDestroyFramebuffer(device, offScreenFrameBuf.frameBuffer, nullptr);
+		vkDestroyRenderPass(device, offScreenFrameBuf.renderPass, nullptr);
+	}
+
+	void destroyPipelines()
+	{
+		vkDestroyPipeline(device, pipelines.composition, nullptr);
+		vkDestroyPipeline(device, pipelines.compositionBruteForce, nullptr);
+		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+	}
+
+	// Estimated G-buffer traffic per pixel, everything written in the offscreen pass is also fetched in the composition pass
+	uint32_t gBufferBytesPerPixel(bool compact)
+	{
+		// Full: RGBA16F position, RGBA16F normal, RGBA8 albedo, RG16F velocity
+		// Compact: 10:10:10:2 normal and specular, RGBA8 albedo, RG16F velocity
+		uint32_t bytes = compact ? 4 + 4 + 4 : 8 + 8 + 4 + 4;
+		// Depth is only stored (and sampled) with the compact layout, stencil is never stored
+		if (compact) {
+			const bool depth16 = offScreenFrameBuf.depth.format == VK_FORMAT_D16_UNORM || offScreenFrameBuf.depth.format == VK_FORMAT_D16_UNORM_S8_UINT;
+			bytes += depth16 ? 2 : 4;
+		}
+		return bytes;
+	}
+
 	// Enable physical device features required for this example
 	virtual void getEnabledFeatures()
 	{
@@ -236,20 +298,24 @@ public:
 	// Prepare a new framebuffer and attachments for offscreen rendering (G-Buffer)
 	void prepareOffscreenFramebuffer()
 	{
-		offScreenFrameBuf.width = FB_DIM;
-		offScreenFrameBuf.height = FB_DIM;
+		// The G-buffer matches the render resolution of the temporal resolve, so its pixels line up with the jitter
+		const VkExtent2D renderExtent = temporalAA.getRenderExtent();
+		offScreenFrameBuf.width = renderExtent.width;
+		offScreenFrameBuf.height = renderExtent.height;
 
 		// Color attachments
 
-		// (World space) Positions
-		createAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			&offScreenFrameBuf.position);
+		// (World space) Positions, reconstructed from depth with the compact layout
+		if (!compactGBuffer) {
+			createAttachment(
+				VK_FORMAT_R16G16B16A16_SFLOAT,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+				&offScreenFrameBuf.position);
+		}
 
 		// (World space) Normals
 		createAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
+			compactGBuffer ? VK_FORMAT_A2B10G10R10_UNORM_PACK32 : VK_FORMAT_R16G16B16A16_SFLOAT,
 			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
 			&offScreenFrameBuf.normal);
 
@@ -259,6 +325,12 @@ public:
 			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
 			&offScreenFrameBuf.albedo);
 
+		// Velocity
+		createAttachment(
+			vks::TemporalAA::velocityFormat,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			&offScreenFrameBuf.velocity);
+
 		// Depth attachment
 
 		// Find a suitable depth format
@@ -271,42 +343,60 @@ public:
 			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
 			&offScreenFrameBuf.depth);
 
+		// Depth is sampled to reconstruct positions, which needs a view without the stencil aspect
+		VkImageViewCreateInfo depthViewCI = vks::initializers::imageViewCreateInfo();
+		depthViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		depthViewCI.format = attDepthFormat;
+		depthViewCI.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		depthViewCI.image = offScreenFrameBuf.depth.image;
+		VK_CHECK_RESULT(vkCreateImageView(device, &depthViewCI, nullptr, &offScreenFrameBuf.depthSampleView));
+
 		// Set up separate renderpass with references to the color and depth attachments
-		std::array<VkAttachmentDescription, 4> attachmentDescs = {};
+		// The compact layout has no position attachment, its shader output at location 0 is discarded
+		std::vector<FrameBufferAttachment*> colorAttachments;
+		if (!compactGBuffer) {
+			colorAttachments.push_back(&offScreenFrameBuf.position);
+		}
+		colorAttachments.push_back(&offScreenFrameBuf.normal);
+		colorAttachments.push_back(&offScreenFrameBuf.albedo);
+		colorAttachments.push_back(&offScreenFrameBuf.velocity);
+		const uint32_t depthAttachmentIndex = static_cast<uint32_t>(colorAttachments.size());
+		std::vector<VkAttachmentDescription> attachmentDescs(depthAttachmentIndex + 1);
 
 		// Init attachment properties
-		for (uint32_t i = 0; i < 4; ++i)
+		for (uint32_t i = 0; i < attachmentDescs.size(); ++i)
 		{
 			attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
 			attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 			attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 			attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 			attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			if (i == 3)
+			if (i == depthAttachmentIndex)
 			{
 				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+				attachmentDescs[i].finalLayout = compactGBuffer ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+				attachmentDescs[i].format = offScreenFrameBuf.depth.format;
+				// Depth only needs to be kept if positions are reconstructed from it
+				attachmentDescs[i].storeOp = compactGBuffer ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 			}
 			else
 			{
 				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 				attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				attachmentDescs[i].format = colorAttachments[i]->format;
 			}
 		}
 
-		// Formats
-		attachmentDescs[0].format = offScreenFrameBuf.position.format;
-		attachmentDescs[1].format = offScreenFrameBuf.normal.format;
-		attachmentDescs[2].format = offScreenFrameBuf.albedo.format;
-		attachmentDescs[3].format = offScreenFrameBuf.depth.format;
-
 		std::vector<VkAttachmentReference> colorReferences;
-		colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-		colorReferences.push_back({ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-		colorReferences.push_back({ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+		if (compactGBuffer) {
+			colorReferences.push_back({ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+		}
+		for (uint32_t i = 0; i < depthAttachmentIndex; i++) {
+			colorReferences.push_back({ i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+		}
 
 		VkAttachmentReference depthReference = {};
-		depthReference.attachment = 3;
+		depthReference.attachment = depthAttachmentIndex;
 		depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 		VkSubpassDescription subpass = {};
@@ -328,10 +418,10 @@ public:
 
 		dependencies[1].srcSubpass = 0;
 		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_MEMORY_READ_BIT;
 		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 		VkRenderPassCreateInfo renderPassInfo = {};
@@ -345,11 +435,11 @@ public:
 
 		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &offScreenFrameBuf.renderPass));
 
-		std::array<VkImageView,4> attachments;
-		attachments[0] = offScreenFrameBuf.position.view;
-		attachments[1] = offScreenFrameBuf.normal.view;
-		attachments[2] = offScreenFrameBuf.albedo.view;
-		attachments[3] = offScreenFrameBuf.depth.view;
+		std::vector<VkImageView> attachments;
+		for (FrameBufferAttachment* attachment : colorAttachments) {
+			attachments.push_back(attachment->view);
+		}
+		attachments.push_back(offScreenFrameBuf.depth.view);
 
 		VkFramebufferCreateInfo fbufCreateInfo = {};
 		fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -387,17 +477,20 @@ public:
 		}
 
 		// Create a semaphore used to synchronize offscreen rendering and usage
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
+		if (offscreenSemaphore == VK_NULL_HANDLE)
+		{
+			VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
+		}
 
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		// Clear values for all attachments written in the fragment shader
-		std::array<VkClearValue,4> clearValues;
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[3].depthStencil = { 1.0f, 0 };
+		std::vector<VkClearValue> clearValues(compactGBuffer ? 4 : 5);
+		for (size_t i = 0; i < clearValues.size() - 1; i++) {
+			clearValues[i].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		}
+		clearValues.back().depthStencil = { 1.0f, 0 };
 
 		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
 		renderPassBeginInfo.renderPass =  offScreenFrameBuf.renderPass;
@@ -467,21 +560,44 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			// Bin the lights into the clusters the composition pass reads from
+			if (clusteredShading) {
+				lightClusters.bin(drawCmdBuffers[i]);
+			}
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			// Composition at render resolution into the temporal anti-aliasing input
+			VkRenderPassBeginInfo compositionPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			VkViewport viewport;
+			VkRect2D scissor;
+			temporalAA.getRenderPassBeginInfo(compositionPassBeginInfo, viewport, scissor);
+			compositionPassBeginInfo.clearValueCount = 1;
+			compositionPassBeginInfo.pClearValues = clearValues;
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &compositionPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 
-   			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, clusteredShading ? pipelines.composition : pipelines.compositionBruteForce);
 			// Final composition as full screen quad
 			// Note: Also used for debug display if debugDisplayTarget > 0
 			vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
+
+			// Accumulate into the full resolution history
+			temporalAA.resolve(drawCmdBuffers[i]);
+
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+
+			scissor = vks::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+
+			temporalAA.present(drawCmdBuffers[i]);
+
 			drawUI(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
@@ -493,8 +609,9 @@ public:
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 9),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
@@ -515,6 +632,14 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
 			// Binding 4 : Fragment shader uniform buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+			// Binding 5 : Light cluster mapping
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),
+			// Binding 6 : Lights
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 6),
+			// Binding 7 : Light cluster grid
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 7),
+			// Binding 8 : Light cluster index lists
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 8),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
@@ -530,38 +655,15 @@ public:
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 
-		// Image descriptors for the offscreen color attachments
-		VkDescriptorImageInfo texDescriptorPosition =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.position.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorNormal =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.normal.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorAlbedo =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.albedo.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
 		// Deferred composition
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 		writeDescriptorSets = {
-			// Binding 1 : Position texture target
-			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptorPosition),
-			// Binding 2 : Normals texture target
-			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorNormal),
-			// Binding 3 : Albedo texture target
-			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &texDescriptorAlbedo),
 			// Binding 4 : Fragment shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.composition.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		updateGBufferDescriptors();
+		updateLightClusterDescriptors();
 
 		// Offscreen (scene)
 
@@ -590,6 +692,57 @@ public:
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
+	// Image descriptors for the offscreen attachments, updated separately as the G-buffer is recreated when switching layouts
+	void updateGBufferDescriptors()
+	{
+		// The compact layout has no position attachment, binding 1 samples depth instead
+		VkDescriptorImageInfo texDescriptorPosition =
+			vks::initializers::descriptorImageInfo(
+				colorSampler,
+				compactGBuffer ? offScreenFrameBuf.depthSampleView : offScreenFrameBuf.position.view,
+				compactGBuffer ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		VkDescriptorImageInfo texDescriptorNormal =
+			vks::initializers::descriptorImageInfo(
+				colorSampler,
+				offScreenFrameBuf.normal.view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		VkDescriptorImageInfo texDescriptorAlbedo =
+			vks::initializers::descriptorImageInfo(
+				colorSampler,
+				offScreenFrameBuf.albedo.view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			// Binding 1 : Position (or depth) texture target
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptorPosition),
+			// Binding 2 : Normals texture target
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorNormal),
+			// Binding 3 : Albedo texture target
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &texDescriptorAlbedo),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		temporalAA.setVelocityView(offScreenFrameBuf.velocity.view);
+	}
+
+	// The cluster grid is recreated on resize, so these are updated separately
+	void updateLightClusterDescriptors()
+	{
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			// Binding 5 : Light cluster mapping
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5, lightClusters.getParamsDescriptor()),
+			// Binding 6 : Lights
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, lightClusters.getLightsDescriptor()),
+			// Binding 7 : Light cluster grid
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, lightClusters.getGridDescriptor()),
+			// Binding 8 : Light cluster index lists
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8, lightClusters.getIndicesDescriptor()),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
 	void preparePipelines()
 	{
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
@@ -614,14 +767,29 @@ public:
 		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
 		pipelineCI.pStages = shaderStages.data();
 
-		// Final fullscreen composition pass pipeline
+		// Final fullscreen composition pass pipeline, renders to the temporal anti-aliasing input
+		pipelineCI.renderPass = temporalAA.getRenderPass();
 		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
 		shaderStages[0] = loadShader(getShadersPath() + "deferred/deferred.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "deferred/deferred.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 		// Empty vertex input state, vertices are generated by the vertex shader
 		VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 		pipelineCI.pVertexInputState = &emptyInputState;
+		// Specialization constants select between clustered and brute force light loops and the G-buffer layout
+		struct SpecializationData {
+			VkBool32 clustered = VK_TRUE;
+			VkBool32 compactGBuffer;
+		} specializationData;
+		specializationData.compactGBuffer = compactGBuffer;
+		std::array<VkSpecializationMapEntry, 2> specializationMapEntries = {
+			vks::initializers::specializationMapEntry(0, offsetof(SpecializationData, clustered), sizeof(VkBool32)),
+			vks::initializers::specializationMapEntry(1, offsetof(SpecializationData, compactGBuffer), sizeof(VkBool32)),
+		};
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(specializationMapEntries.size()), specializationMapEntries.data(), sizeof(SpecializationData), &specializationData);
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.composition));
+		specializationData.clustered = VK_FALSE;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.compositionBruteForce));
 
 		// Vertex input state from glTF model for pipeline rendering models
 		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Tangent});
@@ -630,6 +798,10 @@ public:
 		// Offscreen pipeline
 		shaderStages[0] = loadShader(getShadersPath() + "deferred/mrt.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "deferred/mrt.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VkBool32 compact = compactGBuffer;
+		VkSpecializationMapEntry compactMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+		VkSpecializationInfo compactSpecializationInfo = vks::initializers::specializationInfo(1, &compactMapEntry, sizeof(VkBool32), &compact);
+		shaderStages[1].pSpecializationInfo = &compactSpecializationInfo;
 
 		// Separate render pass
 		pipelineCI.renderPass = offScreenFrameBuf.renderPass;
@@ -637,7 +809,8 @@ public:
 		// Blend attachment states required for all color attachments
 		// This is important, as color write mask will otherwise be 0x0 and you
 		// won't see anything rendered to the attachment
-		std::array<VkPipelineColorBlendAttachmentState, 3> blendAttachmentStates = {
+		std::array<VkPipelineColorBlendAttachmentState, 4> blendAttachmentStates = {
+			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
 			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
 			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
 			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE)
@@ -678,59 +851,125 @@ public:
 		// Update
 		updateUniformBufferOffscreen();
 		updateUniformBufferComposition();
+		previousViewProjection = uboOffscreenVS.currentViewProjection;
+		uboOffscreenVS.previousViewProjection = previousViewProjection;
 	}
 
-	// Update matrices used for the offscreen rendering of the scene
-	void updateUniformBufferOffscreen()
+	void prepareTemporalAA()
 	{
-		uboOffscreenVS.projection = camera.matrices.perspective;
-		uboOffscreenVS.view = camera.matrices.view;
-		uboOffscreenVS.model = glm::mat4(1.0f);
-		memcpy(uniformBuffers.offscreen.mapped, &uboOffscreenVS, sizeof(uboOffscreenVS));
+		temporalAA.resolveShader = loadShader(getShadersPath() + "base/temporalaa.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		temporalAA.presentShaders[0] = loadShader(getShadersPath() + "base/upscale.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+		temporalAA.presentShaders[1] = loadShader(getShadersPath() + "base/upscale.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		temporalAA.renderScale = renderScales[renderScaleIndex];
+		temporalAA.prepare(vulkanDevice, queue, pipelineCache, renderPass, width, height);
 	}
 
-	// Update lights and parameters passed to the composition shaders
-	void updateUniformBufferComposition()
+	void prepareLights()
+	{
+		lightClusters.clusterShader = loadShader(getShadersPath() + "base/lightcluster.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		const VkExtent2D renderExtent = temporalAA.getRenderExtent();
+		lightClusters.prepare(vulkanDevice, queue, pipelineCache, MAX_LIGHT_COUNT, renderExtent.width, renderExtent.height);
+
+		// Small fill lights scattered across the floor, y is flipped so negative values are above the floor
+		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
+		std::uniform_real_distribution<float> rndPosition(-12.0f, 12.0f);
+		std::uniform_real_distribution<float> rndHeight(-1.5f, -0.1f);
+		std::uniform_real_distribution<float> rndUnit(0.0f, 1.0f);
+		vks::LightClusters::Light* lights = lightClusters.getLights();
+		fillLights.resize(MAX_LIGHT_COUNT);
+		for (uint32_t i = SCENE_LIGHT_COUNT; i < MAX_LIGHT_COUNT; i++) {
+			fillLights[i].origin = glm::vec3(rndPosition(rndEngine), rndHeight(rndEngine), rndPosition(rndEngine));
+			fillLights[i].orbitRadius = 0.25f + rndUnit(rndEngine);
+			fillLights[i].phase = rndUnit(rndEngine) * 360.0f;
+			fillLights[i].speed = 0.5f + rndUnit(rndEngine);
+			const glm::vec3 color = glm::vec3(rndUnit(rndEngine), rndUnit(rndEngine), rndUnit(rndEngine));
+			lights[i].position.w = 0.75f + rndUnit(rndEngine) * 1.25f;
+			lights[i].color = glm::vec4(color / std::max(std::max(color.r, color.g), std::max(color.b, 0.1f)), 0.4f);
+		}
+		updateLights();
+		updateLightClusterView();
+	}
+
+	// Finite range at which the unwindowed radius / (dist^2 + 1) attenuation drops below 1%
+	float lightRange(float intensity)
+	{
+		return sqrt(intensity / 0.01f);
+	}
+
+	void updateLights()
 	{
+		vks::LightClusters::Light* lights = lightClusters.getLights();
 		// White
-		uboComposition.lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
-		uboComposition.lights[0].color = glm::vec3(1.5f);
-		uboComposition.lights[0].radius = 15.0f * 0.25f;
+		lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+		lights[0].color = glm::vec4(glm::vec3(1.5f), 15.0f * 0.25f);
 		// Red
-		uboComposition.lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
-		uboComposition.lights[1].color = glm::vec3(1.0f, 0.0f, 0.0f);
-		uboComposition.lights[1].radius = 15.0f;
+		lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
+		lights[1].color = glm::vec4(1.0f, 0.0f, 0.0f, 15.0f);
 		// Blue
-		uboComposition.lights[2].position = glm::vec4(2.0f, -1.0f, 0.0f, 0.0f);
-		uboComposition.lights[2].color = glm::vec3(0.0f, 0.0f, 2.5f);
-		uboComposition.lights[2].radius = 5.0f;
+		lights[2].position = glm::vec4(2.0f, -1.0f, 0.0f, 0.0f);
+		lights[2].color = glm::vec4(0.0f, 0.0f, 2.5f, 5.0f);
 		// Yellow
-		uboComposition.lights[3].position = glm::vec4(0.0f, -0.9f, 0.5f, 0.0f);
-		uboComposition.lights[3].color = glm::vec3(1.0f, 1.0f, 0.0f);
-		uboComposition.lights[3].radius = 2.0f;
+		lights[3].position = glm::vec4(0.0f, -0.9f, 0.5f, 0.0f);
+		lights[3].color = glm::vec4(1.0f, 1.0f, 0.0f, 2.0f);
 		// Green
-		uboComposition.lights[4].position = glm::vec4(0.0f, -0.5f, 0.0f, 0.0f);
-		uboComposition.lights[4].color = glm::vec3(0.0f, 1.0f, 0.2f);
-		uboComposition.lights[4].radius = 5.0f;
+		lights[4].position = glm::vec4(0.0f, -0.5f, 0.0f, 0.0f);
+		lights[4].color = glm::vec4(0.0f, 1.0f, 0.2f, 5.0f);
 		// Yellow
-		uboComposition.lights[5].position = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
-		uboComposition.lights[5].color = glm::vec3(1.0f, 0.7f, 0.3f);
-		uboComposition.lights[5].radius = 25.0f;
+		lights[5].position = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
+		lights[5].color = glm::vec4(1.0f, 0.7f, 0.3f, 25.0f);
 
-		uboComposition.lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
-		uboComposition.lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
+		lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
+		lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
 
-		uboComposition.lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
-		uboComposition.lights[1].position.z =  0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+		lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+		lights[1].position.z =  0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
 
-		uboComposition.lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
-		uboComposition.lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
+		lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
+		lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
 
-		uboComposition.lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
-		uboComposition.lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
+		lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
+		lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
 
-		uboComposition.lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
-		uboComposition.lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
+		lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
+		lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
+
+		for (uint32_t i = 0; i < SCENE_LIGHT_COUNT; i++) {
+			lights[i].position.w = lightRange(lights[i].color.w);
+		}
+
+		for (int32_t i = SCENE_LIGHT_COUNT; i < lightCount; i++) {
+			const FillLight& fillLight = fillLights[i];
+			const float angle = glm::radians(360.0f * timer * fillLight.speed + fillLight.phase);
+			lights[i].position.x = fillLight.origin.x + sin(angle) * fillLight.orbitRadius;
+			lights[i].position.y = fillLight.origin.y;
+			lights[i].position.z = fillLight.origin.z + cos(angle) * fillLight.orbitRadius;
+		}
+		lightClusters.setLightCount(lightCount);
+	}
+
+	void updateLightClusterView()
+	{
+		lightClusters.updateView(camera.matrices.perspective, camera.matrices.view, camera.getNearClip(), camera.getFarClip());
+	}
+
+	// Update matrices used for the offscreen rendering of the scene
+	void updateUniformBufferOffscreen()
+	{
+		uboOffscreenVS.projection = camera.getJitteredPerspective();
+		uboOffscreenVS.view = camera.matrices.view;
+		uboOffscreenVS.model = glm::mat4(1.0f);
+		uboOffscreenVS.currentViewProjection = camera.matrices.perspective * camera.matrices.view;
+		memcpy(uniformBuffers.offscreen.mapped, &uboOffscreenVS, sizeof(uboOffscreenVS));
+		if (prepared) {
+			updateLightClusterView();
+		}
+	}
+
+	// Update lights and parameters passed to the composition shaders
+	void updateUniformBufferComposition()
+	{
+		// Used to reconstruct world space positions from depth with the compact G-buffer, depth has been rendered with the jitter
+		uboComposition.inverseViewProjection = glm::inverse(camera.getJitteredPerspective() * camera.matrices.view);
 
 		// Current view position
 		uboComposition.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
@@ -740,6 +979,17 @@ public:
 		memcpy(uniformBuffers.composition.mapped, &uboComposition, sizeof(uboComposition));
 	}
 
+	// Advances the jitter and the previous frame's matrices, needs to be called exactly once before drawing a frame
+	void updateTemporalAA()
+	{
+		temporalAA.nextFrame();
+		camera.setJitter(temporalAA.getJitter());
+		uboOffscreenVS.previousViewProjection = previousViewProjection;
+		updateUniformBufferOffscreen();
+		updateUniformBufferComposition();
+		previousViewProjection = uboOffscreenVS.currentViewProjection;
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
@@ -785,14 +1035,26 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
+		prepareTemporalAA();
 		prepareOffscreenFramebuffer();
 		prepareUniformBuffers();
+		prepareLights();
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSet();
 		buildCommandBuffers();
 		buildDeferredCommandBuffer();
+		if (benchmark.active) {
+			// Analytic estimate of the G-buffer traffic of both layouts (attachment writes in the offscreen pass, texel fetches in the composition pass), not a measurement
+			const double writeScale = double(offScreenFrameBuf.width) * double(offScreenFrameBuf.height) / (1024.0 * 1024.0);
+			const double readScale = double(width) * double(height) / (1024.0 * 1024.0);
+			benchmark.addResult("gbuffer layout", compactGBuffer ? "compact" : "full");
+			benchmark.addResult("gbuffer full write MB/frame (estimated)", gBufferBytesPerPixel(false) * writeScale);
+			benchmark.addResult("gbuffer full read MB/frame (estimated)", gBufferBytesPerPixel(false) * readScale);
+			benchmark.addResult("gbuffer compact write MB/frame (estimated)", gBufferBytesPerPixel(true) * writeScale);
+			benchmark.addResult("gbuffer compact read MB/frame (estimated)", gBufferBytesPerPixel(true) * readScale);
+		}
 		prepared = true;
 	}
 
@@ -800,17 +1062,56 @@ public:
 	{
 		if (!prepared)
 			return;
+		updateTemporalAA();
 		draw();
 		if (!paused)
 		{
 			updateUniformBufferComposition();
+			updateLights();
+			updateLightClusterView();
 		}
 		if (camera.updated)
 		{
 			updateUniformBufferOffscreen();	
+			updateUniformBufferComposition();
 		}
 	}
 
+	// Switching the G-buffer layout recreates all offscreen attachments and the pipelines writing to or reading from them
+	void recreateGBuffer()
+	{
+		vkDeviceWaitIdle(device);
+		destroyOffscreenFramebuffer();
+		destroyPipelines();
+		prepareOffscreenFramebuffer();
+		preparePipelines();
+		updateGBufferDescriptors();
+		buildCommandBuffers();
+		buildDeferredCommandBuffer();
+	}
+
+	// Window size and render scale determine the size of the G-buffer, the temporal anti-aliasing targets and the cluster grid
+	void resizeRenderTargets()
+	{
+		vkDeviceWaitIdle(device);
+		temporalAA.renderScale = renderScales[renderScaleIndex];
+		temporalAA.resize(width, height);
+		const VkExtent2D renderExtent = temporalAA.getRenderExtent();
+		lightClusters.resize(renderExtent.width, renderExtent.height);
+		updateLightClusterDescriptors();
+		updateLightClusterView();
+		destroyOffscreenFramebuffer();
+		prepareOffscreenFramebuffer();
+		updateGBufferDescriptors();
+		buildCommandBuffers();
+		buildDeferredCommandBuffer();
+	}
+
+	virtual void windowResized()
+	{
+		resizeRenderTargets();
+	}
+
 	virtual void viewChanged()
 	{
 		updateUniformBufferOffscreen();
@@ -819,10 +1120,41 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
-			if (overlay->comboBox("Display", &debugDisplayTarget, {"Final composition", "Position", "Normals", "Albedo", "Specular" }))
+			if (overlay->comboBox("Display", &debugDisplayTarget, {"Final composition", "Position", "Normals", "Albedo", "Specular", "Lights per cluster" }))
 			{
 				updateUniformBufferComposition();
 			}
+			if (overlay->checkBox("Compact G-buffer", &compactGBuffer)) {
+				recreateGBuffer();
+			}
+			overlay->text("G-buffer: %d bytes per pixel", gBufferBytesPerPixel(compactGBuffer));
+		}
+		if (overlay->header("Temporal anti-aliasing")) {
+			if (overlay->checkBox("Enabled", &temporalAA.enabled)) {
+				temporalAA.reset();
+			}
+			if (overlay->comboBox("Render scale", &renderScaleIndex, { "100%", "75%", "67%", "50%" })) {
+				resizeRenderTargets();
+			}
+			const VkExtent2D renderExtent = temporalAA.getRenderExtent();
+			overlay->text("Render resolution: %d x %d", renderExtent.width, renderExtent.height);
+		}
+		if (overlay->header("Lights")) {
+			if (overlay->sliderInt("Light count", &lightCount, SCENE_LIGHT_COUNT, MAX_LIGHT_COUNT)) {
+				updateLights();
+				updateLightClusterView();
+			}
+			if (overlay->checkBox("Clustered shading", &clusteredShading)) {
+				buildCommandBuffers();
+			}
+			const glm::uvec3 gridSize = lightClusters.getGridSize();
+			overlay->text("Clusters: %d x %d x %d", gridSize.x, gridSize.y, gridSize.z);
+			if (overlay->button("Validate clusters")) {
+				clusterValidationResult = static_cast<int32_t>(lightClusters.validate());
+			}
+			if (clusterValidationResult >= 0) {
+				overlay->text(clusterValidationResult == 0 ? "Clusters match CPU reference" : "%d clusters differ from CPU reference", clusterValidationResult);
+			}
 		}
 	}
 };
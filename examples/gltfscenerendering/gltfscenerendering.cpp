@@ -34,9 +34,6 @@ VulkanglTFScene::~VulkanglTFScene()
 		vkDestroySampler(vulkanDevice->logicalDevice, image.texture.sampler, nullptr);
 		vkFreeMemory(vulkanDevice->logicalDevice, image.texture.deviceMemory, nullptr);
 	}
-	for (Material material : materials) {
-		vkDestroyPipeline(vulkanDevice->logicalDevice, material.pipeline, nullptr);
-	}
 }
 
 /*
@@ -85,6 +82,15 @@ void VulkanglTFScene::loadMaterials(tinygltf::Model& input)
 		materials[i].alphaMode = glTFMaterial.alphaMode;
 		materials[i].alphaCutOff = (float)glTFMaterial.alphaCutoff;
 		materials[i].doubleSided = glTFMaterial.doubleSided;
+		// POI: The material properties that require a different pipeline are stored as permutation feature bits
+		materials[i].permutation.features = 0;
+		if (materials[i].alphaMode == "MASK") {
+			materials[i].permutation.features |= vks::MaterialPermutations::AlphaMask;
+			materials[i].permutation.alphaCutoff = materials[i].alphaCutOff;
+		}
+		if (materials[i].doubleSided) {
+			materials[i].permutation.features |= vks::MaterialPermutations::DoubleSided;
+		}
 	}
 }
 
@@ -253,8 +259,8 @@ void VulkanglTFScene::drawNode(VkCommandBuffer commandBuffer, VkPipelineLayout p
 		// Pass the final matrix to the vertex shader using push constants
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &nodeMatrix);
 		for (VulkanglTFScene::Primitive& primitive : node->mesh.primitives) {
-			if (primitive.indexCount > 0) {
-				VulkanglTFScene::Material& material = materials[primitive.materialIndex];
+			VulkanglTFScene::Material& material = materials[primitive.materialIndex];
+			if ((primitive.indexCount > 0) && (material.pipeline != VK_NULL_HANDLE)) {
 				// POI: Bind the pipeline for the node's material
 				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
 				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &material.descriptorSet, 0, nullptr);
@@ -296,6 +302,8 @@ VulkanExample::VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 
 VulkanExample::~VulkanExample()
 {
+	// Material permutations may still be compiled in the background using the pipeline layout
+	pipelineManager.destroy();
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.matrices, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.textures, nullptr);
@@ -328,6 +336,11 @@ void VulkanExample::buildCommandBuffers()
 	const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
 	const VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 
+	// POI: Get the current pipeline of each material's permutation, the command buffers are rebuilt when a pipeline has changed
+	for (auto& material : glTFScene.materials) {
+		material.pipeline = materialPermutations.get(material.permutation);
+	}
+
 	for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 	{
 		renderPassBeginInfo.framebuffer = frameBuffers[i];
@@ -533,68 +546,38 @@ void VulkanExample::setupDescriptors()
 
 void VulkanExample::preparePipelines()
 {
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-	VkPipelineRasterizationStateCreateInfo rasterizationStateCI = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
-	VkPipelineColorBlendAttachmentState blendAttachmentStateCI = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
-	VkPipelineColorBlendStateCreateInfo colorBlendStateCI = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentStateCI);
-	VkPipelineDepthStencilStateCreateInfo depthStencilStateCI = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
-	VkPipelineViewportStateCreateInfo viewportStateCI = vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
-	VkPipelineMultisampleStateCreateInfo multisampleStateCI = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
-	const std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-	VkPipelineDynamicStateCreateInfo dynamicStateCI = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables.data(), static_cast<uint32_t>(dynamicStateEnables.size()), 0);
-	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
-
-	const std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
+	// Setup the pipeline state that's common for all materials
+	vks::PipelineManager::GraphicsPipelineDesc pipelineDesc{};
+	pipelineDesc.layout = pipelineLayout;
+	pipelineDesc.renderPass = renderPass;
+	pipelineDesc.vertexBindings = {
 		vks::initializers::vertexInputBindingDescription(0, sizeof(VulkanglTFScene::Vertex), VK_VERTEX_INPUT_RATE_VERTEX),
 	};
-	const std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
+	pipelineDesc.vertexAttributes = {
 		vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VulkanglTFScene::Vertex, pos)),
 		vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VulkanglTFScene::Vertex, normal)),
 		vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VulkanglTFScene::Vertex, uv)),
 		vks::initializers::vertexInputAttributeDescription(0, 3, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VulkanglTFScene::Vertex, color)),
 		vks::initializers::vertexInputAttributeDescription(0, 4, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VulkanglTFScene::Vertex, tangent)),
 	};
-	VkPipelineVertexInputStateCreateInfo vertexInputStateCI = vks::initializers::pipelineVertexInputStateCreateInfo(vertexInputBindings, vertexInputAttributes);
-
-	VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayout, renderPass, 0);
-	pipelineCI.pVertexInputState = &vertexInputStateCI;
-	pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
-	pipelineCI.pRasterizationState = &rasterizationStateCI;
-	pipelineCI.pColorBlendState = &colorBlendStateCI;
-	pipelineCI.pMultisampleState = &multisampleStateCI;
-	pipelineCI.pViewportState = &viewportStateCI;
-	pipelineCI.pDepthStencilState = &depthStencilStateCI;
-	pipelineCI.pDynamicState = &dynamicStateCI;
-	pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
-	pipelineCI.pStages = shaderStages.data();
-
-	shaderStages[0] = loadShader(getShadersPath() + "gltfscenerendering/scene.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-	shaderStages[1] = loadShader(getShadersPath() + "gltfscenerendering/scene.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-
-	// POI: Instead if using a few fixed pipelines, we create one pipeline for each material using the properties of that material
-	for (auto &material : glTFScene.materials) {
-
-		struct MaterialSpecializationData {
-			VkBool32 alphaMask;
-			float alphaMaskCutoff;
-		} materialSpecializationData;
-
-		materialSpecializationData.alphaMask = material.alphaMode == "MASK";
-		materialSpecializationData.alphaMaskCutoff = material.alphaCutOff;
-
-		// POI: Constant fragment shader material parameters will be set using specialization constants
-		std::vector<VkSpecializationMapEntry> specializationMapEntries = {
-			vks::initializers::specializationMapEntry(0, offsetof(MaterialSpecializationData, alphaMask), sizeof(MaterialSpecializationData::alphaMask)),
-			vks::initializers::specializationMapEntry(1, offsetof(MaterialSpecializationData, alphaMaskCutoff), sizeof(MaterialSpecializationData::alphaMaskCutoff)),
-		};
-		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(specializationMapEntries, sizeof(materialSpecializationData), &materialSpecializationData);
-		shaderStages[1].pSpecializationInfo = &specializationInfo;
+	pipelineDesc.vertexShader.module = loadShader(getShadersPath() + "gltfscenerendering/scene.vert.spv", VK_SHADER_STAGE_VERTEX_BIT).module;
+	pipelineDesc.fragmentShader.module = loadShader(getShadersPath() + "gltfscenerendering/scene.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT).module;
 
-		// For double sided materials, culling will be disabled
-		rasterizationStateCI.cullMode = material.doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+	// POI: Instead of creating one pipeline per material, we create one pipeline per distinct material permutation
+	// The alpha mask feature and its cutoff value are passed to the fragment shader using specialization constants, double sided materials disable culling
+	materialPermutations.prepare(&pipelineManager, pipelineDesc);
+	materialPermutations.addFeatureConstant(vks::MaterialPermutations::AlphaMask, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+	materialPermutations.setAlphaCutoffConstant(1);
 
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &material.pipeline));
+	// POI: Precompile the permutations used by the materials of the glTF file on the pipeline manager's worker threads
+	std::vector<vks::MaterialPermutations::Permutation> permutations;
+	for (auto& material : glTFScene.materials) {
+		permutations.push_back(material.permutation);
 	}
+	materialPermutations.precompile(permutations);
+	// Wait for the pipelines, so they're available for the first frame
+	pipelineManager.wait();
+	pipelineManager.update();
 }
 
 void VulkanExample::prepareUniformBuffers()
@@ -642,6 +625,10 @@ void VulkanExample::viewChanged()
 
 void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 {
+	if (overlay->header("Statistics")) {
+		overlay->text("Materials: %d", (int32_t)glTFScene.materials.size());
+		overlay->text("Pipelines: %d", (int32_t)materialPermutations.getPipelineCount());
+	}
 	if (overlay->header("Visibility")) {
 
 		if (overlay->button("All")) {
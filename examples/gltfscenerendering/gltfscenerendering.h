@@ -23,6 +23,7 @@
 #include "tiny_gltf.h"
 
 #include "vulkanexamplebase.h"
+#include "VulkanMaterialPermutations.h"
 
 #define ENABLE_VALIDATION false
 
@@ -97,7 +98,10 @@ public:
 		float alphaCutOff;
 		bool doubleSided = false;
 		VkDescriptorSet descriptorSet;
-		VkPipeline pipeline;
+		// Features of the material that select its pipeline permutation
+		vks::MaterialPermutations::Permutation permutation;
+		// Owned by the pipeline manager, VK_NULL_HANDLE while the permutation is being compiled
+		VkPipeline pipeline = VK_NULL_HANDLE;
 	};
 
 	// Contains the texture for a single glTF image
@@ -147,6 +151,9 @@ public:
 		} values;
 	} shaderData;
 
+	// Materials with the same relevant features share a pipeline
+	vks::MaterialPermutations materialPermutations;
+
 	VkPipelineLayout pipelineLayout;
 	VkDescriptorSet descriptorSet;
 
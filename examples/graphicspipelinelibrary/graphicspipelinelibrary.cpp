@@ -8,8 +8,6 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
-#include <thread>
-#include <mutex>
 
 #define ENABLE_VALIDATION false
 
@@ -17,6 +15,7 @@ class VulkanExample: public VulkanExampleBase
 {
 public:
 	bool linkTimeOptimization = true;
+	bool wireframe = false;
 
 	vkglTF::Model scene;
 
@@ -33,24 +32,10 @@ public:
 
 	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures{};
 
-	struct PipelineLibrary {
-		VkPipeline vertexInputInterface;
-		VkPipeline preRasterizationShaders;
-		VkPipeline fragmentOutputInterface;
-		std::vector<VkPipeline> fragmentShaders;
-	} pipelineLibrary;
-
-	std::vector<VkPipeline> pipelines{};
-
-	struct ShaderInfo {
-		uint32_t* code;
-		size_t size;
-	};
-
-	std::mutex mutex;
-	VkPipelineCache threadPipelineCache{ VK_NULL_HANDLE };
-
-	bool  newPipelineCreated = false;
+	// Pipelines are compiled by the base class' pipeline manager, which creates and shares the library parts
+	std::vector<vks::PipelineManager::Pipeline> pipelines{};
+	// Lighting model selected by specialization constant for each of the pipelines
+	std::vector<uint32_t> lightingModels{};
 
 	uint32_t splitX{ 2 };
 	uint32_t splitY{ 2 };
@@ -66,36 +51,38 @@ public:
 		camera.setRotation(glm::vec3(-25.0f, 15.0f, 0.0f));
 		camera.setRotationSpeed(0.5f);
 
-		// Enable required extensions
+		// Required by VK_EXT_graphics_pipeline_library
 		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
-		enabledDeviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
-		enabledDeviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
-
-		// Enable required extension features
-		graphicsPipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
-		graphicsPipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
-		deviceCreatepNextChain = &graphicsPipelineLibraryFeatures;
+		srand((unsigned int)time(NULL));
 	}
 
 	~VulkanExample()
 	{
 		if (device) {
-			for (auto pipeline : pipelines) {
-				vkDestroyPipeline(device, pipeline, nullptr);
-			}
-			for (auto pipeline : pipelineLibrary.fragmentShaders) {
-				vkDestroyPipeline(device, pipeline, nullptr);
-			}
-			vkDestroyPipeline(device, pipelineLibrary.fragmentOutputInterface, nullptr);
-			vkDestroyPipeline(device, pipelineLibrary.preRasterizationShaders, nullptr);
-			vkDestroyPipeline(device, pipelineLibrary.vertexInputInterface, nullptr);
-			vkDestroyPipelineCache(device, threadPipelineCache, nullptr);
+			// Background compiles use the pipeline layout and render pass, so the workers need to be joined before these are destroyed
+			pipelineManager.destroy();
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 			uniformBuffer.destroy();
 		}
 	}
 
+	virtual void getEnabledFeatures()
+	{
+		// Fill mode non solid is required for wireframe display
+		if (deviceFeatures.fillModeNonSolid) {
+			enabledFeatures.fillModeNonSolid = VK_TRUE;
+		}
+	}
+
+	virtual void getEnabledExtensions()
+	{
+		// Enable the required extensions and extension features, the pipeline manager compiles complete pipelines if they're not supported
+		if (!vks::PipelineManager::enableGraphicsPipelineLibrary(physicalDevice, enabledDeviceExtensions, graphicsPipelineLibraryFeatures, deviceCreatepNextChain)) {
+			std::cout << "VK_EXT_graphics_pipeline_library is not supported, pipelines are compiled without pipeline libraries\n";
+		}
+	}
+
 	void buildCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
@@ -146,8 +133,10 @@ public:
 					scissor.offset.y = (uint32_t)h * y;
 					vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-					if (pipelines.size() > idx) {
-						vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[idx]);
+					// Pipelines that are still being compiled are skipped, the command buffers are rebuilt once they're available
+					VkPipeline pipeline = (idx < pipelines.size()) ? pipelineManager.get(pipelines[idx]) : VK_NULL_HANDLE;
+					if (pipeline != VK_NULL_HANDLE) {
+						vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 						scene.draw(drawCmdBuffers[i]);
 					}
 
@@ -201,247 +190,48 @@ public:
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
 	}
 
-	// With VK_EXT_graphics_pipeline_library we don't need to create the shader module when loading it, but instead have the driver create it at linking time
-	// So we use a custom function that only loads the required shader information without actually creating the shader module
-	bool loadShaderFile(std::string fileName, ShaderInfo &shaderInfo)
+	// Describes a pipeline variant, the vertex input, pre-rasterization and fragment output parts are shared by all variants
+	// Only the fragment shader part differs by the lighting model, switching to wireframe only changes the pre-rasterization part
+	vks::PipelineManager::GraphicsPipelineDesc pipelineDesc(uint32_t lightingModel)
 	{
-#if defined(__ANDROID__)
-		// Load shader from compressed asset
-		// @todo
-		AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, fileName, AASSET_MODE_STREAMING);
-		assert(asset);
-		size_t size = AAsset_getLength(asset);
-		assert(size > 0);
-
-		shaderInfo.size = size;
-		shaderInfo.code = new uint32_t[size / 4];
-		AAsset_read(asset, shaderCode, size);
-		AAsset_close(asset);
-#else
-		std::ifstream is(fileName, std::ios::binary | std::ios::in | std::ios::ate);
-
-		if (is.is_open())
-		{
-			shaderInfo.size = is.tellg();
-			is.seekg(0, std::ios::beg);
-			shaderInfo.code = new uint32_t[shaderInfo.size];
-			is.read(reinterpret_cast<char*>(shaderInfo.code), shaderInfo.size);
-			is.close();
-			return true;
-		} else {
-			std::cerr << "Error: Could not open shader file \"" << fileName << "\"" << "\n";
-			throw std::runtime_error("Could open shader file");
-			return false;
-		}
-#endif
-	}
-
-	// Create the shared pipeline parts up-front
-	void preparePipelineLibrary()
-	{
-		// Create a pipeline library for the vertex input interface
-		{
-			VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
-			libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
-			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
-
-			VkPipelineVertexInputStateCreateInfo vertexInputState = *vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color });
-			VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-
-			VkGraphicsPipelineCreateInfo pipelineLibraryCI{};
-			pipelineLibraryCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineLibraryCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
-			pipelineLibraryCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineLibraryCI.pNext = &libraryInfo;
-			pipelineLibraryCI.pInputAssemblyState = &inputAssemblyState;
-			pipelineLibraryCI.pVertexInputState = &vertexInputState;
-			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineLibraryCI, nullptr, &pipelineLibrary.vertexInputInterface));
-		}
-
-		// Creata a pipeline library for the vertex shader stage
-		{
-			VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
-			libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
-			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
-
-			VkDynamicState vertexDynamicStates[2] = {
-				VK_DYNAMIC_STATE_VIEWPORT,
-				VK_DYNAMIC_STATE_SCISSOR };
-
-			VkPipelineDynamicStateCreateInfo dynamicInfo{};
-			dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-			dynamicInfo.dynamicStateCount = 2;
-			dynamicInfo.pDynamicStates = vertexDynamicStates;
-
-			VkPipelineViewportStateCreateInfo viewportState = {};
-			viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-			viewportState.viewportCount = 1;
-			viewportState.scissorCount = 1;
-
-			VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
-
-			// @todo: we can skip the pipeline shader module info and directly consume the shader module
-			ShaderInfo shaderInfo{};
-			loadShaderFile(getShadersPath() + "graphicspipelinelibrary/shared.vert.spv", shaderInfo);
-
-			VkShaderModuleCreateInfo shaderModuleCI{};
-			shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			shaderModuleCI.codeSize = shaderInfo.size;
-			shaderModuleCI.pCode = shaderInfo.code;
-
-			VkPipelineShaderStageCreateInfo shaderStageCI{};
-			shaderStageCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-			shaderStageCI.pNext = &shaderModuleCI;
-			shaderStageCI.stage = VK_SHADER_STAGE_VERTEX_BIT;
-			shaderStageCI.pName = "main";
-
-			VkGraphicsPipelineCreateInfo pipelineLibraryCI{};
-			pipelineLibraryCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineLibraryCI.pNext = &libraryInfo;
-			pipelineLibraryCI.renderPass = renderPass;
-			pipelineLibraryCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
-			pipelineLibraryCI.stageCount = 1;
-			pipelineLibraryCI.pStages = &shaderStageCI;
-			pipelineLibraryCI.layout = pipelineLayout;
-			pipelineLibraryCI.pDynamicState = &dynamicInfo;
-			pipelineLibraryCI.pViewportState = &viewportState;
-			pipelineLibraryCI.pRasterizationState = &rasterizationState;
-			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineLibraryCI, nullptr, &pipelineLibrary.preRasterizationShaders));
-		}
-
-		// Create a pipeline library for the fragment output interface
-		{
-			VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
-			libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
-			libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
-
-			VkPipelineColorBlendAttachmentState  blendAttachmentSstate = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
-			VkPipelineColorBlendStateCreateInfo  colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentSstate);
-			VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
-
-			VkGraphicsPipelineCreateInfo pipelineLibraryCI{};
-			pipelineLibraryCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineLibraryCI.pNext = &libraryInfo;
-			pipelineLibraryCI.layout = pipelineLayout;
-			pipelineLibraryCI.renderPass = renderPass;
-			pipelineLibraryCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
-			pipelineLibraryCI.pColorBlendState = &colorBlendState;
-			pipelineLibraryCI.pMultisampleState = &multisampleState;
-			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineLibraryCI, nullptr, &pipelineLibrary.fragmentOutputInterface));
-		}
+		const VkPipelineVertexInputStateCreateInfo* vertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color });
+
+		vks::PipelineManager::GraphicsPipelineDesc desc{};
+		desc.layout = pipelineLayout;
+		desc.renderPass = renderPass;
+		desc.vertexBindings.assign(vertexInputState->pVertexBindingDescriptions, vertexInputState->pVertexBindingDescriptions + vertexInputState->vertexBindingDescriptionCount);
+		desc.vertexAttributes.assign(vertexInputState->pVertexAttributeDescriptions, vertexInputState->pVertexAttributeDescriptions + vertexInputState->vertexAttributeDescriptionCount);
+		desc.vertexShader.module = loadShader(getShadersPath() + "graphicspipelinelibrary/shared.vert.spv", VK_SHADER_STAGE_VERTEX_BIT).module;
+		desc.polygonMode = wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+		desc.fragmentShader.module = loadShader(getShadersPath() + "graphicspipelinelibrary/uber.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT).module;
+		// Select lighting model using a specialization constant
+		desc.fragmentShader.specializationMapEntries = { vks::initializers::specializationMapEntry(0, 0, sizeof(uint32_t)) };
+		desc.fragmentShader.specializationData.resize(sizeof(uint32_t));
+		memcpy(desc.fragmentShader.specializationData.data(), &lightingModel, sizeof(uint32_t));
+		return desc;
 	}
 
-	void threadFn()
+	// Adds a pipeline with a random lighting model, it's compiled in the background and shows up once it has been fast-linked
+	void addPipeline()
 	{
-		const std::lock_guard<std::mutex> lock(mutex);
-
-		auto start = std::chrono::steady_clock::now();
-
-		prepareNewPipeline();
-		newPipelineCreated = true;
+		const uint32_t lightingModel = (uint32_t)(rand() % 4);
+		lightingModels.push_back(lightingModel);
+		pipelines.push_back(pipelineManager.request(pipelineDesc(lightingModel)));
 
 		// Change viewport/draw count
 		if (pipelines.size() > splitX * splitY) {
 			splitX++;
 			splitY++;
 		}
-
-		auto delta = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
-		std::cout << "Pipeline created in " << delta.count() << " microseconds\n";
 	}
 
-	// Create a new pipeline using the pipeline library and a customized fragment shader
-	// Used from a thread
-	void prepareNewPipeline()
+	// Requests the variants of all pipelines for the current settings, variants requested before are available right away
+	void requestPipelines()
 	{
-		// Create the fragment shader part of the pipeline library with some random options
-		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
-		libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
-		libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
-
-		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
-		VkPipelineMultisampleStateCreateInfo  multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
-
-		// Using the pipeline library extension, we can skip the pipeline shader module creation and directly pass the shader code to the pipeline
-		ShaderInfo shaderInfo{};
-		loadShaderFile(getShadersPath() + "graphicspipelinelibrary/uber.frag.spv", shaderInfo);
-
-		VkShaderModuleCreateInfo shaderModuleCI{};
-		shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		shaderModuleCI.codeSize = shaderInfo.size;
-		shaderModuleCI.pCode = shaderInfo.code;
-
-		VkPipelineShaderStageCreateInfo shaderStageCI{};
-		shaderStageCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStageCI.pNext = &shaderModuleCI;
-		shaderStageCI.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		shaderStageCI.pName = "main";
-
-		// Select lighting model using a specialization constant
-		srand((unsigned int)time(NULL));
-		uint32_t lighting_model = (int)(rand() % 4);
-
-		// Each shader constant of a shader stage corresponds to one map entry
-		VkSpecializationMapEntry specializationMapEntry{};
-		specializationMapEntry.constantID = 0;
-		specializationMapEntry.size = sizeof(uint32_t);
-
-		VkSpecializationInfo specializationInfo{};
-		specializationInfo.mapEntryCount = 1;
-		specializationInfo.pMapEntries = &specializationMapEntry;
-		specializationInfo.dataSize = sizeof(uint32_t);
-		specializationInfo.pData = &lighting_model;
-
-		shaderStageCI.pSpecializationInfo = &specializationInfo;
-
-		VkGraphicsPipelineCreateInfo pipelineCI{};
-		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineCI.pNext = &libraryInfo;
-		pipelineCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
-		pipelineCI.stageCount = 1;
-		pipelineCI.pStages = &shaderStageCI;
-		pipelineCI.layout = pipelineLayout;
-		pipelineCI.renderPass = renderPass;
-		pipelineCI.pDepthStencilState = &depthStencilState;
-		pipelineCI.pMultisampleState = &multisampleState;
-		VkPipeline fragmentShader = VK_NULL_HANDLE;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, threadPipelineCache, 1, &pipelineCI, nullptr, &fragmentShader));
-
-		// Create the pipeline using the pre-built pipeline library parts
-		// Except for above fragment shader part all parts have been pre-built and will be re-used
-		std::vector<VkPipeline> libraries = {
-			pipelineLibrary.vertexInputInterface,
-			pipelineLibrary.preRasterizationShaders,
-			fragmentShader,
-			pipelineLibrary.fragmentOutputInterface };
-
-		// Link the library parts into a graphics pipeline
-		VkPipelineLibraryCreateInfoKHR pipelineLibraryCI{};
-		pipelineLibraryCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
-		pipelineLibraryCI.libraryCount = static_cast<uint32_t>(libraries.size());
-		pipelineLibraryCI.pLibraries = libraries.data();
-
-		// If set to true, we pass VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT which will let the implementation do additional optimizations at link time
-		// This trades in pipeline creation time for run-time performance
-		bool optimized = true;
-
-		VkGraphicsPipelineCreateInfo executablePipelineCI{};
-		executablePipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		executablePipelineCI.pNext = &pipelineLibraryCI;
-		executablePipelineCI.layout = pipelineLayout;
-		if (linkTimeOptimization)
-		{
-			// If link time optimization is activated in the UI, we set the VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT flag which will let the implementation do additional optimizations at link time
-			// This trades in pipeline creation time for run-time performance
-			executablePipelineCI.flags = VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+		pipelines.clear();
+		for (uint32_t lightingModel : lightingModels) {
+			pipelines.push_back(pipelineManager.request(pipelineDesc(lightingModel)));
 		}
-
-		VkPipeline executable = VK_NULL_HANDLE;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, threadPipelineCache, 1, &executablePipelineCI, nullptr, &executable));
-
-		pipelines.push_back(executable);
-		// Push fragment shader to list for deletion in the sample's destructor
-		pipelineLibrary.fragmentShaders.push_back(fragmentShader);
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -488,20 +278,13 @@ public:
 		loadAssets();
 		prepareUniformBuffers();
 		setupDescriptorSetLayout();
-		preparePipelineLibrary();
 		setupDescriptorPool();
 		setupDescriptorSet();
+		// The first pipeline is compiled in the background too, wait for it so it's available for the first frame (and benchmark runs)
+		addPipeline();
+		pipelineManager.wait();
+		pipelineManager.update();
 		buildCommandBuffers();
-
-		// Create a separate pipeline cache for the pipeline creation thread
-		VkPipelineCacheCreateInfo pipelineCachCI = {};
-		pipelineCachCI.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-		vkCreatePipelineCache(device, &pipelineCachCI, nullptr, &threadPipelineCache);
-
-		// Create first pipeline using a background thread
-		std::thread pipelineGenerationThread(&VulkanExample::threadFn, this);
-		pipelineGenerationThread.detach();
-
 		prepared = true;
 	}
 
@@ -509,23 +292,30 @@ public:
 	{
 		if (!prepared)
 			return;
-		if (newPipelineCreated)
-		{
-			newPipelineCreated = false;
-			vkQueueWaitIdle(queue);
-			buildCommandBuffers();
-		}
 		draw();
 		updateUniformBuffers();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
-		overlay->checkBox("Link time optimization", &linkTimeOptimization);
+		if (overlay->checkBox("Link time optimization", &linkTimeOptimization)) {
+			// Applies to pipelines requested afterwards
+			pipelineManager.setLinkTimeOptimization(linkTimeOptimization);
+		}
+		if (deviceFeatures.fillModeNonSolid) {
+			if (overlay->checkBox("Wireframe", &wireframe)) {
+				requestPipelines();
+			}
+		}
 		if (overlay->button("New pipeline")) {
-			// Spwan a thread to create a new pipeline in the background
-			std::thread pipelineGenerationThread(&VulkanExample::threadFn, this);
-			pipelineGenerationThread.detach();
+			addPipeline();
+		}
+		if (overlay->header("Statistics")) {
+			const vks::PipelineManager::Statistics statistics = pipelineManager.getStatistics();
+			overlay->text("Pipeline libraries: %s", pipelineManager.usesLibraries() ? "yes" : "no");
+			overlay->text("Library parts: %d (%d reused)", statistics.libraries, statistics.reusedLibraries);
+			overlay->text("Fast-linked: %d (%.2f ms)", statistics.fastLinkedPipelines, statistics.fastLinkedPipelines > 0 ? statistics.fastLinkTime / statistics.fastLinkedPipelines : 0.0);
+			overlay->text("Optimized: %d (%.2f ms)", statistics.optimizedPipelines, statistics.optimizedPipelines > 0 ? statistics.optimizedTime / statistics.optimizedPipelines : 0.0);
 		}
 	}
 };
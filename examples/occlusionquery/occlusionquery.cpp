@@ -1,20 +1,33 @@
 /*
-* Vulkan Example - Using occlusion query for visibility testing
+* Vulkan Example - GPU occlusion culling with a hierarchical depth buffer
 *
-* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+* Objects that were visible in the last frame are drawn first, the resulting depth buffer is reduced into a depth pyramid
+* that all objects are then tested against in a compute shader. Objects that became visible are drawn in a second pass.
+* All draws are issued via indirect draw commands written by the GPU, so unlike occlusion queries no results need to be read back.
+*
+* Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanGeometryPool.h"
+#include "VulkanOcclusionCulling.h"
 
-#define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
 
+// Number of objects per axis on each side of the occluder
+#define OBJECT_GRID_SIZE 8
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
+	// Teapot and sphere share the pool's buffers, so all objects can be drawn with a single indirect draw
+	// Declared before the models as these return their allocations on destruction
+	vks::GeometryPool geometryPool;
+	// Pool generation the command buffers have been recorded with, repacking the pool moves the geometry to new buffers
+	uint32_t recordedGeometryGeneration = 0;
 
 	struct {
 		vkglTF::Model teapot;
@@ -22,11 +35,10 @@ public:
 		vkglTF::Model sphere;
 	} models;
 
-	struct {
-		vks::Buffer occluder;
-		vks::Buffer teapot;
-		vks::Buffer sphere;
-	} uniformBuffers;
+	vks::OcclusionCuller occlusionCuller;
+	vks::OcclusionCuller::Statistics cullingStatistics;
+
+	vks::Buffer uniformBuffer;
 
 	struct UBOVS {
 		glm::mat4 projection;
@@ -34,39 +46,38 @@ public:
 		glm::mat4 model;
 		glm::vec4 color = glm::vec4(0.0f);
 		glm::vec4 lightPos = glm::vec4(10.0f, -10.0f, 10.0f, 1.0f);
-		float visible;
 	} uboVS;
 
+	// Per-object data, indexed by the first instance of each indirect draw
+	struct InstanceData {
+		glm::mat4 model;
+		glm::vec4 color;
+	};
+	std::vector<InstanceData> instances;
+	vks::Buffer instanceBuffer;
+
 	struct {
 		VkPipeline solid;
 		VkPipeline occluder;
-		// Pipeline with basic shaders used for occlusion pass
-		VkPipeline simple;
 	} pipelines;
 
-	struct {
-		VkDescriptorSet teapot;
-		VkDescriptorSet sphere;
-	} descriptorSets;
-
 	VkPipelineLayout pipelineLayout;
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	// Pool that stores all occlusion queries
-	VkQueryPool queryPool;
-
-	// Passed query samples
-	uint64_t passedSamples[2] = { 1,1 };
+	// Same as the default render pass, but loads color and depth written by the early phase
+	VkRenderPass renderPassLoad = VK_NULL_HANDLE;
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
-		title = "Occlusion queries";
+		title = "Hierarchical depth occlusion culling";
 		camera.type = Camera::CameraType::lookat;
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -7.5f));
 		camera.setRotation(glm::vec3(0.0f, -123.75f, 0.0f));
 		camera.setRotationSpeed(0.5f);
 		camera.setPerspective(60.0f, (float)width / (float)height, 1.0f, 256.0f);
+		// The depth pyramid is built from the depth attachment
+		depthStencil.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
 	}
 
 	~VulkanExample()
@@ -75,148 +86,153 @@ public:
 		// Note : Inherited destructor cleans up resources stored in base class
 		vkDestroyPipeline(device, pipelines.solid, nullptr);
 		vkDestroyPipeline(device, pipelines.occluder, nullptr);
-		vkDestroyPipeline(device, pipelines.simple, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-		vkDestroyQueryPool(device, queryPool, nullptr);
+		vkDestroyRenderPass(device, renderPassLoad, nullptr);
 
-		uniformBuffers.occluder.destroy();
-		uniformBuffers.sphere.destroy();
-		uniformBuffers.teapot.destroy();
+		occlusionCuller.destroy();
+		uniformBuffer.destroy();
+		instanceBuffer.destroy();
 	}
 
-	// Create a query pool for storing the occlusion query result
-	void setupQueryPool()
+	virtual void getEnabledFeatures()
 	{
-		VkQueryPoolCreateInfo queryPoolInfo = {};
-		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-		queryPoolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
-		queryPoolInfo.queryCount = 2;
-		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, NULL, &queryPool));
+		// All objects are drawn with one indirect draw per phase if supported
+		if (deviceFeatures.multiDrawIndirect) {
+			enabledFeatures.multiDrawIndirect = VK_TRUE;
+		}
+	}
+
+	void setupRenderPass()
+	{
+		VulkanExampleBase::setupRenderPass();
+
+		std::array<VkAttachmentDescription, 2> attachments = {};
+		// Color attachment
+		attachments[0].format = swapChain.colorFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		// Depth attachment
+		attachments[1].format = depthFormat;
+		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpassDescription = {};
+		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpassDescription.colorAttachmentCount = 1;
+		subpassDescription.pColorAttachments = &colorReference;
+		subpassDescription.pDepthStencilAttachment = &depthReference;
+
+		// Depth pyramid generation and culling are synchronized with explicit barriers, these only cover the attachments
+		std::array<VkSubpassDependency, 2> dependencies;
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		dependencies[0].dependencyFlags = 0;
+
+		dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].dstSubpass = 0;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+		dependencies[1].dependencyFlags = 0;
+
+		VkRenderPassCreateInfo renderPassInfo = vks::initializers::renderPassCreateInfo();
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpassDescription;
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPassLoad));
 	}
 
-	// Retrieves the results of the occlusion queries submitted to the command buffer
-	void getQueryResults()
+	void setupDepthStencil()
 	{
-		// We use vkGetQueryResults to copy the results into a host visible buffer
-		vkGetQueryPoolResults(
-			device,
-			queryPool,
-			0,
-			2,
-			sizeof(passedSamples),
-			passedSamples,
-			sizeof(uint64_t),
-			// Store results a 64 bit values and wait until the results have been finished
-			// If you don't want to wait, you can use VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
-			// which also returns the state of the result (ready) in the result
-			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		VulkanExampleBase::setupDepthStencil();
+		// The pyramid depends on the depth attachment's size
+		if (occlusionCuller.isPrepared()) {
+			occlusionCuller.setDepthSource(depthStencil.image, depthFormat, width, height);
+		}
 	}
 
 	void buildCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		recordedGeometryGeneration = geometryPool.getGeneration();
 
 		VkClearValue clearValues[2];
 		clearValues[0].color = defaultClearColor;
 		clearValues[1].depthStencil = { 1.0f, 0 };
 
 		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		renderPassBeginInfo.renderPass = renderPass;
 		renderPassBeginInfo.renderArea.offset.x = 0;
 		renderPassBeginInfo.renderArea.offset.y = 0;
 		renderPassBeginInfo.renderArea.extent.width = width;
 		renderPassBeginInfo.renderArea.extent.height = height;
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValues;
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
-			// Set target frame buffer
 			renderPassBeginInfo.framebuffer = frameBuffers[i];
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			// Reset query pool
-			// Must be done outside of render pass
-			vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 2);
+			// Early phase: draw the occluder and everything that was visible last frame
+			occlusionCuller.cull(drawCmdBuffers[i], vks::OcclusionCuller::Phase::Early);
 
+			renderPassBeginInfo.renderPass = renderPass;
+			renderPassBeginInfo.clearValueCount = 2;
+			renderPassBeginInfo.pClearValues = clearValues;
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			VkViewport viewport = vks::initializers::viewport(
-				(float)width,
-				(float)height,
-				0.0f,
-				1.0f);
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-			VkRect2D scissor = vks::initializers::rect2D(
-				width,
-				height,
-				0,
-				0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 
-			glm::mat4 modelMatrix = glm::mat4(1.0f);
-
-			// Occlusion pass
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.simple);
-
-			// Occluder first
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.occluder);
 			models.plane.draw(drawCmdBuffers[i]);
 
-			// Teapot
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, VK_FLAGS_NONE);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.teapot, 0, NULL);
-			models.teapot.draw(drawCmdBuffers[i]);
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
-
-			// Sphere
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 1, VK_FLAGS_NONE);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sphere, 0, NULL);
-			models.sphere.draw(drawCmdBuffers[i]);
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 1);
-
-			// Visible pass
-			// Clear color and depth attachments
-			VkClearAttachment clearAttachments[2] = {};
-
-			clearAttachments[0].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			clearAttachments[0].clearValue.color = defaultClearColor;
-			clearAttachments[0].colorAttachment = 0;
-
-			clearAttachments[1].aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			clearAttachments[1].clearValue.depthStencil = { 1.0f, 0 };
-
-			VkClearRect clearRect = {};
-			clearRect.layerCount = 1;
-			clearRect.rect.offset = { 0, 0 };
-			clearRect.rect.extent = { width, height };
-
-			vkCmdClearAttachments(
-				drawCmdBuffers[i],
-				2,
-				clearAttachments,
-				1,
-				&clearRect);
-
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.solid);
+			geometryPool.bind(drawCmdBuffers[i]);
+			occlusionCuller.draw(drawCmdBuffers[i], vks::OcclusionCuller::Phase::Early);
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
-			// Teapot
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.teapot, 0, NULL);
-			models.teapot.draw(drawCmdBuffers[i]);
-
-			// Sphere
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sphere, 0, NULL);
-			models.sphere.draw(drawCmdBuffers[i]);
+			// Reduce the early phase depth and test all objects against it
+			occlusionCuller.buildDepthPyramid(drawCmdBuffers[i]);
+			occlusionCuller.cull(drawCmdBuffers[i], vks::OcclusionCuller::Phase::Late);
 
-			// Occluder
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.occluder);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-			models.plane.draw(drawCmdBuffers[i]);
+			// Late phase: draw objects that became visible
+			renderPassBeginInfo.renderPass = renderPassLoad;
+			renderPassBeginInfo.clearValueCount = 0;
+			renderPassBeginInfo.pClearValues = nullptr;
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.solid);
+			geometryPool.bind(drawCmdBuffers[i]);
+			occlusionCuller.draw(drawCmdBuffers[i], vks::OcclusionCuller::Phase::Late);
 
 			drawUI(drawCmdBuffers[i]);
 
@@ -231,37 +247,97 @@ public:
 		updateUniformBuffers();
 		VulkanExampleBase::prepareFrame();
 
+		if (geometryPool.getGeneration() != recordedGeometryGeneration) {
+			buildCommandBuffers();
+		}
+
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 
-		// Read query results for displaying in next frame
-		getQueryResults();
-
 		VulkanExampleBase::submitFrame();
+
+		// The frame has completed at this point, so this doesn't stall and buffers replaced by repacking are no longer in use
+		cullingStatistics = occlusionCuller.getStatistics();
+		geometryPool.releaseRetiredBuffers();
 	}
 
 	void loadAssets()
 	{
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 		models.plane.loadFromFile(getAssetPath() + "models/plane_z.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		// The pool grows as required
+		geometryPool.create(vulkanDevice, queue, sizeof(vkglTF::Vertex), 1 << 16, 1 << 18);
+		vkglTF::geometryPool = &geometryPool;
+		// Descriptor sets come from the growable pools of the base class, so these models could be unloaded and replaced at runtime
+		vkglTF::descriptorAllocator = &descriptorAllocator;
 		models.teapot.loadFromFile(getAssetPath() + "models/teapot.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.sphere.loadFromFile(getAssetPath() + "models/sphere.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		vkglTF::geometryPool = nullptr;
+		vkglTF::descriptorAllocator = nullptr;
+	}
+
+	// Generates a grid of teapots and spheres on both sides of the occluder and passes their draws and bounds to the culler
+	void prepareOcclusionCulling()
+	{
+		std::vector<vks::OcclusionCuller::Object> objects;
+		const float spacing = 0.75f;
+		const float scale = 0.3f;
+		for (int32_t side = 0; side < 2; side++) {
+			for (int32_t y = 0; y < OBJECT_GRID_SIZE; y++) {
+				for (int32_t x = 0; x < OBJECT_GRID_SIZE; x++) {
+					const bool teapot = ((x + y) % 2) == side;
+					vkglTF::Model& model = teapot ? models.teapot : models.sphere;
+					const glm::vec3 position = glm::vec3(
+						((float)x - (float)(OBJECT_GRID_SIZE - 1) * 0.5f) * spacing,
+						((float)y - (float)(OBJECT_GRID_SIZE - 1) * 0.5f) * spacing,
+						side == 0 ? -3.0f : 3.0f);
+
+					InstanceData instance;
+					instance.model = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(scale));
+					instance.color = teapot ? glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) : glm::vec4(0.0f, 1.0f, 0.0f, 1.0f);
+
+					std::vector<VkDrawIndexedIndirectCommand> drawCommands;
+					model.getDrawCommands(drawCommands);
+					for (const VkDrawIndexedIndirectCommand& drawCommand : drawCommands) {
+						vks::OcclusionCuller::Object object;
+						object.boundingSphere = glm::vec4(position + model.dimensions.center * scale, model.dimensions.radius * scale);
+						object.indexCount = drawCommand.indexCount;
+						object.firstIndex = drawCommand.firstIndex;
+						object.vertexOffset = drawCommand.vertexOffset;
+						object.firstInstance = static_cast<uint32_t>(instances.size());
+						objects.push_back(object);
+					}
+					instances.push_back(instance);
+				}
+			}
+		}
+
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&instanceBuffer,
+			instances.size() * sizeof(InstanceData),
+			instances.data()));
+
+		occlusionCuller.pyramidShader = loadShader(getShadersPath() + "base/depthpyramid.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		occlusionCuller.cullShader = loadShader(getShadersPath() + "base/occlusioncull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		occlusionCuller.prepare(vulkanDevice, queue, pipelineCache, objects, depthStencil.image, depthFormat, width, height);
 	}
 
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			// One uniform buffer block for each mesh
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				poolSizes.size(),
 				poolSizes.data(),
-				3);
+				1);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -274,7 +350,12 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				VK_SHADER_STAGE_VERTEX_BIT,
-				0)
+				0),
+			// Binding 1 : Vertex shader per-object data
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_VERTEX_BIT,
+				1)
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -300,7 +381,6 @@ public:
 				&descriptorSetLayout,
 				1);
 
-		// Occluder (plane)
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
@@ -310,22 +390,16 @@ public:
 				descriptorSet,
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				0,
-				&uniformBuffers.occluder.descriptor)
+				&uniformBuffer.descriptor),
+			// Binding 1 : Vertex shader per-object data
+			vks::initializers::writeDescriptorSet(
+				descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				1,
+				&instanceBuffer.descriptor)
 		};
 
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
-
-		// Teapot
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.teapot));
-		writeDescriptorSets[0].dstSet = descriptorSets.teapot;
-		writeDescriptorSets[0].pBufferInfo = &uniformBuffers.teapot.descriptor;
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
-
-		// Sphere
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.sphere));
-		writeDescriptorSets[0].dstSet = descriptorSets.sphere;
-		writeDescriptorSets[0].pBufferInfo = &uniformBuffers.sphere.descriptor;
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 	}
 
 	void preparePipelines()
@@ -353,56 +427,27 @@ public:
 		pipelineCI.pStages = shaderStages.data();
 		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color });;
 
-		// Solid rendering pipeline
+		// Solid rendering pipeline for the culled objects (compatible with both the clearing and the loading render pass)
 		shaderStages[0] = loadShader(getShadersPath() + "occlusionquery/mesh.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "occlusionquery/mesh.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.solid));
 
-		// Basic pipeline for coloring occluded objects
-		shaderStages[0] = loadShader(getShadersPath() + "occlusionquery/simple.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getShadersPath() + "occlusionquery/simple.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		rasterizationState.cullMode = VK_CULL_MODE_NONE;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.simple));
-
-		// Visual pipeline for the occluder
+		// Pipeline for the occluder
+		// The occluder is opaque, as it needs to write depth for the objects behind it to be culled
 		shaderStages[0] = loadShader(getShadersPath() + "occlusionquery/occluder.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "occlusionquery/occluder.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		// Enable blending
-		blendAttachmentState.blendEnable = VK_TRUE;
-		blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
-		blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_COLOR;
-		blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.occluder));
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
 	{
-		// Vertex shader uniform buffer block
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.occluder,
+			&uniformBuffer,
 			sizeof(uboVS)));
-
-		// Teapot
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.teapot,
-			sizeof(uboVS)));
-
-		// Sphere
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.sphere,
-			sizeof(uboVS)));
-
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.occluder.map());
-		VK_CHECK_RESULT(uniformBuffers.teapot.map());
-		VK_CHECK_RESULT(uniformBuffers.sphere.map());
+		VK_CHECK_RESULT(uniformBuffer.map());
 
 		updateUniformBuffers();
 	}
@@ -411,34 +456,19 @@ public:
 	{
 		uboVS.projection = camera.matrices.perspective;
 		uboVS.view = camera.matrices.view;
-
-		uint8_t *pData;
-		// Occluder
-		uboVS.visible = 1.0f;
+		// Model and color only apply to the occluder, objects take them from their instance data
 		uboVS.model = glm::scale(glm::mat4(1.0f), glm::vec3(6.0f));
-		uboVS.color = glm::vec4(0.0f, 0.0f, 1.0f, 0.5f);
-		memcpy(uniformBuffers.occluder.mapped, &uboVS, sizeof(uboVS));
-
-		// Teapot
-		// Toggle color depending on visibility
-		uboVS.visible = (passedSamples[0] > 0) ? 1.0f : 0.0f;
-		uboVS.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
-		uboVS.color = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
-		memcpy(uniformBuffers.teapot.mapped, &uboVS, sizeof(uboVS));
-
-		// Sphere
-		// Toggle color depending on visibility
-		uboVS.visible = (passedSamples[1] > 0) ? 1.0f : 0.0f;
-		uboVS.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 3.0f));
-		uboVS.color = glm::vec4(0.0f, 1.0f, 0.0f, 1.0f);
-		memcpy(uniformBuffers.sphere.mapped, &uboVS, sizeof(uboVS));
+		uboVS.color = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+		memcpy(uniformBuffer.mapped, &uboVS, sizeof(uboVS));
+
+		occlusionCuller.updateView(camera.matrices.perspective, camera.matrices.view, camera.getNearClip());
 	}
 
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		setupQueryPool();
+		prepareOcclusionCulling();
 		prepareUniformBuffers();
 		setupDescriptorSetLayout();
 		preparePipelines();
@@ -457,9 +487,18 @@ public:
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
-		if (overlay->header("Occlusion query results")) {
-			overlay->text("Teapot: %d samples passed", passedSamples[0]);
-			overlay->text("Sphere: %d samples passed", passedSamples[1]);
+		if (overlay->header("Settings")) {
+			if (overlay->checkBox("Occlusion culling", &occlusionCuller.occlusionCulling)) {
+				buildCommandBuffers();
+			}
+		}
+		if (overlay->header("Culling results")) {
+			overlay->text("Objects: %d", occlusionCuller.getObjectCount());
+			overlay->text("Drawn (early): %d", cullingStatistics.drawnEarly);
+			overlay->text("Drawn (late): %d", cullingStatistics.drawnLate);
+			overlay->text("Frustum culled: %d", cullingStatistics.frustumCulled);
+			overlay->text("Occlusion culled: %d", cullingStatistics.occlusionCulled);
+			overlay->text("Depth pyramid levels: %d", occlusionCuller.getPyramidLevelCount());
 		}
 	}
 
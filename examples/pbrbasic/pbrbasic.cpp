@@ -8,13 +8,17 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <random>
+
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanLightClusters.h"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
 #define GRID_DIM 7
 #define OBJ_DIM 0.05f
+#define MAX_POINT_LIGHT_COUNT 1024
 
 struct Material {
 	// Parameter block used as push constant block
@@ -58,8 +62,14 @@ public:
 		glm::vec4 lights[4];
 	} uboParams;
 
+	// Additional point lights binned into clusters, shaded in the forward pass for the fragment's cluster only
+	vks::LightClusters lightClusters;
+	bool clusteredLights = false;
+	int32_t pointLightCount = 256;
+
 	VkPipelineLayout pipelineLayout;
 	VkPipeline pipeline;
+	VkPipeline pipelineClustered;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSet descriptorSet;
 
@@ -107,12 +117,14 @@ public:
 	~VulkanExample()
 	{
 		vkDestroyPipeline(device, pipeline, nullptr);
+		vkDestroyPipeline(device, pipelineClustered, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
 		uniformBuffers.object.destroy();
 		uniformBuffers.params.destroy();
+		lightClusters.destroy();
 	}
 
 	void buildCommandBuffers()
@@ -139,6 +151,10 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (clusteredLights) {
+				lightClusters.bin(drawCmdBuffers[i]);
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -148,7 +164,7 @@ public:
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
 			// Objects
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, clusteredLights ? pipelineClustered : pipeline);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
 
 			Material mat = materials[materialIndex];
@@ -199,6 +215,11 @@ public:
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+			// Light clusters: mapping, lights, grid and index lists
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -225,6 +246,7 @@ public:
 		// Descriptor Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3),
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
@@ -245,6 +267,19 @@ public:
 			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &uniformBuffers.params.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		updateLightClusterDescriptors();
+	}
+
+	// The cluster grid is recreated on resize, so these are updated separately
+	void updateLightClusterDescriptors()
+	{
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, lightClusters.getParamsDescriptor()),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, lightClusters.getLightsDescriptor()),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, lightClusters.getGridDescriptor()),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, lightClusters.getIndicesDescriptor()),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 	}
 
 	void preparePipelines()
@@ -279,6 +314,13 @@ public:
 		depthStencilState.depthWriteEnable = VK_TRUE;
 		depthStencilState.depthTestEnable = VK_TRUE;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
+
+		// Same shader with the clustered point light loop enabled via specialization constant
+		VkBool32 clustered = VK_TRUE;
+		VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(VkBool32), &clustered);
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelineClustered));
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -306,6 +348,30 @@ public:
 		updateLights();
 	}
 
+	void preparePointLights()
+	{
+		lightClusters.clusterShader = loadShader(getShadersPath() + "base/lightcluster.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		lightClusters.prepare(vulkanDevice, queue, pipelineCache, MAX_POINT_LIGHT_COUNT, width, height);
+
+		// Small colored lights scattered in and around the object grid
+		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
+		std::uniform_real_distribution<float> rndPosition(-10.0f, 10.0f);
+		std::uniform_real_distribution<float> rndHeight(-2.0f, 2.0f);
+		std::uniform_real_distribution<float> rndUnit(0.0f, 1.0f);
+		vks::LightClusters::Light* lights = lightClusters.getLights();
+		for (uint32_t i = 0; i < MAX_POINT_LIGHT_COUNT; i++) {
+			lights[i].position = glm::vec4(rndPosition(rndEngine), rndHeight(rndEngine), rndPosition(rndEngine), 1.5f + rndUnit(rndEngine) * 1.5f);
+			lights[i].color = glm::vec4(rndUnit(rndEngine), rndUnit(rndEngine), rndUnit(rndEngine), 2.0f);
+		}
+		lightClusters.setLightCount(pointLightCount);
+		updateLightClusterView();
+	}
+
+	void updateLightClusterView()
+	{
+		lightClusters.updateView(camera.matrices.perspective, camera.matrices.view, camera.getNearClip(), camera.getFarClip());
+	}
+
 	void updateUniformBuffers()
 	{
 		// 3D object
@@ -351,6 +417,7 @@ public:
 		VulkanExampleBase::prepare();
 		loadAssets();
 		prepareUniformBuffers();
+		preparePointLights();
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorSets();
@@ -370,6 +437,15 @@ public:
 	virtual void viewChanged()
 	{
 		updateUniformBuffers();
+		updateLightClusterView();
+	}
+
+	virtual void windowResized()
+	{
+		lightClusters.resize(width, height);
+		updateLightClusterDescriptors();
+		updateLightClusterView();
+		buildCommandBuffers();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -383,6 +459,15 @@ public:
 				buildCommandBuffers();
 			}
 		}
+		if (overlay->header("Point lights")) {
+			if (overlay->checkBox("Clustered point lights", &clusteredLights)) {
+				buildCommandBuffers();
+			}
+			if (overlay->sliderInt("Count", &pointLightCount, 1, MAX_POINT_LIGHT_COUNT)) {
+				lightClusters.setLightCount(pointLightCount);
+				updateLightClusterView();
+			}
+		}
 	}
 };
 
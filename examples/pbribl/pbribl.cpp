@@ -12,6 +12,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanDynamicResolution.h"
 
 #define ENABLE_VALIDATION false
 #define GRID_DIM 7
@@ -91,6 +92,10 @@ public:
 	std::vector<std::string> materialNames;
 	std::vector<std::string> objectNames;
 
+	// The scene is rendered at a variable resolution that is upscaled to the swapchain, scaled to hit a target GPU frame time
+	vks::DynamicResolution dynamicResolution;
+	float renderScale = 1.0f;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "PBR with image based lighting";
@@ -139,6 +144,7 @@ public:
 		textures.irradianceCube.destroy();
 		textures.prefilteredCube.destroy();
 		textures.lutBrdf.destroy();
+		dynamicResolution.destroy();
 	}
 
 	virtual void getEnabledFeatures()
@@ -156,28 +162,24 @@ public:
 		clearValues[0].color = { { 0.1f, 0.1f, 0.1f, 1.0f } };
 		clearValues[1].depthStencil = { 1.0f, 0 };
 
-		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		renderPassBeginInfo.renderPass = renderPass;
-		renderPassBeginInfo.renderArea.offset.x = 0;
-		renderPassBeginInfo.renderArea.offset.y = 0;
-		renderPassBeginInfo.renderArea.extent.width = width;
-		renderPassBeginInfo.renderArea.extent.height = height;
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValues;
-
 		for (size_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
-
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			dynamicResolution.beginFrame(drawCmdBuffers[i], static_cast<uint32_t>(i));
 
-			VkViewport viewport = vks::initializers::viewport((float)width,	(float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+			/*
+				Scene rendering into the dynamic resolution target (render area and viewport at the current render scale)
+			*/
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.clearValueCount = 2;
+			renderPassBeginInfo.pClearValues = clearValues;
+			VkViewport viewport;
+			VkRect2D scissor;
+			dynamicResolution.getRenderPassBeginInfo(renderPassBeginInfo, viewport, scissor);
 
-			VkRect2D scissor = vks::initializers::rect2D(width,	height,	0, 0);
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
 			// Skybox
@@ -218,30 +220,61 @@ public:
 				}
 			}
 #endif
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
+
+			/*
+				Upscale to the swapchain and draw the UI at full resolution
+			*/
+			renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = renderPass;
+			renderPassBeginInfo.framebuffer = frameBuffers[i];
+			renderPassBeginInfo.renderArea.extent.width = width;
+			renderPassBeginInfo.renderArea.extent.height = height;
+			renderPassBeginInfo.clearValueCount = 2;
+			renderPassBeginInfo.pClearValues = clearValues;
+
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+			scissor = vks::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+
+			dynamicResolution.upscale(drawCmdBuffers[i]);
 			drawUI(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			dynamicResolution.endFrame(drawCmdBuffers[i], static_cast<uint32_t>(i));
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
 
-	void loadAssets()
+	// Adds a startup task for each asset, as they don't depend on each other
+	void addLoadAssetTasks(vks::TaskGraph::Task& skyboxTask, vks::TaskGraph::Task& environmentCubeTask)
 	{
-		uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::FlipY;
+		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::FlipY;
 		// Skybox
-		models.skybox.loadFromFile(getAssetPath() + "models/cube.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		skyboxTask = startupTasks.add("Load skybox", [this, glTFLoadingFlags] {
+			models.skybox.loadFromFile(getAssetPath() + "models/cube.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		});
 		// Objects
 		std::vector<std::string> filenames = { "sphere.gltf", "teapot.gltf", "torusknot.gltf", "venus.gltf" };
 		models.objects.resize(filenames.size());
 		for (size_t i = 0; i < filenames.size(); i++) {
-			models.objects[i].loadFromFile(getAssetPath() + "models/" + filenames[i], vulkanDevice, queue, glTFLoadingFlags);
+			startupTasks.add("Load " + filenames[i], [this, glTFLoadingFlags, i, filename = filenames[i]] {
+				models.objects[i].loadFromFile(getAssetPath() + "models/" + filename, vulkanDevice, queue, glTFLoadingFlags);
+			});
 		}
 		// HDR cubemap
-		textures.environmentCube.loadFromFile(getAssetPath() + "textures/hdr/pisa_cube.ktx", VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
+		environmentCubeTask = startupTasks.add("Load environment cube", [this] {
+			textures.environmentCube.loadFromFile(getAssetPath() + "textures/hdr/pisa_cube.ktx", VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
+		});
 	}
 
-	void setupDescriptors()
+	// The layout is all the pipelines need, so they can be created while the images the descriptors point at are still being generated
+	void setupDescriptorSetLayout()
 	{
 		// Descriptor Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
@@ -261,8 +294,10 @@ public:
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = 	vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
+	}
 
-		// Descriptor sets
+	void setupDescriptorSets()
+	{
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 
 		// Objects
@@ -288,6 +323,7 @@ public:
 
 	void preparePipelines()
 	{
+		VKS_TRACE_FUNCTION();
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
 			vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 
@@ -330,7 +366,7 @@ public:
 		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
 
 		// Pipelines
-		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayout, renderPass);
+		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayout, dynamicResolution.getRenderPass());
 		pipelineCI.pInputAssemblyState = &inputAssemblyState;
 		pipelineCI.pRasterizationState = &rasterizationState;
 		pipelineCI.pColorBlendState = &colorBlendState;
@@ -359,6 +395,7 @@ public:
 	// Generate a BRDF integration map used as a look-up-table (stores roughness / NdotV)
 	void generateBRDFLUT()
 	{
+		VKS_TRACE_FUNCTION();
 		auto tStart = std::chrono::high_resolution_clock::now();
 
 		const VkFormat format = VK_FORMAT_R16G16_SFLOAT;	// R16G16 is supported pretty much everywhere
@@ -544,10 +581,9 @@ public:
 		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		vkCmdDraw(cmdBuf, 3, 1, 0, 0);
 		vkCmdEndRenderPass(cmdBuf);
+		// Waits for the command buffer, so there is no need to wait for the (shared) queue to become idle
 		vulkanDevice->flushCommandBuffer(cmdBuf, queue);
 
-		vkQueueWaitIdle(queue);
-
 		// todo: cleanup
 		vkDestroyPipeline(device, pipeline, nullptr);
 		vkDestroyPipelineLayout(device, pipelinelayout, nullptr);
@@ -564,6 +600,7 @@ public:
 	// Generate an irradiance cube map from the environment cube map
 	void generateIrradianceCube()
 	{
+		VKS_TRACE_FUNCTION();
 		auto tStart = std::chrono::high_resolution_clock::now();
 
 		const VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
@@ -944,6 +981,7 @@ public:
 	// See https://placeholderart.wordpress.com/2015/07/28/implementation-notes-runtime-environment-map-filtering-for-image-based-lighting/
 	void generatePrefilteredCube()
 	{
+		VKS_TRACE_FUNCTION();
 		auto tStart = std::chrono::high_resolution_clock::now();
 
 		const VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
@@ -1391,23 +1429,48 @@ public:
 
 	void prepare()
 	{
-		VulkanExampleBase::prepare();
-		loadAssets();
-		generateBRDFLUT();
-		generateIrradianceCube();
-		generatePrefilteredCube();
-		prepareUniformBuffers();
-		setupDescriptors();
-		preparePipelines();
-		buildCommandBuffers();
+		// Asset loading, the IBL map generation and pipeline creation run as concurrent startup tasks
+		// The base setup (swapchain, render pass, pipeline cache) stays on the main thread, as it may touch the window
+		vks::TaskGraph::Task baseTask = startupTasks.add("Base setup", [this] { VulkanExampleBase::prepare(); }, {}, true);
+		vks::TaskGraph::Task skyboxTask, environmentCubeTask;
+		addLoadAssetTasks(skyboxTask, environmentCubeTask);
+		vks::TaskGraph::Task uniformBuffersTask = startupTasks.add("Prepare uniform buffers", [this] { prepareUniformBuffers(); });
+		vks::TaskGraph::Task descriptorSetLayoutTask = startupTasks.add("Setup descriptor set layout", [this] { setupDescriptorSetLayout(); });
+		vks::TaskGraph::Task brdfLutTask = startupTasks.add("Generate BRDF LUT", [this] { generateBRDFLUT(); }, { baseTask });
+		vks::TaskGraph::Task irradianceCubeTask = startupTasks.add("Generate irradiance cube", [this] { generateIrradianceCube(); }, { baseTask, skyboxTask, environmentCubeTask });
+		vks::TaskGraph::Task prefilteredCubeTask = startupTasks.add("Generate prefiltered cube", [this] { generatePrefilteredCube(); }, { baseTask, skyboxTask, environmentCubeTask });
+		vks::TaskGraph::Task dynamicResolutionTask = startupTasks.add("Prepare dynamic resolution", [this] { prepareDynamicResolution(); }, { baseTask });
+		startupTasks.add("Prepare pipelines", [this] { preparePipelines(); }, { descriptorSetLayoutTask, dynamicResolutionTask });
+		startupTasks.add("Setup descriptor sets", [this] { setupDescriptorSets(); }, { descriptorSetLayoutTask, uniformBuffersTask, environmentCubeTask, brdfLutTask, irradianceCubeTask, prefilteredCubeTask });
+		executeStartupTasks();
+		recordCommandBuffers();
 		prepared = true;
 	}
 
+	void prepareDynamicResolution()
+	{
+		// The scene is tone mapped in the fragment shader, so an 8 bit target is sufficient
+		dynamicResolution.upscaleShaders[0] = loadShader(getShadersPath() + "base/upscale.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+		dynamicResolution.upscaleShaders[1] = loadShader(getShadersPath() + "base/upscale.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		dynamicResolution.prepare(vulkanDevice, queue, pipelineCache, renderPass, VK_FORMAT_R8G8B8A8_UNORM, depthFormat, width, height, static_cast<uint32_t>(drawCmdBuffers.size()));
+	}
+
 	virtual void render()
 	{
 		if (!prepared)
 			return;
 		draw();
+		// Timestamps of the frame are available as the frame has been waited on in submitFrame
+		if (dynamicResolution.update(currentBuffer)) {
+			renderScale = dynamicResolution.getScale();
+			buildCommandBuffers();
+		}
+	}
+
+	virtual void windowResized()
+	{
+		dynamicResolution.resize(width, height);
+		buildCommandBuffers();
 	}
 
 	virtual void viewChanged()
@@ -1435,6 +1498,22 @@ public:
 				buildCommandBuffers();
 			}
 		}
+		if (overlay->header("Dynamic resolution")) {
+			if (dynamicResolution.hasTimestamps()) {
+				overlay->checkBox("Adjust to frame time", &dynamicResolution.enabled);
+				overlay->sliderFloat("Target (ms)", &dynamicResolution.targetFrameTime, 1.0f, 33.3f);
+				overlay->text("GPU time: %.2f ms", dynamicResolution.getGpuTime());
+			}
+			if (!dynamicResolution.enabled || !dynamicResolution.hasTimestamps()) {
+				if (overlay->sliderFloat("Render scale", &renderScale, dynamicResolution.minScale, dynamicResolution.maxScale)) {
+					if (dynamicResolution.setScale(renderScale)) {
+						buildCommandBuffers();
+					}
+				}
+			}
+			const VkExtent2D extent = dynamicResolution.getRenderExtent();
+			overlay->text("Resolution: %dx%d (%.0f%%)", extent.width, extent.height, dynamicResolution.getScale() * 100.0f);
+		}
 	}
 
 };
@@ -8,6 +8,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanAsyncCompute.h"
 
 #define ENABLE_VALIDATION false
 
@@ -15,11 +16,18 @@
 #define FB_DIM 512
 #define FB_COLOR_FORMAT VK_FORMAT_R8G8B8A8_UNORM
 
+// Frame slots of the async compute path, the offscreen pass of one slot is rendered while the other one is blurred
+#define ASYNC_FRAME_COUNT 2
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool blur = true;
 	bool displayTexture = false;
+	// Runs the radial blur as a compute shader on the compute queue, see drawAsync()
+	bool asyncCompute = false;
+	bool timelineSemaphoreSupported = false;
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR enabledTimelineSemaphoreFeatures{};
 
 	struct {
 		vks::Texture2D gradient;
@@ -49,11 +57,15 @@ public:
 		VkPipeline colorPass;
 		VkPipeline phongPass;
 		VkPipeline offscreenDisplay;
+		VkPipeline radialBlurCompute;
+		VkPipeline composite;
+		VkPipeline compositeDisplay;
 	} pipelines;
 
 	struct {
 		VkPipelineLayout radialBlur;
 		VkPipelineLayout scene;
+		VkPipelineLayout radialBlurCompute;
 	} pipelineLayouts;
 
 	struct {
@@ -64,6 +76,7 @@ public:
 	struct {
 		VkDescriptorSetLayout scene;
 		VkDescriptorSetLayout radialBlur;
+		VkDescriptorSetLayout radialBlurCompute;
 	} descriptorSetLayouts;
 
 	// Framebuffer for offscreen rendering
@@ -81,6 +94,44 @@ public:
 		VkDescriptorImageInfo descriptor;
 	} offscreenPass;
 
+	/*
+		Async compute path
+		Frame N renders its offscreen pass into slot N % 2 while the compute queue blurs the offscreen pass of frame N - 1,
+		the final pass of frame N then composites that blur. So the blur lags the scene by one frame, in exchange the
+		blur overlaps graphics work instead of running in between the offscreen and the final pass.
+	*/
+	vks::AsyncCompute compute;
+	struct AsyncFrame {
+		FrameBufferAttachment color;
+		VkFramebuffer frameBuffer;
+		// Blurred color, written by the compute shader
+		FrameBufferAttachment blur;
+		VkDescriptorSet computeDescriptorSet;
+		VkDescriptorSet compositeDescriptorSet;
+		VkCommandBuffer offscreenCommandBuffer;
+		// Final pass compositing this slot's blur, one per swap chain image
+		std::vector<VkCommandBuffer> compositionCommandBuffers;
+		// Timeline values of this slot's last offscreen pass and blur
+		uint64_t graphicsValue = 0;
+		uint64_t computeValue = 0;
+	};
+	std::array<AsyncFrame, ASYNC_FRAME_COUNT> asyncFrames;
+	uint32_t asyncFrameIndex = 0;
+
+	// GPU time of a whole frame on the graphics queue (from the start of the offscreen pass to the end of the final pass) and
+	// of the blur on the compute queue. Sync mode uses two queries per command buffer, async mode two per frame slot after those.
+	struct {
+		bool supported = false;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		uint32_t asyncQueryBase = 0;
+		float timestampPeriod = 1.0f;
+		uint64_t timestampMask = ~0ULL;
+		// Exponential moving averages in ms
+		float frameTime = 0.0f;
+		float blurTime = 0.0f;
+		uint32_t sampleCount = 0;
+	} timing;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Full screen radial blur effect";
@@ -89,6 +140,17 @@ public:
 		camera.setRotation(glm::vec3(-16.25f, -28.75f, 0.0f));
 		camera.setPerspective(45.0f, (float)width / (float)height, 1.0f, 256.0f);
 		timerSpeed *= 0.5f;
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	}
+
+	// The async compute path requires timeline semaphores, the example falls back to the graphics queue only path without them
+	void getEnabledExtensions()
+	{
+		timelineSemaphoreSupported = vulkanDevice->extensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		if (timelineSemaphoreSupported) {
+			vks::AsyncCompute::getFeatures(enabledDeviceExtensions, enabledTimelineSemaphoreFeatures);
+			deviceCreatepNextChain = &enabledTimelineSemaphoreFeatures;
+		}
 	}
 
 	~VulkanExample()
@@ -112,6 +174,23 @@ public:
 		vkDestroySampler(device, offscreenPass.sampler, nullptr);
 		vkDestroyFramebuffer(device, offscreenPass.frameBuffer, nullptr);
 
+		if (timelineSemaphoreSupported) {
+			compute.destroy();
+			for (AsyncFrame& frame : asyncFrames) {
+				destroyAttachment(frame.color);
+				destroyAttachment(frame.blur);
+				vkDestroyFramebuffer(device, frame.frameBuffer, nullptr);
+			}
+			vkDestroyPipeline(device, pipelines.radialBlurCompute, nullptr);
+			vkDestroyPipeline(device, pipelines.composite, nullptr);
+			vkDestroyPipeline(device, pipelines.compositeDisplay, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayouts.radialBlurCompute, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.radialBlurCompute, nullptr);
+		}
+		if (timing.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, timing.queryPool, nullptr);
+		}
+
 		vkDestroyPipeline(device, pipelines.radialBlur, nullptr);
 		vkDestroyPipeline(device, pipelines.phongPass, nullptr);
 		vkDestroyPipeline(device, pipelines.colorPass, nullptr);
@@ -300,43 +379,234 @@ public:
 		offscreenPass.descriptor.sampler = offscreenPass.sampler;
 	}
 
-	void buildCommandBuffers()
+	void createAttachment(VkImageUsageFlags usage, FrameBufferAttachment& attachment)
 	{
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
+		image.imageType = VK_IMAGE_TYPE_2D;
+		image.format = FB_COLOR_FORMAT;
+		image.extent.width = offscreenPass.width;
+		image.extent.height = offscreenPass.height;
+		image.extent.depth = 1;
+		image.mipLevels = 1;
+		image.arrayLayers = 1;
+		image.samples = VK_SAMPLE_COUNT_1_BIT;
+		image.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image.usage = usage;
+		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &attachment.image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, attachment.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment.mem));
+		VK_CHECK_RESULT(vkBindImageMemory(device, attachment.image, attachment.mem, 0));
+
+		VkImageViewCreateInfo imageView = vks::initializers::imageViewCreateInfo();
+		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageView.format = FB_COLOR_FORMAT;
+		imageView.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		imageView.image = attachment.image;
+		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &attachment.view));
+	}
+
+	void destroyAttachment(FrameBufferAttachment& attachment)
+	{
+		vkDestroyImageView(device, attachment.view, nullptr);
+		vkDestroyImage(device, attachment.image, nullptr);
+		vkFreeMemory(device, attachment.mem, nullptr);
+	}
 
+	// Per slot offscreen targets, blur images and command buffers of the async compute path
+	void prepareAsyncCompute()
+	{
+		compute.prepare(vulkanDevice, queue, ASYNC_FRAME_COUNT);
+		for (AsyncFrame& frame : asyncFrames) {
+			createAttachment(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, frame.color);
+			createAttachment(VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, frame.blur);
+
+			// All slots share the depth attachment, their offscreen passes are executed in order on the graphics queue
+			VkImageView attachments[2] = { frame.color.view, offscreenPass.depth.view };
+			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
+			fbufCreateInfo.renderPass = offscreenPass.renderPass;
+			fbufCreateInfo.attachmentCount = 2;
+			fbufCreateInfo.pAttachments = attachments;
+			fbufCreateInfo.width = offscreenPass.width;
+			fbufCreateInfo.height = offscreenPass.height;
+			fbufCreateInfo.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frame.frameBuffer));
+
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &frame.offscreenCommandBuffer));
+		}
+	}
+
+	// Two queries per command buffer for the graphics only path and two per frame slot for the async compute path
+	void prepareTimestamps()
+	{
+		if (timing.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, timing.queryPool, nullptr);
+			timing.queryPool = VK_NULL_HANDLE;
+		}
+		// Timestamps need to be supported by the graphics queue
+		const uint32_t validBits = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits;
+		timing.supported = validBits > 0;
+		timing.timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+		timing.timestampMask = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+		timing.asyncQueryBase = static_cast<uint32_t>(drawCmdBuffers.size()) * 2;
+		if (timing.supported) {
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCI.queryCount = timing.asyncQueryBase + ASYNC_FRAME_COUNT * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolCI, nullptr, &timing.queryPool));
+		}
+		timing.sampleCount = 0;
+	}
+
+	// Reads the timestamps of the frame that just finished without waiting
+	void updateTiming(uint32_t firstQuery, float blurTime)
+	{
+		if (!timing.supported) {
+			return;
+		}
+		uint64_t timestamps[2] = {};
+		VkResult result = vkGetQueryPoolResults(device, timing.queryPool, firstQuery, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return;
+		}
+		const float frameTime = (float)((timestamps[1] - timestamps[0]) & timing.timestampMask) * timing.timestampPeriod / 1000000.0f;
+		if (timing.sampleCount == 0) {
+			timing.frameTime = frameTime;
+			timing.blurTime = blurTime;
+		} else {
+			timing.frameTime += (frameTime - timing.frameTime) * 0.05f;
+			timing.blurTime += (blurTime - timing.blurTime) * 0.05f;
+		}
+		timing.sampleCount++;
+	}
+
+	void recordOffscreenPass(VkCommandBuffer commandBuffer, VkFramebuffer frameBuffer)
+	{
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = offscreenPass.renderPass;
+		renderPassBeginInfo.framebuffer = frameBuffer;
+		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		VkViewport viewport = vks::initializers::viewport((float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		VkRect2D scissor = vks::initializers::rect2D(offscreenPass.width, offscreenPass.height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.colorPass);
+		scene.draw(commandBuffer);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	// Renders the scene and draws a fullscreen triangle (clipped to a quad) with the blur on top
+	void recordFinalPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkDescriptorSet blurDescriptorSet, VkPipeline blurPipeline)
+	{
 		VkClearValue clearValues[2];
-		VkViewport viewport;
-		VkRect2D scissor;
+		clearValues[0].color = defaultClearColor;
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = frameBuffers[imageIndex];
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		// 3D scene
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phongPass);
+		scene.draw(commandBuffer);
+
+		if (blur)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.radialBlur, 0, 1, &blurDescriptorSet, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, blurPipeline);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		}
+
+		drawUI(commandBuffer);
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	void writeTimestamp(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t query)
+	{
+		if (timing.supported) {
+			vkCmdWriteTimestamp(commandBuffer, stage, timing.queryPool, query);
+		}
+	}
+
+	// The offscreen image is handed to the compute queue after the offscreen pass and the blur back to the graphics queue after the dispatch
+	vks::AsyncCompute::ImageTransfer colorTransfer(const AsyncFrame& frame)
+	{
+		vks::AsyncCompute::ImageTransfer transfer;
+		transfer.image = frame.color.image;
+		transfer.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		transfer.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		transfer.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		transfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		transfer.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		transfer.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		return transfer;
+	}
+
+	vks::AsyncCompute::ImageTransfer blurTransfer(const AsyncFrame& frame)
+	{
+		vks::AsyncCompute::ImageTransfer transfer;
+		transfer.image = frame.blur.image;
+		transfer.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		transfer.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		transfer.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		transfer.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		transfer.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		transfer.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		return transfer;
+	}
+
+	void buildCommandBuffers()
+	{
+		// The number of queries depends on the number of swap chain images
+		if (timing.asyncQueryBase != drawCmdBuffers.size() * 2) {
+			prepareTimestamps();
+		}
+
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (timing.supported) {
+				vkCmdResetQueryPool(drawCmdBuffers[i], timing.queryPool, i * 2, 2);
+			}
+			writeTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, i * 2);
+
 			/*
 				First render pass: Offscreen rendering
 			*/
-			{
-				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = offscreenPass.renderPass;
-				renderPassBeginInfo.framebuffer = offscreenPass.frameBuffer;
-				renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
-				renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues;
-
-				viewport = vks::initializers::viewport((float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				scissor = vks::initializers::rect2D(offscreenPass.width, offscreenPass.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.colorPass);
-				scene.draw(drawCmdBuffers[i]);
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
-			}
+			recordOffscreenPass(drawCmdBuffers[i], offscreenPass.frameBuffer);
 
 			/*
 				Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
@@ -345,45 +615,71 @@ public:
 			/*
 				Second render pass: Scene rendering with applied radial blur
 			*/
-			{
-				clearValues[0].color = defaultClearColor;
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = renderPass;
-				renderPassBeginInfo.framebuffer = frameBuffers[i];
-				renderPassBeginInfo.renderArea.extent.width = width;
-				renderPassBeginInfo.renderArea.extent.height = height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues;
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				// 3D scene
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phongPass);
-				scene.draw(drawCmdBuffers[i]);
-
-				// Fullscreen triangle (clipped to a quad) with radial blur
-				if (blur)
-				{
-					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.radialBlur, 0, 1, &descriptorSets.radialBlur, 0, NULL);
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, (displayTexture) ? pipelines.offscreenDisplay : pipelines.radialBlur);
-					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-				}
+			recordFinalPass(drawCmdBuffers[i], i, descriptorSets.radialBlur, (displayTexture) ? pipelines.offscreenDisplay : pipelines.radialBlur);
+
+			writeTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, i * 2 + 1);
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		}
+
+		if (timelineSemaphoreSupported) {
+			buildAsyncCommandBuffers();
+		}
+	}
 
-				drawUI(drawCmdBuffers[i]);
+	void buildAsyncCommandBuffers()
+	{
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+		for (uint32_t slot = 0; slot < ASYNC_FRAME_COUNT; slot++) {
+			AsyncFrame& frame = asyncFrames[slot];
+			const uint32_t queryBase = timing.asyncQueryBase + slot * 2;
+
+			// The final passes depend on the swap chain, which may have been recreated with a different number of images
+			if (frame.compositionCommandBuffers.size() != drawCmdBuffers.size()) {
+				if (!frame.compositionCommandBuffers.empty()) {
+					vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(frame.compositionCommandBuffers.size()), frame.compositionCommandBuffers.data());
+				}
+				frame.compositionCommandBuffers.resize(drawCmdBuffers.size());
+				VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(frame.compositionCommandBuffers.size()));
+				VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, frame.compositionCommandBuffers.data()));
 			}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+			// Graphics queue: offscreen pass of this slot, handed to the compute queue afterwards
+			VK_CHECK_RESULT(vkBeginCommandBuffer(frame.offscreenCommandBuffer, &cmdBufInfo));
+			if (timing.supported) {
+				vkCmdResetQueryPool(frame.offscreenCommandBuffer, timing.queryPool, queryBase, 2);
+			}
+			writeTimestamp(frame.offscreenCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryBase);
+			recordOffscreenPass(frame.offscreenCommandBuffer, frame.frameBuffer);
+			compute.release(frame.offscreenCommandBuffer, vks::AsyncCompute::Transfer::GraphicsToCompute, { colorTransfer(frame) });
+			VK_CHECK_RESULT(vkEndCommandBuffer(frame.offscreenCommandBuffer));
+
+			// Compute queue: radial blur of this slot's offscreen pass
+			VkCommandBuffer computeCommandBuffer = compute.getCommandBuffer(slot);
+			VK_CHECK_RESULT(vkBeginCommandBuffer(computeCommandBuffer, &cmdBufInfo));
+			compute.writeTimestamp(computeCommandBuffer, slot, false);
+			compute.acquire(computeCommandBuffer, vks::AsyncCompute::Transfer::GraphicsToCompute, { colorTransfer(frame) });
+			// The previous content of the blur is discarded, so it doesn't need to be transferred back from the graphics queue
+			vks::tools::setImageLayout(computeCommandBuffer, frame.blur.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+			vkCmdBindPipeline(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.radialBlurCompute);
+			vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.radialBlurCompute, 0, 1, &frame.computeDescriptorSet, 0, NULL);
+			vkCmdDispatch(computeCommandBuffer, (offscreenPass.width + 15) / 16, (offscreenPass.height + 15) / 16, 1);
+			compute.release(computeCommandBuffer, vks::AsyncCompute::Transfer::ComputeToGraphics, { blurTransfer(frame) });
+			compute.writeTimestamp(computeCommandBuffer, slot, true);
+			VK_CHECK_RESULT(vkEndCommandBuffer(computeCommandBuffer));
+
+			// Graphics queue: final pass of the frame following this slot's frame, compositing this slot's blur
+			// Its timestamp closes the frame that started with the other slot's offscreen pass
+			const uint32_t frameQueryBase = timing.asyncQueryBase + ((slot + 1) % ASYNC_FRAME_COUNT) * 2;
+			for (uint32_t i = 0; i < frame.compositionCommandBuffers.size(); i++) {
+				VkCommandBuffer commandBuffer = frame.compositionCommandBuffers[i];
+				VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+				compute.acquire(commandBuffer, vks::AsyncCompute::Transfer::ComputeToGraphics, { blurTransfer(frame) });
+				recordFinalPass(commandBuffer, i, frame.compositeDescriptorSet, (displayTexture) ? pipelines.compositeDisplay : pipelines.composite);
+				writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameQueryBase + 1);
+				VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+			}
 		}
 	}
 
@@ -398,15 +694,17 @@ public:
 		// Example uses three ubos and one image sampler
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4 + ASYNC_FRAME_COUNT * 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6 + ASYNC_FRAME_COUNT * 2),
+			// Async compute path
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, ASYNC_FRAME_COUNT)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				poolSizes.size(),
 				poolSizes.data(),
-				2);
+				2 + ASYNC_FRAME_COUNT * 2);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -442,6 +740,22 @@ public:
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayouts.radialBlur));
 		pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.radialBlur, 1);
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.radialBlur));
+
+		// Radial blur compute shader (async compute path)
+		if (timelineSemaphoreSupported) {
+			setLayoutBindings = {
+				// Binding 0: Compute shader uniform buffer
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+				// Binding 1: Compute shader image sampler
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+				// Binding 2: Compute shader storage image
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2)
+			};
+			descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayouts.radialBlurCompute));
+			pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.radialBlurCompute, 1);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.radialBlurCompute));
+		}
 	}
 
 	void setupDescriptorSet()
@@ -472,6 +786,28 @@ public:
 		};
 
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+
+		// Async compute path: blur of each slot's offscreen pass and its composition
+		if (timelineSemaphoreSupported) {
+			for (AsyncFrame& frame : asyncFrames) {
+				descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.radialBlurCompute, 1);
+				VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &frame.computeDescriptorSet));
+				descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.radialBlur, 1);
+				VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &frame.compositeDescriptorSet));
+
+				VkDescriptorImageInfo colorDescriptor = vks::initializers::descriptorImageInfo(offscreenPass.sampler, frame.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				VkDescriptorImageInfo blurStorageDescriptor = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, frame.blur.view, VK_IMAGE_LAYOUT_GENERAL);
+				VkDescriptorImageInfo blurDescriptor = vks::initializers::descriptorImageInfo(offscreenPass.sampler, frame.blur.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				writeDescriptorSets = {
+					vks::initializers::writeDescriptorSet(frame.computeDescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.blurParams.descriptor),
+					vks::initializers::writeDescriptorSet(frame.computeDescriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &colorDescriptor),
+					vks::initializers::writeDescriptorSet(frame.computeDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, &blurStorageDescriptor),
+					vks::initializers::writeDescriptorSet(frame.compositeDescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.blurParams.descriptor),
+					vks::initializers::writeDescriptorSet(frame.compositeDescriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &blurDescriptor),
+				};
+				vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+			}
+		}
 	}
 
 	void preparePipelines()
@@ -521,6 +857,18 @@ public:
 		blendAttachmentState.blendEnable = VK_FALSE;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreenDisplay));
 
+		// Composition of the blur computed on the compute queue, same blending as above
+		if (timelineSemaphoreSupported) {
+			shaderStages[1] = loadShader(getShadersPath() + "radialblur/composite.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.compositeDisplay));
+			blendAttachmentState.blendEnable = VK_TRUE;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.composite));
+
+			VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayouts.radialBlurCompute, 0);
+			computePipelineCI.stage = loadShader(getShadersPath() + "radialblur/radialblur.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &pipelines.radialBlurCompute));
+		}
+
 		// Phong pass
 		pipelineCI.layout = pipelineLayouts.scene;
 		shaderStages[0] = loadShader(getShadersPath() + "radialblur/phongpass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
@@ -590,6 +938,51 @@ public:
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 
 		VulkanExampleBase::submitFrame();
+
+		updateTiming(currentBuffer * 2, 0.0f);
+	}
+
+	/*
+		Submits the work of frame N as:
+			compute:  blur of frame N - 1 (waits for the offscreen pass of frame N - 1)
+			graphics: offscreen pass of frame N (no wait, overlaps the blur)
+			graphics: final pass compositing the blur of frame N - 1 (waits for the blur)
+	*/
+	void drawAsync()
+	{
+		VulkanExampleBase::prepareFrame();
+
+		const uint32_t currentSlot = asyncFrameIndex % ASYNC_FRAME_COUNT;
+		const uint32_t previousSlot = (asyncFrameIndex + 1) % ASYNC_FRAME_COUNT;
+		AsyncFrame& current = asyncFrames[currentSlot];
+		AsyncFrame& previous = asyncFrames[previousSlot];
+
+		// The first frame after enabling the async path has no previous offscreen pass yet
+		if (asyncFrameIndex == 0) {
+			previous.graphicsValue = compute.submitGraphics(previous.offscreenCommandBuffer, 0, 0);
+		}
+		previous.computeValue = compute.submitCompute(compute.getCommandBuffer(previousSlot), previous.graphicsValue);
+		// The compute queue may still read this slot's offscreen image from two frames ago, wait for that before writing it
+		current.graphicsValue = compute.submitGraphics(current.offscreenCommandBuffer, current.computeValue, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		compute.submitGraphics(previous.compositionCommandBuffers[currentBuffer], previous.computeValue, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			semaphores.presentComplete, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, semaphores.renderComplete);
+
+		VulkanExampleBase::submitFrame();
+
+		// The final pass of this frame closes the queries started by the offscreen pass of the current slot
+		updateTiming(timing.asyncQueryBase + currentSlot * 2, compute.getTime(previousSlot));
+		asyncFrameIndex++;
+	}
+
+	void resetAsyncFrames()
+	{
+		vkDeviceWaitIdle(device);
+		asyncFrameIndex = 0;
+		for (AsyncFrame& frame : asyncFrames) {
+			frame.graphicsValue = 0;
+			frame.computeValue = 0;
+		}
+		timing.sampleCount = 0;
 	}
 
 	void prepare()
@@ -597,6 +990,9 @@ public:
 		VulkanExampleBase::prepare();
 		loadAssets();
 		prepareOffscreen();
+		if (timelineSemaphoreSupported) {
+			prepareAsyncCompute();
+		}
 		prepareUniformBuffers();
 		setupDescriptorSetLayout();
 		preparePipelines();
@@ -610,7 +1006,11 @@ public:
 	{
 		if (!prepared)
 			return;
-		draw();
+		if (asyncCompute && blur) {
+			drawAsync();
+		} else {
+			draw();
+		}
 		if (!paused || camera.updated)
 			updateUniformBuffersScene();
 	}
@@ -619,11 +1019,26 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			if (overlay->checkBox("Radial blur", &blur)) {
+				resetAsyncFrames();
 				buildCommandBuffers();
 			}
 			if (overlay->checkBox("Display render target", &displayTexture)) {
 				buildCommandBuffers();
 			}
+			if (timelineSemaphoreSupported) {
+				if (overlay->checkBox("Async compute", &asyncCompute)) {
+					resetAsyncFrames();
+				}
+			}
+		}
+		if (timing.supported && overlay->header("Timing")) {
+			overlay->text("Frame GPU time: %.3f ms", timing.frameTime);
+			if (asyncCompute && blur) {
+				if (compute.timestampsSupported()) {
+					overlay->text("Blur (compute queue): %.3f ms", timing.blurTime);
+				}
+				overlay->text("Compute queue: %s", compute.isAsync() ? "dedicated" : "shared with graphics");
+			}
 		}
 	}
 };
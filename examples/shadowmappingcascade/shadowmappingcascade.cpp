@@ -13,12 +13,18 @@
 	This results in a better shadow map resolution distribution that can be tweaked even further by increasing
 	the number of frustum splits.
 
-	A further optimization could be done using a geometry shader to do a single-pass render for the depth map
-	cascades instead of multiple passes (geometry shaders are not supported on all target devices).
+	Shadow casters are culled against each cascade, so every cascade only renders its own visible set. Cascade matrices
+	are snapped to shadow map texels, which keeps shadow edges stable while the camera moves.
+
+	Distant cascades can be cached: their depth is only re-rendered every few frames (staggered, so that at most one of them
+	updates per frame), when the light moves or when the camera's frustum slice leaves the area covered by the cached cascade.
+	If all cascades need to be updated in the same frame and multiview (VK_KHR_multiview) is supported, they're rendered
+	in a single pass to the layered depth image.
 */
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "frustum.hpp"
 
 #define ENABLE_VALIDATION false
 
@@ -37,6 +43,12 @@ public:
 	int32_t displayDepthMapCascadeIndex = 0;
 	bool colorCascades = false;
 	bool filterPCF = false;
+	// Only re-render distant cascades if required
+	bool cacheCascades = true;
+	int32_t cascadeUpdateInterval = 4;
+	// Render all cascades in a single multiview pass
+	bool singlePass = true;
+	bool multiviewSupported = false;
 
 	float cascadeSplitLambda = 0.95f;
 
@@ -50,6 +62,23 @@ public:
 		vkglTF::Model tree;
 	} models;
 
+	const std::vector<glm::vec3> treePositions = {
+		glm::vec3(0.0f, 0.0f, 0.0f),
+		glm::vec3(1.25f, 0.25f, 1.25f),
+		glm::vec3(-1.25f, -0.2f, 1.25f),
+		glm::vec3(1.25f, 0.1f, -1.25f),
+		glm::vec3(-1.25f, -0.25f, -1.25f),
+	};
+
+	// A single model draw with its world space bounding sphere
+	struct ShadowCaster {
+		vkglTF::Model* model;
+		glm::vec3 position;
+		glm::vec3 center;
+		float radius;
+	};
+	std::vector<ShadowCaster> shadowCasters;
+
 	struct uniformBuffers {
 		vks::Buffer VS;
 		vks::Buffer FS;
@@ -87,6 +116,8 @@ public:
 	struct PushConstBlock {
 		glm::vec4 position;
 		uint32_t cascadeIndex;
+		// Cascades the current draw is visible in (single pass depth rendering only)
+		uint32_t cascadeMask;
 	};
 
 	// Resources of the depth map generation pass
@@ -95,6 +126,10 @@ public:
 		VkPipelineLayout pipelineLayout;
 		VkPipeline pipeline;
 		vks::Buffer uniformBuffer;
+		// Renders all cascades at once using multiview
+		VkRenderPass multiviewRenderPass;
+		VkPipeline multiviewPipeline;
+		VkFramebuffer multiviewFrameBuffer;
 
 		struct UniformBlock {
 			std::array<glm::mat4, SHADOW_MAP_CASCADE_COUNT> cascadeViewProjMat;
@@ -125,12 +160,32 @@ public:
 		float splitDepth;
 		glm::mat4 viewProjMatrix;
 
+		// Bounds and light direction the cascade's depth was last rendered with
+		glm::vec3 center = glm::vec3(0.0f);
+		float radius = 0.0f;
+		glm::vec3 lightDir = glm::vec3(0.0f);
+		// Depth needs to be re-rendered in the next frame
+		bool update = true;
+		// Forces an update regardless of caching, e.g. after changing the splits
+		bool invalid = true;
+		// Indices of the shadow casters intersecting the cascade
+		std::vector<uint32_t> visibleCasters;
+
 		void destroy(VkDevice device) {
 			vkDestroyImageView(device, view, nullptr);
 			vkDestroyFramebuffer(device, frameBuffer, nullptr);
 		}
 	};
 	std::array<Cascade, SHADOW_MAP_CASCADE_COUNT> cascades;
+	uint32_t cascadeFrameIndex = 0;
+
+	struct {
+		uint32_t cascades = 0;
+		uint32_t renderPasses = 0;
+		uint32_t draws = 0;
+	} shadowPassStats;
+
+	VkPhysicalDeviceMultiviewFeaturesKHR physicalDeviceMultiviewFeatures{};
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
@@ -142,6 +197,8 @@ public:
 		camera.setPosition(glm::vec3(-0.12f, 1.14f, -2.25f));
 		camera.setRotation(glm::vec3(-17.0f, 7.0f, 0.0f));
 		timer = 0.2f;
+		// Required to enable multiview on Vulkan 1.0 devices
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	}
 
 	~VulkanExample()
@@ -152,6 +209,11 @@ public:
 		depth.destroy(device);
 
 		vkDestroyRenderPass(device, depthPass.renderPass, nullptr);
+		if (multiviewSupported) {
+			vkDestroyFramebuffer(device, depthPass.multiviewFrameBuffer, nullptr);
+			vkDestroyRenderPass(device, depthPass.multiviewRenderPass, nullptr);
+			vkDestroyPipeline(device, depthPass.multiviewPipeline, nullptr);
+		}
 
 		vkDestroyPipeline(device, pipelines.debugShadowMap, nullptr);
 		vkDestroyPipeline(device, depthPass.pipeline, nullptr);
@@ -175,6 +237,19 @@ public:
 		enabledFeatures.depthClamp = deviceFeatures.depthClamp;
 	}
 
+	virtual void getEnabledExtensions()
+	{
+		// Multiview is optional, cascades are rendered one by one if it's not available
+		multiviewSupported = vulkanDevice->extensionSupported(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+		if (multiviewSupported) {
+			enabledDeviceExtensions.push_back(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+			physicalDeviceMultiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES_KHR;
+			physicalDeviceMultiviewFeatures.multiview = VK_TRUE;
+			deviceCreatepNextChain = &physicalDeviceMultiviewFeatures;
+		}
+		singlePass = multiviewSupported;
+	}
+
 	/*
 		Render the example scene with given command buffer, pipeline layout and descriptor set
 		Used by the scene rendering and depth pass generation command buffer
@@ -191,15 +266,7 @@ public:
 		models.terrain.draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayout);
 
 		// Trees
-		const std::vector<glm::vec3> positions = {
-			glm::vec3(0.0f, 0.0f, 0.0f),
-			glm::vec3(1.25f, 0.25f, 1.25f),
-			glm::vec3(-1.25f, -0.2f, 1.25f),
-			glm::vec3(1.25f, 0.1f, -1.25f),
-			glm::vec3(-1.25f, -0.25f, -1.25f),
-		};
-
-		for (auto position : positions) {
+		for (auto position : treePositions) {
 			pushConstBlock.position = glm::vec4(position, 0.0f);
 			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
@@ -207,6 +274,94 @@ public:
 		}
 	}
 
+	/*
+		Render the shadow casters visible in a single cascade
+	*/
+	void renderCascade(VkCommandBuffer commandBuffer, uint32_t cascadeIndex)
+	{
+		const Cascade& cascade = cascades[cascadeIndex];
+		for (uint32_t casterIndex : cascade.visibleCasters) {
+			const ShadowCaster& shadowCaster = shadowCasters[casterIndex];
+			PushConstBlock pushConstBlock = { glm::vec4(shadowCaster.position, 0.0f), cascadeIndex, 0 };
+			vkCmdPushConstants(commandBuffer, depthPass.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.pipelineLayout, 0, 1, &cascade.descriptorSet, 0, nullptr);
+			shadowCaster.model->draw(commandBuffer, vkglTF::RenderFlags::BindImages, depthPass.pipelineLayout);
+			shadowPassStats.draws++;
+		}
+	}
+
+	/*
+		Render the shadow casters for all cascades in a single multiview pass
+		Each caster is drawn once, the vertex shader discards the views (cascades) it's not visible in
+	*/
+	void renderCascadesMultiview(VkCommandBuffer commandBuffer)
+	{
+		std::vector<uint32_t> cascadeMasks(shadowCasters.size(), 0);
+		for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+			for (uint32_t casterIndex : cascades[i].visibleCasters) {
+				cascadeMasks[casterIndex] |= 1 << i;
+			}
+		}
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.pipelineLayout, 0, 1, &cascades[0].descriptorSet, 0, nullptr);
+		for (size_t i = 0; i < shadowCasters.size(); i++) {
+			if (cascadeMasks[i] == 0) {
+				continue;
+			}
+			PushConstBlock pushConstBlock = { glm::vec4(shadowCasters[i].position, 0.0f), 0, cascadeMasks[i] };
+			vkCmdPushConstants(commandBuffer, depthPass.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+			shadowCasters[i].model->draw(commandBuffer, vkglTF::RenderFlags::BindImages, depthPass.pipelineLayout);
+			shadowPassStats.draws++;
+		}
+	}
+
+	/*
+		Calculate the world space bounding sphere of a model
+		Applies the same transformations the glTF loader applies to the vertices (pre-transform and flip y)
+	*/
+	void getModelBounds(vkglTF::Model& model, glm::vec3& center, float& radius)
+	{
+		glm::vec3 min = glm::vec3(FLT_MAX);
+		glm::vec3 max = glm::vec3(-FLT_MAX);
+		for (vkglTF::Node* node : model.linearNodes) {
+			if (!node->mesh) {
+				continue;
+			}
+			const glm::mat4 nodeMatrix = node->getMatrix();
+			for (const vkglTF::Primitive* primitive : node->mesh->primitives) {
+				for (uint32_t i = 0; i < 8; i++) {
+					const glm::vec3 corner = glm::vec3(
+						(i & 1) ? primitive->dimensions.max.x : primitive->dimensions.min.x,
+						(i & 2) ? primitive->dimensions.max.y : primitive->dimensions.min.y,
+						(i & 4) ? primitive->dimensions.max.z : primitive->dimensions.min.z);
+					glm::vec3 transformed = glm::vec3(nodeMatrix * glm::vec4(corner, 1.0f));
+					transformed.y *= -1.0f;
+					min = glm::min(min, transformed);
+					max = glm::max(max, transformed);
+				}
+			}
+		}
+		center = (min + max) * 0.5f;
+		radius = glm::length(max - min) * 0.5f;
+	}
+
+	void prepareShadowCasters()
+	{
+		ShadowCaster terrain{};
+		terrain.model = &models.terrain;
+		getModelBounds(models.terrain, terrain.center, terrain.radius);
+		shadowCasters.push_back(terrain);
+
+		ShadowCaster tree{};
+		tree.model = &models.tree;
+		getModelBounds(models.tree, tree.center, tree.radius);
+		const glm::vec3 treeCenter = tree.center;
+		for (auto position : treePositions) {
+			tree.position = position;
+			tree.center = treeCenter + position;
+			shadowCasters.push_back(tree);
+		}
+	}
+
 	/*
 		Setup resources used by the depth pass
 		The depth image is layered with each layer storing one shadow map cascade
@@ -267,6 +422,23 @@ public:
 
 		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &depthPass.renderPass));
 
+		// Multiview render pass broadcasting the subpass to all cascade layers
+		if (multiviewSupported) {
+			const uint32_t viewMask = (1 << SHADOW_MAP_CASCADE_COUNT) - 1;
+			// Cascades are nested, so neighbouring views see mostly the same geometry
+			const uint32_t correlationMask = (1 << SHADOW_MAP_CASCADE_COUNT) - 1;
+
+			VkRenderPassMultiviewCreateInfoKHR renderPassMultiviewCI{};
+			renderPassMultiviewCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO_KHR;
+			renderPassMultiviewCI.subpassCount = 1;
+			renderPassMultiviewCI.pViewMasks = &viewMask;
+			renderPassMultiviewCI.correlationMaskCount = 1;
+			renderPassMultiviewCI.pCorrelationMasks = &correlationMask;
+
+			renderPassCreateInfo.pNext = &renderPassMultiviewCI;
+			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &depthPass.multiviewRenderPass));
+		}
+
 		/*
 			Layered depth image and views
 		*/
@@ -329,6 +501,18 @@ public:
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &cascades[i].frameBuffer));
 		}
 
+		// Single framebuffer with all layers for multiview, the render pass' view mask selects the layers
+		if (multiviewSupported) {
+			VkFramebufferCreateInfo framebufferInfo = vks::initializers::framebufferCreateInfo();
+			framebufferInfo.renderPass = depthPass.multiviewRenderPass;
+			framebufferInfo.attachmentCount = 1;
+			framebufferInfo.pAttachments = &depth.view;
+			framebufferInfo.width = SHADOWMAP_DIM;
+			framebufferInfo.height = SHADOWMAP_DIM;
+			framebufferInfo.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &depthPass.multiviewFrameBuffer));
+		}
+
 		// Shared sampler for cascade depth reads
 		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
 		sampler.magFilter = VK_FILTER_LINEAR;
@@ -346,101 +530,127 @@ public:
 	}
 
 	void buildCommandBuffers()
+	{
+		for (int32_t i = 0; i < drawCmdBuffers.size(); i++) {
+			buildCommandBuffer(i);
+		}
+	}
+
+	void buildCommandBuffer(int32_t i)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); i++) {
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+
+		/*
+			Generate depth map cascades
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+			Cached cascades keep the depth from a previous frame, only cascades flagged for an update are rendered
+			If all cascades need an update, they're rendered in a single multiview pass (if supported)
+			Otherwise one pass per cascade is used, with each pass rendering the scene to the cascade's depth image layer
+		*/
+		{
+			shadowPassStats = {};
 
-			/*
-				Generate depth map cascades
+			VkClearValue clearValues[1];
+			clearValues[0].depthStencil = { 1.0f, 0 };
 
-				Uses multiple passes with each pass rendering the scene to the cascade's depth image layer
-				Could be optimized using a geometry shader (and layered frame buffer) on devices that support geometry shaders
-			*/
-			{
-				VkClearValue clearValues[1];
-				clearValues[0].depthStencil = { 1.0f, 0 };
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = depthPass.renderPass;
+			renderPassBeginInfo.renderArea.offset.x = 0;
+			renderPassBeginInfo.renderArea.offset.y = 0;
+			renderPassBeginInfo.renderArea.extent.width = SHADOWMAP_DIM;
+			renderPassBeginInfo.renderArea.extent.height = SHADOWMAP_DIM;
+			renderPassBeginInfo.clearValueCount = 1;
+			renderPassBeginInfo.pClearValues = clearValues;
 
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = depthPass.renderPass;
-				renderPassBeginInfo.renderArea.offset.x = 0;
-				renderPassBeginInfo.renderArea.offset.y = 0;
-				renderPassBeginInfo.renderArea.extent.width = SHADOWMAP_DIM;
-				renderPassBeginInfo.renderArea.extent.height = SHADOWMAP_DIM;
-				renderPassBeginInfo.clearValueCount = 1;
-				renderPassBeginInfo.pClearValues = clearValues;
+			VkViewport viewport = vks::initializers::viewport((float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0.0f, 1.0f);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
-				VkViewport viewport = vks::initializers::viewport((float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+			VkRect2D scissor = vks::initializers::rect2D(SHADOWMAP_DIM, SHADOWMAP_DIM, 0, 0);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-				VkRect2D scissor = vks::initializers::rect2D(SHADOWMAP_DIM, SHADOWMAP_DIM, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+			for (uint32_t j = 0; j < SHADOW_MAP_CASCADE_COUNT; j++) {
+				if (cascades[j].update) {
+					shadowPassStats.cascades++;
+				}
+			}
 
-				// One pass per cascade
+			if (singlePass && (shadowPassStats.cascades == SHADOW_MAP_CASCADE_COUNT)) {
+				renderPassBeginInfo.renderPass = depthPass.multiviewRenderPass;
+				renderPassBeginInfo.framebuffer = depthPass.multiviewFrameBuffer;
+				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.multiviewPipeline);
+				renderCascadesMultiview(drawCmdBuffers[i]);
+				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				shadowPassStats.renderPasses++;
+			} else {
 				// The layer that this pass renders to is defined by the cascade's image view (selected via the cascade's descriptor set)
 				for (uint32_t j = 0; j < SHADOW_MAP_CASCADE_COUNT; j++) {
+					if (!cascades[j].update) {
+						continue;
+					}
 					renderPassBeginInfo.framebuffer = cascades[j].frameBuffer;
 					vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.pipeline);
-					renderScene(drawCmdBuffers[i], depthPass.pipelineLayout, cascades[j].descriptorSet, j);
+					renderCascade(drawCmdBuffers[i], j);
 					vkCmdEndRenderPass(drawCmdBuffers[i]);
+					shadowPassStats.renderPasses++;
 				}
 			}
+		}
 
-			/*
-				Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
-			*/
-
-			/*
-				Scene rendering using depth cascades for shadow mapping
-			*/
-
-			{
-				VkClearValue clearValues[2];
-				clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = renderPass;
-				renderPassBeginInfo.framebuffer = frameBuffers[i];
-				renderPassBeginInfo.renderArea.offset.x = 0;
-				renderPassBeginInfo.renderArea.offset.y = 0;
-				renderPassBeginInfo.renderArea.extent.width = width;
-				renderPassBeginInfo.renderArea.extent.height = height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues;
+		/*
+			Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
+		*/
 
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		/*
+			Scene rendering using depth cascades for shadow mapping
+		*/
 
-				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		{
+			VkClearValue clearValues[2];
+			clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
+			clearValues[1].depthStencil = { 1.0f, 0 };
 
-				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = renderPass;
+			renderPassBeginInfo.framebuffer = frameBuffers[i];
+			renderPassBeginInfo.renderArea.offset.x = 0;
+			renderPassBeginInfo.renderArea.offset.y = 0;
+			renderPassBeginInfo.renderArea.extent.width = width;
+			renderPassBeginInfo.renderArea.extent.height = height;
+			renderPassBeginInfo.clearValueCount = 2;
+			renderPassBeginInfo.pClearValues = clearValues;
 
-				// Visualize shadow map cascade
-				if (displayDepthMap) {
-					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.debugShadowMap);
-					PushConstBlock pushConstBlock = {};
-					pushConstBlock.cascadeIndex = displayDepthMapCascadeIndex;
-					vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
-					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-				}
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-				// Render shadowed scene
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
-				renderScene(drawCmdBuffers[i], pipelineLayout, descriptorSet);
+			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
-				drawUI(drawCmdBuffers[i]);
+			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+			// Visualize shadow map cascade
+			if (displayDepthMap) {
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.debugShadowMap);
+				PushConstBlock pushConstBlock = {};
+				pushConstBlock.cascadeIndex = displayDepthMapCascadeIndex;
+				vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 			}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+			// Render shadowed scene
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
+			renderScene(drawCmdBuffers[i], pipelineLayout, descriptorSet);
+
+			drawUI(drawCmdBuffers[i]);
+
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
 		}
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 
 	void loadAssets()
@@ -597,6 +807,13 @@ public:
 		pipelineCI.layout = depthPass.pipelineLayout;
 		pipelineCI.renderPass = depthPass.renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &depthPass.pipeline));
+
+		// Single pass depth map generation
+		if (multiviewSupported) {
+			shaderStages[0] = loadShader(getShadersPath() + "shadowmappingcascade/depthpassmultiview.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+			pipelineCI.renderPass = depthPass.multiviewRenderPass;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &depthPass.multiviewPipeline));
+		}
 	}
 
 	void prepareUniformBuffers()
@@ -657,33 +874,36 @@ public:
 			cascadeSplits[i] = (d - nearClip) / clipRange;
 		}
 
+		// Project frustum corners into world space
+		const glm::mat4 invCam = glm::inverse(camera.matrices.perspective * camera.matrices.view);
+		const glm::vec3 clipCorners[8] = {
+			glm::vec3(-1.0f,  1.0f, 0.0f),
+			glm::vec3( 1.0f,  1.0f, 0.0f),
+			glm::vec3( 1.0f, -1.0f, 0.0f),
+			glm::vec3(-1.0f, -1.0f, 0.0f),
+			glm::vec3(-1.0f,  1.0f,  1.0f),
+			glm::vec3( 1.0f,  1.0f,  1.0f),
+			glm::vec3( 1.0f, -1.0f,  1.0f),
+			glm::vec3(-1.0f, -1.0f,  1.0f),
+		};
+		glm::vec3 cameraFrustumCorners[8];
+		for (uint32_t i = 0; i < 8; i++) {
+			glm::vec4 invCorner = invCam * glm::vec4(clipCorners[i], 1.0f);
+			cameraFrustumCorners[i] = invCorner / invCorner.w;
+		}
+
+		const glm::vec3 lightDir = normalize(-lightPos);
+
 		// Calculate orthographic projection matrix for each cascade
 		float lastSplitDist = 0.0;
 		for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
 			float splitDist = cascadeSplits[i];
 
-			glm::vec3 frustumCorners[8] = {
-				glm::vec3(-1.0f,  1.0f, 0.0f),
-				glm::vec3( 1.0f,  1.0f, 0.0f),
-				glm::vec3( 1.0f, -1.0f, 0.0f),
-				glm::vec3(-1.0f, -1.0f, 0.0f),
-				glm::vec3(-1.0f,  1.0f,  1.0f),
-				glm::vec3( 1.0f,  1.0f,  1.0f),
-				glm::vec3( 1.0f, -1.0f,  1.0f),
-				glm::vec3(-1.0f, -1.0f,  1.0f),
-			};
-
-			// Project frustum corners into world space
-			glm::mat4 invCam = glm::inverse(camera.matrices.perspective * camera.matrices.view);
-			for (uint32_t i = 0; i < 8; i++) {
-				glm::vec4 invCorner = invCam * glm::vec4(frustumCorners[i], 1.0f);
-				frustumCorners[i] = invCorner / invCorner.w;
-			}
-
+			glm::vec3 frustumCorners[8];
 			for (uint32_t i = 0; i < 4; i++) {
-				glm::vec3 dist = frustumCorners[i + 4] - frustumCorners[i];
-				frustumCorners[i + 4] = frustumCorners[i] + (dist * splitDist);
-				frustumCorners[i] = frustumCorners[i] + (dist * lastSplitDist);
+				glm::vec3 dist = cameraFrustumCorners[i + 4] - cameraFrustumCorners[i];
+				frustumCorners[i + 4] = cameraFrustumCorners[i] + (dist * splitDist);
+				frustumCorners[i] = cameraFrustumCorners[i] + (dist * lastSplitDist);
 			}
 
 			// Get frustum center
@@ -698,20 +918,73 @@ public:
 				float distance = glm::length(frustumCorners[i] - frustumCenter);
 				radius = glm::max(radius, distance);
 			}
+
+			// Store split distance in cascade
+			cascades[i].splitDepth = (camera.getNearClip() + splitDist * clipRange) * -1.0f;
+			lastSplitDist = cascadeSplits[i];
+
+			Cascade& cascade = cascades[i];
+			// The nearest cascade is always updated, distant cascades are updated in turns (so at most one of them per frame)
+			// The cached depth can only be reused as long as it covers the camera's current frustum slice and the light hasn't moved noticeably
+			cascade.update = !cacheCascades || cascade.invalid || (i == 0) || ((cascadeFrameIndex + i) % cascadeUpdateInterval == 0);
+			cascade.update |= glm::length(frustumCenter - cascade.center) + radius > cascade.radius;
+			cascade.update |= glm::dot(lightDir, cascade.lightDir) < cos(glm::radians(1.0f));
+			if (!cascade.update) {
+				continue;
+			}
+
+			// Cached cascades cover a slightly larger area, so they stay valid while the camera moves for a few frames
+			if (cacheCascades && (i > 0)) {
+				radius *= 1.15f;
+			}
 			radius = std::ceil(radius * 16.0f) / 16.0f;
 
 			glm::vec3 maxExtents = glm::vec3(radius);
 			glm::vec3 minExtents = -maxExtents;
 
-			glm::vec3 lightDir = normalize(-lightPos);
 			glm::mat4 lightViewMatrix = glm::lookAt(frustumCenter - lightDir * -minExtents.z, frustumCenter, glm::vec3(0.0f, 1.0f, 0.0f));
 			glm::mat4 lightOrthoMatrix = glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, 0.0f, maxExtents.z - minExtents.z);
 
-			// Store split distance and matrix in cascade
-			cascades[i].splitDepth = (camera.getNearClip() + splitDist * clipRange) * -1.0f;
-			cascades[i].viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
+			// Snap the projection to shadow map texels, so shadow edges don't shimmer when the cascade moves with the camera
+			glm::vec4 shadowOrigin = (lightOrthoMatrix * lightViewMatrix) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			shadowOrigin *= SHADOWMAP_DIM / 2.0f;
+			glm::vec4 roundOffset = (glm::round(shadowOrigin) - shadowOrigin) * (2.0f / SHADOWMAP_DIM);
+			lightOrthoMatrix[3][0] += roundOffset.x;
+			lightOrthoMatrix[3][1] += roundOffset.y;
+
+			cascade.viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
+			cascade.center = frustumCenter;
+			cascade.radius = radius;
+			cascade.lightDir = lightDir;
+			cascade.invalid = false;
+
+			// Gather the shadow casters intersecting the cascade
+			// The near plane is ignored, as depth clamping keeps casters between the light and the cascade
+			vks::Frustum frustum;
+			frustum.update(cascade.viewProjMatrix);
+			cascade.visibleCasters.clear();
+			for (uint32_t j = 0; j < shadowCasters.size(); j++) {
+				bool visible = true;
+				for (uint32_t side = vks::Frustum::LEFT; side <= vks::Frustum::BOTTOM; side++) {
+					const glm::vec4& plane = frustum.planes[side];
+					if (glm::dot(glm::vec3(plane), shadowCasters[j].center) + plane.w <= -shadowCasters[j].radius) {
+						visible = false;
+						break;
+					}
+				}
+				if (visible) {
+					cascade.visibleCasters.push_back(j);
+				}
+			}
+		}
+		cascadeFrameIndex++;
+	}
 
-			lastSplitDist = cascadeSplits[i];
+	// Forces all cascades to be re-rendered in the next frame
+	void invalidateCascades()
+	{
+		for (Cascade& cascade : cascades) {
+			cascade.invalid = true;
 		}
 	}
 
@@ -756,6 +1029,13 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The set of cascades to render changes from frame to frame with caching
+		if (cacheCascades) {
+			buildCommandBuffer(currentBuffer);
+			for (Cascade& cascade : cascades) {
+				cascade.update = false;
+			}
+		}
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -766,6 +1046,7 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
+		prepareShadowCasters();
 		updateLight();
 		updateCascades();
 		prepareDepthPass();
@@ -792,6 +1073,7 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			if (overlay->sliderFloat("Split lambda", &cascadeSplitLambda, 0.1f, 1.0f)) {
+				invalidateCascades();
 				updateCascades();
 				updateUniformBuffers();
 			}
@@ -810,6 +1092,24 @@ public:
 				buildCommandBuffers();
 			}
 		}
+		if (overlay->header("Shadow pass")) {
+			if (overlay->checkBox("Cache distant cascades", &cacheCascades)) {
+				invalidateCascades();
+				updateCascades();
+				updateUniformBuffers();
+			}
+			if (cacheCascades) {
+				overlay->sliderInt("Update interval", &cascadeUpdateInterval, 1, 16);
+			}
+			if (multiviewSupported) {
+				if (overlay->checkBox("Single pass (multiview)", &singlePass)) {
+					buildCommandBuffers();
+				}
+			}
+			overlay->text("Cascades rendered: %d", shadowPassStats.cascades);
+			overlay->text("Render passes: %d", shadowPassStats.renderPasses);
+			overlay->text("Draws: %d", shadowPassStats.draws);
+		}
 	}
 };
 
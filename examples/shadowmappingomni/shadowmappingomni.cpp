@@ -1,6 +1,9 @@
 /*
 * Vulkan Example - Omni directional shadows using a dynamic cube map
 *
+* The cube map is rendered in a single pass using multiview (VK_KHR_multiview) if supported, with one render pass per face as the fallback
+* Primitives are culled against the frusta of the six faces, so they're only rasterized for the faces they actually cover
+*
 * Copyright (C) by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -8,6 +11,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "frustum.hpp"
 
 #define ENABLE_VALIDATION false
 
@@ -23,6 +27,9 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool displayCubeMap = false;
+	// Render all cube map faces in a single multiview pass
+	bool singlePass = true;
+	bool multiviewSupported = false;
 
 	float zNear = 0.1f;
 	float zFar = 1024.0f;
@@ -51,17 +58,40 @@ public:
 		glm::vec4 lightPos;
 	};
 
-	UBO uboVSscene, uboOffscreenVS;
+	UBO uboVSscene;
+
+	struct UBOOffscreen : UBO {
+		// View matrices of all cube map faces, indexed by the view index in the single pass path
+		glm::mat4 faceViews[6];
+	} uboOffscreenVS;
+
+	// World space bounds of a scene primitive and the mask of the cube map faces whose frustum they intersect
+	struct ShadowCaster {
+		const vkglTF::Primitive* primitive;
+		glm::vec3 center;
+		float radius;
+		uint32_t faceMask;
+	};
+	std::vector<ShadowCaster> shadowCasters;
+	bool faceMasksChanged = false;
+
+	struct {
+		uint32_t renderPasses = 0;
+		uint32_t draws = 0;
+		uint32_t faceDraws = 0;
+	} shadowPassStats;
 
 	struct {
 		VkPipeline scene;
 		VkPipeline offscreen;
+		VkPipeline offscreenMultiview;
 		VkPipeline cubemapDisplay;
 	} pipelines;
 
 	struct {
 		VkPipelineLayout scene;
 		VkPipelineLayout offscreen;
+		VkPipelineLayout offscreenMultiview;
 	} pipelineLayouts;
 
 	struct {
@@ -73,24 +103,31 @@ public:
 
 	vks::Texture shadowCubeMap;
 	std::array<VkImageView, 6> shadowCubeMapFaceImageViews;
+	// All six faces as a layered attachment for multiview
+	VkImageView shadowCubeMapArrayView;
 
 	// Framebuffer for offscreen rendering
 	struct FrameBufferAttachment {
 		VkImage image;
 		VkDeviceMemory mem;
 		VkImageView view;
+		VkImageView arrayView;
 	};
 	struct OffscreenPass {
 		int32_t width, height;
 		std::array<VkFramebuffer, 6> frameBuffers;
+		VkFramebuffer multiviewFrameBuffer;
 		FrameBufferAttachment depth;
 		VkRenderPass renderPass;
+		VkRenderPass multiviewRenderPass;
 		VkSampler sampler;
 		VkDescriptorImageInfo descriptor;
 	} offscreenPass;
 
 	VkFormat fbDepthFormat;
 
+	VkPhysicalDeviceMultiviewFeaturesKHR physicalDeviceMultiviewFeatures{};
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Point light shadows (cubemap)";
@@ -99,6 +136,8 @@ public:
 		camera.setRotation(glm::vec3(-20.5f, -673.0f, 0.0f));
 		camera.setPosition(glm::vec3(0.0f, 0.5f, -15.0f));
 		timerSpeed *= 0.5f;
+		// Required to enable multiview on Vulkan 1.0 devices
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	}
 
 	~VulkanExample()
@@ -113,12 +152,14 @@ public:
 		}
 
 		vkDestroyImageView(device, shadowCubeMap.view, nullptr);
+		vkDestroyImageView(device, shadowCubeMapArrayView, nullptr);
 		vkDestroyImage(device, shadowCubeMap.image, nullptr);
 		vkDestroySampler(device, shadowCubeMap.sampler, nullptr);
 		vkFreeMemory(device, shadowCubeMap.deviceMemory, nullptr);
 
 		// Depth attachment
 		vkDestroyImageView(device, offscreenPass.depth.view, nullptr);
+		vkDestroyImageView(device, offscreenPass.depth.arrayView, nullptr);
 		vkDestroyImage(device, offscreenPass.depth.image, nullptr);
 		vkFreeMemory(device, offscreenPass.depth.mem, nullptr);
 
@@ -129,6 +170,13 @@ public:
 
 		vkDestroyRenderPass(device, offscreenPass.renderPass, nullptr);
 
+		if (multiviewSupported) {
+			vkDestroyFramebuffer(device, offscreenPass.multiviewFrameBuffer, nullptr);
+			vkDestroyRenderPass(device, offscreenPass.multiviewRenderPass, nullptr);
+			vkDestroyPipeline(device, pipelines.offscreenMultiview, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayouts.offscreenMultiview, nullptr);
+		}
+
 		// Pipelines
 		vkDestroyPipeline(device, pipelines.scene, nullptr);
 		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
@@ -144,6 +192,19 @@ public:
 		uniformBuffers.scene.destroy();
 	}
 
+	virtual void getEnabledExtensions()
+	{
+		// Multiview is optional, the cube map faces are rendered one by one if it's not available
+		multiviewSupported = vulkanDevice->extensionSupported(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+		if (multiviewSupported) {
+			enabledDeviceExtensions.push_back(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+			physicalDeviceMultiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES_KHR;
+			physicalDeviceMultiviewFeatures.multiview = VK_TRUE;
+			deviceCreatepNextChain = &physicalDeviceMultiviewFeatures;
+		}
+		singlePass = multiviewSupported;
+	}
+
 	void prepareCubeMap()
 	{
 		shadowCubeMap.width = TEX_DIM;
@@ -232,11 +293,15 @@ public:
 			view.subresourceRange.baseArrayLayer = i;
 			VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &shadowCubeMapFaceImageViews[i]));
 		}
+
+		view.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		view.subresourceRange.baseArrayLayer = 0;
+		view.subresourceRange.layerCount = 6;
+		VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &shadowCubeMapArrayView));
 	}
 
-	// Prepare a new framebuffer for offscreen rendering
-	// The contents of this framebuffer are then
-	// copied to the different cube map faces
+	// Prepare the framebuffers for offscreen rendering
+	// Faces are rendered directly to the cube map layers, either with one framebuffer per face or with a single layered multiview framebuffer
 	void prepareOffscreenFramebuffer()
 	{
 		offscreenPass.width = FB_DIM;
@@ -274,8 +339,10 @@ public:
 		VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
 		// Depth stencil attachment
+		// One layer per view for multiview, rendering one face at a time only uses the first layer
 		imageCreateInfo.format = fbDepthFormat;
 		imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageCreateInfo.arrayLayers = 6;
 
 		VkImageViewCreateInfo depthStencilView = vks::initializers::imageViewCreateInfo();
 		depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -304,15 +371,19 @@ public:
 		vks::tools::setImageLayout(
 			layoutCmd,
 			offscreenPass.depth.image,
-			VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
 			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			{ depthStencilView.subresourceRange.aspectMask, 0, 1, 0, 6 });
 
 		vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
 
 		depthStencilView.image = offscreenPass.depth.image;
 		VK_CHECK_RESULT(vkCreateImageView(device, &depthStencilView, nullptr, &offscreenPass.depth.view));
 
+		depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		depthStencilView.subresourceRange.layerCount = 6;
+		VK_CHECK_RESULT(vkCreateImageView(device, &depthStencilView, nullptr, &offscreenPass.depth.arrayView));
+
 		VkImageView attachments[2];
 		attachments[1] = offscreenPass.depth.view;
 
@@ -329,28 +400,18 @@ public:
 			attachments[0] = shadowCubeMapFaceImageViews[i];
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenPass.frameBuffers[i]));
 		}
+
+		// The multiview framebuffer has a single layer, the view mask of the render pass selects the attachment layers
+		if (multiviewSupported) {
+			attachments[0] = shadowCubeMapArrayView;
+			attachments[1] = offscreenPass.depth.arrayView;
+			fbufCreateInfo.renderPass = offscreenPass.multiviewRenderPass;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenPass.multiviewFrameBuffer));
+		}
 	}
 
-	// Updates a single cube map face
-	// Renders the scene with face's view directly to the cubemap layer `faceIndex`
-	// Uses push constants for quick update of view matrix for the current cube map face
-	void updateCubeFace(uint32_t faceIndex, VkCommandBuffer commandBuffer)
+	glm::mat4 getCubeFaceViewMatrix(uint32_t faceIndex)
 	{
-		VkClearValue clearValues[2];
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-		clearValues[1].depthStencil = { 1.0f, 0 };
-
-		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		// Reuse render pass from example pass
-		renderPassBeginInfo.renderPass = offscreenPass.renderPass;
-		renderPassBeginInfo.framebuffer = offscreenPass.frameBuffers[faceIndex];
-		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
-		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValues;
-
-		// Update view matrix via push constant
-
 		glm::mat4 viewMatrix = glm::mat4(1.0f);
 		switch (faceIndex)
 		{
@@ -375,8 +436,122 @@ public:
 			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 			break;
 		}
+		return viewMatrix;
+	}
+
+	// Gathers the world space bounds of all scene primitives for culling against the cube map faces
+	void prepareShadowCasters()
+	{
+		for (vkglTF::Node* node : models.scene.linearNodes) {
+			if (!node->mesh) {
+				continue;
+			}
+			const glm::mat4 nodeMatrix = node->getMatrix();
+			for (const vkglTF::Primitive* primitive : node->mesh->primitives) {
+				glm::vec3 min = glm::vec3(FLT_MAX);
+				glm::vec3 max = glm::vec3(-FLT_MAX);
+				for (uint32_t i = 0; i < 8; i++) {
+					const glm::vec3 corner = glm::vec3(
+						(i & 1) ? primitive->dimensions.max.x : primitive->dimensions.min.x,
+						(i & 2) ? primitive->dimensions.max.y : primitive->dimensions.min.y,
+						(i & 4) ? primitive->dimensions.max.z : primitive->dimensions.min.z);
+					// Same transform as applied to the vertices at load time (pre-transform and flip y)
+					glm::vec3 transformed = glm::vec3(nodeMatrix * glm::vec4(corner, 1.0f));
+					transformed.y *= -1.0f;
+					min = glm::min(min, transformed);
+					max = glm::max(max, transformed);
+				}
+				ShadowCaster shadowCaster{};
+				shadowCaster.primitive = primitive;
+				shadowCaster.center = (min + max) * 0.5f;
+				shadowCaster.radius = glm::length(max - min) * 0.5f;
+				shadowCaster.faceMask = 0x3f;
+				shadowCasters.push_back(shadowCaster);
+			}
+		}
+	}
+
+	// Tests all primitives against the frusta of the six faces at the current light position
+	void updateFaceMasks()
+	{
+		std::array<vks::Frustum, 6> faceFrusta;
+		for (uint32_t face = 0; face < 6; face++) {
+			faceFrusta[face].update(uboOffscreenVS.projection * uboOffscreenVS.faceViews[face] * uboOffscreenVS.model);
+		}
+		for (ShadowCaster& shadowCaster : shadowCasters) {
+			uint32_t faceMask = 0;
+			for (uint32_t face = 0; face < 6; face++) {
+				if (faceFrusta[face].checkSphere(shadowCaster.center, shadowCaster.radius)) {
+					faceMask |= 1 << face;
+				}
+			}
+			if (faceMask != shadowCaster.faceMask) {
+				shadowCaster.faceMask = faceMask;
+				faceMasksChanged = true;
+			}
+		}
+	}
+
+	void drawShadowCaster(VkCommandBuffer commandBuffer, const ShadowCaster& shadowCaster)
+	{
+		vkCmdDrawIndexed(commandBuffer, shadowCaster.primitive->indexCount, 1, models.scene.getFirstIndex() + shadowCaster.primitive->firstIndex, models.scene.getVertexOffset(), 0);
+		shadowPassStats.draws++;
+	}
+
+	// Updates all cube map faces in a single multiview render pass
+	// Primitives outside of all faces are skipped, for the others the vertex shader discards the views not in their face mask
+	void updateCubeFaces(VkCommandBuffer commandBuffer)
+	{
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = offscreenPass.multiviewRenderPass;
+		renderPassBeginInfo.framebuffer = offscreenPass.multiviewFrameBuffer;
+		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreenMultiview);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.offscreenMultiview, 0, 1, &descriptorSets.offscreen, 0, NULL);
+		models.scene.bindBuffers(commandBuffer);
+		for (const ShadowCaster& shadowCaster : shadowCasters) {
+			if (shadowCaster.faceMask == 0) {
+				continue;
+			}
+			vkCmdPushConstants(commandBuffer, pipelineLayouts.offscreenMultiview, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &shadowCaster.faceMask);
+			drawShadowCaster(commandBuffer, shadowCaster);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+		shadowPassStats.renderPasses++;
+	}
+
+	// Updates a single cube map face
+	// Renders the scene with face's view directly to the cubemap layer `faceIndex`
+	// Uses push constants for quick update of view matrix for the current cube map face
+	void updateCubeFace(uint32_t faceIndex, VkCommandBuffer commandBuffer)
+	{
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		// Reuse render pass from example pass
+		renderPassBeginInfo.renderPass = offscreenPass.renderPass;
+		renderPassBeginInfo.framebuffer = offscreenPass.frameBuffers[faceIndex];
+		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
+		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		// Update view matrix via push constant
+		glm::mat4 viewMatrix = getCubeFaceViewMatrix(faceIndex);
 
-		// Render scene from cube face's point of view
 		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		// Update shader push constant block
@@ -391,21 +566,38 @@ public:
 
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
 		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.offscreen, 0, 1, &descriptorSets.offscreen, 0, NULL);
-		models.scene.draw(commandBuffer);
+		models.scene.bindBuffers(commandBuffer);
+		for (const ShadowCaster& shadowCaster : shadowCasters) {
+			if (shadowCaster.faceMask & (1 << faceIndex)) {
+				drawShadowCaster(commandBuffer, shadowCaster);
+			}
+		}
 
 		vkCmdEndRenderPass(commandBuffer);
+		shadowPassStats.renderPasses++;
 	}
 
 	void buildCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
+		faceMasksChanged = false;
+		shadowPassStats.faceDraws = 0;
+		for (const ShadowCaster& shadowCaster : shadowCasters) {
+			for (uint32_t face = 0; face < 6; face++) {
+				shadowPassStats.faceDraws += (shadowCaster.faceMask >> face) & 1;
+			}
+		}
+
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			shadowPassStats.renderPasses = 0;
+			shadowPassStats.draws = 0;
+
 			/*
-				Generate shadow cube maps using one render pass per face
+				Generate shadow cube maps in a single multiview pass or using one render pass per face
 			*/
 			{
 				VkViewport viewport = vks::initializers::viewport((float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
@@ -414,8 +606,12 @@ public:
 				VkRect2D scissor = vks::initializers::rect2D(offscreenPass.width, offscreenPass.height, 0, 0);
 				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-				for (uint32_t face = 0; face < 6; face++) {
-					updateCubeFace(face, drawCmdBuffers[i]);
+				if (singlePass) {
+					updateCubeFaces(drawCmdBuffers[i]);
+				} else {
+					for (uint32_t face = 0; face < 6; face++) {
+						updateCubeFace(face, drawCmdBuffers[i]);
+					}
 				}
 			}
 
@@ -513,6 +709,13 @@ public:
 		pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
 		pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayouts.offscreen));
+
+		// Single pass offscreen pipeline layout
+		// Push constant for the face mask of the current primitive
+		if (multiviewSupported) {
+			pushConstantRange.size = sizeof(uint32_t);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayouts.offscreenMultiview));
+		}
 	}
 
 	void setupDescriptorSets()
@@ -597,6 +800,23 @@ public:
 		renderPassCreateInfo.pSubpasses = &subpass;
 
 		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &offscreenPass.renderPass));
+
+		if (multiviewSupported) {
+			// Broadcast the subpass to all six cube map faces (attachment layers)
+			const uint32_t viewMask = 0b00111111;
+			// Faces look in different directions and share almost no visible geometry, so they're not correlated
+			const uint32_t correlationMask = 0;
+
+			VkRenderPassMultiviewCreateInfoKHR renderPassMultiviewCI{};
+			renderPassMultiviewCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO_KHR;
+			renderPassMultiviewCI.subpassCount = 1;
+			renderPassMultiviewCI.pViewMasks = &viewMask;
+			renderPassMultiviewCI.correlationMaskCount = 1;
+			renderPassMultiviewCI.pCorrelationMasks = &correlationMask;
+
+			renderPassCreateInfo.pNext = &renderPassMultiviewCI;
+			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &offscreenPass.multiviewRenderPass));
+		}
 	}
 
 	void preparePipelines()
@@ -638,6 +858,14 @@ public:
 		pipelineCI.renderPass = offscreenPass.renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreen));
 
+		// Single pass offscreen pipeline
+		if (multiviewSupported) {
+			shaderStages[0] = loadShader(getShadersPath() + "shadowmappingomni/offscreenmultiview.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+			pipelineCI.layout = pipelineLayouts.offscreenMultiview;
+			pipelineCI.renderPass = offscreenPass.multiviewRenderPass;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreenMultiview));
+		}
+
 		// Cube map display pipeline
 		shaderStages[0] = loadShader(getShadersPath() + "shadowmappingomni/cubemapdisplay.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "shadowmappingomni/cubemapdisplay.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -691,7 +919,11 @@ public:
 		uboOffscreenVS.view = glm::mat4(1.0f);
 		uboOffscreenVS.model = glm::translate(glm::mat4(1.0f), glm::vec3(-lightPos.x, -lightPos.y, -lightPos.z));
 		uboOffscreenVS.lightPos = lightPos;
+		for (uint32_t face = 0; face < 6; face++) {
+			uboOffscreenVS.faceViews[face] = getCubeFaceViewMatrix(face);
+		}
 		memcpy(uniformBuffers.offscreen.mapped, &uboOffscreenVS, sizeof(uboOffscreenVS));
+		updateFaceMasks();
 	}
 
 	void draw()
@@ -707,6 +939,7 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
+		prepareShadowCasters();
 		prepareUniformBuffers();
 		prepareCubeMap();
 		setupDescriptorSetLayout();
@@ -729,6 +962,10 @@ public:
 			updateUniformBufferOffscreen();
 			updateUniformBuffers();
 		}
+		// Primitives moved into or out of cube map faces with the light
+		if (faceMasksChanged) {
+			buildCommandBuffers();
+		}
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -737,6 +974,16 @@ public:
 			if (overlay->checkBox("Display shadow cube render target", &displayCubeMap)) {
 				buildCommandBuffers();
 			}
+			if (multiviewSupported) {
+				if (overlay->checkBox("Single pass (multiview)", &singlePass)) {
+					buildCommandBuffers();
+				}
+			}
+		}
+		if (overlay->header("Shadow pass")) {
+			overlay->text("Render passes: %d", shadowPassStats.renderPasses);
+			overlay->text("Draw calls: %d", shadowPassStats.draws);
+			overlay->text("Face draws: %d / %d", shadowPassStats.faceDraws, (uint32_t)shadowCasters.size() * 6);
 		}
 	}
 };
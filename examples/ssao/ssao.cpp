@@ -8,11 +8,14 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanRenderGraph.h"
 
 #define ENABLE_VALIDATION false
 
 #define SSAO_KERNEL_SIZE 64
 #define SSAO_RADIUS 0.3f
+// Samples per pixel and frame in the reduced resolution modes, consecutive frames use different parts of the kernel
+#define SSAO_REDUCED_KERNEL_SIZE 16
 
 #if defined(__ANDROID__)
 #define SSAO_NOISE_DIM 8
@@ -42,13 +45,37 @@ public:
 		int32_t ssao = true;
 		int32_t ssaoOnly = false;
 		int32_t ssaoBlur = true;
+		// First kernel sample and rotation of the kernel around the normal for the current frame
+		int32_t kernelOffset = 0;
+		float kernelRotation = 0.0f;
 	} uboSSAOParams;
 
+	// The reduced resolution modes compute the SSAO from a downsampled G-Buffer with a fraction of the kernel per frame,
+	// accumulate it over several frames and upsample the result with depth aware weights
+	enum SSAOResolution { Full = 0, Half = 1, Quarter = 2 };
+	int32_t ssaoResolution = Full;
+
+	struct UBOReducedParams {
+		glm::mat4 viewToPreviousView;
+		glm::mat4 previousProjection;
+		float historyWeight = 0.9f;
+		int32_t reset = true;
+		int32_t factor = 2;
+	} uboReducedParams;
+	// View of the frame that wrote the history
+	glm::mat4 previousView;
+	bool historyValid = false;
+	uint32_t frameIndex = 0;
+
 	struct {
 		VkPipeline offscreen;
 		VkPipeline composition;
 		VkPipeline ssao;
 		VkPipeline ssaoBlur;
+		VkPipeline downsample;
+		VkPipeline ssaoReduced;
+		VkPipeline temporal;
+		VkPipeline upsample;
 	} pipelines;
 
 	struct {
@@ -56,15 +83,20 @@ public:
 		VkPipelineLayout ssao;
 		VkPipelineLayout ssaoBlur;
 		VkPipelineLayout composition;
+		VkPipelineLayout reduced;
 	} pipelineLayouts;
 
 	struct {
-		const uint32_t count = 5;
+		const uint32_t count = 9;
 		VkDescriptorSet model;
 		VkDescriptorSet floor;
 		VkDescriptorSet ssao;
 		VkDescriptorSet ssaoBlur;
 		VkDescriptorSet composition;
+		VkDescriptorSet downsample;
+		VkDescriptorSet ssaoReduced;
+		VkDescriptorSet temporal;
+		VkDescriptorSet upsample;
 	} descriptorSets;
 
 	struct {
@@ -72,55 +104,69 @@ public:
 		VkDescriptorSetLayout ssao;
 		VkDescriptorSetLayout ssaoBlur;
 		VkDescriptorSetLayout composition;
+		// Shared by the downsample, temporal accumulation and upsample passes
+		VkDescriptorSetLayout reduced;
 	} descriptorSetLayouts;
 
 	struct {
 		vks::Buffer sceneParams;
 		vks::Buffer ssaoKernel;
 		vks::Buffer ssaoParams;
+		vks::Buffer reducedParams;
 	} uniformBuffers;
 
-	// Framebuffer for offscreen rendering
-	struct FrameBufferAttachment {
-		VkImage image;
-		VkDeviceMemory mem;
-		VkImageView view;
-		VkFormat format;
-		void destroy(VkDevice device)
-		{
-			vkDestroyImage(device, image, nullptr);
-			vkDestroyImageView(device, view, nullptr);
-			vkFreeMemory(device, mem, nullptr);
-		}
-	};
-	struct FrameBuffer {
-		int32_t width, height;
-		VkFramebuffer frameBuffer;
-		VkRenderPass renderPass;
-		void setSize(int32_t w, int32_t h)
-		{
-			this->width = w;
-			this->height = h;
-		}
-		void destroy(VkDevice device)
-		{
-			vkDestroyFramebuffer(device, frameBuffer, nullptr);
-			vkDestroyRenderPass(device, renderPass, nullptr);
-		}
-	};
-
+	// The offscreen passes and their attachments are managed by a render graph, which also places the barriers between the passes
+	// and lets attachments with non-overlapping lifetimes (e.g. the G-Buffer depth and the unblurred SSAO target) share memory
+	vks::RenderGraph* renderGraph = nullptr;
+	struct {
+		vks::RenderGraph::ImageHandle position;
+		vks::RenderGraph::ImageHandle normal;
+		vks::RenderGraph::ImageHandle albedo;
+		vks::RenderGraph::ImageHandle depth;
+		vks::RenderGraph::ImageHandle ssao;
+		vks::RenderGraph::ImageHandle ssaoBlur;
+		vks::RenderGraph::ImageHandle positionReduced;
+		vks::RenderGraph::ImageHandle normalReduced;
+		vks::RenderGraph::ImageHandle ssaoReduced;
+		vks::RenderGraph::ImageHandle ssaoAccumulated;
+		vks::RenderGraph::ImageHandle ssaoUpsampled;
+	} attachments;
 	struct {
-		struct Offscreen : public FrameBuffer {
-			FrameBufferAttachment position, normal, albedo, depth;
-		} offscreen;
-		struct SSAO : public FrameBuffer {
-			FrameBufferAttachment color;
-		} ssao, ssaoBlur;
-	} frameBuffers;
+		vks::RenderGraph::PassHandle gBuffer;
+		vks::RenderGraph::PassHandle ssao;
+		vks::RenderGraph::PassHandle ssaoBlur;
+		vks::RenderGraph::PassHandle downsample;
+		vks::RenderGraph::PassHandle ssaoReduced;
+		vks::RenderGraph::PassHandle temporal;
+		vks::RenderGraph::PassHandle upsample;
+	} passes;
+
+	// The accumulated SSAO of the previous frame, needs to persist between frames so it lives outside of the render graph
+	struct {
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkExtent2D extent{};
+	} ssaoHistory;
 
 	// One sampler for the frame buffer color attachments
 	VkSampler colorSampler;
 
+	// GPU times of the G-Buffer pass and of all SSAO passes, measured with three timestamps per command buffer:
+	// before the graph, at the end of the G-Buffer pass and after the graph (including the history copy)
+	struct {
+		bool supported = false;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		float timestampPeriod = 1.0f;
+		uint64_t timestampMask = ~0ULL;
+		// First query of the command buffer currently being recorded, used by the G-Buffer pass
+		uint32_t queryBase = 0;
+		// Exponential moving averages in ms
+		float gBufferTime = 0.0f;
+		float ssaoTime = 0.0f;
+		uint32_t sampleCount = 0;
+	} timing;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Screen space ambient occlusion";
@@ -136,39 +182,40 @@ public:
 	~VulkanExample()
 	{
 		vkDestroySampler(device, colorSampler, nullptr);
+		if (timing.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, timing.queryPool, nullptr);
+		}
 
-		// Attachments
-		frameBuffers.offscreen.position.destroy(device);
-		frameBuffers.offscreen.normal.destroy(device);
-		frameBuffers.offscreen.albedo.destroy(device);
-		frameBuffers.offscreen.depth.destroy(device);
-		frameBuffers.ssao.color.destroy(device);
-		frameBuffers.ssaoBlur.color.destroy(device);
-
-		// Framebuffers
-		frameBuffers.offscreen.destroy(device);
-		frameBuffers.ssao.destroy(device);
-		frameBuffers.ssaoBlur.destroy(device);
+		// Attachments, render passes and framebuffers
+		delete renderGraph;
+		destroySSAOHistory();
 
 		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
 		vkDestroyPipeline(device, pipelines.composition, nullptr);
 		vkDestroyPipeline(device, pipelines.ssao, nullptr);
 		vkDestroyPipeline(device, pipelines.ssaoBlur, nullptr);
+		vkDestroyPipeline(device, pipelines.downsample, nullptr);
+		vkDestroyPipeline(device, pipelines.ssaoReduced, nullptr);
+		vkDestroyPipeline(device, pipelines.temporal, nullptr);
+		vkDestroyPipeline(device, pipelines.upsample, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayouts.gBuffer, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayouts.ssao, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayouts.ssaoBlur, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayouts.composition, nullptr);
+		vkDestroyPipelineLayout(device, pipelineLayouts.reduced, nullptr);
 
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.gBuffer, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssao, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssaoBlur, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.composition, nullptr);
+		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.reduced, nullptr);
 
 		// Uniform buffers
 		uniformBuffers.sceneParams.destroy();
 		uniformBuffers.ssaoKernel.destroy();
 		uniformBuffers.ssaoParams.destroy();
+		uniformBuffers.reducedParams.destroy();
 
 		textures.ssaoNoise.destroy();
 	}
@@ -178,69 +225,42 @@ public:
 		enabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
 	}
 
-	// Create a frame buffer attachment
-	void createAttachment(
-		VkFormat format,
-		VkImageUsageFlagBits usage,
-		FrameBufferAttachment *attachment,
-		uint32_t width,
-		uint32_t height)
+	// Downsampling factor of the reduced resolution modes
+	uint32_t getReductionFactor()
 	{
-		VkImageAspectFlags aspectMask = 0;
-
-		attachment->format = format;
-
-		if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-		{
-			aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		}
-		if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
-		{
-			aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			if (format >= VK_FORMAT_D16_UNORM_S8_UINT)
-				aspectMask |=VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-
-		assert(aspectMask > 0);
-
-		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
-		image.imageType = VK_IMAGE_TYPE_2D;
-		image.format = format;
-		image.extent.width = width;
-		image.extent.height = height;
-		image.extent.depth = 1;
-		image.mipLevels = 1;
-		image.arrayLayers = 1;
-		image.samples = VK_SAMPLE_COUNT_1_BIT;
-		image.tiling = VK_IMAGE_TILING_OPTIMAL;
-		image.usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT;
+		return (ssaoResolution == Quarter) ? 4 : 2;
+	}
 
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
+	VkExtent2D getReducedExtent()
+	{
+		const uint32_t factor = getReductionFactor();
+		return { std::max((width + factor - 1) / factor, 1u), std::max((height + factor - 1) / factor, 1u) };
+	}
 
-		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &attachment->image));
-		vkGetImageMemoryRequirements(device, attachment->image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment->mem));
-		VK_CHECK_RESULT(vkBindImageMemory(device, attachment->image, attachment->mem, 0));
+	void prepareRenderGraph()
+	{
+		renderGraph = new vks::RenderGraph(vulkanDevice);
+		buildRenderGraph();
 
-		VkImageViewCreateInfo imageView = vks::initializers::imageViewCreateInfo();
-		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageView.format = format;
-		imageView.subresourceRange = {};
-		imageView.subresourceRange.aspectMask = aspectMask;
-		imageView.subresourceRange.baseMipLevel = 0;
-		imageView.subresourceRange.levelCount = 1;
-		imageView.subresourceRange.baseArrayLayer = 0;
-		imageView.subresourceRange.layerCount = 1;
-		imageView.image = attachment->image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &attachment->view));
+		// Shared sampler used for all color attachments
+		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
+		sampler.magFilter = VK_FILTER_NEAREST;
+		sampler.minFilter = VK_FILTER_NEAREST;
+		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.addressModeV = sampler.addressModeU;
+		sampler.addressModeW = sampler.addressModeU;
+		sampler.mipLodBias = 0.0f;
+		sampler.maxAnisotropy = 1.0f;
+		sampler.minLod = 0.0f;
+		sampler.maxLod = 1.0f;
+		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &colorSampler));
 	}
 
-	void prepareOffscreenFramebuffers()
+	// Declares and compiles all passes, attachment sizes depend on the window size and the SSAO resolution
+	void buildRenderGraph()
 	{
-		// Attachments
 #if defined(__ANDROID__)
 		const uint32_t ssaoWidth = width / 2;
 		const uint32_t ssaoHeight = height / 2;
@@ -248,239 +268,273 @@ public:
 		const uint32_t ssaoWidth = width;
 		const uint32_t ssaoHeight = height;
 #endif
-
-		frameBuffers.offscreen.setSize(width, height);
-		frameBuffers.ssao.setSize(ssaoWidth, ssaoHeight);
-		frameBuffers.ssaoBlur.setSize(width, height);
+		const VkExtent2D reducedExtent = getReducedExtent();
 
 		// Find a suitable depth format
 		VkFormat attDepthFormat;
 		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &attDepthFormat);
 		assert(validDepthFormat);
 
-		// G-Buffer
-		createAttachment(VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.position, width, height);	// Position + Depth
-		createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.normal, width, height);			// Normals
-		createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.albedo, width, height);			// Albedo (color)
-		createAttachment(attDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, &frameBuffers.offscreen.depth, width, height);			// Depth
+		renderGraph->destroy();
+
+		// Usage flags, layouts and lifetimes of the attachments are derived from the passes they are used in
+		attachments.position = renderGraph->addImage("position", VK_FORMAT_R32G32B32A32_SFLOAT, width, height);	// Position + Depth
+		attachments.normal = renderGraph->addImage("normal", VK_FORMAT_R8G8B8A8_UNORM, width, height);				// Normals
+		attachments.albedo = renderGraph->addImage("albedo", VK_FORMAT_R8G8B8A8_UNORM, width, height);				// Albedo (color)
+		attachments.depth = renderGraph->addImage("depth", attDepthFormat, width, height);							// Depth
+		attachments.ssao = renderGraph->addImage("ssao", VK_FORMAT_R8_UNORM, ssaoWidth, ssaoHeight);
+		attachments.ssaoBlur = renderGraph->addImage("ssao blur", VK_FORMAT_R8_UNORM, width, height);
+		// Reduced resolution modes
+		attachments.positionReduced = renderGraph->addImage("position (reduced)", VK_FORMAT_R32G32B32A32_SFLOAT, reducedExtent.width, reducedExtent.height);
+		attachments.normalReduced = renderGraph->addImage("normal (reduced)", VK_FORMAT_R8G8B8A8_UNORM, reducedExtent.width, reducedExtent.height);
+		attachments.ssaoReduced = renderGraph->addImage("ssao (reduced)", VK_FORMAT_R8_UNORM, reducedExtent.width, reducedExtent.height);
+		attachments.ssaoAccumulated = renderGraph->addImage("ssao accumulated", VK_FORMAT_R16G16_SFLOAT, reducedExtent.width, reducedExtent.height);	// Occlusion + linear depth
+		attachments.ssaoUpsampled = renderGraph->addImage("ssao upsampled", VK_FORMAT_R8_UNORM, width, height);
+		// The accumulated SSAO is copied to the history after the graph has been executed
+		renderGraph->addExternalUsage(attachments.ssaoAccumulated, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+		/*
+			First pass: Fill G-Buffer components (positions+depth, normals, albedo) using MRT
+		*/
+		passes.gBuffer = renderGraph->addPass("G-Buffer", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.gBuffer, 0, 1, &descriptorSets.floor, 0, NULL);
+			scene.draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayouts.gBuffer);
+			writeTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timing.queryBase + 1);
+		});
+		renderGraph->writeColor(passes.gBuffer, attachments.position);
+		renderGraph->writeColor(passes.gBuffer, attachments.normal);
+		renderGraph->writeColor(passes.gBuffer, attachments.albedo);
+		renderGraph->writeDepth(passes.gBuffer, attachments.depth);
+
+		/*
+			Second pass: SSAO generation
+		*/
+		passes.ssao = renderGraph->addPass("SSAO", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssao, 0, 1, &descriptorSets.ssao, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssao);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph->read(passes.ssao, attachments.position);
+		renderGraph->read(passes.ssao, attachments.normal);
+		renderGraph->writeColor(passes.ssao, attachments.ssao);
+
+		/*
+			Third pass: SSAO blur
+		*/
+		passes.ssaoBlur = renderGraph->addPass("SSAO blur", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssaoBlur, 0, 1, &descriptorSets.ssaoBlur, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoBlur);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph->read(passes.ssaoBlur, attachments.ssao);
+		renderGraph->writeColor(passes.ssaoBlur, attachments.ssaoBlur);
+
+		/*
+			Reduced resolution modes, replace the second and third pass
+		*/
+
+		// Keep the closest position and normal of each block of G-Buffer texels
+		passes.downsample = renderGraph->addPass("G-Buffer downsample", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.reduced, 0, 1, &descriptorSets.downsample, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.downsample);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph->read(passes.downsample, attachments.position);
+		renderGraph->read(passes.downsample, attachments.normal);
+		renderGraph->writeColor(passes.downsample, attachments.positionReduced);
+		renderGraph->writeColor(passes.downsample, attachments.normalReduced);
+
+		// SSAO generation with this frame's part of the kernel
+		passes.ssaoReduced = renderGraph->addPass("SSAO (reduced)", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssao, 0, 1, &descriptorSets.ssaoReduced, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoReduced);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph->read(passes.ssaoReduced, attachments.positionReduced);
+		renderGraph->read(passes.ssaoReduced, attachments.normalReduced);
+		renderGraph->writeColor(passes.ssaoReduced, attachments.ssaoReduced);
+
+		// Blend with the reprojected history, replaces the blur
+		passes.temporal = renderGraph->addPass("SSAO temporal accumulation", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.reduced, 0, 1, &descriptorSets.temporal, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.temporal);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph->read(passes.temporal, attachments.ssaoReduced);
+		renderGraph->read(passes.temporal, attachments.positionReduced);
+		renderGraph->writeColor(passes.temporal, attachments.ssaoAccumulated);
+
+		// Depth aware upsampling to the full resolution
+		passes.upsample = renderGraph->addPass("SSAO upsample", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.reduced, 0, 1, &descriptorSets.upsample, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.upsample);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph->read(passes.upsample, attachments.position);
+		renderGraph->read(passes.upsample, attachments.ssaoAccumulated);
+		renderGraph->writeColor(passes.upsample, attachments.ssaoUpsampled);
+
+		updateRenderGraphOutputs();
+		renderGraph->compile();
+	}
 
-		// SSAO
-		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssao.color, ssaoWidth, ssaoHeight);				// Color
+	// The final composition samples the G-Buffer and either the blurred, the unblurred or the upsampled SSAO target, passes producing
+	// targets the composition doesn't use are culled by the render graph
+	void updateRenderGraphOutputs()
+	{
+		const bool ssaoUsed = uboSSAOParams.ssao || uboSSAOParams.ssaoOnly;
+		const bool reduced = ssaoResolution != Full;
+		renderGraph->setExported(attachments.position, true);
+		renderGraph->setExported(attachments.normal, true);
+		renderGraph->setExported(attachments.albedo, true);
+		renderGraph->setExported(attachments.ssao, ssaoUsed && !reduced && !uboSSAOParams.ssaoBlur);
+		renderGraph->setExported(attachments.ssaoBlur, ssaoUsed && !reduced && uboSSAOParams.ssaoBlur);
+		renderGraph->setExported(attachments.ssaoAccumulated, ssaoUsed && reduced);
+		renderGraph->setExported(attachments.ssaoUpsampled, ssaoUsed && reduced);
+	}
 
-		// SSAO blur
-		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssaoBlur.color, width, height);					// Color
+	void recompileRenderGraph()
+	{
+		vkDeviceWaitIdle(device);
+		updateRenderGraphOutputs();
+		renderGraph->compile();
+		updateAttachmentDescriptors();
+		// The history isn't updated while the reduced resolution passes are culled
+		historyValid = false;
+		updateUniformBufferReducedParams();
+		timing.sampleCount = 0;
+	}
 
-		// Render passes
+	// Rebuilds all attachments after the window size or the SSAO resolution has changed
+	void rebuildRenderGraph()
+	{
+		vkDeviceWaitIdle(device);
+		buildRenderGraph();
+		destroySSAOHistory();
+		prepareSSAOHistory();
+		updateAttachmentDescriptors();
+		historyValid = false;
+		updateUniformBufferReducedParams();
+		timing.sampleCount = 0;
+	}
 
-		// G-Buffer creation
-		{
-			std::array<VkAttachmentDescription, 4> attachmentDescs = {};
+	void prepareSSAOHistory()
+	{
+		ssaoHistory.extent = getReducedExtent();
+
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = VK_FORMAT_R16G16_SFLOAT;
+		imageCI.extent = { ssaoHistory.extent.width, ssaoHistory.extent.height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &ssaoHistory.image));
 
-			// Init attachment properties
-			for (uint32_t i = 0; i < static_cast<uint32_t>(attachmentDescs.size()); i++)
-			{
-				attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
-				attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-				attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-				attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-				attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-				attachmentDescs[i].finalLayout = (i == 3) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			}
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, ssaoHistory.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &ssaoHistory.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device, ssaoHistory.image, ssaoHistory.memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = imageCI.format;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		viewCI.image = ssaoHistory.image;
+		VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &ssaoHistory.view));
+
+		// The history is sampled before anything has been copied to it, its content is ignored until the first accumulation (reset)
+		VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(commandBuffer, ssaoHistory.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, viewCI.subresourceRange);
+		vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+	}
 
-			// Formats
-			attachmentDescs[0].format = frameBuffers.offscreen.position.format;
-			attachmentDescs[1].format = frameBuffers.offscreen.normal.format;
-			attachmentDescs[2].format = frameBuffers.offscreen.albedo.format;
-			attachmentDescs[3].format = frameBuffers.offscreen.depth.format;
-
-			std::vector<VkAttachmentReference> colorReferences;
-			colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-			colorReferences.push_back({ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-			colorReferences.push_back({ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-
-			VkAttachmentReference depthReference = {};
-			depthReference.attachment = 3;
-			depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-			VkSubpassDescription subpass = {};
-			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = colorReferences.data();
-			subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
-			subpass.pDepthStencilAttachment = &depthReference;
-
-			// Use subpass dependencies for attachment layout transitions
-			std::array<VkSubpassDependency, 2> dependencies;
-
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			VkRenderPassCreateInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = attachmentDescs.data();
-			renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
-			renderPassInfo.subpassCount = 1;
-			renderPassInfo.pSubpasses = &subpass;
-			renderPassInfo.dependencyCount = 2;
-			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.offscreen.renderPass));
-
-			std::array<VkImageView, 4> attachments;
-			attachments[0] = frameBuffers.offscreen.position.view;
-			attachments[1] = frameBuffers.offscreen.normal.view;
-			attachments[2] = frameBuffers.offscreen.albedo.view;
-			attachments[3] = frameBuffers.offscreen.depth.view;
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.offscreen.renderPass;
-			fbufCreateInfo.pAttachments = attachments.data();
-			fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-			fbufCreateInfo.width = frameBuffers.offscreen.width;
-			fbufCreateInfo.height = frameBuffers.offscreen.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.offscreen.frameBuffer));
+	void destroySSAOHistory()
+	{
+		if (ssaoHistory.image == VK_NULL_HANDLE) {
+			return;
 		}
+		vkDestroyImageView(device, ssaoHistory.view, nullptr);
+		vkDestroyImage(device, ssaoHistory.image, nullptr);
+		vkFreeMemory(device, ssaoHistory.memory, nullptr);
+		ssaoHistory.image = VK_NULL_HANDLE;
+	}
 
-		// SSAO
-		{
-			VkAttachmentDescription attachmentDescription{};
-			attachmentDescription.format = frameBuffers.ssao.color.format;
-			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-			VkSubpassDescription subpass = {};
-			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = &colorReference;
-			subpass.colorAttachmentCount = 1;
-
-			std::array<VkSubpassDependency, 2> dependencies;
-
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			VkRenderPassCreateInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = &attachmentDescription;
-			renderPassInfo.attachmentCount = 1;
-			renderPassInfo.subpassCount = 1;
-			renderPassInfo.pSubpasses = &subpass;
-			renderPassInfo.dependencyCount = 2;
-			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.ssao.renderPass));
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.ssao.renderPass;
-			fbufCreateInfo.pAttachments = &frameBuffers.ssao.color.view;
-			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = frameBuffers.ssao.width;
-			fbufCreateInfo.height = frameBuffers.ssao.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.ssao.frameBuffer));
+	// The accumulated SSAO of this frame becomes the history of the next one
+	void copyToSSAOHistory(VkCommandBuffer commandBuffer)
+	{
+		const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VkImage accumulated = renderGraph->getImage(attachments.ssaoAccumulated);
+		// The accumulated image is left in its read layout by the graph and transitioned from an undefined layout again in the next frame
+		vks::tools::setImageLayout(commandBuffer, accumulated, renderGraph->getReadLayout(attachments.ssaoAccumulated), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		vks::tools::setImageLayout(commandBuffer, ssaoHistory.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		VkImageCopy copyRegion{};
+		copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.extent = { ssaoHistory.extent.width, ssaoHistory.extent.height, 1 };
+		vkCmdCopyImage(commandBuffer, accumulated, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, ssaoHistory.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+		vks::tools::setImageLayout(commandBuffer, ssaoHistory.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+
+	// Three timestamps per command buffer
+	void prepareTimestamps()
+	{
+		if (timing.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, timing.queryPool, nullptr);
+			timing.queryPool = VK_NULL_HANDLE;
+		}
+		// Timestamps need to be supported by the graphics queue
+		const uint32_t validBits = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits;
+		timing.supported = validBits > 0;
+		timing.timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+		timing.timestampMask = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+		if (timing.supported) {
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCI.queryCount = static_cast<uint32_t>(drawCmdBuffers.size()) * 3;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolCI, nullptr, &timing.queryPool));
 		}
+		timing.sampleCount = 0;
+	}
 
-		// SSAO Blur
-		{
-			VkAttachmentDescription attachmentDescription{};
-			attachmentDescription.format = frameBuffers.ssaoBlur.color.format;
-			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-			VkSubpassDescription subpass = {};
-			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = &colorReference;
-			subpass.colorAttachmentCount = 1;
-
-			std::array<VkSubpassDependency, 2> dependencies;
-
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			VkRenderPassCreateInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = &attachmentDescription;
-			renderPassInfo.attachmentCount = 1;
-			renderPassInfo.subpassCount = 1;
-			renderPassInfo.pSubpasses = &subpass;
-			renderPassInfo.dependencyCount = 2;
-			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.ssaoBlur.renderPass));
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-			fbufCreateInfo.pAttachments = &frameBuffers.ssaoBlur.color.view;
-			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = frameBuffers.ssaoBlur.width;
-			fbufCreateInfo.height = frameBuffers.ssaoBlur.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.ssaoBlur.frameBuffer));
+	void writeTimestamp(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t query)
+	{
+		if (timing.supported) {
+			vkCmdWriteTimestamp(commandBuffer, stage, timing.queryPool, query);
 		}
+	}
 
-		// Shared sampler used for all color attachments
-		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
-		sampler.magFilter = VK_FILTER_NEAREST;
-		sampler.minFilter = VK_FILTER_NEAREST;
-		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-		sampler.addressModeV = sampler.addressModeU;
-		sampler.addressModeW = sampler.addressModeU;
-		sampler.mipLodBias = 0.0f;
-		sampler.maxAnisotropy = 1.0f;
-		sampler.minLod = 0.0f;
-		sampler.maxLod = 1.0f;
-		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &colorSampler));
+	// Reads the timestamps of a command buffer without waiting
+	void updateTiming(uint32_t commandBufferIndex)
+	{
+		if (!timing.supported) {
+			return;
+		}
+		uint64_t timestamps[3] = {};
+		VkResult result = vkGetQueryPoolResults(device, timing.queryPool, commandBufferIndex * 3, 3, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return;
+		}
+		const float gBufferTime = (float)((timestamps[1] - timestamps[0]) & timing.timestampMask) * timing.timestampPeriod / 1000000.0f;
+		const float ssaoTime = (float)((timestamps[2] - timestamps[1]) & timing.timestampMask) * timing.timestampPeriod / 1000000.0f;
+		if (timing.sampleCount == 0) {
+			timing.gBufferTime = gBufferTime;
+			timing.ssaoTime = ssaoTime;
+		} else {
+			timing.gBufferTime += (gBufferTime - timing.gBufferTime) * 0.05f;
+			timing.ssaoTime += (ssaoTime - timing.ssaoTime) * 0.05f;
+		}
+		timing.sampleCount++;
 	}
 
 	void loadAssets()
@@ -498,97 +552,21 @@ public:
 		{
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			/*
-				Offscreen SSAO generation
-			*/
-			{
-				// Clear values for all attachments written in the fragment shader
-				std::vector<VkClearValue> clearValues(4);
-				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[3].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = frameBuffers.offscreen.renderPass;
-				renderPassBeginInfo.framebuffer = frameBuffers.offscreen.frameBuffer;
-				renderPassBeginInfo.renderArea.extent.width = frameBuffers.offscreen.width;
-				renderPassBeginInfo.renderArea.extent.height = frameBuffers.offscreen.height;
-				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-				renderPassBeginInfo.pClearValues = clearValues.data();
-
-				/*
-					First pass: Fill G-Buffer components (positions+depth, normals, albedo) using MRT
-				*/
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				VkViewport viewport = vks::initializers::viewport((float)frameBuffers.offscreen.width, (float)frameBuffers.offscreen.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor = vks::initializers::rect2D(frameBuffers.offscreen.width, frameBuffers.offscreen.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.gBuffer, 0, 1, &descriptorSets.floor, 0, NULL);
-				scene.draw(drawCmdBuffers[i], vkglTF::RenderFlags::BindImages, pipelineLayouts.gBuffer);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
-
-				/*
-					Second pass: SSAO generation
-				*/
-
-				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				renderPassBeginInfo.framebuffer = frameBuffers.ssao.frameBuffer;
-				renderPassBeginInfo.renderPass = frameBuffers.ssao.renderPass;
-				renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssao.width;
-				renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssao.height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues.data();
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				viewport = vks::initializers::viewport((float)frameBuffers.ssao.width, (float)frameBuffers.ssao.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				scissor = vks::initializers::rect2D(frameBuffers.ssao.width, frameBuffers.ssao.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssao, 0, 1, &descriptorSets.ssao, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssao);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
-
-				/*
-					Third pass: SSAO blur
-				*/
-
-				renderPassBeginInfo.framebuffer = frameBuffers.ssaoBlur.frameBuffer;
-				renderPassBeginInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-				renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssaoBlur.width;
-				renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssaoBlur.height;
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				viewport = vks::initializers::viewport((float)frameBuffers.ssaoBlur.width, (float)frameBuffers.ssaoBlur.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				scissor = vks::initializers::rect2D(frameBuffers.ssaoBlur.width, frameBuffers.ssaoBlur.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssaoBlur, 0, 1, &descriptorSets.ssaoBlur, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoBlur);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+			timing.queryBase = i * 3;
+			if (timing.supported) {
+				vkCmdResetQueryPool(drawCmdBuffers[i], timing.queryPool, timing.queryBase, 3);
 			}
+			writeTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timing.queryBase);
 
 			/*
-				Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
+				Offscreen SSAO generation
+				The render graph records all passes that contribute to the composition, including the barriers and layout transitions between them
 			*/
+			renderGraph->execute(drawCmdBuffers[i]);
+			if (!renderGraph->isCulled(passes.temporal)) {
+				copyToSSAOHistory(drawCmdBuffers[i]);
+			}
+			writeTimestamp(drawCmdBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timing.queryBase + 2);
 
 			/*
 				Final render pass: Scene rendering with applied radial blur
@@ -632,8 +610,8 @@ public:
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 12)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 12),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 24)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes,  descriptorSets.count);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -646,7 +624,6 @@ public:
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo();
 		VkDescriptorSetAllocateInfo descriptorAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, nullptr, 1);
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
-		std::vector<VkDescriptorImageInfo> imageDescriptors;
 
 		// G-Buffer creation (offscreen scene rendering)
 		setLayoutBindings = {
@@ -681,19 +658,22 @@ public:
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.ssao));
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.ssao;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.ssao));
-		imageDescriptors = {
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-		};
 		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),					// FS Position+Depth
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),					// FS Normals
 			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.ssaoNoise.descriptor),		// FS SSAO Noise
 			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoKernel.descriptor),		// FS SSAO Kernel UBO
 			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoParams.descriptor),		// FS SSAO Params UBO
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 
+		// SSAO Generation at reduced resolution, uses the same layout
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.ssaoReduced));
+		writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoReduced, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.ssaoNoise.descriptor),	// FS SSAO Noise
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoReduced, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoKernel.descriptor),	// FS SSAO Kernel UBO
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoReduced, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoParams.descriptor),	// FS SSAO Params UBO
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
 		// SSAO Blur
 		setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Sampler SSAO
@@ -704,11 +684,25 @@ public:
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.ssaoBlur));
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.ssaoBlur;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.ssaoBlur));
-		imageDescriptors = {
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+
+		// G-Buffer downsample, temporal accumulation and upsample
+		setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Input 0
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),						// FS Input 1
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),						// FS Input 2
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),								// FS Reduced resolution Params UBO
 		};
+		setLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.reduced));
+		pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.reduced;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.reduced));
+		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.reduced;
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.downsample));
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.temporal));
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.upsample));
 		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets.ssaoBlur, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),
+			vks::initializers::writeDescriptorSet(descriptorSets.downsample, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.reducedParams.descriptor),	// FS Reduced resolution Params UBO
+			vks::initializers::writeDescriptorSet(descriptorSets.temporal, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.reducedParams.descriptor),		// FS Reduced resolution Params UBO
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 
@@ -727,22 +721,57 @@ public:
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.composition));
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.composition;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.composition));
-		imageDescriptors = {
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.albedo.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoBlur.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-		};
 		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),			// FS Sampler Position+Depth
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),			// FS Sampler Normals
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[2]),			// FS Sampler Albedo
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[3]),			// FS Sampler SSAO
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &imageDescriptors[4]),			// FS Sampler SSAO blurred
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5, &uniformBuffers.ssaoParams.descriptor),	// FS SSAO Params UBO
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
+		updateAttachmentDescriptors();
+	}
+
+	// Attachment views change whenever the render graph is recompiled
+	void updateAttachmentDescriptors()
+	{
+		// Targets of culled passes don't exist, the composition doesn't sample them but the descriptors still need to point to a valid image
+		auto attachmentDescriptor = [this](vks::RenderGraph::ImageHandle image) {
+			VkImageView view = renderGraph->getView(image);
+			return vks::initializers::descriptorImageInfo(colorSampler, view != VK_NULL_HANDLE ? view : renderGraph->getView(attachments.albedo), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		};
+		std::vector<VkDescriptorImageInfo> imageDescriptors = {
+			attachmentDescriptor(attachments.position),
+			attachmentDescriptor(attachments.normal),
+			attachmentDescriptor(attachments.albedo),
+			attachmentDescriptor(attachments.ssao),
+			attachmentDescriptor(attachments.ssaoBlur),
+			attachmentDescriptor(attachments.positionReduced),
+			attachmentDescriptor(attachments.normalReduced),
+			attachmentDescriptor(attachments.ssaoReduced),
+			attachmentDescriptor(attachments.ssaoAccumulated),
+			attachmentDescriptor(attachments.ssaoUpsampled),
+			vks::initializers::descriptorImageInfo(colorSampler, ssaoHistory.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		// The reduced resolution modes replace both SSAO inputs of the composition with the upsampled result
+		const bool reduced = ssaoResolution != Full;
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),				// FS Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),				// FS Normals
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoBlur, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[3]),			// FS Sampler SSAO
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),		// FS Sampler Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),		// FS Sampler Normals
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[2]),		// FS Sampler Albedo
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[reduced ? 9 : 3]),	// FS Sampler SSAO
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &imageDescriptors[reduced ? 9 : 4]),	// FS Sampler SSAO blurred
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoReduced, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[5]),		// FS Position+Depth (reduced)
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoReduced, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[6]),		// FS Normals (reduced)
+			vks::initializers::writeDescriptorSet(descriptorSets.downsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),		// FS Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.downsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),		// FS Normals
+			vks::initializers::writeDescriptorSet(descriptorSets.temporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[7]),			// FS SSAO (reduced)
+			vks::initializers::writeDescriptorSet(descriptorSets.temporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[5]),			// FS Position+Depth (reduced)
+			vks::initializers::writeDescriptorSet(descriptorSets.temporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[10]),		// FS SSAO History
+			vks::initializers::writeDescriptorSet(descriptorSets.upsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),			// FS Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.upsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[8]),			// FS SSAO accumulated
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 	}
 
 	void preparePipelines()
@@ -781,7 +810,7 @@ public:
 
 		// SSAO generation pipeline
 		{
-			pipelineCreateInfo.renderPass = frameBuffers.ssao.renderPass;
+			pipelineCreateInfo.renderPass = renderGraph->getRenderPass(passes.ssao);
 			pipelineCreateInfo.layout = pipelineLayouts.ssao;
 			// SSAO Kernel size and radius are constant for this pipeline, so we set them using specialization constants
 			struct SpecializationData {
@@ -796,21 +825,51 @@ public:
 			shaderStages[1] = loadShader(getShadersPath() + "ssao/ssao.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 			shaderStages[1].pSpecializationInfo = &specializationInfo;
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.ssao));
+
+			// Reduced resolution modes only evaluate a part of the kernel per frame
+			pipelineCreateInfo.renderPass = renderGraph->getRenderPass(passes.ssaoReduced);
+			specializationData.kernelSize = SSAO_REDUCED_KERNEL_SIZE;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.ssaoReduced));
 		}
 
 		// SSAO blur pipeline
 		{
-			pipelineCreateInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
+			pipelineCreateInfo.renderPass = renderGraph->getRenderPass(passes.ssaoBlur);
 			pipelineCreateInfo.layout = pipelineLayouts.ssaoBlur;
 			shaderStages[1] = loadShader(getShadersPath() + "ssao/blur.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.ssaoBlur));
 		}
 
+		// Reduced resolution pipelines
+		{
+			pipelineCreateInfo.layout = pipelineLayouts.reduced;
+
+			// The temporal accumulation and the upsample write a single attachment
+			pipelineCreateInfo.renderPass = renderGraph->getRenderPass(passes.temporal);
+			shaderStages[1] = loadShader(getShadersPath() + "ssao/temporal.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.temporal));
+
+			pipelineCreateInfo.renderPass = renderGraph->getRenderPass(passes.upsample);
+			shaderStages[1] = loadShader(getShadersPath() + "ssao/upsample.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.upsample));
+
+			// The downsample writes the reduced position and normal
+			std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachmentStates = {
+				vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
+				vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE)
+			};
+			colorBlendState.attachmentCount = static_cast<uint32_t>(blendAttachmentStates.size());
+			colorBlendState.pAttachments = blendAttachmentStates.data();
+			pipelineCreateInfo.renderPass = renderGraph->getRenderPass(passes.downsample);
+			shaderStages[1] = loadShader(getShadersPath() + "ssao/downsample.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.downsample));
+		}
+
 		// Fill G-Buffer pipeline
 		{
 			// Vertex input state from glTF model loader
 			pipelineCreateInfo.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal });
-			pipelineCreateInfo.renderPass = frameBuffers.offscreen.renderPass;
+			pipelineCreateInfo.renderPass = renderGraph->getRenderPass(passes.gBuffer);
 			pipelineCreateInfo.layout = pipelineLayouts.gBuffer;
 			// Blend attachment states required for all color attachments
 			// This is important, as color write mask will otherwise be 0x0 and you
@@ -851,9 +910,18 @@ public:
 			&uniformBuffers.ssaoParams,
 			sizeof(uboSSAOParams));
 
+		// Reduced resolution parameters
+		vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&uniformBuffers.reducedParams,
+			sizeof(uboReducedParams));
+
 		// Update
 		updateUniformBufferMatrices();
-		updateUniformBufferSSAOParams();
+		previousView = uboSceneParams.view;
+		uboReducedParams.previousProjection = uboSceneParams.projection;
+		updateUniformBufferReducedParams();
 
 		// SSAO
 		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
@@ -909,6 +977,29 @@ public:
 		uniformBuffers.ssaoParams.unmap();
 	}
 
+	// Selects this frame's part of the kernel and its rotation, and the reprojection into the history
+	// Also updates the SSAO parameters as they contain the kernel selection
+	void updateUniformBufferReducedParams()
+	{
+		if (ssaoResolution == Full) {
+			uboSSAOParams.kernelOffset = 0;
+			uboSSAOParams.kernelRotation = 0.0f;
+		} else {
+			// Cycle through the kernel in parts of SSAO_REDUCED_KERNEL_SIZE samples and rotate by the golden angle
+			// every frame, so the accumulated samples cover the hemisphere evenly
+			uboSSAOParams.kernelOffset = (frameIndex % (SSAO_KERNEL_SIZE / SSAO_REDUCED_KERNEL_SIZE)) * SSAO_REDUCED_KERNEL_SIZE;
+			uboSSAOParams.kernelRotation = fmod((float)frameIndex * 2.39996323f, 2.0f * (float)M_PI);
+		}
+		updateUniformBufferSSAOParams();
+
+		uboReducedParams.viewToPreviousView = previousView * glm::inverse(uboSceneParams.view);
+		uboReducedParams.reset = !historyValid;
+		uboReducedParams.factor = getReductionFactor();
+		VK_CHECK_RESULT(uniformBuffers.reducedParams.map());
+		uniformBuffers.reducedParams.copyTo(&uboReducedParams, sizeof(uboReducedParams));
+		uniformBuffers.reducedParams.unmap();
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
@@ -922,11 +1013,13 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		prepareOffscreenFramebuffers();
+		prepareRenderGraph();
+		prepareSSAOHistory();
 		prepareUniformBuffers();
 		setupDescriptorPool();
 		setupLayoutsAndDescriptors();
 		preparePipelines();
+		prepareTimestamps();
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -937,16 +1030,30 @@ public:
 			return;
 		}
 		draw();
+		updateTiming(currentBuffer);
+		// The frame just drawn wrote the history for the next one
+		previousView = uboSceneParams.view;
+		uboReducedParams.previousProjection = uboSceneParams.projection;
+		historyValid = true;
+		frameIndex++;
 		if (camera.updated) {
 			updateUniformBufferMatrices();
-			updateUniformBufferSSAOParams();
 		}
+		updateUniformBufferReducedParams();
 	}
 
 	virtual void viewChanged()
 	{
 		updateUniformBufferMatrices();
-		updateUniformBufferSSAOParams();
+		updateUniformBufferReducedParams();
+	}
+
+	virtual void windowResized()
+	{
+		rebuildRenderGraph();
+		// The number of command buffers may have changed with the swap chain
+		prepareTimestamps();
+		buildCommandBuffers();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -954,14 +1061,36 @@ public:
 		if (overlay->header("Settings")) {
 			if (overlay->checkBox("Enable SSAO", &uboSSAOParams.ssao)) {
 				updateUniformBufferSSAOParams();
+				recompileRenderGraph();
+			}
+			if (overlay->comboBox("Resolution", &ssaoResolution, { "Full", "Half (temporal)", "Quarter (temporal)" })) {
+				rebuildRenderGraph();
 			}
-			if (overlay->checkBox("SSAO blur", &uboSSAOParams.ssaoBlur)) {
+			// The temporal accumulation replaces the blur in the reduced resolution modes
+			if ((ssaoResolution == Full) && overlay->checkBox("SSAO blur", &uboSSAOParams.ssaoBlur)) {
 				updateUniformBufferSSAOParams();
+				recompileRenderGraph();
 			}
 			if (overlay->checkBox("SSAO pass only", &uboSSAOParams.ssaoOnly)) {
 				updateUniformBufferSSAOParams();
+				recompileRenderGraph();
 			}
 		}
+		if (overlay->header("Timing")) {
+			if (!timing.supported) {
+				overlay->text("Timestamps not supported");
+			} else {
+				overlay->text("G-Buffer GPU time: %.3f ms", timing.gBufferTime);
+				overlay->text("SSAO GPU time: %.3f ms", timing.ssaoTime);
+			}
+		}
+		if (overlay->header("Render graph")) {
+			const vks::RenderGraph::Statistics& statistics = renderGraph->getStatistics();
+			overlay->text("Passes: %d (%d culled)", statistics.passCount - statistics.culledPassCount, statistics.culledPassCount);
+			overlay->text("Image barriers: %d", statistics.barrierCount);
+			overlay->text("Attachment memory: %.1f MB", (float)statistics.transientMemory / (1024.0f * 1024.0f));
+			overlay->text("Without aliasing: %.1f MB", (float)statistics.unaliasedMemory / (1024.0f * 1024.0f));
+		}
 	}
 };
 
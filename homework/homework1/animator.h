@@ -17,7 +17,7 @@ public:
 	void setScales(const std::vector<glm::vec3>& inScales);
 private:
 	int timelineIndex = -1;
-	float currentTime;
+	float currentTime = 0.0f;
 	std::vector<float> times;
 	std::vector<glm::vec3> translation;
 	std::vector<glm::vec3> scale;
@@ -33,6 +33,7 @@
 #include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include "vulkanexamplebase.h"
+#include "VulkanRenderQueue.h"
 
 #include "animator.h"
 #include "transform.h"
@@ -592,7 +593,7 @@ public:
 		}
 	}
 	// @param descriptorSetLayout 是材质需要的参数的Layout
-	void setupDescriptorSet(vks::VulkanDevice* inDevice, VkDescriptorPool descriptorPool, 
+	void setupDescriptorSet(vks::VulkanDevice* inDevice, vks::DescriptorAllocator& descriptorAllocator, 
 		VkDescriptorSetLayout descritorSetLayout, VkDescriptorSetLayout nodeDescriptorSetLayout)
 	{
 		VkDevice device = inDevice->logicalDevice;
@@ -642,8 +643,7 @@ public:
 				mat.CBO.setupDescriptor();
 				mat.CBO.bind();
 			}
-			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descritorSetLayout, 1);
-			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &mat._descriptorSet));
+			mat._descriptorSet = descriptorAllocator.allocate(descritorSetLayout);
 
 			std::array< VkDescriptorImageInfo, 6> imageDescriptor = {
 				images[mat.baseColorTextureIndex].texture.descriptor,
@@ -659,18 +659,16 @@ public:
 
 			};	
 
-			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(),0,NULL);
+			descriptorAllocator.updateDescriptorSets(writeDescriptorSets);
 		}
 		for (size_t i = 0; i < nodes.size(); ++i)
 		{
 			breadthFirstSearch(nodes[i], [&](VulkanglTFModel::Node* node)
 				{
-					VkDescriptorSetAllocateInfo nodeDescriptorSetAllcInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &nodeDescriptorSetLayout, 1);
-					VkResult allcateResult = vkAllocateDescriptorSets(device, &nodeDescriptorSetAllcInfo, &node->descriptorSet);
-					VK_CHECK_RESULT(allcateResult);
+					node->descriptorSet = descriptorAllocator.allocate(nodeDescriptorSetLayout);
 					VkWriteDescriptorSet writeNodeDesc = vks::initializers::writeDescriptorSet(node->descriptorSet, 
 						VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &node->CBO.descriptor, 1);
-					vkUpdateDescriptorSets(device, 1, &writeNodeDesc, 0, NULL);
+					descriptorAllocator.updateDescriptorSets({ writeNodeDesc });
 				});
 
 		}
@@ -739,6 +737,49 @@ public:
 		}
 	}
 
+	// Add a single node including child nodes (if present) to a render queue
+	void enqueueNode(vks::RenderQueue& renderQueue, vks::DrawPacket& packet, const glm::mat4& view, VulkanglTFModel::Node* node)
+	{
+		if (node->mesh.primitives.size() > 0) {
+			glm::mat4 nodeMatrix = node->getNodeMatrix();
+			VulkanglTFModel::Node* currentParent = node->parent;
+			while (currentParent) {
+				nodeMatrix = currentParent->getNodeMatrix() * nodeMatrix;
+				currentParent = currentParent->parent;
+			}
+			// Primitives don't store their bounds, so the node's origin is used for depth sorting
+			const float viewDepth = -(view * nodeMatrix[3]).z;
+			packet.pushConstantStages = VK_SHADER_STAGE_VERTEX_BIT;
+			packet.pushConstantSize = sizeof(glm::mat4);
+			packet.pushConstantOffset = renderQueue.pushConstants(&nodeMatrix, sizeof(glm::mat4));
+			packet.descriptorSets[2] = node->descriptorSet;
+			for (VulkanglTFModel::Primitive& primitive : node->mesh.primitives) {
+				if (primitive.indexCount > 0) {
+					packet.descriptorSets[1] = materials[primitive.materialIndex]._descriptorSet;
+					packet.indexCount = primitive.indexCount;
+					packet.firstIndex = primitive.firstIndex;
+					renderQueue.push(vks::RenderBucket::Opaque, viewDepth, packet);
+				}
+			}
+		}
+		for (auto& child : node->children) {
+			enqueueNode(renderQueue, packet, view, child);
+		}
+	}
+
+	// Add the glTF scene to a render queue, draws get sorted by material and front-to-back instead of following the node hierarchy
+	void enqueue(vks::RenderQueue& renderQueue, const glm::mat4& view, VkPipeline pipeline, VkPipelineLayout pipelineLayout)
+	{
+		vks::DrawPacket packet{};
+		packet.pipeline = pipeline;
+		packet.pipelineLayout = pipelineLayout;
+		packet.vertexBuffer = vertices.buffer;
+		packet.indexBuffer = indices.buffer;
+		for (auto& node : nodes) {
+			enqueueNode(renderQueue, packet, view, node);
+		}
+	}
+
 	// Draw the glTF scene starting at the top-level-nodes
 	void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout)
 	{
@@ -760,6 +801,7 @@ public:
 	bool wireframe = false;
 
 	VulkanglTFModel glTFModel;
+	vks::RenderQueue renderQueue;
 
 	// 每个Pipeline都应该接受的Uniform参数，表示场景的全局状态
 	struct ShaderData {
@@ -806,8 +848,7 @@ public:
 		}
 
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.matrices, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.material, nullptr);
+		// Descriptor set layouts and sets are owned by the descriptor allocator
 
 		shaderData.buffer.destroy();
 	}
@@ -841,6 +882,10 @@ public:
 		const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
 		const VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 
+		renderQueue.begin(camera.getNearClip(), camera.getFarClip());
+		glTFModel.enqueue(renderQueue, camera.matrices.view, wireframe ? pipelines.wireframe : pipelines.solid, pipelineLayout);
+		renderQueue.sort();
+
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
 			renderPassBeginInfo.framebuffer = frameBuffers[i];
@@ -852,8 +897,7 @@ public:
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 
 			// Draw model
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.solid);
-			glTFModel.draw(drawCmdBuffers[i], pipelineLayout);
+			renderQueue.record(drawCmdBuffers[i]);
 
 			drawUI(drawCmdBuffers[i]);
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
@@ -979,43 +1023,28 @@ public:
 
 	void setupDescriptors()
 	{
-		const int32_t nodeNum = glTFModel.getNodeNum(); 
 		/* 
 			This sample uses separate descriptor sets (and layouts) for the matrices and materials (textures)
+			Sets are allocated from the descriptor allocator's pools, which grow as required, so no pool sizes need to be counted upfront
 		*/
-		std::vector<VkDescriptorPoolSize> poolSizes = {
-			// 1 scene info + object info per node
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 65 + glTFModel.materials.size()/*glTFModel.nodes.size()*/), 
-			// One combined image sampler per model image/texture how many textures per material ?
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(glTFModel.materials.size() * 12)),
-		};
-		// One set for scene matrices and one per model for model info (model transform and animation data), one set per material for textures
-		const uint32_t maxSetCount = static_cast<uint32_t>(glTFModel.images.size() + nodeNum) + 1;
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, maxSetCount);
-		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Descriptor set layout for passing scene matrices, 绑定是指绑定到Shader中的位置 -- > 第0个UBO
-		VkDescriptorSetLayoutBinding setLayoutBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
-		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(&setLayoutBinding, 1);
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.matrices));
+		descriptorSetLayouts.matrices = descriptorAllocator.getLayout({
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0)
+		});
 		
 		// Descriptor set layout for node info
-		std::array<VkDescriptorSetLayoutBinding, 2> nodeInfoSetLayoutBindings = {
+		descriptorSetLayouts.nodeParams = descriptorAllocator.getLayout({
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0, 1),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1, 1)
-		};
-		VkDescriptorSetLayoutCreateInfo nodeDescriptorSetLayoutCI = 
-			vks::initializers::descriptorSetLayoutCreateInfo(nodeInfoSetLayoutBindings.data(), nodeInfoSetLayoutBindings.size());
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &nodeDescriptorSetLayoutCI, nullptr, &descriptorSetLayouts.nodeParams));
+		});
 		
 		// Descriptor set layout for passing material textures, 绑定到第0 个位置，Texture和Sampler, 用于PixelShader
 		// space 1 
-		std::array<VkDescriptorSetLayoutBinding, 2> materialTexturesLayout = {
+		descriptorSetLayouts.material = descriptorAllocator.getLayout({
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT,0 ,1),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1, 6) // 材质中可能用到的最多纹理数量
-		};
-		VkDescriptorSetLayoutCreateInfo materialSetCI = vks::initializers::descriptorSetLayoutCreateInfo(materialTexturesLayout.data(), materialTexturesLayout.size());
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &materialSetCI, nullptr, &descriptorSetLayouts.material));
+		});
 		
 		// Pipeline layout using both descriptor sets (set 0 = matrices, set 1 = material, set 2 = model info)
 		std::array<VkDescriptorSetLayout, 3> setLayouts = { descriptorSetLayouts.matrices, descriptorSetLayouts.material, descriptorSetLayouts.nodeParams };
@@ -1030,13 +1059,12 @@ public:
 
 		// Descriptor set for scene matrices
 		// VkDescriptorSetLayout只是定义这个DescritporSet的绑定和格式，这里要创建真正的DescritporSet
-		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.matrices, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+		descriptorSet = descriptorAllocator.allocate(descriptorSetLayouts.matrices);
 		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &shaderData.buffer.descriptor);
-		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+		descriptorAllocator.updateDescriptorSets({ writeDescriptorSet });
 		
 		// descriptor set for each node 
-		glTFModel.setupDescriptorSet(vulkanDevice, descriptorPool, descriptorSetLayouts.material, descriptorSetLayouts.nodeParams);
+		glTFModel.setupDescriptorSet(vulkanDevice, descriptorAllocator, descriptorSetLayouts.material, descriptorSetLayouts.nodeParams);
 	}
 
 	void preparePipelines()
@@ -1147,6 +1175,10 @@ public:
 
 	virtual void render()
 	{
+		if (camera.updated) {
+			// Depth ordering of the render queue depends on the camera
+			buildCommandBuffers();
+		}
 		renderFrame();
 		if (camera.updated) {
 			updateUniformBuffers();
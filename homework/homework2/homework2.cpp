@@ -19,7 +19,6 @@ VulkanExample::VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
 	camera.setRotationSpeed(0.25f);
 	enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
-	enabledDeviceExtensions.push_back(VK_NV_SHADING_RATE_IMAGE_EXTENSION_NAME);
 }
 
 VulkanExample::~VulkanExample()
@@ -28,35 +27,64 @@ VulkanExample::~VulkanExample()
 	vkDestroyPipeline(device, basePipelines.opaque, nullptr);
 	vkDestroyPipeline(device, shadingRatePipelines.masked, nullptr);
 	vkDestroyPipeline(device, shadingRatePipelines.opaque, nullptr);
+	vkDestroyPipeline(device, presentPipeline, nullptr);
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyPipelineLayout(device, presentPipelineLayout, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-	vkDestroyImageView(device, shadingRateImage.view, nullptr);
-	vkDestroyImage(device, shadingRateImage.image, nullptr);
-	vkFreeMemory(device, shadingRateImage.memory, nullptr);
+	vkDestroyDescriptorSetLayout(device, presentDescriptorSetLayout, nullptr);
+	destroyOffscreenFramebuffer();
+	vkDestroyRenderPass(device, offscreenPass.renderPass, nullptr);
+	vkDestroySampler(device, offscreenPass.sampler, nullptr);
+	shadingRate.destroy();
 	shaderData.buffer.destroy();
 }
 
 void VulkanExample::getEnabledFeatures()
 {
 	enabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
-	// POI
-	enabledPhysicalDeviceShadingRateImageFeaturesNV = {};
-	enabledPhysicalDeviceShadingRateImageFeaturesNV.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADING_RATE_IMAGE_FEATURES_NV;
-	enabledPhysicalDeviceShadingRateImageFeaturesNV.shadingRateImage = VK_TRUE;
-	deviceCreatepNextChain = &enabledPhysicalDeviceShadingRateImageFeaturesNV;
+}
+
+void VulkanExample::getEnabledExtensions()
+{
+	// [POI] Prefer the cross vendor extension, both consume an R8_UINT image with one texel per tile but encode the rates differently
+	if (vulkanDevice->extensionSupported(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME)) {
+		VkPhysicalDeviceFragmentShadingRateFeaturesKHR supportedFeatures{};
+		supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+		VkPhysicalDeviceFeatures2 deviceFeatures2{};
+		deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		deviceFeatures2.pNext = &supportedFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &deviceFeatures2);
+		fragmentShadingRateKHR = supportedFeatures.attachmentFragmentShadingRate == VK_TRUE;
+	}
+	if (fragmentShadingRateKHR) {
+		enabledDeviceExtensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+		enabledDeviceExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+		enabledPhysicalDeviceFragmentShadingRateFeaturesKHR = {};
+		enabledPhysicalDeviceFragmentShadingRateFeaturesKHR.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+		enabledPhysicalDeviceFragmentShadingRateFeaturesKHR.pipelineFragmentShadingRate = VK_TRUE;
+		enabledPhysicalDeviceFragmentShadingRateFeaturesKHR.attachmentFragmentShadingRate = VK_TRUE;
+		deviceCreatepNextChain = &enabledPhysicalDeviceFragmentShadingRateFeaturesKHR;
+	} else {
+		enabledDeviceExtensions.push_back(VK_NV_SHADING_RATE_IMAGE_EXTENSION_NAME);
+		enabledPhysicalDeviceShadingRateImageFeaturesNV = {};
+		enabledPhysicalDeviceShadingRateImageFeaturesNV.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADING_RATE_IMAGE_FEATURES_NV;
+		enabledPhysicalDeviceShadingRateImageFeaturesNV.shadingRateImage = VK_TRUE;
+		deviceCreatepNextChain = &enabledPhysicalDeviceShadingRateImageFeaturesNV;
+	}
 }
 
 /*
-	If the window has been resized, we need to recreate the shading rate image
+	If the window has been resized, we need to recreate the shading rate image and the offscreen images it's derived from
 */
 void VulkanExample::handleResize()
 {
-	// Delete allocated resources
-	vkDestroyImageView(device, shadingRateImage.view, nullptr);
-	vkDestroyImage(device, shadingRateImage.image, nullptr);
-	vkFreeMemory(device, shadingRateImage.memory, nullptr);
-	// Recreate image
-	prepareShadingRateImage();
+	destroyOffscreenFramebuffer();
+	shadingRate.resize(width, height);
+	prepareOffscreenFramebuffer();
+	updatePresentDescriptorSet();
+	if (!adaptiveShadingRate) {
+		uploadShadingRatePattern();
+	}
 	resized = false;
 }
 
@@ -74,6 +102,14 @@ void VulkanExample::buildCommandBuffers()
 	clearValues[0].color = { { 0.25f, 0.25f, 0.25f, 1.0f } };;
 	clearValues[1].depthStencil = { 1.0f, 0 };
 
+	VkRenderPassBeginInfo offscreenPassBeginInfo = vks::initializers::renderPassBeginInfo();
+	offscreenPassBeginInfo.renderPass = offscreenPass.renderPass;
+	offscreenPassBeginInfo.framebuffer = offscreenPass.frameBuffer;
+	offscreenPassBeginInfo.renderArea.extent.width = width;
+	offscreenPassBeginInfo.renderArea.extent.height = height;
+	offscreenPassBeginInfo.clearValueCount = 2;
+	offscreenPassBeginInfo.pClearValues = clearValues;
+
 	VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
 	renderPassBeginInfo.renderPass = renderPass;
 	renderPassBeginInfo.renderArea.offset.x = 0;
@@ -86,27 +122,48 @@ void VulkanExample::buildCommandBuffers()
 	const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
 	const VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 
+	// Sort the scene once for all command buffers
+	// Opaque and masked primitives are batched by pipeline and material and drawn front-to-back inside each batch
+	Pipelines& pipelines = enableShadingRate ? shadingRatePipelines : basePipelines;
+	vkglTF::RenderPipelines scenePipelines{};
+	scenePipelines.opaque = pipelines.opaque;
+	scenePipelines.masked = pipelines.masked;
+	renderQueue.begin(camera.getNearClip(), camera.getFarClip());
+	scene.enqueue(renderQueue, camera.matrices.view, scenePipelines, pipelineLayout, vkglTF::RenderFlags::BindImages);
+	renderQueue.sort();
+
 	for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 	{
 		renderPassBeginInfo.framebuffer = frameBuffers[i];
 		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		// [POI] Derive this frame's shading rates from the last frame's color and depth
+		if (enableShadingRate && adaptiveShadingRate) {
+			shadingRate.update(drawCmdBuffers[i]);
+		}
+
+		vkCmdBeginRenderPass(drawCmdBuffers[i], &offscreenPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 		vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 
-		// POI: Bind the image that contains the shading rate patterns
-		if (enableShadingRate) {
-			vkCmdBindShadingRateImageNV(drawCmdBuffers[i], shadingRateImage.view, VK_IMAGE_LAYOUT_SHADING_RATE_OPTIMAL_NV);
+		// POI: Bind the image that contains the shading rate patterns, with VK_KHR_fragment_shading_rate it's an attachment of the offscreen pass instead
+		if (enableShadingRate && !fragmentShadingRateKHR) {
+			vkCmdBindShadingRateImageNV(drawCmdBuffers[i], shadingRate.getView(), VK_IMAGE_LAYOUT_SHADING_RATE_OPTIMAL_NV);
 		};
 
 		// Render the scene
-		Pipelines& pipelines = enableShadingRate ? shadingRatePipelines : basePipelines;
-		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.opaque);
-		scene.draw(drawCmdBuffers[i], vkglTF::RenderFlags::BindImages | vkglTF::RenderFlags::RenderOpaqueNodes, pipelineLayout);
-		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.masked);
-		scene.draw(drawCmdBuffers[i], vkglTF::RenderFlags::BindImages | vkglTF::RenderFlags::RenderAlphaMaskedNodes, pipelineLayout);
+		renderQueue.record(drawCmdBuffers[i]);
+		vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		const float presentConstants[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, presentPipeline);
+		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, presentPipelineLayout, 0, 1, &presentDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(drawCmdBuffers[i], presentPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(presentConstants), presentConstants);
+		vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 		drawUI(drawCmdBuffers[i]);
 		vkCmdEndRenderPass(drawCmdBuffers[i]);
 		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -124,8 +181,9 @@ void VulkanExample::setupDescriptors()
 	// Pool
 	const std::vector<VkDescriptorPoolSize> poolSizes = {
 		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
 	};
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 	// Descriptor set layout
@@ -150,71 +208,286 @@ void VulkanExample::setupDescriptors()
 		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &shaderData.buffer.descriptor),
 	};
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+	// Present pass, samples the offscreen color
+	const VkDescriptorSetLayoutBinding presentBinding = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+	descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(&presentBinding, 1);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &presentDescriptorSetLayout));
+	// UV scale and clamp of the base upscale shader
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, 4 * sizeof(float), 0);
+	pPipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&presentDescriptorSetLayout, 1);
+	pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &presentPipelineLayout));
+	allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &presentDescriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &presentDescriptorSet));
+	updatePresentDescriptorSet();
 }
 
-// [POI]
-void VulkanExample::prepareShadingRateImage()
+void VulkanExample::updatePresentDescriptorSet()
 {
-	// Shading rate image size depends on shading rate texel size
-	// For each texel in the target image, there is a corresponding shading texel size width x height block in the shading rate image
-	VkExtent3D imageExtent{};
-	imageExtent.width = static_cast<uint32_t>(ceil(width / (float)physicalDeviceShadingRateImagePropertiesNV.shadingRateTexelSize.width));
-	imageExtent.height = static_cast<uint32_t>(ceil(height / (float)physicalDeviceShadingRateImagePropertiesNV.shadingRateTexelSize.height));
-	imageExtent.depth = 1;
+	VkDescriptorImageInfo imageDescriptor = vks::initializers::descriptorImageInfo(offscreenPass.sampler, offscreenPass.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(presentDescriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptor);
+	vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+}
 
-	VkImageCreateInfo imageCI{};
-	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+void VulkanExample::createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask, FrameBufferAttachment& attachment)
+{
+	VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
 	imageCI.imageType = VK_IMAGE_TYPE_2D;
-	imageCI.format = VK_FORMAT_R8_UINT;
-	imageCI.extent = imageExtent;
+	imageCI.format = format;
+	imageCI.extent = { width, height, 1 };
 	imageCI.mipLevels = 1;
 	imageCI.arrayLayers = 1;
 	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageCI.usage = VK_IMAGE_USAGE_SHADING_RATE_IMAGE_BIT_NV | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &shadingRateImage.image));
-	VkMemoryRequirements memReqs{};
-	vkGetImageMemoryRequirements(device, shadingRateImage.image, &memReqs);
-	
-	VkDeviceSize bufferSize = imageExtent.width * imageExtent.height * sizeof(uint8_t);
-
-	VkMemoryAllocateInfo memAllloc{};
-	memAllloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAllloc.allocationSize = memReqs.size;
-	memAllloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memAllloc, nullptr, &shadingRateImage.memory));
-	VK_CHECK_RESULT(vkBindImageMemory(device, shadingRateImage.image, shadingRateImage.memory, 0));
-
-	VkImageViewCreateInfo imageViewCI{};
-	imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	imageViewCI.image = shadingRateImage.image;
-	imageViewCI.format = VK_FORMAT_R8_UINT;
-	imageViewCI.subresourceRange.baseMipLevel = 0;
-	imageViewCI.subresourceRange.levelCount = 1;
-	imageViewCI.subresourceRange.baseArrayLayer = 0;
-	imageViewCI.subresourceRange.layerCount = 1;
-	imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &shadingRateImage.view));
-
-	// Populate with lowest possible shading rate pattern
-	uint8_t val = VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_4X4_PIXELS_NV;
-	uint8_t* shadingRatePatternData = new uint8_t[bufferSize];
-	memset(shadingRatePatternData, val, bufferSize);
-
-	// Create a circular pattern with decreasing sampling rates outwards (max. range, pattern)
-	std::map<float, VkShadingRatePaletteEntryNV> patternLookup = {
-		{ 8.0f, VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_PIXEL_NV },
-		{ 12.0f, VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X1_PIXELS_NV },
-		{ 16.0f, VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_1X2_PIXELS_NV },
-		{ 18.0f, VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X2_PIXELS_NV },
-		{ 20.0f, VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_4X2_PIXELS_NV },
-		{ 24.0f, VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X4_PIXELS_NV }
+	imageCI.usage = usage;
+	VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &attachment.image));
+
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(device, attachment.image, &memReqs);
+	VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+	memAlloc.allocationSize = memReqs.size;
+	memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment.memory));
+	VK_CHECK_RESULT(vkBindImageMemory(device, attachment.image, attachment.memory, 0));
+
+	VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+	viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCI.format = format;
+	viewCI.subresourceRange = { aspectMask, 0, 1, 0, 1 };
+	viewCI.image = attachment.image;
+	VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &attachment.view));
+}
+
+void VulkanExample::destroyAttachment(FrameBufferAttachment& attachment)
+{
+	vkDestroyImageView(device, attachment.view, nullptr);
+	vkDestroyImage(device, attachment.image, nullptr);
+	vkFreeMemory(device, attachment.memory, nullptr);
+	attachment = FrameBufferAttachment();
+}
+
+void VulkanExample::prepareOffscreenRenderPass()
+{
+	// Depth is sampled for the camera reprojection, so it needs a depth only format that supports sampling
+	offscreenPass.depthFormat = VK_FORMAT_D16_UNORM;
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_D32_SFLOAT, &formatProperties);
+	const VkFormatFeatureFlags depthFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	if ((formatProperties.optimalTilingFeatures & depthFeatures) == depthFeatures) {
+		offscreenPass.depthFormat = VK_FORMAT_D32_SFLOAT;
+	}
+
+	// Color and depth are stored for the present pass and the next frame's shading rate update
+	// Both read them, so clearing them for the next frame has to wait for the compute and fragment stages
+	const VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	const VkPipelineStageFlags writeStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	const VkAccessFlags writeAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	if (fragmentShadingRateKHR) {
+		// [POI] With VK_KHR_fragment_shading_rate the shading rate image is an attachment of the subpass, which requires VkRenderPassCreateInfo2
+		std::array<VkAttachmentDescription2, 3> attachments{};
+		for (VkAttachmentDescription2& attachment : attachments) {
+			attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+		attachments[0].format = VK_FORMAT_R8G8B8A8_UNORM;
+		attachments[1].format = offscreenPass.depthFormat;
+		attachments[2].format = VK_FORMAT_R8_UINT;
+		attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[2].initialLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+		attachments[2].finalLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+
+		VkAttachmentReference2 colorReference{ VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2, nullptr, 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT };
+		VkAttachmentReference2 depthReference{ VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2, nullptr, 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT };
+		VkAttachmentReference2 shadingRateReference{ VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2, nullptr, 2, VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR, 0 };
+
+		VkFragmentShadingRateAttachmentInfoKHR shadingRateAttachmentInfo{};
+		shadingRateAttachmentInfo.sType = VK_STRUCTURE_TYPE_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR;
+		shadingRateAttachmentInfo.pFragmentShadingRateAttachment = &shadingRateReference;
+		shadingRateAttachmentInfo.shadingRateAttachmentTexelSize = shadingRate.getTexelSize();
+
+		VkSubpassDescription2 subpassDescription{};
+		subpassDescription.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
+		subpassDescription.pNext = &shadingRateAttachmentInfo;
+		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpassDescription.colorAttachmentCount = 1;
+		subpassDescription.pColorAttachments = &colorReference;
+		subpassDescription.pDepthStencilAttachment = &depthReference;
+
+		std::array<VkSubpassDependency2, 2> dependencies{};
+		dependencies[0].sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = readStages;
+		dependencies[0].dstStageMask = writeStages;
+		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[0].dstAccessMask = writeAccess;
+		dependencies[1].sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = writeStages;
+		dependencies[1].dstStageMask = readStages;
+		dependencies[1].srcAccessMask = writeAccess;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo2 renderPassCI{};
+		renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
+		renderPassCI.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassCI.pAttachments = attachments.data();
+		renderPassCI.subpassCount = 1;
+		renderPassCI.pSubpasses = &subpassDescription;
+		renderPassCI.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassCI.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass2KHR(device, &renderPassCI, nullptr, &offscreenPass.renderPass));
+	} else {
+		std::array<VkAttachmentDescription, 2> attachments{};
+		for (VkAttachmentDescription& attachment : attachments) {
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+		attachments[0].format = VK_FORMAT_R8G8B8A8_UNORM;
+		attachments[1].format = offscreenPass.depthFormat;
+
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpassDescription = {};
+		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpassDescription.colorAttachmentCount = 1;
+		subpassDescription.pColorAttachments = &colorReference;
+		subpassDescription.pDepthStencilAttachment = &depthReference;
+
+		std::array<VkSubpassDependency, 2> dependencies{};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = readStages;
+		dependencies[0].dstStageMask = writeStages;
+		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[0].dstAccessMask = writeAccess;
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = writeStages;
+		dependencies[1].dstStageMask = readStages;
+		dependencies[1].srcAccessMask = writeAccess;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+		renderPassCI.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassCI.pAttachments = attachments.data();
+		renderPassCI.subpassCount = 1;
+		renderPassCI.pSubpasses = &subpassDescription;
+		renderPassCI.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassCI.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCI, nullptr, &offscreenPass.renderPass));
+	}
+
+	VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+	samplerCI.magFilter = VK_FILTER_NEAREST;
+	samplerCI.minFilter = VK_FILTER_NEAREST;
+	samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &offscreenPass.sampler));
+}
+
+void VulkanExample::prepareOffscreenFramebuffer()
+{
+	createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, offscreenPass.color);
+	createAttachment(offscreenPass.depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, offscreenPass.depth);
+
+	std::vector<VkImageView> attachments = { offscreenPass.color.view, offscreenPass.depth.view };
+	if (fragmentShadingRateKHR) {
+		attachments.push_back(shadingRate.getView());
+	}
+	VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+	framebufferCI.renderPass = offscreenPass.renderPass;
+	framebufferCI.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferCI.pAttachments = attachments.data();
+	framebufferCI.width = width;
+	framebufferCI.height = height;
+	framebufferCI.layers = 1;
+	VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferCI, nullptr, &offscreenPass.frameBuffer));
+
+	// The first shading rate update samples both images before anything has been rendered to them
+	VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	vks::tools::setImageLayout(layoutCmd, offscreenPass.color.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	vks::tools::setImageLayout(layoutCmd, offscreenPass.depth.image, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
+
+	shadingRate.setSource(offscreenPass.color.view, offscreenPass.depth.view);
+}
+
+void VulkanExample::destroyOffscreenFramebuffer()
+{
+	vkDestroyFramebuffer(device, offscreenPass.frameBuffer, nullptr);
+	offscreenPass.frameBuffer = VK_NULL_HANDLE;
+	destroyAttachment(offscreenPass.color);
+	destroyAttachment(offscreenPass.depth);
+}
+
+// [POI]
+void VulkanExample::prepareShadingRate()
+{
+	// For each texel in the target image, there is a corresponding shading texel size width x height block in the shading rate image
+	VkExtent2D texelSize{};
+	VkPhysicalDeviceProperties2 deviceProperties2{};
+	deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	if (fragmentShadingRateKHR) {
+		vkCreateRenderPass2KHR = reinterpret_cast<PFN_vkCreateRenderPass2KHR>(vkGetDeviceProcAddr(device, "vkCreateRenderPass2KHR"));
+		physicalDeviceFragmentShadingRatePropertiesKHR.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR;
+		deviceProperties2.pNext = &physicalDeviceFragmentShadingRatePropertiesKHR;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties2);
+		// The texel size is up to the application, 16 x 16 pixel tiles (if supported) keep the rate selection statistics meaningful
+		const VkExtent2D minTexelSize = physicalDeviceFragmentShadingRatePropertiesKHR.minFragmentShadingRateAttachmentTexelSize;
+		const VkExtent2D maxTexelSize = physicalDeviceFragmentShadingRatePropertiesKHR.maxFragmentShadingRateAttachmentTexelSize;
+		texelSize.width = std::clamp(16u, minTexelSize.width, maxTexelSize.width);
+		texelSize.height = std::clamp(16u, minTexelSize.height, maxTexelSize.height);
+	} else {
+		vkCmdBindShadingRateImageNV = reinterpret_cast<PFN_vkCmdBindShadingRateImageNV>(vkGetDeviceProcAddr(device, "vkCmdBindShadingRateImageNV"));
+		physicalDeviceShadingRateImagePropertiesNV.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADING_RATE_IMAGE_PROPERTIES_NV;
+		deviceProperties2.pNext = &physicalDeviceShadingRateImagePropertiesNV;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties2);
+		texelSize = physicalDeviceShadingRateImagePropertiesNV.shadingRateTexelSize;
+	}
+
+	shadingRate.rateShader = loadShader(getShadersPath() + "base/shadingrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	const vks::AdaptiveShadingRate::Mode mode = fragmentShadingRateKHR ? vks::AdaptiveShadingRate::Mode::FragmentShadingRateKHR : vks::AdaptiveShadingRate::Mode::ShadingRateImageNV;
+	shadingRate.prepare(vulkanDevice, queue, pipelineCache, mode, texelSize, width, height);
+}
+
+// Fixed pattern used if the content adaptive rates are disabled
+void VulkanExample::uploadShadingRatePattern()
+{
+	const VkExtent2D imageExtent = shadingRate.getExtent();
+
+	// Create a circular pattern with decreasing sampling rates outwards (max. range, log2 of the fragment size), lowest possible rate everywhere else
+	std::map<float, glm::uvec2> patternLookup = {
+		{ 8.0f, glm::uvec2(0, 0) },
+		{ 12.0f, glm::uvec2(1, 0) },
+		{ 16.0f, glm::uvec2(0, 1) },
+		{ 18.0f, glm::uvec2(1, 1) },
+		{ 20.0f, glm::uvec2(2, 1) },
+		{ 24.0f, glm::uvec2(1, 2) }
 	};
 
-	uint8_t* ptrData = shadingRatePatternData;
+	std::vector<uint8_t> shadingRatePatternData(imageExtent.width * imageExtent.height, vks::AdaptiveShadingRate::encodeRate(shadingRate.getMode(), glm::uvec2(2, 2)));
+	uint8_t* ptrData = shadingRatePatternData.data();
 	for (uint32_t y = 0; y < imageExtent.height; y++) {
 		for (uint32_t x = 0; x < imageExtent.width; x++) {
 			const float deltaX = (float)imageExtent.width / 2.0f - (float)x;
@@ -222,78 +495,14 @@ void VulkanExample::prepareShadingRateImage()
 			const float dist = std::sqrt(deltaX * deltaX + deltaY * deltaY);
 			for (auto pattern : patternLookup) {
 				if (dist < pattern.first) {
-					*ptrData = pattern.second;
+					*ptrData = vks::AdaptiveShadingRate::encodeRate(shadingRate.getMode(), pattern.second);
 					break;
 				}
 			}
 			ptrData++;
 		}
 	}
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingMemory;
-
-	VkBufferCreateInfo bufferCreateInfo{};
-	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferCreateInfo.size = bufferSize;
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &stagingBuffer));
-	VkMemoryAllocateInfo memAllocInfo{};
-	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memReqs = {};
-	vkGetBufferMemoryRequirements(device, stagingBuffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &stagingMemory));
-	VK_CHECK_RESULT(vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0));
-
-	uint8_t* mapped;
-	VK_CHECK_RESULT(vkMapMemory(device, stagingMemory, 0, memReqs.size, 0, (void**)&mapped));
-	memcpy(mapped, shadingRatePatternData, bufferSize);
-	vkUnmapMemory(device, stagingMemory);
-
-	delete[] shadingRatePatternData;
-
-	// Upload
-	VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.levelCount = 1;
-	subresourceRange.layerCount = 1;
-	{
-		VkImageMemoryBarrier imageMemoryBarrier{};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = 0;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.image = shadingRateImage.image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-	}
-	VkBufferImageCopy bufferCopyRegion{};
-	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	bufferCopyRegion.imageSubresource.layerCount = 1;
-	bufferCopyRegion.imageExtent.width = imageExtent.width;
-	bufferCopyRegion.imageExtent.height = imageExtent.height;
-	bufferCopyRegion.imageExtent.depth = 1;
-	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, shadingRateImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-	{
-		VkImageMemoryBarrier imageMemoryBarrier{};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADING_RATE_OPTIMAL_NV;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = 0;
-		imageMemoryBarrier.image = shadingRateImage.image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-	}
-	vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-
-	vkFreeMemory(device, stagingMemory, nullptr);
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	shadingRate.upload(shadingRatePatternData);
 }
 
 void VulkanExample::preparePipelines()
@@ -309,7 +518,7 @@ void VulkanExample::preparePipelines()
 	VkPipelineDynamicStateCreateInfo dynamicStateCI = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables.data(), static_cast<uint32_t>(dynamicStateEnables.size()), 0);
 	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
 
-	VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayout, renderPass, 0);
+	VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayout, offscreenPass.renderPass, 0);
 	pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
 	pipelineCI.pRasterizationState = &rasterizationStateCI;
 	pipelineCI.pColorBlendState = &colorBlendStateCI;
@@ -347,34 +556,49 @@ void VulkanExample::preparePipelines()
 	specializationData.alphaMask = false;
 
 	// Create pipeline with shading rate enabled
-	// [POI] Possible per-Viewport shading rate palette entries
-	const std::vector<VkShadingRatePaletteEntryNV> shadingRatePaletteEntries = {
-		VK_SHADING_RATE_PALETTE_ENTRY_NO_INVOCATIONS_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_16_INVOCATIONS_PER_PIXEL_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_8_INVOCATIONS_PER_PIXEL_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_4_INVOCATIONS_PER_PIXEL_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_2_INVOCATIONS_PER_PIXEL_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_PIXEL_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X1_PIXELS_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_1X2_PIXELS_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X2_PIXELS_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_4X2_PIXELS_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_2X4_PIXELS_NV,
-		VK_SHADING_RATE_PALETTE_ENTRY_1_INVOCATION_PER_4X4_PIXELS_NV,
-	};
-	VkShadingRatePaletteNV shadingRatePalette{};
-	shadingRatePalette.shadingRatePaletteEntryCount = static_cast<uint32_t>(shadingRatePaletteEntries.size());
-	shadingRatePalette.pShadingRatePaletteEntries = shadingRatePaletteEntries.data();
-	VkPipelineViewportShadingRateImageStateCreateInfoNV pipelineViewportShadingRateImageStateCI{};
-	pipelineViewportShadingRateImageStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_SHADING_RATE_IMAGE_STATE_CREATE_INFO_NV;
-	pipelineViewportShadingRateImageStateCI.shadingRateImageEnable = VK_TRUE;
-	pipelineViewportShadingRateImageStateCI.viewportCount = 1;
-	pipelineViewportShadingRateImageStateCI.pShadingRatePalettes = &shadingRatePalette;
-	viewportStateCI.pNext = &pipelineViewportShadingRateImageStateCI;
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &shadingRatePipelines.opaque));
-	specializationData.alphaMask = true;
+	if (fragmentShadingRateKHR) {
+		// [POI] Take the rate from the attachment, the pipeline rate only serves as the base it replaces
+		VkPipelineFragmentShadingRateStateCreateInfoKHR fragmentShadingRateStateCI{};
+		fragmentShadingRateStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR;
+		fragmentShadingRateStateCI.fragmentSize = { 1, 1 };
+		fragmentShadingRateStateCI.combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+		fragmentShadingRateStateCI.combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
+		pipelineCI.pNext = &fragmentShadingRateStateCI;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &shadingRatePipelines.opaque));
+		specializationData.alphaMask = true;
+		rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &shadingRatePipelines.masked));
+		pipelineCI.pNext = nullptr;
+	} else {
+		// [POI] Possible per-Viewport shading rate palette entries, the shading rate image stores indices into it
+		const std::vector<VkShadingRatePaletteEntryNV> shadingRatePaletteEntries = vks::AdaptiveShadingRate::getPaletteNV();
+		VkShadingRatePaletteNV shadingRatePalette{};
+		shadingRatePalette.shadingRatePaletteEntryCount = static_cast<uint32_t>(shadingRatePaletteEntries.size());
+		shadingRatePalette.pShadingRatePaletteEntries = shadingRatePaletteEntries.data();
+		VkPipelineViewportShadingRateImageStateCreateInfoNV pipelineViewportShadingRateImageStateCI{};
+		pipelineViewportShadingRateImageStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_SHADING_RATE_IMAGE_STATE_CREATE_INFO_NV;
+		pipelineViewportShadingRateImageStateCI.shadingRateImageEnable = VK_TRUE;
+		pipelineViewportShadingRateImageStateCI.viewportCount = 1;
+		pipelineViewportShadingRateImageStateCI.pShadingRatePalettes = &shadingRatePalette;
+		viewportStateCI.pNext = &pipelineViewportShadingRateImageStateCI;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &shadingRatePipelines.opaque));
+		specializationData.alphaMask = true;
+		rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &shadingRatePipelines.masked));
+		viewportStateCI.pNext = nullptr;
+	}
+
+	// Present the offscreen color as a fullscreen triangle into the swapchain render pass
 	rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &shadingRatePipelines.masked));
+	depthStencilStateCI.depthTestEnable = VK_FALSE;
+	depthStencilStateCI.depthWriteEnable = VK_FALSE;
+	VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+	pipelineCI.pVertexInputState = &emptyInputState;
+	pipelineCI.layout = presentPipelineLayout;
+	pipelineCI.renderPass = renderPass;
+	shaderStages[0] = loadShader(getShadersPath() + "base/upscale.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+	shaderStages[1] = loadShader(getShadersPath() + "base/upscale.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &presentPipeline));
 }
 
 void VulkanExample::prepareUniformBuffers()
@@ -401,17 +625,11 @@ void VulkanExample::prepare()
 {
 	VulkanExampleBase::prepare();
 	loadAssets();
-	
-	// [POI]
-	vkCmdBindShadingRateImageNV = reinterpret_cast<PFN_vkCmdBindShadingRateImageNV>(vkGetDeviceProcAddr(device, "vkCmdBindShadingRateImageNV"));
-	physicalDeviceShadingRateImagePropertiesNV.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADING_RATE_IMAGE_PROPERTIES_NV;
-	VkPhysicalDeviceProperties2 deviceProperties2{};
-	deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
-	deviceProperties2.pNext = &physicalDeviceShadingRateImagePropertiesNV;
-	vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties2);
-
-	prepareShadingRateImage();
+	prepareShadingRate();
+	prepareOffscreenRenderPass();
+	prepareOffscreenFramebuffer();
 	prepareUniformBuffers();
+	previousViewProjection = shaderData.values.projection * shaderData.values.view;
 	setupDescriptors();
 	preparePipelines();
 	buildCommandBuffers();
@@ -420,7 +638,15 @@ void VulkanExample::prepare()
 
 void VulkanExample::render()
 {
+	if (camera.updated) {
+		// Depth ordering of the render queue depends on the camera, the previous frame has already finished (see submitFrame)
+		buildCommandBuffers();
+	}
+	// The rates of this frame are derived from the last frame's images, reprojected with the camera matrices of both frames
+	const glm::mat4 viewProjection = shaderData.values.projection * shaderData.values.view;
+	shadingRate.updateView(previousViewProjection, viewProjection);
 	renderFrame();
+	previousViewProjection = viewProjection;
 	if (camera.updated) {
 		updateUniformBuffers();
 	}
@@ -428,12 +654,35 @@ void VulkanExample::render()
 
 void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 {
+	overlay->text(fragmentShadingRateKHR ? "VK_KHR_fragment_shading_rate" : "VK_NV_shading_rate_image");
 	if (overlay->checkBox("Enable shading rate", &enableShadingRate)) {
 		buildCommandBuffers();
 	}
+	if (overlay->checkBox("Content adaptive", &adaptiveShadingRate)) {
+		if (!adaptiveShadingRate) {
+			uploadShadingRatePattern();
+		}
+		rateMismatches = -1;
+		buildCommandBuffers();
+	}
+	if (adaptiveShadingRate) {
+		// Picked up by the next frame's update
+		overlay->sliderFloat("Sensitivity", &shadingRate.sensitivity, 0.05f, 0.5f);
+		if (overlay->button("Validate rates")) {
+			rateMismatches = shadingRate.validate();
+		}
+		if (rateMismatches >= 0) {
+			overlay->text("Mismatching tiles: %d", rateMismatches);
+		}
+	}
 	if (overlay->checkBox("Color shading rates", &colorShadingRate)) {
 		updateUniformBuffers();
 	}
+	if (overlay->header("Render queue")) {
+		overlay->text("Draws: %d", renderQueue.stats.draws);
+		overlay->text("Pipeline binds: %d", renderQueue.stats.pipelineBinds);
+		overlay->text("Descriptor set binds: %d", renderQueue.stats.descriptorSetBinds);
+	}
 }
 
 VULKAN_EXAMPLE_MAIN()
@@ -8,6 +8,8 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanRenderQueue.h"
+#include "VulkanAdaptiveShadingRate.h"
 
 #define ENABLE_VALIDATION false
 
@@ -15,15 +17,30 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	vkglTF::Model scene;
-
-	struct ShadingRateImage {
-		VkImage image;
-		VkDeviceMemory memory;
-		VkImageView view;
-	} shadingRateImage;
+	vks::RenderQueue renderQueue;
+	vks::AdaptiveShadingRate shadingRate;
 
 	bool enableShadingRate = true;
+	bool adaptiveShadingRate = true;
 	bool colorShadingRate = false;
+	// VK_KHR_fragment_shading_rate is used if supported, VK_NV_shading_rate_image otherwise
+	bool fragmentShadingRateKHR = false;
+	int32_t rateMismatches = -1;
+
+	struct FrameBufferAttachment {
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+	};
+
+	// The scene is rendered offscreen, so the next frame's shading rates can be derived from its color and depth
+	struct OffscreenPass {
+		FrameBufferAttachment color, depth;
+		VkFormat depthFormat;
+		VkRenderPass renderPass;
+		VkFramebuffer frameBuffer = VK_NULL_HANDLE;
+		VkSampler sampler;
+	} offscreenPass;
 
 	struct ShaderData {
 		vks::Buffer buffer;
@@ -36,6 +53,8 @@ public:
 			int32_t colorShadingRate;
 		} values;
 	} shaderData;
+	// View projection the offscreen images have been rendered with
+	glm::mat4 previousViewProjection;
 
 	struct Pipelines {
 		VkPipeline opaque;
@@ -44,28 +63,44 @@ public:
 
 	Pipelines basePipelines;
 	Pipelines shadingRatePipelines;
+	VkPipeline presentPipeline;
 
 	VkPipelineLayout pipelineLayout;
+	VkPipelineLayout presentPipelineLayout;
 	VkDescriptorSet descriptorSet;
+	VkDescriptorSet presentDescriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorSetLayout presentDescriptorSetLayout;
 
 	VkPhysicalDeviceShadingRateImagePropertiesNV physicalDeviceShadingRateImagePropertiesNV{};
 	VkPhysicalDeviceShadingRateImageFeaturesNV enabledPhysicalDeviceShadingRateImageFeaturesNV{};
 	PFN_vkCmdBindShadingRateImageNV vkCmdBindShadingRateImageNV;
 
+	VkPhysicalDeviceFragmentShadingRatePropertiesKHR physicalDeviceFragmentShadingRatePropertiesKHR{};
+	VkPhysicalDeviceFragmentShadingRateFeaturesKHR enabledPhysicalDeviceFragmentShadingRateFeaturesKHR{};
+	PFN_vkCreateRenderPass2KHR vkCreateRenderPass2KHR;
+
 	VulkanExample();
 	~VulkanExample();
 	virtual void getEnabledFeatures();
+	virtual void getEnabledExtensions();
 	void handleResize();
 	void buildCommandBuffers();
 	void loadglTFFile(std::string filename);
 	void loadAssets();
-	void prepareShadingRateImage();
+	void createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask, FrameBufferAttachment& attachment);
+	void destroyAttachment(FrameBufferAttachment& attachment);
+	void prepareOffscreenRenderPass();
+	void prepareOffscreenFramebuffer();
+	void destroyOffscreenFramebuffer();
+	void prepareShadingRate();
+	void uploadShadingRatePattern();
 	void setupDescriptors();
+	void updatePresentDescriptorSet();
 	void preparePipelines();
 	void prepareUniformBuffers();
 	void updateUniformBuffers();
 	void prepare();
 	virtual void render();
 	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay);
-};
\ No newline at end of file
+};